@@ -1,5 +1,6 @@
 #include "controllers/GroupController.h"
 #include <json/json.h>
+#include "repository/ActivityLog.h"
 
 GroupController::GroupController()
 {
@@ -141,6 +142,9 @@ void GroupController::addUserToGroup(const HttpRequestPtr &req, std::function<vo
         return;
     }
 
+    ActivityLog::instance()->record(requester_user_id, "permission_change", user_id,
+                                    "added to group " + std::to_string(group_id));
+
     Json::Value respJson;
     respJson["message"] = "User added to group successfully";
     auto resp = HttpResponse::newHttpJsonResponse(respJson);
@@ -169,6 +173,9 @@ void GroupController::removeUserFromGroup(const HttpRequestPtr &req, std::functi
         return;
     }
 
+    ActivityLog::instance()->record(requester_user_id, "permission_change", user_id,
+                                    "removed from group " + std::to_string(group_id));
+
     Json::Value respJson;
     respJson["message"] = "User removed from group successfully";
     auto resp = HttpResponse::newHttpJsonResponse(respJson);
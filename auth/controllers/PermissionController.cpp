@@ -1,6 +1,10 @@
 #include "PermissionController.h"
 #include <json/json.h>
 
+// Upper bounds for a single batch check request
+const size_t MAX_BATCH_USERS = 10000;
+const size_t MAX_BATCH_PERMISSIONS = 64;
+
 PermissionController::PermissionController()
 {
     accessControlService_ = AccessControlService::instance();
@@ -67,4 +71,93 @@ void PermissionController::getCurrentUserPermissions(const HttpRequestPtr &req,
 
     auto resp = HttpResponse::newHttpJsonResponse(respData);
     callback(resp);
-}
\ No newline at end of file
+}
+
+void PermissionController::checkPermissions(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string requester_user_id = req->attributes()->get<std::string>("user_id");
+
+    // Checking other users' permissions requires manage_roles
+    if (!accessControlService_->hasPermission(requester_user_id, "manage_roles"))
+    {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - manage_roles permission required");
+        callback(resp);
+        return;
+    }
+
+    auto json = req->getJsonObject();
+    if (!json || !(*json)["user_ids"].isArray() || !(*json)["permissions"].isArray())
+    {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON: 'user_ids' and 'permissions' arrays are required");
+        callback(resp);
+        return;
+    }
+
+    const auto &userIdsJson = (*json)["user_ids"];
+    const auto &permissionsJson = (*json)["permissions"];
+    if (userIdsJson.size() > MAX_BATCH_USERS || permissionsJson.size() > MAX_BATCH_PERMISSIONS)
+    {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Too many entries: at most " + std::to_string(MAX_BATCH_USERS) + " user_ids and "
+                      + std::to_string(MAX_BATCH_PERMISSIONS) + " permissions per request");
+        callback(resp);
+        return;
+    }
+
+    std::vector<int> user_ids;
+    user_ids.reserve(userIdsJson.size());
+    for (Json::ArrayIndex i = 0; i < userIdsJson.size(); ++i)
+    {
+        if (!userIdsJson[i].isInt())
+        {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k400BadRequest);
+            resp->setBody("Invalid user_ids[" + std::to_string(i) + "]: expected an integer user id");
+            callback(resp);
+            return;
+        }
+        user_ids.push_back(userIdsJson[i].asInt());
+    }
+
+    std::vector<std::string> permission_names;
+    permission_names.reserve(permissionsJson.size());
+    for (Json::ArrayIndex i = 0; i < permissionsJson.size(); ++i)
+    {
+        if (!permissionsJson[i].isString())
+        {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k400BadRequest);
+            resp->setBody("Invalid permissions[" + std::to_string(i) + "]: expected a permission name string");
+            callback(resp);
+            return;
+        }
+        permission_names.push_back(permissionsJson[i].asString());
+    }
+
+    LOG_INFO << "Processing 'checkPermissions' request by user_id: " << requester_user_id
+             << " for " << user_ids.size() << " users and " << permission_names.size() << " permissions";
+
+    auto granted = accessControlService_->checkPermissions(user_ids, permission_names);
+
+    // Only the granted pairs are listed: { "granted": { "<permission>": [user_id, ...] } }
+    Json::Value respData;
+    Json::Value grantedJson(Json::objectValue);
+    for (size_t i = 0; i < permission_names.size(); ++i)
+    {
+        Json::Value usersArray(Json::arrayValue);
+        for (int userId : granted[i])
+        {
+            usersArray.append(userId);
+        }
+        grantedJson[permission_names[i]] = usersArray;
+    }
+    respData["granted"] = grantedJson;
+
+    auto resp = HttpResponse::newHttpJsonResponse(respData);
+    callback(resp);
+}
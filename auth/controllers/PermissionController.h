@@ -14,12 +14,16 @@ public:
 
         // Get permissions for the current authenticated user
         ADD_METHOD_TO(PermissionController::getCurrentUserPermissions, "/api/v1/permissions", Get, "JwtAuthFilter");
+
+        // Check many (user, permission) pairs in one call
+        ADD_METHOD_TO(PermissionController::checkPermissions, "/api/v1/permissions/check", Post, "JwtAuthFilter");
     METHOD_LIST_END
 
     PermissionController();
 
     void getUserPermissions(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string user_id);
     void getCurrentUserPermissions(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void checkPermissions(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
 
 private:
     std::shared_ptr<AccessControlService> accessControlService_;
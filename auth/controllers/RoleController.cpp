@@ -1,6 +1,22 @@
 #include "RoleController.h"
 #include <json/json.h>
 #include "../utils/JWT.h"
+#include "repository/ActivityLog.h"
+
+namespace {
+
+std::string joinIds(const std::vector<int>& ids)
+{
+    std::string list;
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0) list += ",";
+        list += std::to_string(ids[i]);
+    }
+    return list;
+}
+
+} // namespace
 
 RoleController::RoleController()
 {
@@ -108,6 +124,8 @@ void RoleController::deleteRole(const HttpRequestPtr &req, std::function<void(co
         return;
     }
 
+    ActivityLog::instance()->record(user_id, "permission_change", role_id, "role deleted");
+
     Json::Value respData;
     respData["message"] = "Role deleted successfully";
     auto resp = HttpResponse::newHttpJsonResponse(respData);
@@ -173,6 +191,9 @@ void RoleController::assignPermissionsToRole(const HttpRequestPtr &req, std::fun
         return;
     }
 
+    ActivityLog::instance()->record(user_id, "permission_change", role_id,
+                                    "role permissions: " + joinIds(permission_ids));
+
     Json::Value respData;
     respData["message"] = "Permissions assigned to role successfully";
     auto resp = HttpResponse::newHttpJsonResponse(respData);
@@ -238,6 +259,9 @@ void RoleController::assignRoleToUser(const HttpRequestPtr &req, std::function<v
         return;
     }
 
+    ActivityLog::instance()->record(requester_user_id, "permission_change", user_id,
+                                    "user roles: " + joinIds(role_ids));
+
     Json::Value respData;
     respData["message"] = "Roles assigned to user successfully";
     auto resp = HttpResponse::newHttpJsonResponse(respData);
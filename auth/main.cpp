@@ -1,6 +1,8 @@
 #include <drogon/drogon.h>
 #include "utils/JWT.h"
 #include "repository/DB.h"
+#include "services/AccessControlService.h"
+#include "repository/ActivityLog.h"
 #include <fstream>
 #include <sstream>
 
@@ -80,11 +82,22 @@ int main() {
     try {
         DB::initInstance(dbHost, dbPort, dbName, dbUser, dbPassword);
         LOG_INFO << "Database initialized successfully";
+
+        // Build the in-memory RBAC model before serving requests
+        AccessControlService::instance();
     } catch (const std::exception& e) {
         LOG_ERROR << e.what();
         return 1;
     }
 
+    // Activity log (logins, permission changes), buffered in memory and written in batches
+    auto activityConfig = app.getCustomConfig()["activity_log"];
+    if (activityConfig.get("enabled", true).asBool()) {
+        size_t capacity = activityConfig.get("buffer_size", 16384).asUInt64();
+        double flushInterval = activityConfig.get("flush_interval", 1.0).asDouble();
+        ActivityLog::instance()->start(capacity, flushInterval);
+    }
+
     // Load RSA keys for JWT authentication
     try {
         // Get paths from config
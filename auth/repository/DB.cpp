@@ -49,21 +49,28 @@ void DB::connect()
 {
     if (!conn_)
     {
-        std::string connInfo =
-                "host=" + host_ +
-                " port=" + port_ +
-                " dbname=" + dbname_ +
-                " user=" + user_ +
-                " password=" + password_;
-        conn_ = PQconnectdb(connInfo.c_str());
-
-        if (PQstatus(conn_) != CONNECTION_OK)
-        {
-            std::cerr << "Connection to database failed: " << PQerrorMessage(conn_) << std::endl;
-            PQfinish(conn_);
-            conn_ = nullptr;
-        }
+        conn_ = openConnection();
+    }
+}
+
+PGconn* DB::openConnection()
+{
+    std::string connInfo =
+            "host=" + host_ +
+            " port=" + port_ +
+            " dbname=" + dbname_ +
+            " user=" + user_ +
+            " password=" + password_;
+    PGconn* conn = PQconnectdb(connInfo.c_str());
+
+    if (PQstatus(conn) != CONNECTION_OK)
+    {
+        std::cerr << "Connection to database failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+        return nullptr;
     }
+
+    return conn;
 }
 
 bool DB::init()
@@ -138,14 +145,26 @@ bool DB::init()
             );
         )",
 
-            // User activity logs table
+            // User activity log, partitioned by day (UTC); see ActivityLog. No foreign key to users,
+            // so entries outlive the user and COPY does not pay for key checks
             R"(
-            CREATE TABLE IF NOT EXISTS user_activity_logs (
-                log_id SERIAL PRIMARY KEY,
-                user_id INT REFERENCES users(user_id) ON DELETE SET NULL,
-                action VARCHAR(100) NOT NULL,
-                timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-            );
+            CREATE TABLE IF NOT EXISTS activity_log (
+                event_id BIGSERIAL,
+                occurred_at TIMESTAMP NOT NULL,
+                user_id INT,
+                action VARCHAR(32) NOT NULL,
+                object_id BIGINT,
+                detail TEXT
+            ) PARTITION BY RANGE (occurred_at);
+        )",
+            R"(
+            CREATE INDEX IF NOT EXISTS activity_log_time_idx ON activity_log (occurred_at, event_id);
+        )",
+            R"(
+            CREATE INDEX IF NOT EXISTS activity_log_user_idx ON activity_log (user_id, occurred_at, event_id);
+        )",
+            R"(
+            CREATE INDEX IF NOT EXISTS activity_log_action_idx ON activity_log (action, occurred_at, event_id);
         )"
     };
 
@@ -544,6 +563,91 @@ bool DB::userHasPermission(const std::string &user_id, const std::string &permis
     return hasPermission;
 }
 
+std::optional<std::vector<std::pair<int, std::string>>> DB::getAllPermissions()
+{
+    std::vector<std::pair<int, std::string>> permissions;
+    if (!conn_) return std::nullopt;
+
+    std::string query = R"(
+        SELECT permission_id, permission_name
+        FROM permissions
+        ORDER BY permission_id;
+    )";
+
+    PGresult* res = PQexec(conn_, query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get all permissions: " << PQerrorMessage(conn_) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        int permission_id = std::stoi(PQgetvalue(res, i, 0));
+        std::string permission_name = PQgetvalue(res, i, 1);
+        permissions.emplace_back(permission_id, permission_name);
+    }
+
+    PQclear(res);
+    return permissions;
+}
+
+std::optional<std::vector<std::pair<int, int>>> DB::getAllRolePermissionIds()
+{
+    std::vector<std::pair<int, int>> rolePermissions;
+    if (!conn_) return std::nullopt;
+
+    std::string query = "SELECT role_id, permission_id FROM role_permissions;";
+
+    PGresult* res = PQexec(conn_, query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get role permissions: " << PQerrorMessage(conn_) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        int role_id = std::stoi(PQgetvalue(res, i, 0));
+        int permission_id = std::stoi(PQgetvalue(res, i, 1));
+        rolePermissions.emplace_back(role_id, permission_id);
+    }
+
+    PQclear(res);
+    return rolePermissions;
+}
+
+std::optional<std::vector<std::pair<int, int>>> DB::getAllUserRoleIds()
+{
+    std::vector<std::pair<int, int>> userRoles;
+    if (!conn_) return std::nullopt;
+
+    std::string query = "SELECT user_id, role_id FROM user_roles;";
+
+    PGresult* res = PQexec(conn_, query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get user roles: " << PQerrorMessage(conn_) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        int user_id = std::stoi(PQgetvalue(res, i, 0));
+        int role_id = std::stoi(PQgetvalue(res, i, 1));
+        userRoles.emplace_back(user_id, role_id);
+    }
+
+    PQclear(res);
+    return userRoles;
+}
+
 std::vector<std::pair<int, std::string>> DB::getAllRoles()
 {
     std::vector<std::pair<int, std::string>> roles;
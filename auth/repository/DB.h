@@ -5,6 +5,7 @@
 #include <utility>
 #include <vector>
 #include <tuple>
+#include <optional>
 #include <postgresql@14/libpq-fe.h>
 
 enum class UserFetchStatus {
@@ -33,6 +34,9 @@ public:
 
     bool init();
 
+    // Opens a separate connection with the same parameters (caller owns it)
+    PGconn* openConnection();
+
     std::tuple<std::string, std::string, UserFetchStatus> getPasswordHashByLogin(const std::string& login);
     std::tuple<std::string, std::string, UserFetchStatus> getPasswordHashByUserID(const std::string& userID);
     CreateUserStatus createUser(const std::string& login, const std::string& password_hash);
@@ -51,6 +55,11 @@ public:
     std::vector<std::string> getUserPermissions(const std::string &user_id);
     bool userHasPermission(const std::string &user_id, const std::string &permission_name);
 
+    // Full RBAC tables for the in-memory model (nullopt on query failure)
+    std::optional<std::vector<std::pair<int, std::string>>> getAllPermissions();
+    std::optional<std::vector<std::pair<int, int>>> getAllRolePermissionIds();
+    std::optional<std::vector<std::pair<int, int>>> getAllUserRoleIds();
+
     // Groups management
     bool createGroup(const std::string &group_name);
     bool deleteGroup(int group_id);
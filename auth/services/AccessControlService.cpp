@@ -1,4 +1,6 @@
 #include "AccessControlService.h"
+#include <drogon/drogon.h>
+#include <mutex>
 
 std::shared_ptr<AccessControlService> AccessControlService::instance()
 {
@@ -14,22 +16,241 @@ AccessControlService::AccessControlService()
     {
         throw std::runtime_error("Database instance is not initialized");
     }
+
+    if (!reloadModel())
+    {
+        throw std::runtime_error("Failed to load RBAC model");
+    }
 }
 
 bool AccessControlService::hasPermission(const std::string &user_id, const std::string &permission_name)
 {
-    auto roles = db_->getUserRoles(user_id);
-    for (const auto &role : roles)
+    int userId = 0;
+    try
+    {
+        userId = std::stoi(user_id);
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(modelMutex_);
+
+    auto permIt = permissionIndex_.find(permission_name);
+    if (permIt == permissionIndex_.end())
+    {
+        return false;
+    }
+
+    auto userIt = userPermissions_.find(userId);
+    return userIt != userPermissions_.end() && userIt->second.test(permIt->second);
+}
+
+std::vector<std::string> AccessControlService::getUserPermissions(const std::string &user_id)
+{
+    std::vector<std::string> permissions;
+
+    int userId = 0;
+    try
+    {
+        userId = std::stoi(user_id);
+    }
+    catch (const std::exception &)
+    {
+        return permissions;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(modelMutex_);
+
+    auto userIt = userPermissions_.find(userId);
+    if (userIt == userPermissions_.end())
+    {
+        return permissions;
+    }
+
+    for (size_t bit = 0; bit < permissionNames_.size(); ++bit)
     {
-        if (db_->roleHasPermission(role, permission_name))
+        if (userIt->second.test(bit))
         {
-            return true;
+            permissions.push_back(permissionNames_[bit]);
         }
     }
-    return false;
+    return permissions;
 }
 
-std::vector<std::string> AccessControlService::getUserPermissions(const std::string &user_id)
+std::vector<std::vector<int>> AccessControlService::checkPermissions(const std::vector<int> &user_ids,
+                                                                     const std::vector<std::string> &permission_names)
 {
-    return db_->getUserPermissions(user_id);
-}
\ No newline at end of file
+    std::vector<std::vector<int>> granted(permission_names.size());
+
+    std::shared_lock<std::shared_mutex> lock(modelMutex_);
+
+    // Resolve names once; unknown permissions are granted to nobody
+    PermissionBits requested;
+    std::vector<int> bits(permission_names.size(), -1);
+    for (size_t i = 0; i < permission_names.size(); ++i)
+    {
+        auto it = permissionIndex_.find(permission_names[i]);
+        if (it != permissionIndex_.end())
+        {
+            bits[i] = it->second;
+            requested.set(it->second);
+        }
+    }
+
+    for (int userId : user_ids)
+    {
+        auto userIt = userPermissions_.find(userId);
+        if (userIt == userPermissions_.end() || (userIt->second & requested).none())
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < bits.size(); ++i)
+        {
+            if (bits[i] >= 0 && userIt->second.test(bits[i]))
+            {
+                granted[i].push_back(userId);
+            }
+        }
+    }
+
+    return granted;
+}
+
+bool AccessControlService::reloadModel()
+{
+    auto permissions = db_->getAllPermissions();
+    auto rolePermissions = db_->getAllRolePermissionIds();
+    auto userRoles = db_->getAllUserRoleIds();
+    if (!permissions || !rolePermissions || !userRoles)
+    {
+        LOG_ERROR << "Failed to load RBAC tables";
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(modelMutex_);
+
+    permissionIndex_.clear();
+    permissionIdIndex_.clear();
+    permissionNames_.clear();
+    rolePermissions_.clear();
+    userRoles_.clear();
+    userPermissions_.clear();
+
+    for (const auto &[permissionId, permissionName] : *permissions)
+    {
+        if (permissionNames_.size() >= kMaxPermissions)
+        {
+            LOG_ERROR << "Too many permissions, ignoring " << permissionName;
+            continue;
+        }
+        int bit = static_cast<int>(permissionNames_.size());
+        permissionNames_.push_back(permissionName);
+        permissionIndex_[permissionName] = bit;
+        permissionIdIndex_[permissionId] = bit;
+    }
+
+    for (const auto &[roleId, permissionId] : *rolePermissions)
+    {
+        auto it = permissionIdIndex_.find(permissionId);
+        if (it != permissionIdIndex_.end())
+        {
+            rolePermissions_[roleId].set(it->second);
+        }
+    }
+
+    for (const auto &[userId, roleId] : *userRoles)
+    {
+        userRoles_[userId].insert(roleId);
+    }
+
+    for (const auto &entry : userRoles_)
+    {
+        recomputeUser(entry.first);
+    }
+
+    LOG_INFO << "Loaded RBAC model: " << permissionNames_.size() << " permissions, "
+             << rolePermissions_.size() << " roles, " << userRoles_.size() << " users";
+    return true;
+}
+
+void AccessControlService::onRoleDeleted(int role_id)
+{
+    std::unique_lock<std::shared_mutex> lock(modelMutex_);
+
+    rolePermissions_.erase(role_id);
+
+    for (auto &[userId, roles] : userRoles_)
+    {
+        if (roles.erase(role_id) > 0)
+        {
+            recomputeUser(userId);
+        }
+    }
+}
+
+void AccessControlService::onPermissionsAssignedToRole(int role_id, const std::vector<int> &permission_ids)
+{
+    {
+        std::unique_lock<std::shared_mutex> lock(modelMutex_);
+
+        bool unknownPermission = false;
+        auto &bits = rolePermissions_[role_id];
+        for (int permissionId : permission_ids)
+        {
+            auto it = permissionIdIndex_.find(permissionId);
+            if (it == permissionIdIndex_.end())
+            {
+                unknownPermission = true;
+                break;
+            }
+            bits.set(it->second);
+        }
+
+        if (!unknownPermission)
+        {
+            for (auto &[userId, roles] : userRoles_)
+            {
+                if (roles.count(role_id) > 0)
+                {
+                    recomputeUser(userId);
+                }
+            }
+            return;
+        }
+    }
+
+    // A permission created after the model was built: rebuild from scratch
+    reloadModel();
+}
+
+void AccessControlService::onRolesAssignedToUser(int user_id, const std::vector<int> &role_ids)
+{
+    std::unique_lock<std::shared_mutex> lock(modelMutex_);
+
+    auto &roles = userRoles_[user_id];
+    roles.insert(role_ids.begin(), role_ids.end());
+    recomputeUser(user_id);
+}
+
+void AccessControlService::recomputeUser(int user_id)
+{
+    PermissionBits bits;
+
+    auto rolesIt = userRoles_.find(user_id);
+    if (rolesIt != userRoles_.end())
+    {
+        for (int roleId : rolesIt->second)
+        {
+            auto roleIt = rolePermissions_.find(roleId);
+            if (roleIt != rolePermissions_.end())
+            {
+                bits |= roleIt->second;
+            }
+        }
+    }
+
+    userPermissions_[user_id] = bits;
+}
@@ -1,18 +1,60 @@
 #pragma once
 
+#include <bitset>
 #include <string>
 #include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "repository/DB.h"
 
+/**
+ * Answers permission checks from an in-memory RBAC model.
+ *
+ * Permission ids are interned into bit positions; every role has a
+ * permission bitset and every user the union of the bitsets of its roles.
+ * The model is built from the database once and then kept up to date by
+ * RoleService, so checks cost no database round trips.
+ */
 class AccessControlService
 {
 public:
+    static constexpr size_t kMaxPermissions = 256;
+    using PermissionBits = std::bitset<kMaxPermissions>;
+
     static std::shared_ptr<AccessControlService> instance();
 
     bool hasPermission(const std::string &user_id, const std::string &permission_name);
 
     std::vector<std::string> getUserPermissions(const std::string &user_id);
+
+    // For each permission, the subset of user_ids that hold it (same order as permission_names)
+    std::vector<std::vector<int>> checkPermissions(const std::vector<int> &user_ids,
+                                                   const std::vector<std::string> &permission_names);
+
+    // Rebuild the whole model from the database
+    bool reloadModel();
+
+    // Incremental updates, called after the corresponding DB change succeeded
+    void onRoleDeleted(int role_id);
+    void onPermissionsAssignedToRole(int role_id, const std::vector<int> &permission_ids);
+    void onRolesAssignedToUser(int user_id, const std::vector<int> &role_ids);
+
 private:
     AccessControlService();
+
+    // Recomputes the effective permissions of one user; caller holds the write lock
+    void recomputeUser(int user_id);
+
     std::shared_ptr<DB> db_;
-};
\ No newline at end of file
+
+    mutable std::shared_mutex modelMutex_;
+
+    std::unordered_map<std::string, int> permissionIndex_;     // permission_name -> bit
+    std::unordered_map<int, int> permissionIdIndex_;            // permission_id -> bit
+    std::vector<std::string> permissionNames_;                  // bit -> permission_name
+    std::unordered_map<int, PermissionBits> rolePermissions_;   // role_id -> bits
+    std::unordered_map<int, std::unordered_set<int>> userRoles_; // user_id -> role_ids
+    std::unordered_map<int, PermissionBits> userPermissions_;   // user_id -> effective bits
+};
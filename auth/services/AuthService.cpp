@@ -1,5 +1,6 @@
 #include "AuthService.h"
 #include "bcrypt/BCrypt.hpp"
+#include "repository/ActivityLog.h"
 #include "vector"
 
 std::shared_ptr<AuthService> AuthService::instance()
@@ -24,6 +25,7 @@ std::pair<std::string, bool> AuthService::login(const std::string& login, const
 
     if (status == UserFetchStatus::UserNotFound)
     {
+        ActivityLog::instance()->record("", "login_failed", 0, login);
         throw std::runtime_error("User not found");
     }
 
@@ -36,9 +38,11 @@ std::pair<std::string, bool> AuthService::login(const std::string& login, const
 
     if (!password_valid)
     {
+        ActivityLog::instance()->record(userId, "login_failed", 0, login);
         return {"", false};
     }
 
+    ActivityLog::instance()->record(userId, "login");
     return {userId, true};
 }
 
@@ -77,6 +81,12 @@ bool AuthService::changePassword(const std::string &userId, const std::string &c
     }
 
     std::string new_password_hash = BCrypt::generateHash(newPassword);
-    
-    return db_->updatePasswordHash(userId, new_password_hash);
+
+    if (!db_->updatePasswordHash(userId, new_password_hash))
+    {
+        return false;
+    }
+
+    ActivityLog::instance()->record(userId, "password_change");
+    return true;
 }
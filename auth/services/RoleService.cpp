@@ -14,26 +14,51 @@ RoleService::RoleService()
     {
         throw std::runtime_error("Database instance is not initialized");
     }
+
+    accessControlService_ = AccessControlService::instance();
 }
 
 bool RoleService::createRole(const std::string &role_name, const std::string &description)
 {
+    // A new role has no permissions and no users yet, so the RBAC model is unaffected
     return db_->createRole(role_name, description);
 }
 
 bool RoleService::deleteRole(int role_id)
 {
-    return db_->deleteRole(role_id);
+    if (!db_->deleteRole(role_id))
+    {
+        return false;
+    }
+
+    accessControlService_->onRoleDeleted(role_id);
+    return true;
 }
 
 bool RoleService::assignPermissionsToRole(int role_id, const std::vector<int> &permission_ids)
 {
-    return db_->assignPermissionsToRole(role_id, permission_ids);
+    if (!db_->assignPermissionsToRole(role_id, permission_ids))
+    {
+        // Some rows may have been inserted before the failure
+        accessControlService_->reloadModel();
+        return false;
+    }
+
+    accessControlService_->onPermissionsAssignedToRole(role_id, permission_ids);
+    return true;
 }
 
 bool RoleService::assignRolesToUser(int user_id, const std::vector<int> &role_ids)
 {
-    return db_->assignRolesToUser(user_id, role_ids);
+    if (!db_->assignRolesToUser(user_id, role_ids))
+    {
+        // Some rows may have been inserted before the failure
+        accessControlService_->reloadModel();
+        return false;
+    }
+
+    accessControlService_->onRolesAssignedToUser(user_id, role_ids);
+    return true;
 }
 
 std::vector<std::pair<int, std::string>> RoleService::getUserRoles(int user_id)
@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include "../repository/DB.h"
+#include "AccessControlService.h"
 
 class RoleService
 {
@@ -20,4 +21,5 @@ public:
 private:
     RoleService();
     std::shared_ptr<DB> db_;
+    std::shared_ptr<AccessControlService> accessControlService_;
 };
\ No newline at end of file
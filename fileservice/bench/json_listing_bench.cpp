@@ -0,0 +1,185 @@
+// Compares the two ways a file listing has been serialized: a Json::Value tree
+// written by jsoncpp, and the streaming JsonWriter fed by ListingRows.
+//
+// Build with -DFILESERVICE_BUILD_BENCH=ON and run ./json_listing_bench.
+// Each size reports the best of several runs and the peak bytes held by
+// operator new during one serialization (rows excluded).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "json_writer.h"
+#include "listing_rows.h"
+
+namespace {
+
+// Allocation accounting; the benchmark is single-threaded
+struct AllocStats {
+    size_t current = 0;
+    size_t peak = 0;
+    size_t count = 0;
+};
+
+AllocStats g_alloc;
+
+// Keeps the size in front of every block so operator delete can account for it
+constexpr size_t HEADER = alignof(std::max_align_t);
+
+void* countedAlloc(size_t size)
+{
+    auto* block = static_cast<char*>(std::malloc(size + HEADER));
+    if (!block)
+    {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    g_alloc.current += size;
+    g_alloc.peak = std::max(g_alloc.peak, g_alloc.current);
+    ++g_alloc.count;
+    return block + HEADER;
+}
+
+void countedFree(void* ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+    char* block = static_cast<char*>(ptr) - HEADER;
+    g_alloc.current -= *reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { countedFree(ptr); }
+
+namespace {
+
+const int REQUESTER_ID = 7;
+const int RUNS = 5;
+
+std::vector<ExtendedFileInfo> makeRows(size_t count)
+{
+    std::vector<ExtendedFileInfo> rows;
+    rows.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        bool shared = i % 3 == 0;
+        int owner = static_cast<int>(i % 50);
+        rows.push_back({static_cast<int>(i + 1),
+                        "report_" + std::to_string(i) + (i % 2 ? ".pdf" : ".txt"),
+                        static_cast<int>(1024 + i * 37 % 1000000),
+                        "2024-05-17 12:34:56.789012",
+                        shared ? "shared" : "personal",
+                        owner,
+                        "user" + std::to_string(owner) + "@example.com",
+                        shared ? static_cast<int>(i % 10 + 1) : 0,
+                        shared ? "group_" + std::to_string(i % 10 + 1) : "",
+                        i % 5 == 0});
+    }
+    return rows;
+}
+
+// What FileController::getFiles did before the streaming writer
+size_t viaJsonValue(const std::vector<ExtendedFileInfo>& rows)
+{
+    Json::Value data;
+    data["files"] = Json::arrayValue;
+    for (const auto& file : rows)
+    {
+        Json::Value fileJson;
+        fileJson["file_id"] = file.file_id;
+        fileJson["file_name"] = file.file_name;
+        fileJson["file_size"] = file.file_size;
+        fileJson["created_at"] = file.created_at;
+        fileJson["file_type"] = file.file_type;
+        fileJson["owner_id"] = file.owner_id;
+        fileJson["owner_email"] = file.owner_email;
+        fileJson["group_id"] = file.group_id;
+        fileJson["group_name"] = file.group_name;
+        fileJson["can_modify"] = file.owner_id == REQUESTER_ID;
+        fileJson["is_favorite"] = file.is_favorite;
+        data["files"].append(fileJson);
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, data).size();
+}
+
+size_t viaJsonWriter(const std::vector<ExtendedFileInfo>& rows)
+{
+    std::string body;
+    JsonWriter writer(body);
+    writer.startObject();
+    writer.key("files");
+    writer.startArray();
+    for (const auto& file : rows)
+    {
+        ListingRows::writeFile(writer, file, REQUESTER_ID);
+    }
+    writer.endArray();
+    writer.endObject();
+    return body.size();
+}
+
+struct Result {
+    double millis;
+    size_t peakBytes;
+    size_t allocations;
+    size_t outputBytes;
+};
+
+template <typename Encode>
+Result measure(Encode encode, const std::vector<ExtendedFileInfo>& rows)
+{
+    Result result{1e300, 0, 0, 0};
+    for (int run = 0; run < RUNS; ++run)
+    {
+        size_t base = g_alloc.current;
+        g_alloc.peak = base;
+        g_alloc.count = 0;
+
+        auto started = std::chrono::steady_clock::now();
+        size_t outputBytes = encode(rows);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+
+        result.millis = std::min(result.millis, elapsed.count());
+        result.peakBytes = g_alloc.peak - base;
+        result.allocations = g_alloc.count;
+        result.outputBytes = outputBytes;
+    }
+    return result;
+}
+
+void print(const char* path, size_t rows, const Result& result)
+{
+    std::printf("%-12s %8zu %10.2f %14zu %12zu %12zu\n", path, rows, result.millis, result.peakBytes,
+                result.allocations, result.outputBytes);
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-12s %8s %10s %14s %12s %12s\n", "path", "rows", "ms", "peak bytes", "allocations",
+                "output");
+    for (size_t count : {1000, 10000, 100000})
+    {
+        auto rows = makeRows(count);
+        print("Json::Value", count, measure(viaJsonValue, rows));
+        print("JsonWriter", count, measure(viaJsonWriter, rows));
+    }
+    return 0;
+}
@@ -1,5 +1,11 @@
 #include "AdminController.h"
 #include <drogon/drogon.h>
+#include <ctime>
+#include "wire_format.h"
+
+// Page size of /admin/files and /admin/folders when paginated, and of /admin/activity
+const int DEFAULT_ADMIN_PAGE_SIZE = 500;
+const int MAX_ADMIN_PAGE_SIZE = 5000;
 
 AdminController::AdminController() {
     LOG_INFO << "Initializing AdminController";
@@ -23,53 +29,90 @@ void AdminController::getAllFiles(const HttpRequestPtr &req, std::function<void(
         return;
     }
 
-    // Get all files from all users
-    auto filesData = adminService_->getAllFiles();
+    respondWithListing(AdminListing::Files, req, std::move(callback));
+}
 
-    // Create JSON response
-    Json::Value response;
-    response["total_users"] = static_cast<int>(filesData.size());
-    response["users"] = Json::arrayValue;
+void AdminController::getAllFolders(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    // Extract user_id from the token (set by JwtAuthFilter)
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
 
-    int totalFiles = 0;
+    LOG_INFO << "Processing 'getAllFolders' admin request by user_id: " << admin_user_id;
 
-    for (const auto& userData : filesData) {
-        Json::Value userJson;
-        userJson["user_id"] = userData.user_id;
-        userJson["email"] = userData.email;
-        userJson["files_count"] = static_cast<int>(userData.files.size());
-
-        totalFiles += userData.files.size();
-
-        Json::Value filesArray = Json::arrayValue;
-        for (const auto& file : userData.files) {
-            Json::Value fileJson;
-            fileJson["file_id"] = file.file_id;
-            fileJson["file_name"] = file.file_name;
-            fileJson["file_size"] = file.file_size;
-            fileJson["folder_id"] = file.folder_id;
-            fileJson["created_at"] = file.created_at;
-            filesArray.append(fileJson);
+    // Check if the user has the admin permission (should already be handled by PermissionFilter)
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    respondWithListing(AdminListing::Folders, req, std::move(callback));
+}
+
+void AdminController::respondWithListing(AdminListing listing, const HttpRequestPtr &req,
+                                         std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    WireFormat::Format format = WireFormat::negotiate(req);
+    const char* name = listing == AdminListing::Folders ? "folders" : "files";
+
+    std::string cursor = req->getParameter("cursor");
+    std::string limitParam = req->getParameter("limit");
+    if (!cursor.empty() || !limitParam.empty()) {
+        int limit = DEFAULT_ADMIN_PAGE_SIZE;
+        try {
+            limit = req->getOptionalParameter<int>("limit").value_or(DEFAULT_ADMIN_PAGE_SIZE);
+        } catch (const std::exception&) {
+            limit = 0;
+        }
+        if (limit <= 0 || limit > MAX_ADMIN_PAGE_SIZE) {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k400BadRequest);
+            resp->setBody("Invalid limit, expected 1.." + std::to_string(MAX_ADMIN_PAGE_SIZE));
+            callback(resp);
+            return;
         }
 
-        userJson["files"] = filesArray;
-        response["users"].append(userJson);
+        std::string body;
+        std::string errorMsg;
+        if (!adminService_->getListingPage(listing, cursor, limit, format, body, errorMsg)) {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(errorMsg == "Invalid cursor" ? k400BadRequest : k500InternalServerError);
+            resp->setBody(errorMsg);
+            callback(resp);
+            return;
+        }
+        callback(WireFormat::makeResponse(format, std::move(body)));
+        return;
     }
 
-    response["total_files"] = totalFiles;
+    // The whole listing is unbounded, so it is streamed as a chunked response
+    auto producer = adminService_->streamListing(listing, format);
+    if (!producer) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k500InternalServerError);
+        resp->setBody(std::string("Failed to get ") + name);
+        callback(resp);
+        return;
+    }
 
-    auto resp = HttpResponse::newHttpJsonResponse(response);
+    auto resp = HttpResponse::newStreamResponse(producer, "", CT_APPLICATION_JSON);
+    resp->setContentTypeString(WireFormat::contentType(format));
+    WireFormat::setVary(resp);
     callback(resp);
 }
 
-void AdminController::getAllFolders(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+void AdminController::exportListing(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
 {
-    // Extract user_id from the token (set by JwtAuthFilter)
     std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+    std::string type = req->getParameter("type");
+    std::string formatParam = req->getParameter("format");
 
-    LOG_INFO << "Processing 'getAllFolders' admin request by user_id: " << admin_user_id;
+    LOG_INFO << "Processing 'exportListing' admin request by user_id: " << admin_user_id
+             << ", type: " << type << ", format: " << formatParam;
 
-    // Check if the user has the admin permission (should already be handled by PermissionFilter)
     if (!req->attributes()->get<bool>("has_admin_permission")) {
         LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
         auto resp = HttpResponse::newHttpResponse();
@@ -79,41 +122,30 @@ void AdminController::getAllFolders(const HttpRequestPtr &req, std::function<voi
         return;
     }
 
-    // Get all folders from all users
-    auto foldersData = adminService_->getAllFolders();
-
-    // Create JSON response
-    Json::Value response;
-    response["total_users"] = static_cast<int>(foldersData.size());
-    response["users"] = Json::arrayValue;
-
-    int totalFolders = 0;
+    if ((type != "files" && type != "folders") || (formatParam != "ndjson" && formatParam != "csv")) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Expected type=files|folders and format=ndjson|csv");
+        callback(resp);
+        return;
+    }
 
-    for (const auto& userData : foldersData) {
-        Json::Value userJson;
-        userJson["user_id"] = userData.user_id;
-        userJson["email"] = userData.email;
-        userJson["folders_count"] = static_cast<int>(userData.folders.size());
-
-        totalFolders += userData.folders.size();
-
-        Json::Value foldersArray = Json::arrayValue;
-        for (const auto& folder : userData.folders) {
-            Json::Value folderJson;
-            folderJson["folder_id"] = folder.folder_id;
-            folderJson["folder_name"] = folder.folder_name;
-            folderJson["parent_folder_id"] = folder.parent_folder_id;
-            folderJson["created_at"] = folder.created_at;
-            foldersArray.append(folderJson);
-        }
+    AdminListing listing = type == "folders" ? AdminListing::Folders : AdminListing::Files;
+    ExportFormat format = formatParam == "csv" ? ExportFormat::Csv : ExportFormat::Ndjson;
 
-        userJson["folders"] = foldersArray;
-        response["users"].append(userJson);
+    auto producer = adminService_->exportListing(listing, format);
+    if (!producer) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k500InternalServerError);
+        resp->setBody("Failed to export " + type);
+        callback(resp);
+        return;
     }
 
-    response["total_folders"] = totalFolders;
-
-    auto resp = HttpResponse::newHttpJsonResponse(response);
+    std::string fileName = type + (format == ExportFormat::Csv ? ".csv" : ".ndjson");
+    // Sent as an attachment named fileName
+    auto resp = HttpResponse::newStreamResponse(producer, fileName, CT_CUSTOM,
+                                                format == ExportFormat::Csv ? "text/csv; charset=utf-8" : "application/x-ndjson");
     callback(resp);
 }
 
@@ -135,8 +167,31 @@ void AdminController::getUserContent(const HttpRequestPtr &req, std::function<vo
         return;
     }
 
-    // Get content for specified user
-    auto userContent = adminService_->getUserContent(user_id);
+    int limit = DEFAULT_ADMIN_PAGE_SIZE;
+    int files_after = 0;
+    int folders_after = 0;
+    try {
+        limit = req->getOptionalParameter<int>("limit").value_or(DEFAULT_ADMIN_PAGE_SIZE);
+        files_after = req->getOptionalParameter<int>("files_after").value_or(0);
+        folders_after = req->getOptionalParameter<int>("folders_after").value_or(0);
+    } catch (const std::exception&) {
+        limit = 0;
+    }
+    std::string section = req->getParameter("section");
+    if (limit <= 0 || limit > MAX_ADMIN_PAGE_SIZE ||
+        (!section.empty() && section != "all" && section != "files" && section != "folders")) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid parameters, expected limit 1.." + std::to_string(MAX_ADMIN_PAGE_SIZE) +
+                      ", integer files_after/folders_after and section=all|files|folders");
+        callback(resp);
+        return;
+    }
+
+    // Get content for specified user; section limits the response to one of the lists
+    auto userContent = adminService_->getUserContent(user_id,
+                                                     files_after, section == "folders" ? 0 : limit,
+                                                     folders_after, section == "files" ? 0 : limit);
 
     if (!userContent.has_value()) {
         LOG_WARN << "Target user not found or has no content. User ID: " << user_id;
@@ -147,23 +202,10 @@ void AdminController::getUserContent(const HttpRequestPtr &req, std::function<vo
         return;
     }
 
-    // Create JSON response
-    Json::Value response;
     const auto& content = userContent.value();
 
-    response["user_id"] = content.user_id;
-    response["email"] = content.email;
-    response["files_count"] = static_cast<int>(content.files.size());
-    response["folders_count"] = static_cast<int>(content.folders.size());
-
-    // Calculate total storage used
-    long long totalStorageBytes = 0;
-    for (const auto& file : content.files) {
-        totalStorageBytes += file.file_size;
-    }
-    response["total_storage_bytes"] = Json::Int64(totalStorageBytes);
-
     // Format total storage in human-readable format
+    long long totalStorageBytes = content.total_storage_bytes;
     std::string readableStorage;
     if (totalStorageBytes < 1024) {
         readableStorage = std::to_string(totalStorageBytes) + " B";
@@ -174,35 +216,65 @@ void AdminController::getUserContent(const HttpRequestPtr &req, std::function<vo
     } else {
         readableStorage = std::to_string(totalStorageBytes / (1024 * 1024 * 1024)) + " GB";
     }
-    response["total_storage_readable"] = readableStorage;
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->field("user_id", content.user_id);
+    writer->field("email", content.email);
+    writer->field("files_count", content.files_count);
+    writer->field("folders_count", content.folders_count);
+    writer->field("total_storage_bytes", totalStorageBytes);
+    writer->field("total_storage_readable", readableStorage);
+    writer->key("root");
+    writer->startObject();
+    writer->field("files_count", content.root_files_count);
+    writer->field("total_bytes", content.root_storage_bytes);
+    writer->endObject();
 
     // Add files
-    Json::Value filesArray = Json::arrayValue;
-    for (const auto& file : content.files) {
-        Json::Value fileJson;
-        fileJson["file_id"] = file.file_id;
-        fileJson["file_name"] = file.file_name;
-        fileJson["file_size"] = file.file_size;
-        fileJson["folder_id"] = file.folder_id;
-        fileJson["created_at"] = file.created_at;
-        filesArray.append(fileJson);
-    }
-    response["files"] = filesArray;
-
-    // Add folders
-    Json::Value foldersArray = Json::arrayValue;
-    for (const auto& folder : content.folders) {
-        Json::Value folderJson;
-        folderJson["folder_id"] = folder.folder_id;
-        folderJson["folder_name"] = folder.folder_name;
-        folderJson["parent_folder_id"] = folder.parent_folder_id;
-        folderJson["created_at"] = folder.created_at;
-        foldersArray.append(folderJson);
-    }
-    response["folders"] = foldersArray;
+    if (section != "folders") {
+        writer->key("files");
+        writer->startArray();
+        for (const auto& file : content.files) {
+            writer->startObject();
+            writer->field("file_id", file.file_id);
+            writer->field("file_name", file.file_name);
+            writer->field("file_size", file.file_size);
+            writer->field("folder_id", file.folder_id);
+            writer->field("created_at", file.created_at);
+            writer->endObject();
+        }
+        writer->endArray();
+        if (content.more_files) {
+            writer->field("next_files_after", content.files.back().file_id);
+        }
+    }
 
-    auto resp = HttpResponse::newHttpJsonResponse(response);
-    callback(resp);
+    // Add folders, each with the files directly inside it
+    if (section != "files") {
+        writer->key("folders");
+        writer->startArray();
+        for (const auto& folder : content.folders) {
+            writer->startObject();
+            writer->field("folder_id", folder.folder_id);
+            writer->field("folder_name", folder.folder_name);
+            writer->field("parent_folder_id", folder.parent_folder_id);
+            writer->field("created_at", folder.created_at);
+            writer->field("files_count", folder.files_count);
+            writer->field("total_bytes", folder.total_bytes);
+            writer->endObject();
+        }
+        writer->endArray();
+        if (content.more_folders) {
+            writer->field("next_folders_after", content.folders.back().folder_id);
+        }
+    }
+    writer->endObject();
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
 }
 
 void AdminController::getSystemStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
@@ -260,11 +332,580 @@ void AdminController::getSystemStats(const HttpRequestPtr &req, std::function<vo
     for (const auto& user : stats.top_users_by_storage) {
         Json::Value userJson;
         userJson["user_id"] = user.first;
-        userJson["storage_bytes"] = user.second;
+        userJson["storage_bytes"] = Json::Int64(user.second);
         topUsersArray.append(userJson);
     }
     response["top_users_by_storage"] = topUsersArray;
 
+    // Add top groups by storage
+    Json::Value topGroupsArray = Json::arrayValue;
+    for (const auto& [group, filesCount, storageBytes] : stats.top_groups_by_storage) {
+        Json::Value groupJson;
+        groupJson["group_id"] = group;
+        groupJson["files_count"] = Json::Int64(filesCount);
+        groupJson["storage_bytes"] = Json::Int64(storageBytes);
+        topGroupsArray.append(groupJson);
+    }
+    response["top_groups_by_storage"] = topGroupsArray;
+
     auto resp = HttpResponse::newHttpJsonResponse(response);
     callback(resp);
-}
\ No newline at end of file
+}
+
+void AdminController::getUsageHistory(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getUsageHistory' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    // Default range: the last 24 hours
+    long long to = static_cast<long long>(std::time(nullptr));
+    long long from = 0;
+    int id = 0;
+    try {
+        to = req->getOptionalParameter<long long>("to").value_or(to);
+        from = req->getOptionalParameter<long long>("from").value_or(to - 24 * 60 * 60);
+        id = req->getOptionalParameter<int>("id").value_or(0);
+    } catch (const std::exception&) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid parameters, from and to are Unix timestamps and id is an integer");
+        callback(resp);
+        return;
+    }
+
+    std::string scope = req->getParameter("scope");
+    if (scope.empty()) {
+        scope = "system";
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getUsageHistory(scope, id, from, to, req->getParameter("resolution"), format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else {
+            LOG_ERROR << "Failed to get usage history: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::getActivity(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getActivity' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    // Default range: the last 24 hours
+    ActivityFilter filter;
+    int limit = DEFAULT_ADMIN_PAGE_SIZE;
+    try {
+        filter.to = req->getOptionalParameter<long long>("to").value_or(static_cast<long long>(std::time(nullptr)) + 1);
+        filter.from = req->getOptionalParameter<long long>("from").value_or(filter.to - 24 * 60 * 60);
+        filter.user_id = req->getOptionalParameter<int>("user_id").value_or(0);
+        limit = req->getOptionalParameter<int>("limit").value_or(DEFAULT_ADMIN_PAGE_SIZE);
+    } catch (const std::exception&) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid parameters, from and to are Unix timestamps, user_id and limit are integers");
+        callback(resp);
+        return;
+    }
+    filter.action = req->getParameter("action");
+
+    if (limit <= 0 || limit > MAX_ADMIN_PAGE_SIZE) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid limit, expected 1.." + std::to_string(MAX_ADMIN_PAGE_SIZE));
+        callback(resp);
+        return;
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getActivity(filter, req->getParameter("cursor"), limit, format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else {
+            LOG_ERROR << "Failed to get activity log: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::getAnalytics(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getAnalytics' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    int limit = 10;
+    try {
+        limit = req->getOptionalParameter<int>("limit").value_or(10);
+    } catch (const std::exception&) {
+        limit = 0;
+    }
+
+    std::string period = req->getParameter("period");
+    if (!period.empty() && period != "current" && period != "previous") {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid period, expected current or previous");
+        callback(resp);
+        return;
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getAnalytics(req->getParameter("window"), period == "previous", limit, format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else {
+            resp->setStatusCode(k503ServiceUnavailable);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::getDuplicates(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getDuplicates' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    int limit = 50;
+    try {
+        limit = req->getOptionalParameter<int>("limit").value_or(50);
+    } catch (const std::exception&) {
+        limit = 0;
+    }
+
+    if (limit <= 0 || limit > MAX_ADMIN_PAGE_SIZE) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid limit, expected 1.." + std::to_string(MAX_ADMIN_PAGE_SIZE));
+        callback(resp);
+        return;
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getDuplicateReport(limit, format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else {
+            LOG_ERROR << "Failed to get duplicate report: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::scanDuplicates(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'scanDuplicates' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    long long job_id = 0;
+    std::string errorMsg;
+    if (!adminService_->startDuplicateScan(std::atoi(admin_user_id.c_str()), job_id, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else if (errorMsg.find("already") != std::string::npos) {
+            resp->setStatusCode(k409Conflict);
+        } else {
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    Json::Value result;
+    result["job_id"] = static_cast<Json::Int64>(job_id);
+    auto resp = HttpResponse::newHttpJsonResponse(result);
+    resp->setStatusCode(k202Accepted);
+    callback(resp);
+}
+
+void AdminController::getJobs(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getJobs' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    JobFilter filter;
+    long long before_id = 0;
+    int limit = DEFAULT_ADMIN_PAGE_SIZE;
+    try {
+        before_id = req->getOptionalParameter<long long>("before").value_or(0);
+        limit = req->getOptionalParameter<int>("limit").value_or(DEFAULT_ADMIN_PAGE_SIZE);
+    } catch (const std::exception&) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid parameters, before and limit are integers");
+        callback(resp);
+        return;
+    }
+    filter.state = req->getParameter("state");
+    filter.kind = req->getParameter("kind");
+
+    if (limit <= 0 || limit > MAX_ADMIN_PAGE_SIZE) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid limit, expected 1.." + std::to_string(MAX_ADMIN_PAGE_SIZE));
+        callback(resp);
+        return;
+    }
+
+    respondWithJobs(filter, before_id, limit, req, std::move(callback));
+}
+
+void AdminController::getJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string job_id)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getJob' admin request by user_id: " << admin_user_id << " for job_id: " << job_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    JobFilter filter;
+    try {
+        filter.job_id = std::stoll(job_id);
+    } catch (const std::exception&) {
+        filter.job_id = 0;
+    }
+    if (filter.job_id <= 0) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid job_id");
+        callback(resp);
+        return;
+    }
+
+    respondWithJobs(filter, 0, 1, req, std::move(callback));
+}
+
+void AdminController::respondWithJobs(const JobFilter& filter, long long before_id, int limit, const HttpRequestPtr &req,
+                                      std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getJobs(filter, before_id, limit, format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("not found") != std::string::npos) {
+            resp->setStatusCode(k404NotFound);
+        } else if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else {
+            LOG_ERROR << "Failed to get jobs: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::createJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'createJob' admin request by user_id: " << admin_user_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    auto json = req->getJsonObject();
+    if (!json || !(*json)["kind"].isString() ||
+        (json->isMember("payload") && !(*json)["payload"].isObject()) ||
+        (json->isMember("priority") && !(*json)["priority"].isInt())) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON, expected kind, optional payload object and priority");
+        callback(resp);
+        return;
+    }
+
+    Json::Value payload = json->get("payload", Json::Value(Json::objectValue));
+    int priority = json->get("priority", 0).asInt();
+
+    long long job_id = 0;
+    std::string errorMsg;
+    if (!adminService_->createJob((*json)["kind"].asString(), payload, priority, std::atoi(admin_user_id.c_str()),
+                                  job_id, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else if (errorMsg.find("already") != std::string::npos) {
+            resp->setStatusCode(k409Conflict);
+        } else if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else {
+            LOG_ERROR << "Failed to create job: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    Json::Value result;
+    result["job_id"] = static_cast<Json::Int64>(job_id);
+    auto resp = HttpResponse::newHttpJsonResponse(result);
+    resp->setStatusCode(k202Accepted);
+    callback(resp);
+}
+
+void AdminController::cancelJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string job_id)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'cancelJob' admin request by user_id: " << admin_user_id << " for job_id: " << job_id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    long long id = 0;
+    try {
+        id = std::stoll(job_id);
+    } catch (const std::exception&) {
+        id = 0;
+    }
+    if (id <= 0) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid job_id");
+        callback(resp);
+        return;
+    }
+
+    std::string errorMsg;
+    auto resp = HttpResponse::newHttpResponse();
+    if (!adminService_->cancelJob(id, errorMsg)) {
+        resp->setStatusCode(errorMsg.find("disabled") != std::string::npos ? k503ServiceUnavailable : k409Conflict);
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    resp->setStatusCode(k204NoContent);
+    callback(resp);
+}
+
+void AdminController::getQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'getQuota' admin request by user_id: " << admin_user_id
+             << " for " << scope << " " << id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    std::string errorMsg;
+    if (!adminService_->getQuota(scope, id, format, body, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else {
+            resp->setStatusCode(k503ServiceUnavailable);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void AdminController::setQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'setQuota' admin request by user_id: " << admin_user_id
+             << " for " << scope << " " << id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    auto json = req->getJsonObject();
+    if (!json || !(*json)["byte_limit"].isIntegral()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON, expected byte_limit");
+        callback(resp);
+        return;
+    }
+
+    respondWithQuotaChange(scope, id, (*json)["byte_limit"].asInt64(), false, std::move(callback));
+}
+
+void AdminController::removeQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id)
+{
+    std::string admin_user_id = req->attributes()->get<std::string>("user_id");
+
+    LOG_INFO << "Processing 'removeQuota' admin request by user_id: " << admin_user_id
+             << " for " << scope << " " << id;
+
+    if (!req->attributes()->get<bool>("has_admin_permission")) {
+        LOG_WARN << "Unauthorized access attempt to admin endpoint by user_id: " << admin_user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k403Forbidden);
+        resp->setBody("Forbidden - Admin permission required");
+        callback(resp);
+        return;
+    }
+
+    respondWithQuotaChange(scope, id, 0, true, std::move(callback));
+}
+
+void AdminController::respondWithQuotaChange(const std::string& scope, int id, long long byte_limit, bool remove,
+                                             std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string errorMsg;
+    auto resp = HttpResponse::newHttpResponse();
+    if (!adminService_->setQuota(scope, id, byte_limit, remove, errorMsg)) {
+        if (errorMsg.find("Invalid") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else if (errorMsg.find("disabled") != std::string::npos) {
+            resp->setStatusCode(k503ServiceUnavailable);
+        } else {
+            LOG_ERROR << "Failed to change quota: " << errorMsg;
+            resp->setStatusCode(k500InternalServerError);
+        }
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    resp->setStatusCode(k204NoContent);
+    callback(resp);
+}
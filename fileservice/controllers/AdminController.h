@@ -16,20 +16,74 @@ public:
         // Get all folders in the system grouped by user
         ADD_METHOD_TO(AdminController::getAllFolders, "/api/v1/admin/folders", Get, "JwtAuthFilter", "PermissionFilter");
 
+        // Export all files or folders as NDJSON or CSV, one row per line
+        ADD_METHOD_TO(AdminController::exportListing, "/api/v1/admin/export", Get, "JwtAuthFilter", "PermissionFilter");
+
         // Get all files and folders for a specific user
         ADD_METHOD_TO(AdminController::getUserContent, "/api/v1/admin/users/{user_id}/content", Get, "JwtAuthFilter", "PermissionFilter");
 
         // Get system statistics (file counts, storage usage, etc.)
         ADD_METHOD_TO(AdminController::getSystemStats, "/api/v1/admin/stats", Get, "JwtAuthFilter", "PermissionFilter");
+
+        // Get usage history (storage, active users, transfer volume) over a time range
+        ADD_METHOD_TO(AdminController::getUsageHistory, "/api/v1/admin/usage", Get, "JwtAuthFilter", "PermissionFilter");
+
+        // Get the activity log (logins, uploads, downloads, deletions, permission changes), newest first
+        ADD_METHOD_TO(AdminController::getActivity, "/api/v1/admin/activity", Get, "JwtAuthFilter", "PermissionFilter");
+
+        // Get approximate distinct users and the hottest files and folders of the hour or day
+        ADD_METHOD_TO(AdminController::getAnalytics, "/api/v1/admin/analytics", Get, "JwtAuthFilter", "PermissionFilter");
+
+        // Get sets of stored files with identical content and the bytes they waste
+        ADD_METHOD_TO(AdminController::getDuplicates, "/api/v1/admin/duplicates", Get, "JwtAuthFilter", "PermissionFilter");
+
+        // Start a duplicate scan now instead of waiting for the next scheduled one
+        ADD_METHOD_TO(AdminController::scanDuplicates, "/api/v1/admin/duplicates/scan", Post, "JwtAuthFilter", "PermissionFilter");
+
+        // Background jobs: list with progress, queue, inspect and cancel
+        ADD_METHOD_TO(AdminController::getJobs, "/api/v1/admin/jobs", Get, "JwtAuthFilter", "PermissionFilter");
+        ADD_METHOD_TO(AdminController::createJob, "/api/v1/admin/jobs", Post, "JwtAuthFilter", "PermissionFilter");
+        ADD_METHOD_TO(AdminController::getJob, "/api/v1/admin/jobs/{job_id}", Get, "JwtAuthFilter", "PermissionFilter");
+        ADD_METHOD_TO(AdminController::cancelJob, "/api/v1/admin/jobs/{job_id}/cancel", Post, "JwtAuthFilter", "PermissionFilter");
+
+        // Storage quota of a user or group (scope: user or group): usage, set, back to the default
+        ADD_METHOD_TO(AdminController::getQuota, "/api/v1/admin/quotas/{scope}/{id}", Get, "JwtAuthFilter", "PermissionFilter");
+        ADD_METHOD_TO(AdminController::setQuota, "/api/v1/admin/quotas/{scope}/{id}", Put, "JwtAuthFilter", "PermissionFilter");
+        ADD_METHOD_TO(AdminController::removeQuota, "/api/v1/admin/quotas/{scope}/{id}", Delete, "JwtAuthFilter", "PermissionFilter");
     METHOD_LIST_END
 
     AdminController();
 
     void getAllFiles(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void getAllFolders(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void exportListing(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void getUserContent(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string user_id);
     void getSystemStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getUsageHistory(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getActivity(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getAnalytics(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getDuplicates(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void scanDuplicates(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getJobs(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void createJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void getJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string job_id);
+    void cancelJob(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string job_id);
+    void getQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id);
+    void setQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id);
+    void removeQuota(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::string scope, int id);
 
 private:
+    // Saves or removes the quota and writes the status of AdminService::setQuota
+    void respondWithQuotaChange(const std::string& scope, int id, long long byte_limit, bool remove,
+                                std::function<void(const HttpResponsePtr &)> &&callback);
+
+    // Writes the jobs matching the filter, or the error of AdminService::getJobs
+    void respondWithJobs(const JobFilter& filter, long long before_id, int limit, const HttpRequestPtr &req,
+                         std::function<void(const HttpResponsePtr &)> &&callback);
+
+    // Whole listing as a chunked response, or one page of it if cursor or limit is given
+    void respondWithListing(AdminListing listing, const HttpRequestPtr &req,
+                            std::function<void(const HttpResponsePtr &)> &&callback);
+
     std::shared_ptr<AdminService> adminService_;
 };
\ No newline at end of file
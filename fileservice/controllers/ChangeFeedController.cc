@@ -0,0 +1,136 @@
+#include "ChangeFeedController.h"
+#include <drogon/drogon.h>
+#include <sstream>
+#include "json_writer.h"
+
+// Client messages are small control frames
+const size_t MAX_CONTROL_MESSAGE_SIZE = 16 * 1024;
+
+namespace {
+
+// Reply to a control message: {"action":"...","accepted":[...],"rejected":[...]} or {"error":"..."}
+std::string makeReply(const std::string& action, const std::vector<int>& accepted, const std::vector<int>& rejected)
+{
+    std::string out;
+    JsonWriter writer(out);
+    writer.startObject();
+    writer.field("action", action);
+    writer.key("accepted");
+    writer.startArray();
+    for (int id : accepted) writer.value(id);
+    writer.endArray();
+    writer.key("rejected");
+    writer.startArray();
+    for (int id : rejected) writer.value(id);
+    writer.endArray();
+    writer.endObject();
+    return out;
+}
+
+std::string makeError(const std::string& error)
+{
+    std::string out;
+    JsonWriter writer(out);
+    writer.startObject();
+    writer.field("error", error);
+    writer.endObject();
+    return out;
+}
+
+} // namespace
+
+ChangeFeedController::ChangeFeedController() {
+    LOG_INFO << "Initializing ChangeFeedController";
+    fileService_ = FileService::instance();
+    changeFeed_ = ChangeFeed::instance();
+}
+
+void ChangeFeedController::handleNewConnection(const HttpRequestPtr &req, const WebSocketConnectionPtr &conn)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    LOG_INFO << "Processing 'changeFeed' connection for user_id: " << user_id;
+
+    int requester_id = 0;
+    try {
+        requester_id = std::stoi(user_id);
+    } catch (const std::exception&) {
+        conn->shutdown(CloseCode::kViolation, "Invalid user");
+        return;
+    }
+
+    conn->setContext(changeFeed_->connect(requester_id, conn));
+}
+
+void ChangeFeedController::handleConnectionClosed(const WebSocketConnectionPtr &conn)
+{
+    auto subscriber = conn->getContext<ChangeFeed::Subscriber>();
+    if (subscriber) {
+        changeFeed_->disconnect(subscriber);
+        conn->clearContext();
+    }
+}
+
+void ChangeFeedController::handleNewMessage(const WebSocketConnectionPtr &conn, std::string &&message, const WebSocketMessageType &type)
+{
+    auto subscriber = conn->getContext<ChangeFeed::Subscriber>();
+    if (!subscriber) {
+        return;
+    }
+
+    // Confirms the frames sent before the ping it answers (backpressure)
+    if (type == WebSocketMessageType::Pong) {
+        changeFeed_->acknowledge(subscriber, message);
+        return;
+    }
+    if (type != WebSocketMessageType::Text) {
+        return;
+    }
+
+    if (message.size() > MAX_CONTROL_MESSAGE_SIZE) {
+        conn->send(makeError("Message too large"));
+        return;
+    }
+
+    Json::Value json;
+    Json::CharReaderBuilder builder;
+    std::string parseErrors;
+    std::istringstream input(message);
+    if (!Json::parseFromStream(builder, input, &json, &parseErrors) || !json.isObject()) {
+        conn->send(makeError("Invalid JSON"));
+        return;
+    }
+
+    std::string action = json.get("action", "").asString();
+    const Json::Value& folderIds = json["folder_ids"];
+    if ((action != "subscribe" && action != "unsubscribe") || !folderIds.isArray()) {
+        conn->send(makeError("Expected {\"action\":\"subscribe\"|\"unsubscribe\",\"folder_ids\":[...]}"));
+        return;
+    }
+
+    std::string user_id = std::to_string(ChangeFeed::userOf(subscriber));
+    std::vector<int> accepted;
+    std::vector<int> rejected;
+
+    for (const auto& id : folderIds) {
+        if (!id.isInt() || id.asInt() < 0) {
+            continue;
+        }
+        int folder_id = id.asInt();
+
+        if (action == "unsubscribe") {
+            changeFeed_->unsubscribe(subscriber, folder_id);
+            accepted.push_back(folder_id);
+            continue;
+        }
+
+        // Events carry names and ids, so subscribing requires read access to the folder
+        if (!fileService_->canUserAccessFolder(user_id, folder_id) ||
+            !changeFeed_->subscribe(subscriber, folder_id)) {
+            rejected.push_back(folder_id);
+            continue;
+        }
+        accepted.push_back(folder_id);
+    }
+
+    conn->send(makeReply(action, accepted, rejected));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <drogon/WebSocketController.h>
+#include <memory>
+#include "services/FileService.h"
+#include "change_feed.h"
+
+using namespace drogon;
+
+/**
+ * WebSocket change feed: clients subscribe to folder ids and receive
+ * {"events":[...]} frames whenever files or folders in them change.
+ *
+ * Client messages:
+ *   {"action":"subscribe","folder_ids":[0,12]}
+ *   {"action":"unsubscribe","folder_ids":[12]}
+ */
+class ChangeFeedController : public drogon::WebSocketController<ChangeFeedController>
+{
+public:
+    WS_PATH_LIST_BEGIN
+        WS_PATH_ADD("/api/v1/ws", "JwtAuthFilter");
+    WS_PATH_LIST_END
+
+    ChangeFeedController();
+
+    void handleNewMessage(const WebSocketConnectionPtr &conn, std::string &&message, const WebSocketMessageType &type) override;
+    void handleNewConnection(const HttpRequestPtr &req, const WebSocketConnectionPtr &conn) override;
+    void handleConnectionClosed(const WebSocketConnectionPtr &conn) override;
+
+private:
+    std::shared_ptr<FileService> fileService_;
+    std::shared_ptr<ChangeFeed> changeFeed_;
+};
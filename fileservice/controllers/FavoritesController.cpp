@@ -1,5 +1,8 @@
 #include "FavoritesController.h"
 #include <drogon/drogon.h>
+#include "etag_utils.h"
+#include "wire_format.h"
+#include "listing_rows.h"
 
 FavoritesController::FavoritesController() {
     LOG_INFO << "Initializing FavoritesController";
@@ -101,29 +104,32 @@ void FavoritesController::getFavoriteFiles(const HttpRequestPtr &req, std::funct
     std::string user_id = req->attributes()->get<std::string>("user_id");
     LOG_INFO << "Processing 'getFavoriteFiles' request for user_id: " << user_id;
 
-    auto files = fileService_->getFavoriteFiles(user_id);
+    WireFormat::Format format = WireFormat::negotiate(req);
+    std::string etag = WireFormat::etag(format, fileService_->favoritesETag(user_id));
+    if (EtagUtils::isNotModified(req, etag)) {
+        auto resp = EtagUtils::notModified(etag);
+        WireFormat::setVary(resp);
+        callback(resp);
+        return;
+    }
 
-    Json::Value data;
-    data["files"] = Json::arrayValue;
+    auto files = fileService_->getFavoriteFiles(user_id);
+    int requester_id = std::stoi(user_id);
 
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("files");
+    writer->startArray();
     for (const auto& file : files)
     {
-        Json::Value fileJson;
-        fileJson["file_id"] = file.file_id;
-        fileJson["file_name"] = file.file_name;
-        fileJson["file_size"] = file.file_size;
-        fileJson["created_at"] = file.created_at;
-        fileJson["file_type"] = file.file_type;
-        fileJson["owner_id"] = file.owner_id;
-        fileJson["owner_email"] = file.owner_email;
-        fileJson["group_id"] = file.group_id;
-        fileJson["group_name"] = file.group_name;
-        fileJson["can_modify"] = (file.owner_id == std::stoi(user_id));
-        fileJson["is_favorite"] = file.is_favorite;
-        data["files"].append(fileJson);
+        ListingRows::writeFile(*writer, file, requester_id);
     }
+    writer->endArray();
+    writer->endObject();
 
-    auto resp = HttpResponse::newHttpJsonResponse(data);
+    auto resp = WireFormat::makeResponse(format, std::move(body));
+    EtagUtils::setValidator(resp, etag);
     callback(resp);
 }
 
@@ -132,29 +138,32 @@ void FavoritesController::getFavoriteFolders(const HttpRequestPtr &req, std::fun
     std::string user_id = req->attributes()->get<std::string>("user_id");
     LOG_INFO << "Processing 'getFavoriteFolders' request for user_id: " << user_id;
 
-    auto folders = fileService_->getFavoriteFolders(user_id);
+    WireFormat::Format format = WireFormat::negotiate(req);
+    std::string etag = WireFormat::etag(format, fileService_->favoritesETag(user_id));
+    if (EtagUtils::isNotModified(req, etag)) {
+        auto resp = EtagUtils::notModified(etag);
+        WireFormat::setVary(resp);
+        callback(resp);
+        return;
+    }
 
-    Json::Value data;
-    data["folders"] = Json::arrayValue;
+    auto folders = fileService_->getFavoriteFolders(user_id);
+    int requester_id = std::stoi(user_id);
 
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("folders");
+    writer->startArray();
     for (const auto& folder : folders)
     {
-        Json::Value folderJson;
-        folderJson["folder_id"] = folder.folder_id;
-        folderJson["folder_name"] = folder.folder_name;
-        folderJson["parent_folder_id"] = folder.parent_folder_id;
-        folderJson["created_at"] = folder.created_at;
-        folderJson["folder_type"] = folder.folder_type;
-        folderJson["owner_id"] = folder.owner_id;
-        folderJson["owner_email"] = folder.owner_email;
-        folderJson["group_id"] = folder.group_id;
-        folderJson["group_name"] = folder.group_name;
-        folderJson["can_modify"] = (folder.owner_id == std::stoi(user_id));
-        folderJson["is_favorite"] = folder.is_favorite;
-        data["folders"].append(folderJson);
+        ListingRows::writeFolder(*writer, folder, requester_id);
     }
+    writer->endArray();
+    writer->endObject();
 
-    auto resp = HttpResponse::newHttpJsonResponse(data);
+    auto resp = WireFormat::makeResponse(format, std::move(body));
+    EtagUtils::setValidator(resp, etag);
     callback(resp);
 }
 
@@ -162,45 +171,37 @@ void FavoritesController::getAllFavorites(const HttpRequestPtr &req, std::functi
     std::string user_id = req->attributes()->get<std::string>("user_id");
     LOG_INFO << "Processing 'getAllFavorites' request for user_id: " << user_id;
 
+    WireFormat::Format format = WireFormat::negotiate(req);
+    std::string etag = WireFormat::etag(format, fileService_->favoritesETag(user_id));
+    if (EtagUtils::isNotModified(req, etag)) {
+        auto resp = EtagUtils::notModified(etag);
+        WireFormat::setVary(resp);
+        callback(resp);
+        return;
+    }
+
     auto files = fileService_->getFavoriteFiles(user_id);
     auto folders = fileService_->getFavoriteFolders(user_id);
+    int requester_id = std::stoi(user_id);
 
-    Json::Value data;
-    data["files"] = Json::arrayValue;
-    data["folders"] = Json::arrayValue;
-
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("files");
+    writer->startArray();
     for (const auto &file: files) {
-        Json::Value fileJson;
-        fileJson["file_id"] = file.file_id;
-        fileJson["file_name"] = file.file_name;
-        fileJson["file_size"] = file.file_size;
-        fileJson["created_at"] = file.created_at;
-        fileJson["file_type"] = file.file_type;
-        fileJson["owner_id"] = file.owner_id;
-        fileJson["owner_email"] = file.owner_email;
-        fileJson["group_id"] = file.group_id;
-        fileJson["group_name"] = file.group_name;
-        fileJson["can_modify"] = (file.owner_id == std::stoi(user_id));
-        fileJson["is_favorite"] = file.is_favorite;
-        data["files"].append(fileJson);
+        ListingRows::writeFile(*writer, file, requester_id);
     }
-
+    writer->endArray();
+    writer->key("folders");
+    writer->startArray();
     for (const auto &folder: folders) {
-        Json::Value folderJson;
-        folderJson["folder_id"] = folder.folder_id;
-        folderJson["folder_name"] = folder.folder_name;
-        folderJson["parent_folder_id"] = folder.parent_folder_id;
-        folderJson["created_at"] = folder.created_at;
-        folderJson["folder_type"] = folder.folder_type;
-        folderJson["owner_id"] = folder.owner_id;
-        folderJson["owner_email"] = folder.owner_email;
-        folderJson["group_id"] = folder.group_id;
-        folderJson["group_name"] = folder.group_name;
-        folderJson["can_modify"] = (folder.owner_id == std::stoi(user_id));
-        folderJson["is_favorite"] = folder.is_favorite;
-        data["folders"].append(folderJson);
+        ListingRows::writeFolder(*writer, folder, requester_id);
     }
+    writer->endArray();
+    writer->endObject();
 
-    auto resp = HttpResponse::newHttpJsonResponse(data);
+    auto resp = WireFormat::makeResponse(format, std::move(body));
+    EtagUtils::setValidator(resp, etag);
     callback(resp);
-}
\ No newline at end of file
+}
@@ -1,5 +1,94 @@
 #include "FileController.h"
 #include <drogon/drogon.h>
+#include "wire_format.h"
+#include "listing_rows.h"
+#include "etag_utils.h"
+#include "usage_sampler.h"
+#include "activity_log.h"
+#include "analytics.h"
+
+// Upper bound for operations in one /api/v1/batch request
+const size_t MAX_BATCH_OPERATIONS = 500;
+
+// Page size of /api/v1/changes
+const int DEFAULT_CHANGES_LIMIT = 1000;
+const int MAX_CHANGES_LIMIT = 5000;
+
+namespace {
+
+// Reads the id list of move_files/delete_files; non-integer entries are rejected
+bool parseIdArray(const Json::Value &json, std::vector<int> &ids)
+{
+    if (!json.isArray() || json.empty()) {
+        return false;
+    }
+    for (const auto &id : json) {
+        if (!id.isInt()) {
+            return false;
+        }
+        ids.push_back(id.asInt());
+    }
+    return true;
+}
+
+// Validates one operation of a batch request and converts it for FileService
+bool parseBatchOperation(const Json::Value &json, BatchOperation &operation, std::string &errorMsg)
+{
+    if (!json.isObject() || !json["op"].isString()) {
+        errorMsg = "'op' is required";
+        return false;
+    }
+
+    operation.op = json["op"].asString();
+
+    if (operation.op == "move_files") {
+        if (!parseIdArray(json["file_ids"], operation.file_ids) || !json["target_folder_id"].isInt()) {
+            errorMsg = "'file_ids' array and 'target_folder_id' are required";
+            return false;
+        }
+        operation.target_folder_id = json["target_folder_id"].asInt();
+    } else if (operation.op == "delete_files") {
+        if (!parseIdArray(json["file_ids"], operation.file_ids)) {
+            errorMsg = "'file_ids' array is required";
+            return false;
+        }
+    } else if (operation.op == "create_folder") {
+        if (!json["folder_name"].isString()) {
+            errorMsg = "'folder_name' is required";
+            return false;
+        }
+        operation.folder_name = json["folder_name"].asString();
+        operation.parent_folder_id = json.get("parent_folder_id", 0).asInt();
+        operation.group_id = json.get("group_id", 0).asInt();
+    } else if (operation.op == "delete_folder") {
+        if (!json["folder_id"].isInt()) {
+            errorMsg = "'folder_id' is required";
+            return false;
+        }
+        operation.folder_id = json["folder_id"].asInt();
+    } else if (operation.op == "toggle_file_favorite") {
+        if (!json["file_id"].isInt() || !json["is_favorite"].isBool()) {
+            errorMsg = "'file_id' and 'is_favorite' are required";
+            return false;
+        }
+        operation.file_id = json["file_id"].asInt();
+        operation.is_favorite = json["is_favorite"].asBool();
+    } else if (operation.op == "toggle_folder_favorite") {
+        if (!json["folder_id"].isInt() || !json["is_favorite"].isBool()) {
+            errorMsg = "'folder_id' and 'is_favorite' are required";
+            return false;
+        }
+        operation.folder_id = json["folder_id"].asInt();
+        operation.is_favorite = json["is_favorite"].asBool();
+    } else {
+        errorMsg = "unknown operation '" + operation.op + "'";
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
 
 FileController::FileController() {
     LOG_INFO << "Initializing FileController";
@@ -13,32 +102,53 @@ void FileController::getFiles(const HttpRequestPtr &req, std::function<void(cons
 
     LOG_INFO << "Processing 'getFiles' request for user_id: " << user_id << ", folder_id: " << folder_id;
 
-    auto files = fileService_->getExtendedFiles(user_id, folder_id);
-    if (files.empty()) {
-        LOG_WARN << "No files found for user_id: " << user_id << " in folder_id: " << folder_id;
+    // A folder view fetches both listings; only this one counts towards the folder's activity
+    Analytics::instance()->recordFolderActivity(user_id, folder_id);
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    // Taken before the query, so a concurrent change always yields a newer ETag
+    std::string etag = WireFormat::etag(format, fileService_->folderListingETag(user_id, folder_id));
+    if (EtagUtils::isNotModified(req, etag)) {
+        auto resp = EtagUtils::notModified(etag);
+        WireFormat::setVary(resp);
+        callback(resp);
+        return;
     }
 
-    Json::Value data;
-    data["files"] = Json::arrayValue;
+    int requester_id = std::stoi(user_id);
 
-    for (const auto& file : files)
-    {
-        Json::Value fileJson;
-        fileJson["file_id"] = file.file_id;
-        fileJson["file_name"] = file.file_name;
-        fileJson["file_size"] = file.file_size;
-        fileJson["created_at"] = file.created_at;
-        fileJson["file_type"] = file.file_type;
-        fileJson["owner_id"] = file.owner_id;
-        fileJson["owner_email"] = file.owner_email;
-        fileJson["group_id"] = file.group_id;
-        fileJson["group_name"] = file.group_name;
-        fileJson["can_modify"] = (file.owner_id == std::stoi(user_id));
-        fileJson["is_favorite"] = file.is_favorite;
-        data["files"].append(fileJson);
+    // Rows are encoded straight into the response body, without a Json::Value tree
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("files");
+    writer->startArray();
+
+    size_t count = 0;
+    bool ok = fileService_->forEachExtendedFile(user_id, folder_id, [&](const ExtendedFileInfo& file) {
+        ListingRows::writeFile(*writer, file, requester_id);
+        ++count;
+    });
+
+    writer->endArray();
+    writer->endObject();
+
+    if (!ok) {
+        LOG_ERROR << "Failed to list files for user_id: " << user_id << " in folder_id: " << folder_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k500InternalServerError);
+        resp->setBody("Failed to list files");
+        callback(resp);
+        return;
     }
 
-    auto resp = HttpResponse::newHttpJsonResponse(data);
+    if (count == 0) {
+        LOG_WARN << "No files found for user_id: " << user_id << " in folder_id: " << folder_id;
+    }
+
+    auto resp = WireFormat::makeResponse(format, std::move(body));
+    EtagUtils::setValidator(resp, etag);
     callback(resp);
 }
 
@@ -61,6 +171,10 @@ void FileController::uploadFile(const HttpRequestPtr &req, std::function<void(co
             resp->setStatusCode(k400BadRequest);
         } else if (errorMsg.find("Permission denied") != std::string::npos) {
             resp->setStatusCode(k403Forbidden);
+        } else if (errorMsg.find("Quota exceeded") != std::string::npos) {
+            resp->setStatusCode(k413RequestEntityTooLarge);
+        } else if (errorMsg.find("Insufficient storage") != std::string::npos) {
+            resp->setStatusCode(k507InsufficientStorage);
         } else {
             resp->setStatusCode(k500InternalServerError);
         }
@@ -109,6 +223,8 @@ void FileController::deleteFiles(const HttpRequestPtr &req, std::function<void(c
 
         if (errorMsg.find("Permission denied") != std::string::npos) {
             resp->setStatusCode(k403Forbidden);
+        } else if (errorMsg.find("not found") != std::string::npos) {
+            resp->setStatusCode(k404NotFound);
         } else {
             resp->setStatusCode(k500InternalServerError);
         }
@@ -216,6 +332,8 @@ void FileController::moveFiles(const HttpRequestPtr &req, std::function<void(con
 
         if (errorMsg.find("Permission denied") != std::string::npos) {
             resp->setStatusCode(k403Forbidden);
+        } else if (errorMsg.find("not found") != std::string::npos) {
+            resp->setStatusCode(k404NotFound);
         } else {
             resp->setStatusCode(k500InternalServerError);
         }
@@ -248,7 +366,8 @@ void FileController::downloadFile(const HttpRequestPtr &req, std::function<void(
     }
 
     int file_id = std::stoi(file_id_str);
-    auto filePathOpt = fileService_->getFilePath(user_id, file_id);
+    int group_id = 0;
+    auto filePathOpt = fileService_->getFilePath(user_id, file_id, &group_id);
     if (!filePathOpt.has_value())
     {
         LOG_ERROR << "File not found or access denied for user_id: " << user_id << " with file_id: " << file_id;
@@ -262,6 +381,14 @@ void FileController::downloadFile(const HttpRequestPtr &req, std::function<void(
     auto resp = HttpResponse::newFileResponse(filePathOpt.value());
     resp->setStatusCode(k200OK);
     resp->addHeader("Content-Disposition", "attachment; filename=\"" + fs::path(filePathOpt.value()).filename().string() + "\"");
+
+    std::error_code ec;
+    auto size = fs::file_size(filePathOpt.value(), ec);
+    if (!ec) {
+        UsageSampler::instance()->recordDownload(user_id, group_id, static_cast<long long>(size));
+    }
+    ActivityLog::instance()->record(user_id, "download", file_id, fs::path(filePathOpt.value()).filename().string());
+    Analytics::instance()->recordDownload(user_id, file_id);
     callback(resp);
 }
 
@@ -274,29 +401,44 @@ void FileController::getFolders(const HttpRequestPtr &req, std::function<void(co
 
         LOG_INFO << "Processing 'getFolders' request for user_id: " << user_id << ", parent_folder_id: " << parent_folder_id;
 
-        auto folders = fileService_->getExtendedFolders(user_id, parent_folder_id);
+        Analytics::instance()->recordUser(user_id);
 
-        Json::Value data;
-        data["folders"] = Json::arrayValue;
+        WireFormat::Format format = WireFormat::negotiate(req);
 
-        for (const auto& folder : folders)
-        {
-            Json::Value folderJson;
-            folderJson["folder_id"] = folder.folder_id;
-            folderJson["folder_name"] = folder.folder_name;
-            folderJson["parent_folder_id"] = folder.parent_folder_id;
-            folderJson["created_at"] = folder.created_at;
-            folderJson["folder_type"] = folder.folder_type;
-            folderJson["owner_id"] = folder.owner_id;
-            folderJson["owner_email"] = folder.owner_email;
-            folderJson["group_id"] = folder.group_id;
-            folderJson["group_name"] = folder.group_name;
-            folderJson["can_modify"] = (folder.owner_id == std::stoi(user_id));
-            folderJson["is_favorite"] = folder.is_favorite;
-            data["folders"].append(folderJson);
+        std::string etag = WireFormat::etag(format, fileService_->folderListingETag(user_id, parent_folder_id));
+        if (EtagUtils::isNotModified(req, etag)) {
+            auto resp = EtagUtils::notModified(etag);
+            WireFormat::setVary(resp);
+            callback(resp);
+            return;
         }
 
-        auto resp = HttpResponse::newHttpJsonResponse(data);
+        int requester_id = std::stoi(user_id);
+
+        std::string body;
+        auto writer = WireFormat::makeWriter(format, body);
+        writer->startObject();
+        writer->key("folders");
+        writer->startArray();
+
+        bool ok = fileService_->forEachExtendedFolder(user_id, parent_folder_id, [&](const ExtendedFolderInfo& folder) {
+            ListingRows::writeFolder(*writer, folder, requester_id);
+        });
+
+        writer->endArray();
+        writer->endObject();
+
+        if (!ok) {
+            LOG_ERROR << "Failed to list folders for user_id: " << user_id << " in parent_folder_id: " << parent_folder_id;
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k500InternalServerError);
+            resp->setBody("Failed to list folders");
+            callback(resp);
+            return;
+        }
+
+        auto resp = WireFormat::makeResponse(format, std::move(body));
+        EtagUtils::setValidator(resp, etag);
         callback(resp);
     }
     catch (const std::exception& e)
@@ -361,6 +503,121 @@ void FileController::createFolder(const HttpRequestPtr &req, std::function<void(
     callback(resp);
 }
 
+void FileController::createFolderPath(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    auto json = req->getJsonObject();
+
+    if (!json || !(*json)["path"].isString())
+    {
+        LOG_ERROR << "Invalid JSON in request for creating folder path for user_id: " << user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON, expected {\"path\": \"/a/b/c\"}");
+        callback(resp);
+        return;
+    }
+
+    std::string path = (*json)["path"].asString();
+    int group_id = (*json).get("group_id", 0).asInt();
+
+    LOG_INFO << "Processing 'createFolderPath' request for user_id: " << user_id
+             << ", path: " << path << ", group_id: " << group_id;
+
+    std::vector<std::string> components;
+    std::vector<PathFolder> folders;
+    std::string errorMsg;
+    if (!fileService_->createFolderPath(user_id, path, group_id, components, folders, errorMsg))
+    {
+        LOG_ERROR << "Failed to create folder path for user_id: " << user_id << " with error: " << errorMsg;
+        auto resp = HttpResponse::newHttpResponse();
+
+        if (errorMsg.find("Invalid path") != std::string::npos ||
+            errorMsg.find("Invalid folder name:") != std::string::npos) {
+            resp->setStatusCode(k400BadRequest);
+        } else if (errorMsg.find("Permission denied") != std::string::npos) {
+            resp->setStatusCode(k403Forbidden);
+        } else {
+            resp->setStatusCode(k500InternalServerError);
+        }
+
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    Json::Value respData;
+    respData["folder_id"] = folders.back().folder_id;
+    respData["folders"] = Json::Value(Json::arrayValue);
+    int created = 0;
+    for (size_t i = 0; i < folders.size(); ++i) {
+        Json::Value item;
+        item["name"] = components[i];
+        item["folder_id"] = folders[i].folder_id;
+        item["group_id"] = folders[i].group_id;
+        item["created"] = folders[i].created;
+        respData["folders"].append(item);
+        created += folders[i].created ? 1 : 0;
+    }
+    respData["created"] = created;
+
+    auto resp = HttpResponse::newHttpJsonResponse(respData);
+    if (created > 0) {
+        resp->setStatusCode(k201Created);
+    }
+    callback(resp);
+}
+
+void FileController::resolvePath(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    std::string path = req->getParameter("p");
+
+    LOG_INFO << "Processing 'resolvePath' request for user_id: " << user_id << ", path: " << path;
+
+    std::vector<std::string> components;
+    PathLookup lookup;
+    std::string errorMsg;
+    if (!fileService_->resolvePath(user_id, path, components, lookup, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(errorMsg.find("Invalid path") != std::string::npos ? k400BadRequest : k500InternalServerError);
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    Json::Value respData;
+    size_t depth = static_cast<size_t>(lookup.depth);
+    if (depth == components.size()) {
+        respData["type"] = "folder";
+        respData["id"] = lookup.folder_id;
+    } else if (lookup.file_id > 0) {
+        respData["type"] = "file";
+        respData["id"] = lookup.file_id;
+        respData["folder_id"] = lookup.folder_id;
+    } else {
+        // Names the first component that does not exist
+        std::string missing;
+        for (size_t i = 0; i <= depth && i < components.size(); ++i) {
+            missing += "/" + components[i];
+        }
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        resp->setBody("Path not found: " + missing);
+        callback(resp);
+        return;
+    }
+
+    std::string normalized;
+    for (const auto& component : components) {
+        normalized += "/" + component;
+    }
+    respData["path"] = normalized.empty() ? "/" : normalized;
+
+    auto resp = HttpResponse::newHttpJsonResponse(respData);
+    callback(resp);
+}
+
 void FileController::deleteFolder(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int folder_id)
 {
     std::string user_id = req->attributes()->get<std::string>("user_id");
@@ -452,6 +709,10 @@ void FileController::uploadSharedFile(const HttpRequestPtr &req, std::function<v
             resp->setStatusCode(k400BadRequest);
         } else if (errorMsg.find("Permission denied") != std::string::npos) {
             resp->setStatusCode(k403Forbidden);
+        } else if (errorMsg.find("Quota exceeded") != std::string::npos) {
+            resp->setStatusCode(k413RequestEntityTooLarge);
+        } else if (errorMsg.find("Insufficient storage") != std::string::npos) {
+            resp->setStatusCode(k507InsufficientStorage);
         } else {
             resp->setStatusCode(k500InternalServerError);
         }
@@ -528,4 +789,149 @@ void FileController::createSharedFolder(const HttpRequestPtr &req, std::function
     respData["group_id"] = group_id;
     auto resp = HttpResponse::newHttpJsonResponse(respData);
     callback(resp);
-}
\ No newline at end of file
+}
+
+void FileController::executeBatch(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    auto json = req->getJsonObject();
+
+    if (!json || !(*json)["operations"].isArray() || (*json)["operations"].empty())
+    {
+        LOG_ERROR << "Invalid JSON in batch request for user_id: " << user_id;
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON: non-empty 'operations' array is required");
+        callback(resp);
+        return;
+    }
+
+    const auto &operationsJson = (*json)["operations"];
+    if (operationsJson.size() > MAX_BATCH_OPERATIONS)
+    {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Too many operations: at most " + std::to_string(MAX_BATCH_OPERATIONS) + " per batch");
+        callback(resp);
+        return;
+    }
+
+    // Malformed operations reject the whole batch before anything runs
+    std::vector<BatchOperation> operations(operationsJson.size());
+    for (Json::ArrayIndex i = 0; i < operationsJson.size(); ++i)
+    {
+        std::string errorMsg;
+        if (!parseBatchOperation(operationsJson[i], operations[i], errorMsg))
+        {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k400BadRequest);
+            resp->setBody("Invalid operation " + std::to_string(i) + ": " + errorMsg);
+            callback(resp);
+            return;
+        }
+    }
+
+    bool transactional = (*json).get("transactional", true).asBool();
+
+    LOG_INFO << "Processing 'executeBatch' request for user_id: " << user_id
+             << ", operations: " << operations.size() << ", transactional: " << transactional;
+
+    std::vector<BatchOperationResult> results;
+    bool committed = fileService_->executeBatch(user_id, operations, transactional, results);
+
+    Json::Value respData;
+    respData["transactional"] = transactional;
+    respData["committed"] = committed;
+    respData["results"] = Json::arrayValue;
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        Json::Value resultJson;
+        resultJson["index"] = static_cast<int>(i);
+        resultJson["op"] = operations[i].op;
+        switch (results[i].status)
+        {
+            case BatchOperationResult::Status::Ok:
+                resultJson["status"] = "ok";
+                break;
+            case BatchOperationResult::Status::Failed:
+                resultJson["status"] = "failed";
+                resultJson["error"] = results[i].error;
+                break;
+            case BatchOperationResult::Status::Skipped:
+                resultJson["status"] = "skipped";
+                if (!results[i].error.empty()) {
+                    resultJson["error"] = results[i].error;
+                }
+                break;
+        }
+        respData["results"].append(resultJson);
+    }
+
+    auto resp = HttpResponse::newHttpJsonResponse(respData);
+    callback(resp);
+}
+
+void FileController::getChanges(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    std::string since = req->getParameter("since");
+    int limit = DEFAULT_CHANGES_LIMIT;
+
+    LOG_INFO << "Processing 'getChanges' request for user_id: " << user_id << ", since: " << since;
+
+    try {
+        limit = req->getOptionalParameter<int>("limit").value_or(DEFAULT_CHANGES_LIMIT);
+    } catch (const std::exception&) {
+        limit = 0;
+    }
+    if (limit <= 0 || limit > MAX_CHANGES_LIMIT) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid limit, expected 1.." + std::to_string(MAX_CHANGES_LIMIT));
+        callback(resp);
+        return;
+    }
+
+    std::vector<JournalEntry> changes;
+    std::string cursor;
+    bool hasMore = false;
+    std::string errorMsg;
+    if (!fileService_->getChanges(user_id, since, limit, changes, cursor, hasMore, errorMsg)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(errorMsg == "Invalid cursor" ? k400BadRequest : k500InternalServerError);
+        resp->setBody(errorMsg);
+        callback(resp);
+        return;
+    }
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("changes");
+    writer->startArray();
+    for (const auto& change : changes) {
+        writer->startObject();
+        writer->field("entity", change.entity);
+        writer->field("id", change.entity_id);
+        writer->field("op", change.op);
+        if (change.op == "upsert") {
+            writer->field("parent_id", change.parent_id);
+            writer->field("name", change.name);
+            if (change.file_size >= 0) {
+                writer->field("file_size", change.file_size);
+            }
+        }
+        writer->field("group_id", change.scope_type == 'g' ? change.scope_id : 0);
+        writer->field("changed_at", change.changed_at);
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->field("cursor", cursor);
+    writer->field("has_more", hasMore);
+    writer->endObject();
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
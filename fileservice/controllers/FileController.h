@@ -21,10 +21,20 @@ public:
         ADD_METHOD_TO(FileController::getFolders, "/api/v1/folders", Get, "JwtAuthFilter");
         ADD_METHOD_TO(FileController::createFolder, "/api/v1/folders", Post, "JwtAuthFilter");
         ADD_METHOD_TO(FileController::deleteFolder, "/api/v1/folders/{folder_id}", Delete, "JwtAuthFilter");
+        ADD_METHOD_TO(FileController::createFolderPath, "/api/v1/folders/path", Post, "JwtAuthFilter");
+
+        // Адресация по пути: /Course/Lab3/src -> id папки или файла
+        ADD_METHOD_TO(FileController::resolvePath, "/api/v1/path", Get, "JwtAuthFilter");
 
         ADD_METHOD_TO(FileController::getUserGroups, "/api/v1/user/groups", Get, "JwtAuthFilter");
         ADD_METHOD_TO(FileController::uploadSharedFile, "/api/v1/files/shared", Post, "JwtAuthFilter");
         ADD_METHOD_TO(FileController::createSharedFolder, "/api/v1/folders/shared", Post, "JwtAuthFilter");
+
+        // Несколько операций над файлами и папками одним запросом
+        ADD_METHOD_TO(FileController::executeBatch, "/api/v1/batch", Post, "JwtAuthFilter");
+
+        // Изменения после курсора (инкрементальная синхронизация)
+        ADD_METHOD_TO(FileController::getChanges, "/api/v1/changes", Get, "JwtAuthFilter");
     METHOD_LIST_END
 
     FileController();
@@ -41,11 +51,19 @@ public:
     void getFolders(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void createFolder(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void deleteFolder(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int folder_id);
+    void createFolderPath(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+
+    void resolvePath(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
 
     // Методы для работы с общими файлами.
     void getUserGroups(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void uploadSharedFile(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
     void createSharedFolder(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+
+    void executeBatch(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+
+    void getChanges(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+
 private:
     std::shared_ptr<FileService> fileService_;
 };
@@ -0,0 +1,142 @@
+#include "SearchController.h"
+#include <drogon/drogon.h>
+#include "wire_format.h"
+
+// Limits of /api/v1/search and /api/v1/search/content
+const size_t DEFAULT_SEARCH_LIMIT = 50;
+const size_t MAX_SEARCH_LIMIT = 200;
+const size_t MAX_QUERY_LENGTH = 255;
+
+SearchController::SearchController() {
+    LOG_INFO << "Initializing SearchController";
+    fileService_ = FileService::instance();
+}
+
+void SearchController::search(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    std::string query = req->getParameter("q");
+    std::string type = req->getParameter("type");
+
+    LOG_INFO << "Processing 'search' request for user_id: " << user_id << ", q: " << query;
+
+    if (query.empty() || query.size() > MAX_QUERY_LENGTH) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Parameter q is required (up to " + std::to_string(MAX_QUERY_LENGTH) + " bytes)");
+        callback(resp);
+        return;
+    }
+
+    NameIndex::Kind kind = NameIndex::Kind::Any;
+    if (type == "file") {
+        kind = NameIndex::Kind::File;
+    } else if (type == "folder") {
+        kind = NameIndex::Kind::Folder;
+    } else if (!type.empty() && type != "all") {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid type, expected file, folder or all");
+        callback(resp);
+        return;
+    }
+
+    size_t limit = DEFAULT_SEARCH_LIMIT;
+    try {
+        int requested = req->getOptionalParameter<int>("limit").value_or(DEFAULT_SEARCH_LIMIT);
+        limit = requested > 0 ? std::min(static_cast<size_t>(requested), MAX_SEARCH_LIMIT) : DEFAULT_SEARCH_LIMIT;
+    } catch (const std::exception&) {
+        limit = DEFAULT_SEARCH_LIMIT;
+    }
+
+    if (!NameIndex::instance()->isLoaded()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k503ServiceUnavailable);
+        resp->setBody("Search index is not ready");
+        callback(resp);
+        return;
+    }
+
+    auto matches = fileService_->searchNames(user_id, query, kind, limit);
+    int requester_id = std::stoi(user_id);
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("results");
+    writer->startArray();
+    for (const auto& match : matches) {
+        writer->startObject();
+        writer->field("type", match.is_folder ? "folder" : "file");
+        writer->field("id", match.id);
+        writer->field("name", match.name);
+        writer->field("parent_id", match.parent_id);
+        writer->field("owner_id", match.owner_id);
+        writer->field("group_id", match.group_id);
+        writer->field("can_modify", match.owner_id == requester_id);
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->field("count", static_cast<int>(matches.size()));
+    writer->endObject();
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
+
+void SearchController::searchContent(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    std::string user_id = req->attributes()->get<std::string>("user_id");
+    std::string query = req->getParameter("q");
+
+    LOG_INFO << "Processing 'searchContent' request for user_id: " << user_id << ", q: " << query;
+
+    if (query.empty() || query.size() > MAX_QUERY_LENGTH) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Parameter q is required (up to " + std::to_string(MAX_QUERY_LENGTH) + " bytes)");
+        callback(resp);
+        return;
+    }
+
+    size_t limit = DEFAULT_SEARCH_LIMIT;
+    try {
+        int requested = req->getOptionalParameter<int>("limit").value_or(DEFAULT_SEARCH_LIMIT);
+        limit = requested > 0 ? std::min(static_cast<size_t>(requested), MAX_SEARCH_LIMIT) : DEFAULT_SEARCH_LIMIT;
+    } catch (const std::exception&) {
+        limit = DEFAULT_SEARCH_LIMIT;
+    }
+
+    if (!ContentIndex::instance()->isRunning()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k503ServiceUnavailable);
+        resp->setBody("Content search is not enabled");
+        callback(resp);
+        return;
+    }
+
+    // Best match first
+    auto matches = fileService_->searchContent(user_id, query, limit);
+
+    WireFormat::Format format = WireFormat::negotiate(req);
+
+    std::string body;
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("results");
+    writer->startArray();
+    for (const auto& match : matches) {
+        writer->startObject();
+        writer->field("id", match.file_id);
+        writer->field("name", match.file_name);
+        writer->field("folder_id", match.folder_id);
+        writer->field("file_size", match.file_size);
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->field("count", static_cast<int>(matches.size()));
+    writer->endObject();
+
+    callback(WireFormat::makeResponse(format, std::move(body)));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+#include <memory>
+#include "services/FileService.h"
+
+using namespace drogon;
+
+class SearchController : public drogon::HttpController<SearchController>
+{
+public:
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(SearchController::search, "/api/v1/search", Get, "JwtAuthFilter");
+        ADD_METHOD_TO(SearchController::searchContent, "/api/v1/search/content", Get, "JwtAuthFilter");
+    METHOD_LIST_END
+
+    SearchController();
+
+    void search(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+    void searchContent(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback);
+
+private:
+    std::shared_ptr<FileService> fileService_;
+};
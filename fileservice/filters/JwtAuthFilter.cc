@@ -1,6 +1,7 @@
 #include "JwtAuthFilter.h"
 #include <drogon/drogon.h>
 #include "../pkg/jwt_utils.h"
+#include "../pkg/usage_sampler.h"
 
 std::string JwtAuthFilter::privateKey_;
 std::string JwtAuthFilter::publicKey_;
@@ -17,7 +18,18 @@ JwtAuthFilter::JwtAuthFilter()
 void JwtAuthFilter::doFilter(const HttpRequestPtr &req, FilterCallback &&fcb, FilterChainCallback &&fccb)
 {
     auto authHeader = req->getHeader("Authorization");
-    if (authHeader.empty() || authHeader.substr(0, 7) != "Bearer ")
+    std::string token;
+    if (!authHeader.empty() && authHeader.substr(0, 7) == "Bearer ")
+    {
+        token = authHeader.substr(7);
+    }
+    else if (req->getHeader("Upgrade") == "websocket")
+    {
+        // Browsers cannot set headers on a WebSocket handshake
+        token = req->getParameter("access_token");
+    }
+
+    if (token.empty())
     {
         auto resp = HttpResponse::newHttpResponse();
         resp->setStatusCode(k401Unauthorized);
@@ -26,8 +38,6 @@ void JwtAuthFilter::doFilter(const HttpRequestPtr &req, FilterCallback &&fcb, Fi
         return;
     }
 
-    std::string token = authHeader.substr(7);
-
     try
     {
         std::string userId;
@@ -43,6 +53,7 @@ void JwtAuthFilter::doFilter(const HttpRequestPtr &req, FilterCallback &&fcb, Fi
 
         // Save userId and roles in request attributes
         req->attributes()->insert("user_id", userId);
+        UsageSampler::instance()->recordRequest(userId);
 
         fccb(); // Proceed to next filter or controller
     }
@@ -27,9 +27,8 @@ void PermissionFilter::doFilter(const HttpRequestPtr &req, FilterCallback &&fcb,
 
         // Check if this is an admin endpoint
         if (path.find("/api/v1/admin") == 0) {
-            if (!checkAdminPermission(req, fcb)) {
-                return;  // Permission check failed
-            }
+            checkAdminPermission(req, std::move(fcb), std::move(fccb));
+            return;
         }
 
         // Proceed to next filter or controller
@@ -45,22 +44,25 @@ void PermissionFilter::doFilter(const HttpRequestPtr &req, FilterCallback &&fcb,
     }
 }
 
-bool PermissionFilter::checkAdminPermission(const HttpRequestPtr &req, FilterCallback &fcb)
+void PermissionFilter::checkAdminPermission(const HttpRequestPtr &req, FilterCallback &&fcb, FilterChainCallback &&fccb)
 {
     std::string userId = req->attributes()->get<std::string>("user_id");
 
-    // Check if user has manage_files permission
-    if (!permissionUtils_->hasPermission(userId, "manage_files")) {
-        LOG_WARN << "User " << userId << " does not have required admin permissions";
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k403Forbidden);
-        resp->setBody("Forbidden - Admin permission required");
-        fcb(resp);
-        return false;
-    }
+    // Check if user has manage_files permission; the chain resumes once the answer is known
+    permissionUtils_->hasPermission(userId, "manage_files",
+        [req, userId, fcb = std::move(fcb), fccb = std::move(fccb)](bool allowed) {
+            if (!allowed) {
+                LOG_WARN << "User " << userId << " does not have required admin permissions";
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(k403Forbidden);
+                resp->setBody("Forbidden - Admin permission required");
+                fcb(resp);
+                return;
+            }
 
-    // Store the permission check result in the request attributes
-    req->attributes()->insert("has_admin_permission", true);
-    LOG_INFO << "User " << userId << " has admin permissions, proceeding";
-    return true;
+            // Store the permission check result in the request attributes
+            req->attributes()->insert("has_admin_permission", true);
+            LOG_INFO << "User " << userId << " has admin permissions, proceeding";
+            fccb();
+        });
 }
\ No newline at end of file
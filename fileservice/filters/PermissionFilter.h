@@ -24,5 +24,5 @@ private:
     std::shared_ptr<PermissionUtils> permissionUtils_;
 
     // Helper methods for permission checks
-    bool checkAdminPermission(const HttpRequestPtr &req, FilterCallback &fcb);
+    void checkAdminPermission(const HttpRequestPtr &req, FilterCallback &&fcb, FilterChainCallback &&fccb);
 };
\ No newline at end of file
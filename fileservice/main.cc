@@ -1,6 +1,18 @@
 #include <drogon/drogon.h>
 #include "filters/JwtAuthFilter.h"
 #include "db.h"
+#include "rbac_matrix.h"
+#include "name_index.h"
+#include "content_index.h"
+#include "usage_sampler.h"
+#include "folder_sizes.h"
+#include "activity_log.h"
+#include "analytics.h"
+#include "duplicate_scanner.h"
+#include "job_queue.h"
+#include "quota_manager.h"
+#include "services/AdminService.h"
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 
@@ -86,6 +98,109 @@ int main() {
         return 1;
     }
 
+    // Evaluate permissions locally from the shared RBAC tables
+    auto rbacConfig = app.getCustomConfig()["rbac"];
+    if (rbacConfig.get("local_evaluation", true).asBool()) {
+        double pollInterval = rbacConfig.get("poll_interval", 1.0).asDouble();
+        double reloadInterval = rbacConfig.get("reload_interval", 300.0).asDouble();
+        if (!RbacMatrix::instance()->start(pollInterval, reloadInterval)) {
+            LOG_WARN << "Failed to load RBAC matrix, permissions will be fetched from the auth service";
+        }
+    }
+
+    // Filename search index, kept up to date from the name_changes channel
+    auto searchConfig = app.getCustomConfig()["search"];
+    if (searchConfig.get("enabled", true).asBool()) {
+        double pollInterval = searchConfig.get("poll_interval", 0.5).asDouble();
+        if (!NameIndex::instance()->start(pollInterval)) {
+            LOG_WARN << "Failed to build the search index, /api/v1/search is unavailable";
+        }
+    }
+
+    // Full-text index over text uploads, built by a background thread
+    auto contentSearchConfig = app.getCustomConfig()["content_search"];
+    if (contentSearchConfig.get("enabled", false).asBool()) {
+        std::string indexPath = contentSearchConfig.get("index_path", "./content_index").asString();
+        size_t maxFileSize = contentSearchConfig.get("max_file_size", 8 * 1024 * 1024).asUInt64();
+        size_t readBytesPerSecond = contentSearchConfig.get("read_bytes_per_second", 4 * 1024 * 1024).asUInt64();
+        double pollInterval = contentSearchConfig.get("poll_interval", 1.0).asDouble();
+        std::string storagePath = (std::filesystem::current_path() / "storage").string();
+        if (!ContentIndex::instance()->start(storagePath, indexPath, maxFileSize, readBytesPerSecond, pollInterval)) {
+            LOG_WARN << "Failed to start the content indexer, /api/v1/search/content is unavailable";
+        }
+    }
+
+    // Storage quotas, checked from Content-Length before an upload is parsed or written
+    auto quotasConfig = app.getCustomConfig()["quotas"];
+    if (quotasConfig.get("enabled", true).asBool()) {
+        long long defaultUserBytes = quotasConfig.get("default_user_bytes", 0).asInt64();
+        long long defaultGroupBytes = quotasConfig.get("default_group_bytes", 0).asInt64();
+        long long minFreeBytes = quotasConfig.get("min_free_bytes", static_cast<Json::Int64>(1024) * 1024 * 1024).asInt64();
+        double reconcileInterval = quotasConfig.get("reconcile_interval", 10.0).asDouble();
+        std::string storagePath = (std::filesystem::current_path() / "storage").string();
+        if (!QuotaManager::instance()->start(storagePath, defaultUserBytes, defaultGroupBytes, minFreeBytes,
+                                             reconcileInterval)) {
+            LOG_WARN << "Failed to load storage quotas, uploads are not limited";
+        }
+    }
+
+    // Background jobs in the jobs table, shared by every instance using the database
+    auto jobsConfig = app.getCustomConfig()["jobs"];
+    AdminService::instance()->registerJobs();
+    if (jobsConfig.get("enabled", true).asBool()) {
+        size_t workers = jobsConfig.get("workers", 4).asUInt64();
+        double pollInterval = jobsConfig.get("poll_interval", 1.0).asDouble();
+        double heartbeatInterval = jobsConfig.get("heartbeat_interval", 10.0).asDouble();
+        double staleAfter = jobsConfig.get("stale_after", 60.0).asDouble();
+        int retentionDays = jobsConfig.get("retention_days", 7).asInt();
+        JobQueue::instance()->start(workers, pollInterval, heartbeatInterval, staleAfter, retentionDays);
+    }
+
+    // Admin statistics are kept by triggers; a periodic recount corrects any drift
+    auto statsConfig = app.getCustomConfig()["storage_stats"];
+    double reconcileInterval = statsConfig.get("reconcile_interval", 3600.0).asDouble();
+    AdminService::instance()->startStatsReconciliation(reconcileInterval);
+
+    // Recursive folder sizes, applied in batches from the events the triggers record
+    auto folderSizesConfig = app.getCustomConfig()["folder_sizes"];
+    double applyInterval = folderSizesConfig.get("apply_interval", 1.0).asDouble();
+    FolderSizes::instance()->start(applyInterval);
+
+    // Usage history for capacity planning, sampled once a minute and rolled up by hour and day
+    auto usageConfig = app.getCustomConfig()["usage_history"];
+    if (usageConfig.get("enabled", true).asBool()) {
+        int minuteRetentionDays = usageConfig.get("minute_retention_days", 7).asInt();
+        int hourRetentionDays = usageConfig.get("hour_retention_days", 180).asInt();
+        UsageSampler::instance()->start(minuteRetentionDays, hourRetentionDays);
+    }
+
+    // Activity log, buffered in memory and written in batches
+    auto activityConfig = app.getCustomConfig()["activity_log"];
+    if (activityConfig.get("enabled", true).asBool()) {
+        size_t capacity = activityConfig.get("buffer_size", 65536).asUInt64();
+        double flushInterval = activityConfig.get("flush_interval", 1.0).asDouble();
+        int retentionDays = activityConfig.get("retention_days", 90).asInt();
+        ActivityLog::instance()->start(capacity, flushInterval, retentionDays);
+    }
+
+    // Approximate dashboard analytics (distinct users, hot files and folders), checkpointed periodically
+    auto analyticsConfig = app.getCustomConfig()["analytics"];
+    if (analyticsConfig.get("enabled", true).asBool()) {
+        size_t topCapacity = analyticsConfig.get("top_capacity", 256).asUInt64();
+        double checkpointInterval = analyticsConfig.get("checkpoint_interval", 60.0).asDouble();
+        Analytics::instance()->start(topCapacity, checkpointInterval);
+    }
+
+    // Duplicate content detection: stored files of equal size are hashed by a throttled background job
+    auto duplicatesConfig = app.getCustomConfig()["duplicates"];
+    if (duplicatesConfig.get("enabled", true).asBool()) {
+        size_t threads = duplicatesConfig.get("threads", 2).asUInt64();
+        size_t readBytesPerSecond = duplicatesConfig.get("read_bytes_per_second", 8 * 1024 * 1024).asUInt64();
+        double scanInterval = duplicatesConfig.get("scan_interval", 86400.0).asDouble();
+        std::string storagePath = (std::filesystem::current_path() / "storage").string();
+        DuplicateScanner::instance()->start(storagePath, threads, readBytesPerSecond, scanInterval);
+    }
+
     // Load RSA keys for JWT authentication
     try {
         // Get paths from config
@@ -0,0 +1,378 @@
+#include "activity_log.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "db.h"
+
+namespace {
+
+const long long DAY = 24 * 60 * 60;
+
+// Once this many events are queued, a write starts before the flush interval ends
+const size_t FLUSH_BATCH = 1024;
+
+// Bytes handed to PQputCopyData at a time
+const size_t COPY_CHUNK = 256 * 1024;
+
+bool execute(PGconn* conn, const std::string& command)
+{
+    PGresult* res = PQexec(conn, command.c_str());
+    bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ok)
+    {
+        LOG_ERROR << "Failed to execute " << command << ": " << PQerrorMessage(conn);
+    }
+    PQclear(res);
+    return ok;
+}
+
+// A moment (seconds since the epoch) in UTC, in the given strftime format
+std::string formatUtc(long long seconds, const char* format)
+{
+    std::time_t t = static_cast<std::time_t>(seconds);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), format, &tm);
+    return buffer;
+}
+
+std::string partitionName(long long day)
+{
+    return "activity_log_" + formatUtc(day, "%Y%m%d");
+}
+
+// Appends a value in the COPY text format
+void appendCopyText(std::string& out, const std::string& value)
+{
+    for (char c : value)
+    {
+        switch (c)
+        {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default: out += c;
+        }
+    }
+}
+
+} // namespace
+
+std::shared_ptr<ActivityLog> ActivityLog::instance()
+{
+    static std::shared_ptr<ActivityLog> instance(new ActivityLog());
+    return instance;
+}
+
+ActivityLog::~ActivityLog()
+{
+    if (conn_)
+    {
+        PQfinish(conn_);
+    }
+}
+
+void ActivityLog::start(size_t capacity, double flushInterval, int retentionDays)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    size_t size = FLUSH_BATCH;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    for (size_t i = 0; i < size; ++i)
+    {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+    retentionDays_ = std::max(1, retentionDays);
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("ActivityLog");
+    thread_->run();
+    thread_->getLoop()->runEvery(flushInterval, [this]() { flush(); });
+
+    LOG_INFO << "Activity log started, buffering up to " << size << " events and keeping "
+             << retentionDays_ << " days";
+}
+
+void ActivityLog::record(const std::string& user_id, const std::string& action, long long object_id,
+                         const std::string& detail)
+{
+    if (!thread_)
+    {
+        return;
+    }
+
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    Event event{std::chrono::duration_cast<std::chrono::microseconds>(now).count(),
+                std::atoi(user_id.c_str()), action, object_id, detail};
+
+    size_t position;
+    if (!push(std::move(event), position))
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if ((position + 1) % FLUSH_BATCH == 0 && !flushQueued_.exchange(true))
+    {
+        thread_->getLoop()->queueInLoop([this]() { flush(); });
+    }
+}
+
+bool ActivityLog::push(Event&& event, size_t& position)
+{
+    // Bounded MPMC queue (D. Vyukov): a slot is free for position p when its sequence equals p,
+    // and holds an event for the consumer when it equals p + 1
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;)
+    {
+        slot = &slots_[pos & mask_];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0)
+        {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = std::move(event);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    position = pos;
+    return true;
+}
+
+bool ActivityLog::pop(Event& event)
+{
+    Slot& slot = slots_[tail_ & mask_];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != tail_ + 1)
+    {
+        return false;
+    }
+
+    event = std::move(slot.event);
+    slot.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+    ++tail_;
+    return true;
+}
+
+void ActivityLog::flush()
+{
+    flushQueued_.store(false);
+
+    // At most one buffer's worth per write, so a steady stream cannot keep the loop busy forever
+    std::vector<Event> batch;
+    Event event;
+    while (batch.size() <= mask_ && pop(event))
+    {
+        batch.push_back(std::move(event));
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped_)
+    {
+        LOG_WARN << "Activity log buffer was full, " << dropped - reportedDropped_ << " events dropped";
+        reportedDropped_ = dropped;
+    }
+
+    if (!batch.empty() && !copyBatch(batch))
+    {
+        LOG_ERROR << "Failed to write " << batch.size() << " activity events, they are lost";
+    }
+
+    prune();
+
+    if (batch.size() > mask_)
+    {
+        thread_->getLoop()->queueInLoop([this]() { flush(); });
+    }
+}
+
+bool ActivityLog::connect()
+{
+    if (conn_ && PQstatus(conn_) == CONNECTION_OK)
+    {
+        return true;
+    }
+    if (conn_)
+    {
+        PQfinish(conn_);
+        partitions_.clear();
+    }
+    conn_ = DB::instance()->openConnection();
+    return conn_ != nullptr;
+}
+
+bool ActivityLog::copyBatch(const std::vector<Event>& batch)
+{
+    std::string data;
+    data.reserve(batch.size() * 96);
+    for (const auto& event : batch)
+    {
+        long long seconds = event.time_us / 1000000;
+        char fraction[8];
+        std::snprintf(fraction, sizeof(fraction), ".%06lld", event.time_us % 1000000);
+        data += formatUtc(seconds, "%Y-%m-%d %H:%M:%S");
+        data += fraction;
+        data += '\t';
+        data += event.user_id > 0 ? std::to_string(event.user_id) : "\\N";
+        data += '\t';
+        appendCopyText(data, event.action);
+        data += '\t';
+        data += event.object_id > 0 ? std::to_string(event.object_id) : "\\N";
+        data += '\t';
+        if (event.detail.empty())
+        {
+            data += "\\N";
+        }
+        else
+        {
+            appendCopyText(data, event.detail);
+        }
+        data += '\n';
+    }
+
+    // A second attempt only if the connection was lost since the previous write
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (!connect() || !ensurePartitions(batch))
+        {
+            return false;
+        }
+
+        PGresult* res = PQexec(conn_, "COPY activity_log (occurred_at, user_id, action, object_id, detail) FROM STDIN;");
+        bool ok = (PQresultStatus(res) == PGRES_COPY_IN);
+        PQclear(res);
+
+        for (size_t offset = 0; ok && offset < data.size(); offset += COPY_CHUNK)
+        {
+            size_t length = std::min(COPY_CHUNK, data.size() - offset);
+            ok = PQputCopyData(conn_, data.data() + offset, static_cast<int>(length)) == 1;
+        }
+        if (PQputCopyEnd(conn_, ok ? nullptr : "aborted") != 1)
+        {
+            ok = false;
+        }
+
+        while ((res = PQgetResult(conn_)) != nullptr)
+        {
+            if (PQresultStatus(res) != PGRES_COMMAND_OK)
+            {
+                ok = false;
+            }
+            PQclear(res);
+        }
+
+        if (ok)
+        {
+            return true;
+        }
+        LOG_ERROR << "Failed to copy activity events: " << PQerrorMessage(conn_);
+        if (PQstatus(conn_) == CONNECTION_OK)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool ActivityLog::ensurePartitions(const std::vector<Event>& batch)
+{
+    // Tomorrow's as well, so the first events after midnight do not wait for it
+    std::set<long long> days;
+    days.insert(static_cast<long long>(std::time(nullptr)) / DAY * DAY + DAY);
+    for (const auto& event : batch)
+    {
+        days.insert(event.time_us / 1000000 / DAY * DAY);
+    }
+
+    for (long long day : days)
+    {
+        if (partitions_.count(day))
+        {
+            continue;
+        }
+        std::string command = "CREATE TABLE IF NOT EXISTS " + partitionName(day) +
+                              " PARTITION OF activity_log FOR VALUES FROM ('" + formatUtc(day, "%Y-%m-%d") +
+                              "') TO ('" + formatUtc(day + DAY, "%Y-%m-%d") + "');";
+        // The auth service creates the same partitions, so a concurrent creation can fail once
+        if (!execute(conn_, command) && !execute(conn_, command))
+        {
+            return false;
+        }
+        partitions_.insert(day);
+    }
+    return true;
+}
+
+void ActivityLog::prune()
+{
+    long long today = static_cast<long long>(std::time(nullptr)) / DAY * DAY;
+    if (prunedDay_ == today || !connect())
+    {
+        return;
+    }
+
+    // Partition names contain their day, so the expired ones sort before the oldest kept
+    long long oldest = today - static_cast<long long>(retentionDays_) * DAY;
+    std::string oldestName = partitionName(oldest);
+    const char* paramValues[1] = { oldestName.c_str() };
+    PGresult* res = PQexecParams(conn_, R"(
+        SELECT c.relname
+        FROM pg_inherits i
+        JOIN pg_class c ON c.oid = i.inhrelid
+        WHERE i.inhparent = 'activity_log'::regclass AND c.relname < $1
+        ORDER BY c.relname;
+    )", 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOG_ERROR << "Failed to list activity log partitions: " << PQerrorMessage(conn_);
+        PQclear(res);
+        return;
+    }
+
+    std::vector<std::string> expired;
+    for (int i = 0; i < PQntuples(res); ++i)
+    {
+        expired.emplace_back(PQgetvalue(res, i, 0));
+    }
+    PQclear(res);
+
+    bool ok = true;
+    for (const auto& partition : expired)
+    {
+        ok = execute(conn_, "DROP TABLE IF EXISTS " + partition + ";") && ok;
+    }
+    partitions_.erase(partitions_.begin(), partitions_.lower_bound(oldest));
+
+    if (ok)
+    {
+        if (!expired.empty())
+        {
+            LOG_INFO << "Dropped " << expired.size() << " expired activity log partitions";
+        }
+        prunedDay_ = today;
+    }
+}
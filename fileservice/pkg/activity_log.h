@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <libpq-fe.h>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Writes the user activity log (uploads, downloads, deletions; logins and
+ * permission changes are written by the auth service) into activity_log.
+ *
+ * Request handlers only enqueue an event into a bounded lock-free ring
+ * buffer, so logging never waits for the database. A background thread
+ * drains the buffer and writes each batch with a single COPY. When the
+ * buffer is full, events are dropped and counted rather than slowing down
+ * the request.
+ *
+ * activity_log is partitioned by day (UTC). The writer creates the
+ * partitions it needs and drops those older than the retention period.
+ */
+class ActivityLog {
+public:
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<ActivityLog> instance();
+
+    ~ActivityLog();
+
+    /**
+     * Start the writer. Must be called once, after DB::initInstance().
+     *
+     * @param capacity Events the buffer holds (rounded up to a power of two)
+     * @param flushInterval Seconds between writes; a write also starts early once a batch has accumulated
+     * @param retentionDays Days of activity to keep
+     */
+    void start(size_t capacity, double flushInterval, int retentionDays);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    int retentionDays() const { return retentionDays_; }
+
+    /**
+     * Enqueue an event by user_id. Never blocks; does nothing until started.
+     *
+     * @param object_id The file or folder acted on, 0 if none
+     * @param detail Free text such as the file name
+     */
+    void record(const std::string& user_id, const std::string& action, long long object_id = 0,
+                const std::string& detail = "");
+
+    // Events dropped because the buffer was full
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    ActivityLog() = default;
+
+    struct Event {
+        long long time_us;       // microseconds since the epoch
+        int user_id;
+        std::string action;
+        long long object_id;
+        std::string detail;
+    };
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Event event;
+    };
+
+    // Multi-producer push; false when the buffer is full
+    bool push(Event&& event, size_t& position);
+    // Single-consumer pop, only called on the writer thread; false when the buffer is empty
+    bool pop(Event& event);
+
+    void flush();
+    bool copyBatch(const std::vector<Event>& batch);
+
+    bool connect();
+
+    // Creates the daily partitions the batch needs, plus tomorrow's
+    bool ensurePartitions(const std::vector<Event>& batch);
+
+    void prune();
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    std::atomic<size_t> head_{0};
+    size_t tail_ = 0;                       // writer thread only
+
+    std::atomic<bool> flushQueued_{false};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reportedDropped_ = 0;
+
+    int retentionDays_ = 90;
+
+    // Only used on the writer thread
+    PGconn *conn_ = nullptr;
+    std::set<long long> partitions_;        // days (seconds at 00:00 UTC) known to have a partition
+    long long prunedDay_ = 0;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
@@ -0,0 +1,287 @@
+#include "analytics.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "db.h"
+
+std::shared_ptr<Analytics> Analytics::instance()
+{
+    static std::shared_ptr<Analytics> instance(new Analytics());
+    return instance;
+}
+
+void Analytics::start(size_t topCapacity, double checkpointInterval)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    topCapacity_ = std::max<size_t>(16, topCapacity);
+    restore();
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("Analytics");
+    thread_->run();
+    thread_->getLoop()->runEvery(checkpointInterval, [this]() { checkpoint(); });
+
+    LOG_INFO << "Analytics started, tracking the top " << topCapacity_ << " files and folders";
+}
+
+void Analytics::recordUser(const std::string& user_id)
+{
+    int id = std::atoi(user_id.c_str());
+    if (!thread_ || id <= 0)
+    {
+        return;
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& series : series_)
+    {
+        rotate(series, now);
+        series.current->recorded.users.add(static_cast<uint64_t>(id));
+    }
+}
+
+void Analytics::recordDownload(const std::string& user_id, int file_id)
+{
+    int id = std::atoi(user_id.c_str());
+    if (!thread_ || id <= 0)
+    {
+        return;
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& series : series_)
+    {
+        rotate(series, now);
+        series.current->recorded.users.add(static_cast<uint64_t>(id));
+        series.current->recorded.files.add(file_id);
+    }
+}
+
+void Analytics::recordFolderActivity(const std::string& user_id, int folder_id)
+{
+    int id = std::atoi(user_id.c_str());
+    if (!thread_ || id <= 0)
+    {
+        return;
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& series : series_)
+    {
+        rotate(series, now);
+        series.current->recorded.users.add(static_cast<uint64_t>(id));
+        if (folder_id > 0)
+        {
+            series.current->recorded.folders.add(folder_id);
+        }
+    }
+}
+
+Analytics::Summary Analytics::summary(Window window, bool previous, size_t limit)
+{
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Series& series = series_[window == Window::Hour ? 0 : 1];
+    rotate(series, now);
+    const Period& period = previous ? *series.previous : *series.current;
+    Sketches total = period.merged;
+    total.merge(period.recorded);
+    return {period.start, total.users.estimate(), total.files.top(limit), total.folders.top(limit)};
+}
+
+void Analytics::rotate(Series& series, long long now)
+{
+    long long start = now / series.length * series.length;
+    if (series.current && series.current->start == start)
+    {
+        return;
+    }
+
+    if (series.current && series.current->start == start - series.length)
+    {
+        series.previous = std::move(series.current);
+    }
+    else
+    {
+        series.previous = std::make_unique<Period>(start - series.length, topCapacity_);
+    }
+    series.current = std::make_unique<Period>(start, topCapacity_);
+}
+
+Analytics::Period* Analytics::find(Series& series, long long start)
+{
+    for (Period* period : {series.current.get(), series.previous.get()})
+    {
+        if (period && period->start == start)
+        {
+            return period;
+        }
+    }
+    return nullptr;
+}
+
+void Analytics::Sketches::merge(const Sketches& other)
+{
+    users.merge(other.users);
+    files.merge(other.files);
+    folders.merge(other.folders);
+}
+
+bool Analytics::Sketches::load(const AnalyticsCheckpoint& checkpoint)
+{
+    Sketches loaded = *this;
+    if (!loaded.users.deserialize(checkpoint.users) || !loaded.files.deserialize(checkpoint.files) ||
+        !loaded.folders.deserialize(checkpoint.folders))
+    {
+        return false;
+    }
+    *this = std::move(loaded);
+    return true;
+}
+
+void Analytics::Sketches::save(AnalyticsCheckpoint& checkpoint) const
+{
+    checkpoint.users = users.serialize();
+    checkpoint.files = files.serialize();
+    checkpoint.folders = folders.serialize();
+}
+
+void Analytics::checkpoint()
+{
+    // What was recorded since the last checkpoint, taken out so that recording goes on
+    // while the database is busy
+    struct Pending {
+        size_t series;
+        std::string name;
+        long long start;
+        Sketches recorded;
+    };
+    std::vector<Pending> pending;
+    {
+        long long now = static_cast<long long>(std::time(nullptr));
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < 2; ++i)
+        {
+            Series& series = series_[i];
+            rotate(series, now);
+            for (Period* period : {series.current.get(), series.previous.get()})
+            {
+                std::string name = series.name;
+                if (period == series.previous.get())
+                {
+                    name += "_previous";
+                }
+                pending.push_back({i, name, period->start, std::move(period->recorded)});
+                period->recorded = Sketches(topCapacity_);
+            }
+        }
+    }
+
+    // Other processes checkpoint into the same rows: each adds its own activity
+    // to what is stored, one at a time
+    auto db = DB::instance();
+    std::vector<Sketches> merged;
+    bool saved = false;
+    {
+        DB::Transaction transaction(*db);
+        auto stored = transaction.ok() ? db->lockAnalyticsCheckpoints() : std::nullopt;
+        if (stored)
+        {
+            std::vector<AnalyticsCheckpoint> checkpoints;
+            for (const auto& item : pending)
+            {
+                const char* seriesName = series_[item.series].name;
+                Sketches total(topCapacity_);
+                // Matched by start: the "hour" stored an hour ago is "hour_previous" now
+                for (const auto& checkpoint : *stored)
+                {
+                    if (checkpoint.name.compare(0, std::strlen(seriesName), seriesName) == 0 &&
+                        checkpoint.period_start == item.start && !total.load(checkpoint))
+                    {
+                        LOG_WARN << "Analytics checkpoint '" << checkpoint.name << "' does not parse, replacing it";
+                    }
+                }
+                total.merge(item.recorded);
+
+                checkpoints.push_back({item.name, item.start, "", "", ""});
+                total.save(checkpoints.back());
+                merged.push_back(std::move(total));
+            }
+            saved = db->saveAnalyticsCheckpoints(checkpoints) && transaction.commit();
+        }
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        Series& series = series_[pending[i].series];
+        rotate(series, now);
+        Period* period = find(series, pending[i].start);
+        if (!period)
+        {
+            continue;
+        }
+        if (saved)
+        {
+            period->merged = std::move(merged[i]);
+        }
+        else
+        {
+            // Kept for the next checkpoint
+            period->recorded.merge(pending[i].recorded);
+        }
+    }
+
+    if (!saved)
+    {
+        LOG_ERROR << "Failed to checkpoint analytics";
+    }
+}
+
+void Analytics::restore()
+{
+    auto checkpoints = DB::instance()->loadAnalyticsCheckpoints();
+    if (!checkpoints)
+    {
+        LOG_WARN << "Failed to load the analytics checkpoint, starting empty";
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t restored = 0;
+    for (auto& series : series_)
+    {
+        rotate(series, now);
+        if (!checkpoints)
+        {
+            continue;
+        }
+
+        // Placed by their start, so a current period saved before a restart across
+        // the boundary comes back as the previous one
+        for (const auto& checkpoint : *checkpoints)
+        {
+            if (checkpoint.name.compare(0, std::strlen(series.name), series.name) != 0)
+            {
+                continue;
+            }
+
+            Period* period = find(series, checkpoint.period_start);
+            if (period && period->merged.load(checkpoint))
+            {
+                ++restored;
+            }
+        }
+    }
+    LOG_INFO << "Restored " << restored << " analytics periods from the checkpoint";
+}
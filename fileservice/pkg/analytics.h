@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <trantor/net/EventLoopThread.h>
+#include "sketches.h"
+
+struct AnalyticsCheckpoint;
+
+/**
+ * Approximate dashboard analytics, kept in memory for the current and the
+ * previous hour and day (UTC):
+ *  - distinct users who listed, uploaded or downloaded (HyperLogLog);
+ *  - most downloaded files and most active folders, by listings and
+ *    uploads (Space-Saving).
+ *
+ * Each update is a few hundred nanoseconds under one mutex, regardless of
+ * traffic, and the admin summary needs no scan of any log. Every checkpoint
+ * interval the activity recorded since the last checkpoint is merged into
+ * the sketches in analytics_checkpoints (HyperLogLog register maximum,
+ * Space-Saving merge), so all processes add up to one summary and a restart
+ * loses at most one interval. Summaries show the stored sketches as of the
+ * last checkpoint plus this process's activity since.
+ */
+class Analytics {
+public:
+    enum class Window {
+        Hour,
+        Day
+    };
+
+    struct Summary {
+        long long start;                                // Unix seconds
+        long long distinct_users;
+        std::vector<SpaceSaving::Item> top_files;       // by downloads
+        std::vector<SpaceSaving::Item> top_folders;     // by listings and uploads
+    };
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<Analytics> instance();
+
+    /**
+     * Restore the last checkpoint and start checkpointing. Must be called once, after DB::initInstance().
+     *
+     * @param topCapacity Counters per top list; items above 1/topCapacity of the total are always listed
+     * @param checkpointInterval Seconds between checkpoints
+     */
+    void start(size_t topCapacity, double checkpointInterval);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    size_t topCapacity() const { return topCapacity_; }
+
+    // Activity by user_id; nothing is recorded until started
+    void recordUser(const std::string& user_id);
+    void recordDownload(const std::string& user_id, int file_id);
+    // A listing of or an upload into folder_id (the root, 0, is not ranked)
+    void recordFolderActivity(const std::string& user_id, int folder_id);
+
+    // The current period of the window, or the one before it; at most limit items per top list
+    Summary summary(Window window, bool previous, size_t limit);
+
+private:
+    Analytics() = default;
+
+    struct Sketches {
+        explicit Sketches(size_t capacity)
+            : files(capacity), folders(capacity) {}
+
+        void merge(const Sketches& other);
+
+        // false if the checkpoint does not parse; the sketches are then unchanged
+        bool load(const AnalyticsCheckpoint& checkpoint);
+        void save(AnalyticsCheckpoint& checkpoint) const;
+
+        HyperLogLog users;
+        SpaceSaving files;
+        SpaceSaving folders;
+    };
+
+    struct Period {
+        Period(long long start, size_t capacity)
+            : start(start), recorded(capacity), merged(capacity) {}
+
+        long long start;
+        Sketches recorded;      // by this process since its last checkpoint
+        Sketches merged;        // of all processes, as of this process's last checkpoint
+    };
+
+    struct Series {
+        const char* name;
+        long long length;
+        std::unique_ptr<Period> current;
+        std::unique_ptr<Period> previous;
+    };
+
+    // Moves the series forward to the period containing now; called with mutex_ held
+    void rotate(Series& series, long long now);
+
+    // The current or previous period of the series starting at start, if any; called with mutex_ held
+    Period* find(Series& series, long long start);
+
+    void checkpoint();
+    void restore();
+
+    size_t topCapacity_ = 256;
+
+    Series series_[2] = {{"hour", 60 * 60, nullptr, nullptr}, {"day", 24 * 60 * 60, nullptr, nullptr}};
+    std::mutex mutex_;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
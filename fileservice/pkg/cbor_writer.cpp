@@ -0,0 +1,115 @@
+#include "cbor_writer.h"
+
+namespace {
+
+// Major types
+const uint8_t kUnsigned = 0;
+const uint8_t kNegative = 1;
+const uint8_t kText = 3;
+
+// Indefinite-length containers and simple values
+const char kMapStart = '\xbf';
+const char kArrayStart = '\x9f';
+const char kBreak = '\xff';
+const char kFalse = '\xf4';
+const char kTrue = '\xf5';
+const char kNull = '\xf6';
+
+} // namespace
+
+CborWriter::CborWriter(std::string &out) : out_(out)
+{
+}
+
+void CborWriter::startObject()
+{
+    out_ += kMapStart;
+}
+
+void CborWriter::endObject()
+{
+    out_ += kBreak;
+}
+
+void CborWriter::startArray()
+{
+    out_ += kArrayStart;
+}
+
+void CborWriter::endArray()
+{
+    out_ += kBreak;
+}
+
+void CborWriter::key(std::string_view name)
+{
+    value(name);
+}
+
+void CborWriter::value(std::string_view str)
+{
+    writeHead(kText, str.size());
+    out_.append(str.data(), str.size());
+}
+
+void CborWriter::value(long long number)
+{
+    if (number >= 0)
+    {
+        writeHead(kUnsigned, static_cast<uint64_t>(number));
+    }
+    else
+    {
+        // Negative integers are encoded as -1 - n
+        writeHead(kNegative, static_cast<uint64_t>(-1 - number));
+    }
+}
+
+void CborWriter::value(bool flag)
+{
+    out_ += flag ? kTrue : kFalse;
+}
+
+void CborWriter::null()
+{
+    out_ += kNull;
+}
+
+void CborWriter::writeHead(uint8_t majorType, uint64_t argument)
+{
+    uint8_t type = static_cast<uint8_t>(majorType << 5);
+
+    if (argument < 24)
+    {
+        out_ += static_cast<char>(type | argument);
+        return;
+    }
+
+    int bytes;
+    if (argument <= 0xFF)
+    {
+        out_ += static_cast<char>(type | 24);
+        bytes = 1;
+    }
+    else if (argument <= 0xFFFF)
+    {
+        out_ += static_cast<char>(type | 25);
+        bytes = 2;
+    }
+    else if (argument <= 0xFFFFFFFFULL)
+    {
+        out_ += static_cast<char>(type | 26);
+        bytes = 4;
+    }
+    else
+    {
+        out_ += static_cast<char>(type | 27);
+        bytes = 8;
+    }
+
+    // Big-endian
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8)
+    {
+        out_ += static_cast<char>((argument >> shift) & 0xFF);
+    }
+}
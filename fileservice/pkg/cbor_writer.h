@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "structured_writer.h"
+
+/**
+ * Streaming CBOR (RFC 8949) encoder.
+ *
+ * Objects and arrays are written as indefinite-length maps and arrays, so
+ * the encoder never needs element counts up front and output can be
+ * flushed while a container is still open, like JsonWriter. Integers use the
+ * shortest encoding.
+ */
+class CborWriter final : public StructuredWriter {
+public:
+    explicit CborWriter(std::string &out);
+
+    using StructuredWriter::value;
+
+    void startObject() override;
+    void endObject() override;
+    void startArray() override;
+    void endArray() override;
+    void key(std::string_view name) override;
+    void value(std::string_view str) override;
+    void value(long long number) override;
+    void value(bool flag) override;
+    void null() override;
+
+private:
+    // Writes the initial byte of an item with its argument (length or integer value)
+    void writeHead(uint8_t majorType, uint64_t argument);
+
+    std::string &out_;
+};
@@ -0,0 +1,337 @@
+#include "change_feed.h"
+#include <drogon/drogon.h>
+#include <cstdlib>
+#include <deque>
+#include "json_writer.h"
+
+std::string ChangeEvent::encode() const
+{
+    std::string out;
+    JsonWriter writer(out);
+    writer.startObject();
+    writer.field("type", type);
+    if (folder_id >= 0)
+    {
+        writer.field("folder_id", folder_id);
+    }
+    if (!file_ids.empty())
+    {
+        writer.key("file_ids");
+        writer.startArray();
+        for (int id : file_ids)
+        {
+            writer.value(id);
+        }
+        writer.endArray();
+    }
+    if (item_id > 0)
+    {
+        writer.field("item_id", item_id);
+    }
+    if (!name.empty())
+    {
+        writer.field("name", name);
+    }
+    if (file_size >= 0)
+    {
+        writer.field("file_size", file_size);
+    }
+    if (is_favorite >= 0)
+    {
+        writer.field("is_favorite", is_favorite != 0);
+    }
+    writer.endObject();
+    return out;
+}
+
+struct ChangeFeed::Subscriber {
+    int user_id = 0;
+    std::weak_ptr<drogon::WebSocketConnection> conn;
+    trantor::EventLoop *loop = nullptr;
+
+    // Subscribed folder keys; guarded by the hub mutex
+    std::unordered_set<int64_t> folders;
+
+    // Outgoing events not yet flushed
+    std::mutex queueMutex;
+    std::vector<Payload> queue;
+    bool flushScheduled = false;
+    bool overflowed = false;        // events were dropped; a resync is owed
+
+    // Frames sent but not yet confirmed by a pong: (ping number, frame size), oldest first
+    std::deque<std::pair<uint64_t, size_t>> unacked;
+    size_t unackedBytes = 0;
+    uint64_t lastPing = 0;
+};
+
+std::shared_ptr<ChangeFeed> ChangeFeed::instance()
+{
+    static std::shared_ptr<ChangeFeed> instance(new ChangeFeed());
+    return instance;
+}
+
+int64_t ChangeFeed::folderKey(int owner_id, int folder_id)
+{
+    return folder_id > 0 ? static_cast<int64_t>(folder_id) : -static_cast<int64_t>(owner_id);
+}
+
+ChangeFeed::SubscriberPtr ChangeFeed::connect(int user_id, const drogon::WebSocketConnectionPtr &conn)
+{
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->user_id = user_id;
+    subscriber->conn = conn;
+    subscriber->loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    userConnections_[user_id].insert(subscriber);
+    return subscriber;
+}
+
+void ChangeFeed::disconnect(const SubscriberPtr &subscriber)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    for (int64_t key : subscriber->folders)
+    {
+        auto it = folderSubscribers_.find(key);
+        if (it != folderSubscribers_.end())
+        {
+            it->second.erase(subscriber);
+            if (it->second.empty())
+            {
+                folderSubscribers_.erase(it);
+            }
+        }
+    }
+    subscriber->folders.clear();
+
+    auto userIt = userConnections_.find(subscriber->user_id);
+    if (userIt != userConnections_.end())
+    {
+        userIt->second.erase(subscriber);
+        if (userIt->second.empty())
+        {
+            userConnections_.erase(userIt);
+        }
+    }
+}
+
+bool ChangeFeed::subscribe(const SubscriberPtr &subscriber, int folder_id)
+{
+    int64_t key = folderKey(subscriber->user_id, folder_id);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (subscriber->folders.count(key) == 0 && subscriber->folders.size() >= MAX_SUBSCRIPTIONS)
+    {
+        return false;
+    }
+    subscriber->folders.insert(key);
+    folderSubscribers_[key].insert(subscriber);
+    return true;
+}
+
+void ChangeFeed::unsubscribe(const SubscriberPtr &subscriber, int folder_id)
+{
+    int64_t key = folderKey(subscriber->user_id, folder_id);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (subscriber->folders.erase(key) == 0)
+    {
+        return;
+    }
+    auto it = folderSubscribers_.find(key);
+    if (it != folderSubscribers_.end())
+    {
+        it->second.erase(subscriber);
+        if (it->second.empty())
+        {
+            folderSubscribers_.erase(it);
+        }
+    }
+}
+
+int ChangeFeed::userOf(const SubscriberPtr &subscriber)
+{
+    return subscriber->user_id;
+}
+
+void ChangeFeed::publish(int owner_id, const std::vector<int> &folder_ids, const ChangeEvent &event)
+{
+    std::vector<SubscriberPtr> targets;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (folderSubscribers_.empty())
+        {
+            return;
+        }
+
+        std::unordered_set<Subscriber *> seen;
+        for (int folder_id : folder_ids)
+        {
+            auto it = folderSubscribers_.find(folderKey(owner_id, folder_id));
+            if (it == folderSubscribers_.end())
+            {
+                continue;
+            }
+            for (const auto &subscriber : it->second)
+            {
+                if (seen.insert(subscriber.get()).second)
+                {
+                    targets.push_back(subscriber);
+                }
+            }
+        }
+    }
+
+    if (targets.empty())
+    {
+        return;
+    }
+
+    auto payload = std::make_shared<const std::string>(event.encode());
+    for (const auto &subscriber : targets)
+    {
+        enqueue(subscriber, payload);
+    }
+}
+
+void ChangeFeed::publishToUser(int user_id, const ChangeEvent &event)
+{
+    std::vector<SubscriberPtr> targets;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = userConnections_.find(user_id);
+        if (it == userConnections_.end())
+        {
+            return;
+        }
+        targets.assign(it->second.begin(), it->second.end());
+    }
+
+    auto payload = std::make_shared<const std::string>(event.encode());
+    for (const auto &subscriber : targets)
+    {
+        enqueue(subscriber, payload);
+    }
+}
+
+void ChangeFeed::acknowledge(const SubscriberPtr &subscriber, const std::string &payload)
+{
+    char *end = nullptr;
+    uint64_t ping = std::strtoull(payload.c_str(), &end, 10);
+    if (payload.empty() || *end != '\0')
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(subscriber->queueMutex);
+    while (!subscriber->unacked.empty() && subscriber->unacked.front().first <= ping)
+    {
+        subscriber->unackedBytes -= subscriber->unacked.front().second;
+        subscriber->unacked.pop_front();
+    }
+
+    // Caught up after falling behind: time for the resync
+    if (subscriber->overflowed && subscriber->unacked.empty() && !subscriber->flushScheduled)
+    {
+        scheduleFlush(subscriber);
+    }
+}
+
+void ChangeFeed::enqueue(const SubscriberPtr &subscriber, const Payload &payload)
+{
+    std::lock_guard<std::mutex> lock(subscriber->queueMutex);
+    if (subscriber->overflowed)
+    {
+        // Already behind: the client will resync, so further events are redundant
+        return;
+    }
+    if (subscriber->queue.size() >= MAX_QUEUED_EVENTS)
+    {
+        subscriber->queue.clear();
+        subscriber->overflowed = true;
+    }
+    else
+    {
+        subscriber->queue.push_back(payload);
+    }
+    if (!subscriber->flushScheduled)
+    {
+        scheduleFlush(subscriber);
+    }
+}
+
+void ChangeFeed::scheduleFlush(const SubscriberPtr &subscriber)
+{
+    subscriber->flushScheduled = true;
+
+    std::weak_ptr<Subscriber> weak = subscriber;
+    auto *loop = subscriber->loop ? subscriber->loop : drogon::app().getLoop();
+    loop->queueInLoop([weak]() {
+        if (auto subscriber = weak.lock())
+        {
+            flush(subscriber);
+        }
+    });
+}
+
+void ChangeFeed::flush(const SubscriberPtr &subscriber)
+{
+    std::vector<Payload> events;
+    bool overflowed;
+    uint64_t ping;
+    {
+        std::lock_guard<std::mutex> lock(subscriber->queueMutex);
+        subscriber->flushScheduled = false;
+
+        // The client has not confirmed enough of what was sent: drop instead of buffering,
+        // and owe it a resync once it confirms everything (see acknowledge)
+        if (subscriber->unackedBytes >= MAX_UNACKED_BYTES ||
+            (subscriber->overflowed && !subscriber->unacked.empty()))
+        {
+            subscriber->queue.clear();
+            subscriber->overflowed = true;
+            return;
+        }
+
+        events.swap(subscriber->queue);
+        overflowed = subscriber->overflowed;
+        subscriber->overflowed = false;
+        ping = ++subscriber->lastPing;
+    }
+
+    auto conn = subscriber->conn.lock();
+    if (!conn || !conn->connected())
+    {
+        return;
+    }
+
+    // {"events":[...]}: pre-encoded events are spliced in without re-encoding
+    std::string frame = "{\"events\":[";
+    if (overflowed)
+    {
+        ChangeEvent resync;
+        resync.type = "resync";
+        frame += resync.encode();
+    }
+    else
+    {
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            if (i > 0)
+            {
+                frame += ',';
+            }
+            frame += *events[i];
+        }
+    }
+    frame += "]}";
+
+    {
+        std::lock_guard<std::mutex> lock(subscriber->queueMutex);
+        subscriber->unacked.emplace_back(ping, frame.size());
+        subscriber->unackedBytes += frame.size();
+    }
+    conn->send(frame);
+    conn->send(std::to_string(ping), drogon::WebSocketMessageType::Ping);
+}
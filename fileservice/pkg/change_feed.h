@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <drogon/WebSocketConnection.h>
+#include <trantor/net/EventLoop.h>
+
+/**
+ * One change to a folder listing, as pushed to /api/v1/ws subscribers.
+ * Only the fields that apply to the type are sent.
+ */
+struct ChangeEvent {
+    std::string type;            // file_added, files_moved, files_deleted, folder_created,
+                                 // folder_deleted, favorite_changed, resync
+    int folder_id = -1;          // folder the change happened in (target for moves)
+    std::vector<int> file_ids;   // files_moved, files_deleted, favorite_changed
+    int item_id = 0;             // folder_deleted, favorite_changed (folder)
+    std::string name;            // file_added, folder_created
+    int file_size = -1;          // file_added
+    int is_favorite = -1;        // favorite_changed (0/1)
+
+    // Compact JSON encoding, done once per event regardless of the number of subscribers
+    std::string encode() const;
+};
+
+/**
+ * Fan-out hub for the folder change feed.
+ *
+ * WebSocket connections subscribe to folder ids; mutations publish events
+ * for the folders they touched. An event is encoded once and queued on
+ * every matching connection. Each connection flushes its queue on its own
+ * event loop, batching everything queued since the last flush into one
+ * frame; publishers only append to the queue.
+ *
+ * Backpressure is per connection. Every frame is followed by a ping whose
+ * payload numbers it; the client's pong (RFC 6455 requires one) confirms
+ * that it has received everything up to that frame. Once MAX_UNACKED_BYTES
+ * are sent but not confirmed, or MAX_QUEUED_EVENTS wait in the queue, the
+ * connection's events are dropped instead of buffered, and after the
+ * client has confirmed everything it receives a single "resync" event,
+ * upon which it re-fetches its listings. Memory per connection is thus
+ * bounded by the two limits, whatever the client's speed.
+ *
+ * Folder 0 (the root) is private to each user, so root subscriptions are
+ * keyed by the owner.
+ */
+class ChangeFeed {
+public:
+    // Connection state owned by the hub; opaque to callers
+    struct Subscriber;
+    using SubscriberPtr = std::shared_ptr<Subscriber>;
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<ChangeFeed> instance();
+
+    /**
+     * Register a connection. Must be called on the connection's event loop.
+     */
+    SubscriberPtr connect(int user_id, const drogon::WebSocketConnectionPtr &conn);
+
+    /**
+     * Drop a connection and all its subscriptions
+     */
+    void disconnect(const SubscriberPtr &subscriber);
+
+    /**
+     * Subscribe to a folder the user is known to have access to.
+     *
+     * @return false if the connection already has MAX_SUBSCRIPTIONS folders
+     */
+    bool subscribe(const SubscriberPtr &subscriber, int folder_id);
+
+    void unsubscribe(const SubscriberPtr &subscriber, int folder_id);
+
+    // User the connection was opened by
+    static int userOf(const SubscriberPtr &subscriber);
+
+    /**
+     * Deliver an event to the subscribers of the given folders (each connection
+     * receives it once). owner_id identifies whose root folder 0 means.
+     */
+    void publish(int owner_id, const std::vector<int> &folder_ids, const ChangeEvent &event);
+
+    /**
+     * Deliver an event to every connection of one user, whatever it is subscribed to
+     */
+    void publishToUser(int user_id, const ChangeEvent &event);
+
+    /**
+     * A pong received on the connection; payload is that of the ping it answers.
+     * Must be called on the connection's event loop.
+     */
+    void acknowledge(const SubscriberPtr &subscriber, const std::string &payload);
+
+    // Limits per connection
+    static const size_t MAX_SUBSCRIPTIONS = 256;
+    static const size_t MAX_QUEUED_EVENTS = 512;
+    static const size_t MAX_UNACKED_BYTES = 1024 * 1024;
+
+private:
+    ChangeFeed() = default;
+
+    using Payload = std::shared_ptr<const std::string>;
+
+    // Folder id, or -owner_id for a user's root
+    static int64_t folderKey(int owner_id, int folder_id);
+
+    // Queues a payload on one connection and schedules a flush if none is pending
+    static void enqueue(const SubscriberPtr &subscriber, const Payload &payload);
+
+    // Runs flush on the connection's event loop; called with the queue mutex held
+    static void scheduleFlush(const SubscriberPtr &subscriber);
+
+    // Sends everything queued on the connection as one frame; runs on its event loop
+    static void flush(const SubscriberPtr &subscriber);
+
+    std::shared_mutex mutex_;
+    std::unordered_map<int64_t, std::unordered_set<SubscriberPtr>> folderSubscribers_;
+    std::unordered_map<int, std::unordered_set<SubscriberPtr>> userConnections_;
+};
@@ -0,0 +1,985 @@
+#include "content_index.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "db.h"
+#include "text_utils.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Segment layout: magic, u64 docs offset, u64 dictionary offset, then the
+// posting lists, the sorted file ids and the dictionary
+const char SEGMENT_MAGIC[4] = {'C', 'I', 'X', '1'};
+const uint64_t HEADER_SIZE = 20;
+
+// Postings kept in memory before they are written out as a segment
+const size_t FLUSH_POSTINGS = 200000;
+
+// An idle worker writes out whatever is buffered after this long
+const auto IDLE_FLUSH_AFTER = std::chrono::seconds(10);
+
+// Segments are merged into one once there are more than this many
+const size_t MAX_SEGMENTS = 8;
+
+const size_t READ_CHUNK = 64 * 1024;
+
+// A NUL byte in this much of a file marks it as binary
+const size_t BINARY_SNIFF_BYTES = 4096;
+
+const size_t MIN_TERM_LENGTH = 2;
+const size_t MAX_TERM_LENGTH = 64;
+
+const char* const TEXT_EXTENSIONS[] = {
+    "txt", "md", "markdown", "rst", "csv", "tsv", "log", "ini", "conf", "cfg", "yaml", "yml", "toml",
+    "json", "xml", "html", "htm", "css", "tex", "srt",
+    "c", "cc", "cpp", "cxx", "h", "hh", "hpp", "cs", "java", "kt", "go", "rs", "py", "rb", "php",
+    "js", "jsx", "ts", "tsx", "swift", "scala", "lua", "pl", "sh", "bash", "sql", "cmake"
+};
+
+void putVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void putFixed64(char* p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        p[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t getFixed64(const char* p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    }
+    return value;
+}
+
+// Term frequencies of a text: runs of ASCII letters and digits or non-ASCII
+// bytes (UTF-8 letters), case-folded
+std::unordered_map<std::string, uint32_t> tokenize(const std::string& text)
+{
+    std::unordered_map<std::string, uint32_t> terms;
+    std::string folded = TextUtils::foldCase(text);
+
+    size_t i = 0;
+    while (i < folded.size())
+    {
+        auto isWordByte = [](unsigned char c) { return std::isalnum(c) || c >= 0x80; };
+        while (i < folded.size() && !isWordByte(folded[i]))
+        {
+            ++i;
+        }
+        size_t start = i;
+        while (i < folded.size() && isWordByte(folded[i]))
+        {
+            ++i;
+        }
+        size_t length = i - start;
+        if (length >= MIN_TERM_LENGTH && length <= MAX_TERM_LENGTH)
+        {
+            ++terms[folded.substr(start, length)];
+        }
+    }
+    return terms;
+}
+
+// Writes a segment term by term, so merges never hold more than one posting list
+class SegmentWriter {
+public:
+    explicit SegmentWriter(const std::string& path)
+        : path_(path), tmpPath_(path + ".tmp"), out_(tmpPath_, std::ios::binary | std::ios::trunc)
+    {
+        std::string header(HEADER_SIZE, '\0');
+        std::copy(SEGMENT_MAGIC, SEGMENT_MAGIC + 4, header.begin());
+        out_.write(header.data(), header.size());
+    }
+
+    // Terms must be added in ascending order, postings sorted by file id
+    void addTerm(const std::string& term, const std::vector<std::pair<int, uint32_t>>& postings)
+    {
+        std::string encoded;
+        int previous = 0;
+        for (const auto& [file_id, tf] : postings)
+        {
+            putVarint(encoded, static_cast<uint64_t>(file_id - previous));
+            putVarint(encoded, tf);
+            previous = file_id;
+        }
+        out_.write(encoded.data(), encoded.size());
+
+        putVarint(dictionary_, term.size());
+        dictionary_ += term;
+        putVarint(dictionary_, postingsSize_);
+        putVarint(dictionary_, encoded.size());
+        putVarint(dictionary_, postings.size());
+        postingsSize_ += encoded.size();
+        ++termCount_;
+    }
+
+    bool finish(const std::vector<int>& docs)
+    {
+        std::string tail;
+        putVarint(tail, docs.size());
+        int previous = 0;
+        for (int file_id : docs)
+        {
+            putVarint(tail, static_cast<uint64_t>(file_id - previous));
+            previous = file_id;
+        }
+        uint64_t dictOffset = HEADER_SIZE + postingsSize_ + tail.size();
+        putVarint(tail, termCount_);
+        tail += dictionary_;
+        out_.write(tail.data(), tail.size());
+
+        char offsets[16];
+        putFixed64(offsets, HEADER_SIZE + postingsSize_);
+        putFixed64(offsets + 8, dictOffset);
+        out_.seekp(4);
+        out_.write(offsets, sizeof(offsets));
+        out_.close();
+
+        std::error_code ec;
+        if (!out_ || (fs::rename(tmpPath_, path_, ec), ec))
+        {
+            LOG_ERROR << "Failed to write index segment " << path_;
+            fs::remove(tmpPath_, ec);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string path_;
+    std::string tmpPath_;
+    std::ofstream out_;
+    std::string dictionary_;
+    uint64_t postingsSize_ = 0;
+    uint64_t termCount_ = 0;
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+ContentIndex::Segment::~Segment()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+std::shared_ptr<ContentIndex> ContentIndex::instance()
+{
+    static std::shared_ptr<ContentIndex> instance(new ContentIndex());
+    return instance;
+}
+
+ContentIndex::~ContentIndex()
+{
+    stop();
+    if (listenConn_)
+    {
+        PQfinish(listenConn_);
+    }
+}
+
+bool ContentIndex::start(const std::string& storagePath, const std::string& indexPath,
+                         size_t maxFileSize, size_t readBytesPerSecond, double pollInterval)
+{
+    LOG_INFO << "Initializing ContentIndex in " << indexPath;
+
+    storagePath_ = storagePath;
+    indexPath_ = indexPath;
+    maxFileSize_ = maxFileSize;
+    readBytesPerSecond_ = readBytesPerSecond;
+
+    std::error_code ec;
+    fs::create_directories(indexPath_, ec);
+    if (ec)
+    {
+        LOG_ERROR << "Failed to create content index directory " << indexPath_ << ": " << ec.message();
+        return false;
+    }
+
+    if (!loadSegments())
+    {
+        return false;
+    }
+    loadTombstones();
+
+    // LISTEN before the catch-up scan, so nothing committed meanwhile is missed
+    if (!listen())
+    {
+        LOG_WARN << "Name change notifications are unavailable, new uploads will be indexed on restart";
+    }
+
+    stopping_ = false;
+    worker_ = std::thread([this]() { run(); });
+
+    drogon::app().getLoop()->runEvery(pollInterval, [this]() { pollNotifications(); });
+    return true;
+}
+
+bool ContentIndex::isRunning() const
+{
+    return worker_.joinable();
+}
+
+void ContentIndex::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex_);
+        stopping_ = true;
+    }
+    jobsReady_.notify_all();
+    if (worker_.joinable())
+    {
+        worker_.join();
+    }
+}
+
+bool ContentIndex::isTextLike(const std::string& file_name)
+{
+    size_t dot = file_name.rfind('.');
+    if (dot == std::string::npos || dot + 1 == file_name.size())
+    {
+        return false;
+    }
+    std::string extension = TextUtils::foldCase(file_name.substr(dot + 1));
+    return std::find(std::begin(TEXT_EXTENSIONS), std::end(TEXT_EXTENSIONS), extension) != std::end(TEXT_EXTENSIONS);
+}
+
+std::vector<ContentIndex::Hit> ContentIndex::search(const std::string& query, size_t maxHits,
+                                                    const std::function<bool(int file_id)>& accept) const
+{
+    std::vector<Hit> hits;
+
+    std::vector<std::string> terms;
+    for (const auto& [term, tf] : tokenize(query))
+    {
+        terms.push_back(term);
+    }
+    if (terms.empty() || maxHits == 0)
+    {
+        return hits;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(stateMutex_);
+    double documentCount = static_cast<double>(std::max<size_t>(indexed_.size(), 1));
+
+    // file_id -> accumulated score, narrowed to the files matching every term so far
+    std::unordered_map<int, double> scores;
+    bool first = true;
+
+    // Deleted and (for the first term) rejected files never enter the intersection;
+    // later terms only count files still in it
+    auto candidate = [&](int file_id) {
+        if (deleted_.count(file_id))
+        {
+            return false;
+        }
+        if (first)
+        {
+            return !accept || accept(file_id);
+        }
+        return scores.count(file_id) > 0;
+    };
+
+    for (const auto& term : terms)
+    {
+        std::unordered_map<int, uint32_t> frequencies;
+        for (const auto& segment : segments_)
+        {
+            auto it = segment->terms.find(term);
+            if (it == segment->terms.end())
+            {
+                continue;
+            }
+            for (const auto& [file_id, tf] : readPostings(*segment, it->second))
+            {
+                if (candidate(file_id))
+                {
+                    frequencies[file_id] += tf;
+                }
+            }
+        }
+        auto bufferIt = buffer_.find(term);
+        if (bufferIt != buffer_.end())
+        {
+            for (const auto& [file_id, tf] : bufferIt->second)
+            {
+                if (candidate(file_id))
+                {
+                    frequencies[file_id] += tf;
+                }
+            }
+        }
+
+        if (frequencies.empty())
+        {
+            return hits;
+        }
+
+        double idf = std::log(1.0 + documentCount / frequencies.size());
+        std::unordered_map<int, double> next;
+        for (const auto& [file_id, tf] : frequencies)
+        {
+            double weight = idf * tf / (tf + 1.2);
+            if (first)
+            {
+                next[file_id] = weight;
+            }
+            else
+            {
+                auto it = scores.find(file_id);
+                if (it != scores.end())
+                {
+                    next[file_id] = it->second + weight;
+                }
+            }
+        }
+        scores.swap(next);
+        first = false;
+
+        if (scores.empty())
+        {
+            return hits;
+        }
+    }
+    lock.unlock();
+
+    hits.reserve(scores.size());
+    for (const auto& [file_id, score] : scores)
+    {
+        hits.push_back({file_id, score});
+    }
+    size_t count = std::min(maxHits, hits.size());
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), [](const Hit& a, const Hit& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.file_id > b.file_id;
+    });
+    hits.resize(count);
+    return hits;
+}
+
+void ContentIndex::enqueue(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex_);
+        jobs_.push_back(std::move(job));
+    }
+    jobsReady_.notify_one();
+}
+
+void ContentIndex::run()
+{
+#ifdef __linux__
+    // Lower the worker's CPU priority; the read rate is bounded separately
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+
+    catchUp();
+
+    auto lastWork = std::chrono::steady_clock::now();
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex_);
+            jobsReady_.wait_for(lock, std::chrono::seconds(2), [this]() { return stopping_ || !jobs_.empty(); });
+            if (stopping_)
+            {
+                break;
+            }
+            if (jobs_.empty())
+            {
+                lock.unlock();
+                if (bufferPostings_ > 0 && std::chrono::steady_clock::now() - lastWork >= IDLE_FLUSH_AFTER)
+                {
+                    flushBuffer();
+                }
+                continue;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        process(job);
+        lastWork = std::chrono::steady_clock::now();
+
+        if (bufferPostings_ >= FLUSH_POSTINGS)
+        {
+            flushBuffer();
+        }
+    }
+
+    // Whatever is buffered would otherwise be read again on the next start
+    flushBuffer();
+}
+
+void ContentIndex::process(const Job& job)
+{
+    // Only this thread writes the state, so it can read it without the lock
+    if (job.remove)
+    {
+        if (!indexed_.count(job.file_id) || deleted_.count(job.file_id))
+        {
+            return;
+        }
+        {
+            std::unique_lock<std::shared_mutex> lock(stateMutex_);
+            deleted_.insert(job.file_id);
+            indexed_.erase(job.file_id);
+        }
+        saveTombstones();
+        return;
+    }
+
+    // File ids are never reused, so a tombstoned file cannot come back
+    if (indexed_.count(job.file_id) || deleted_.count(job.file_id) || !isTextLike(job.file_name))
+    {
+        return;
+    }
+
+    std::string path = storagePath_ + "/" + job.file_name;
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec || size > maxFileSize_)
+    {
+        return;
+    }
+
+    std::string content;
+    if (!readThrottled(path, content))
+    {
+        return;
+    }
+    if (content.find('\0') < BINARY_SNIFF_BYTES)
+    {
+        return;
+    }
+
+    auto terms = tokenize(content);
+
+    std::unique_lock<std::shared_mutex> lock(stateMutex_);
+    for (auto& [term, tf] : terms)
+    {
+        buffer_[term].emplace_back(job.file_id, tf);
+    }
+    bufferPostings_ += terms.size();
+    indexed_.insert(job.file_id);
+}
+
+bool ContentIndex::readThrottled(const std::string& path, std::string& content)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+
+    // Bytes read since throttleEpoch_ may not run ahead of the configured rate;
+    // after a pause the count starts over, allowing at most one chunk of burst
+    auto dueAt = [this]() {
+        return throttleEpoch_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(throttledBytes_) / readBytesPerSecond_));
+    };
+    if (readBytesPerSecond_ > 0 && dueAt() < std::chrono::steady_clock::now())
+    {
+        throttleEpoch_ = std::chrono::steady_clock::now();
+        throttledBytes_ = 0;
+    }
+
+    char chunk[READ_CHUNK];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+    {
+        content.append(chunk, static_cast<size_t>(in.gcount()));
+        throttledBytes_ += static_cast<size_t>(in.gcount());
+
+        if (readBytesPerSecond_ > 0)
+        {
+            std::this_thread::sleep_until(dueAt());
+        }
+
+        if (content.size() > maxFileSize_)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ContentIndex::segmentPath(uint64_t id) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "seg-%08llu.cix", static_cast<unsigned long long>(id));
+    return indexPath_ + "/" + name;
+}
+
+void ContentIndex::flushBuffer()
+{
+    if (buffer_.empty())
+    {
+        return;
+    }
+
+    // The buffer only changes on this thread, so it can be written out without the lock
+    std::vector<int> docs;
+    std::set<int> seen;
+    uint64_t id = nextSegmentId_;
+    SegmentWriter writer(segmentPath(id));
+    for (auto& [term, postings] : buffer_)
+    {
+        std::vector<std::pair<int, uint32_t>> sorted = postings;
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto& posting : sorted)
+        {
+            seen.insert(posting.first);
+        }
+        writer.addTerm(term, sorted);
+    }
+    docs.assign(seen.begin(), seen.end());
+
+    if (!writer.finish(docs))
+    {
+        // Keep buffering; the next flush tries again
+        return;
+    }
+
+    auto segment = openSegment(segmentPath(id), id);
+    if (!segment)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(stateMutex_);
+        segments_.push_back(segment);
+        buffer_.clear();
+        bufferPostings_ = 0;
+        nextSegmentId_ = id + 1;
+    }
+
+    LOG_INFO << "Wrote content index segment " << id << ": " << docs.size() << " files, "
+             << segment->terms.size() << " terms";
+
+    if (segments_.size() > MAX_SEGMENTS)
+    {
+        mergeSegments();
+    }
+}
+
+void ContentIndex::mergeSegments()
+{
+    std::vector<std::shared_ptr<const Segment>> sources = segments_;
+    std::unordered_set<int> dropped = deleted_;
+
+    std::set<std::string> terms;
+    std::set<int> docs;
+    for (const auto& segment : sources)
+    {
+        for (const auto& [term, info] : segment->terms)
+        {
+            terms.insert(term);
+        }
+        for (int file_id : segment->docs)
+        {
+            if (!dropped.count(file_id))
+            {
+                docs.insert(file_id);
+            }
+        }
+    }
+
+    uint64_t id = nextSegmentId_;
+    SegmentWriter writer(segmentPath(id));
+    for (const auto& term : terms)
+    {
+        std::vector<std::pair<int, uint32_t>> merged;
+        for (const auto& segment : sources)
+        {
+            auto it = segment->terms.find(term);
+            if (it == segment->terms.end())
+            {
+                continue;
+            }
+            for (const auto& posting : readPostings(*segment, it->second))
+            {
+                if (!dropped.count(posting.first))
+                {
+                    merged.push_back(posting);
+                }
+            }
+        }
+        if (!merged.empty())
+        {
+            std::sort(merged.begin(), merged.end());
+            writer.addTerm(term, merged);
+        }
+    }
+
+    if (!writer.finish(std::vector<int>(docs.begin(), docs.end())))
+    {
+        return;
+    }
+
+    auto segment = openSegment(segmentPath(id), id);
+    if (!segment)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(stateMutex_);
+        segments_.assign(1, segment);
+        nextSegmentId_ = id + 1;
+        // Tombstones of files that were only in the merged segments are no longer needed
+        for (int file_id : dropped)
+        {
+            deleted_.erase(file_id);
+        }
+    }
+    saveTombstones();
+
+    // Open descriptors keep the data readable for queries still using the old segments
+    std::error_code ec;
+    for (const auto& old : sources)
+    {
+        fs::remove(old->path, ec);
+    }
+
+    LOG_INFO << "Merged " << sources.size() << " content index segments into segment " << id
+             << ": " << docs.size() << " files, " << segment->terms.size() << " terms";
+}
+
+std::shared_ptr<ContentIndex::Segment> ContentIndex::openSegment(const std::string& path, uint64_t id)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < HEADER_SIZE || !std::equal(SEGMENT_MAGIC, SEGMENT_MAGIC + 4, data.begin()))
+    {
+        LOG_ERROR << "Invalid content index segment " << path;
+        return nullptr;
+    }
+
+    uint64_t docsOffset = getFixed64(data.data() + 4);
+    uint64_t dictOffset = getFixed64(data.data() + 12);
+    if (docsOffset < HEADER_SIZE || dictOffset < docsOffset || dictOffset > data.size())
+    {
+        LOG_ERROR << "Invalid content index segment " << path;
+        return nullptr;
+    }
+
+    auto segment = std::make_shared<Segment>();
+    segment->id = id;
+    segment->path = path;
+
+    const char* end = data.data() + data.size();
+    const char* p = data.data() + docsOffset;
+    uint64_t count, value;
+    bool ok = getVarint(p, end, count);
+    int file_id = 0;
+    for (uint64_t i = 0; ok && i < count; ++i)
+    {
+        ok = getVarint(p, end, value);
+        file_id += static_cast<int>(value);
+        segment->docs.push_back(file_id);
+    }
+
+    p = data.data() + dictOffset;
+    ok = ok && getVarint(p, end, count);
+    for (uint64_t i = 0; ok && i < count; ++i)
+    {
+        uint64_t length, offset, size, docFreq;
+        ok = getVarint(p, end, length) && static_cast<uint64_t>(end - p) >= length;
+        if (!ok) break;
+        std::string term(p, length);
+        p += length;
+        ok = getVarint(p, end, offset) && getVarint(p, end, size) && getVarint(p, end, docFreq) &&
+             HEADER_SIZE + offset + size <= docsOffset;
+        if (ok)
+        {
+            segment->terms.emplace(std::move(term), TermInfo{offset, static_cast<uint32_t>(size),
+                                                             static_cast<uint32_t>(docFreq)});
+        }
+    }
+    if (!ok)
+    {
+        LOG_ERROR << "Corrupt content index segment " << path;
+        return nullptr;
+    }
+
+    segment->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (segment->fd < 0)
+    {
+        LOG_ERROR << "Failed to open content index segment " << path;
+        return nullptr;
+    }
+    return segment;
+}
+
+std::vector<std::pair<int, uint32_t>> ContentIndex::readPostings(const Segment& segment, const TermInfo& info) const
+{
+    std::vector<std::pair<int, uint32_t>> postings;
+    std::string data(info.length, '\0');
+    ssize_t read = ::pread(segment.fd, data.data(), info.length, static_cast<off_t>(HEADER_SIZE + info.offset));
+    if (read != static_cast<ssize_t>(info.length))
+    {
+        LOG_ERROR << "Failed to read postings from " << segment.path;
+        return postings;
+    }
+
+    postings.reserve(info.docFreq);
+    const char* p = data.data();
+    const char* end = p + data.size();
+    int file_id = 0;
+    uint64_t delta, tf;
+    while (p < end && getVarint(p, end, delta) && getVarint(p, end, tf))
+    {
+        file_id += static_cast<int>(delta);
+        postings.emplace_back(file_id, static_cast<uint32_t>(tf));
+    }
+    return postings;
+}
+
+bool ContentIndex::loadSegments()
+{
+    std::vector<std::pair<uint64_t, std::string>> found;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(indexPath_, ec))
+    {
+        std::string name = entry.path().filename().string();
+        unsigned long long id;
+        char extension[8];
+        if (sscanf(name.c_str(), "seg-%llu.%7s", &id, extension) == 2 && std::string(extension) == "cix")
+        {
+            found.emplace_back(id, entry.path().string());
+        }
+        else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+        {
+            // Left over from an interrupted write
+            fs::remove(entry.path(), ec);
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    std::unique_lock<std::shared_mutex> lock(stateMutex_);
+    segments_.clear();
+    indexed_.clear();
+    for (const auto& [id, path] : found)
+    {
+        auto segment = openSegment(path, id);
+        if (!segment)
+        {
+            // The files it covered are found missing and queued again by the catch-up scan
+            continue;
+        }
+        indexed_.insert(segment->docs.begin(), segment->docs.end());
+        segments_.push_back(segment);
+        nextSegmentId_ = std::max<uint64_t>(nextSegmentId_, id + 1);
+    }
+
+    LOG_INFO << "Loaded " << segments_.size() << " content index segments covering " << indexed_.size() << " files";
+    return true;
+}
+
+void ContentIndex::saveTombstones()
+{
+    std::string data;
+    {
+        std::shared_lock<std::shared_mutex> lock(stateMutex_);
+        std::vector<int> sorted(deleted_.begin(), deleted_.end());
+        std::sort(sorted.begin(), sorted.end());
+        putVarint(data, sorted.size());
+        int previous = 0;
+        for (int file_id : sorted)
+        {
+            putVarint(data, static_cast<uint64_t>(file_id - previous));
+            previous = file_id;
+        }
+    }
+
+    std::string path = indexPath_ + "/deleted.bin";
+    {
+        std::ofstream out(path + ".tmp", std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+    }
+    std::error_code ec;
+    fs::rename(path + ".tmp", path, ec);
+    if (ec)
+    {
+        LOG_ERROR << "Failed to save content index tombstones: " << ec.message();
+    }
+}
+
+void ContentIndex::loadTombstones()
+{
+    std::ifstream in(indexPath_ + "/deleted.bin", std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t count, delta;
+    if (!getVarint(p, end, count))
+    {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(stateMutex_);
+    int file_id = 0;
+    for (uint64_t i = 0; i < count && getVarint(p, end, delta); ++i)
+    {
+        file_id += static_cast<int>(delta);
+        deleted_.insert(file_id);
+        indexed_.erase(file_id);
+    }
+}
+
+void ContentIndex::catchUp()
+{
+    auto cursor = DB::instance()->openAllNamesCursor();
+    if (!cursor)
+    {
+        LOG_ERROR << "Failed to query files, the content index only follows new changes";
+        return;
+    }
+
+    std::unordered_set<int> existing;
+    size_t queued = 0;
+    while (cursor->next())
+    {
+        if (std::string(cursor->get(0)) != "file")
+        {
+            continue;
+        }
+        int file_id = std::stoi(cursor->get(1));
+        existing.insert(file_id);
+
+        std::string file_name = cursor->get(5);
+        if (!indexed_.count(file_id) && isTextLike(file_name))
+        {
+            enqueue({false, file_id, file_name});
+            ++queued;
+        }
+    }
+    if (cursor->failed())
+    {
+        LOG_ERROR << "Failed to read files, the content index catch-up is incomplete";
+        return;
+    }
+
+    // Files deleted while the service was down
+    for (int file_id : std::vector<int>(indexed_.begin(), indexed_.end()))
+    {
+        if (!existing.count(file_id))
+        {
+            enqueue({true, file_id, ""});
+        }
+    }
+
+    LOG_INFO << "Content index catch-up: " << queued << " files queued";
+}
+
+bool ContentIndex::listen()
+{
+    if (!listenConn_)
+    {
+        listenConn_ = DB::instance()->openConnection();
+        if (!listenConn_)
+        {
+            return false;
+        }
+    }
+
+    PGresult *res = PQexec(listenConn_, "LISTEN name_changes;");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        LOG_ERROR << "Failed to LISTEN on name_changes: " << PQerrorMessage(listenConn_);
+        PQclear(res);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return false;
+    }
+    PQclear(res);
+    return true;
+}
+
+void ContentIndex::pollNotifications()
+{
+    if (!listenConn_ || PQstatus(listenConn_) != CONNECTION_OK)
+    {
+        // Uploads committed while disconnected are picked up by the catch-up on the next start
+        if (listenConn_)
+        {
+            PQfinish(listenConn_);
+            listenConn_ = nullptr;
+        }
+        listen();
+        return;
+    }
+
+    if (!PQconsumeInput(listenConn_))
+    {
+        LOG_ERROR << "Lost content index notification connection: " << PQerrorMessage(listenConn_);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return;
+    }
+
+    Json::CharReaderBuilder builder;
+    while (PGnotify *notify = PQnotifies(listenConn_))
+    {
+        Json::Value payload;
+        std::string errors;
+        std::istringstream input(notify->extra);
+        if (Json::parseFromStream(builder, input, &payload, &errors) && payload.isObject() &&
+            payload["e"].asString() == "file")
+        {
+            // Moves and renames also arrive as upserts; the worker skips files it already has
+            bool remove = payload["op"].asString() != "upsert";
+            std::string file_name = payload["n"].asString();
+            if (remove || isTextLike(file_name))
+            {
+                enqueue({remove, payload["id"].asInt(), file_name});
+            }
+        }
+        PQfreemem(notify);
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <libpq-fe.h>
+
+/**
+ * Full-text index over the contents of text-like files (txt, md, csv,
+ * source code).
+ *
+ * A background thread reads and tokenizes new uploads and keeps their
+ * postings in memory until enough have accumulated, then writes them out
+ * as an immutable segment: a term dictionary plus delta- and
+ * varint-compressed posting lists. Only the dictionaries stay in memory;
+ * posting lists are read from disk per query. Deleted files are recorded
+ * as tombstones and dropped when segments are merged.
+ *
+ * Work arrives through the name_changes channel (see NameIndex), so
+ * nothing runs on the upload request path, and file reads are throttled to
+ * a configurable byte rate so indexing does not starve interactive I/O.
+ *
+ * The index knows nothing about access; callers pass a filter of the files
+ * the user may see, applied while the posting lists are intersected.
+ */
+class ContentIndex {
+public:
+    struct Hit {
+        int file_id;
+        double score;
+    };
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<ContentIndex> instance();
+
+    ~ContentIndex();
+
+    /**
+     * Load the segments in indexPath, queue files not indexed yet and start
+     * the worker. Must be called once, after DB::initInstance().
+     *
+     * @param storagePath Directory the uploaded files are stored in
+     * @param indexPath Directory for segment files (created if missing)
+     * @param maxFileSize Larger files are not indexed
+     * @param readBytesPerSecond Upper bound for the worker's file reads
+     * @param pollInterval Seconds between checks for change notifications
+     */
+    bool start(const std::string& storagePath, const std::string& indexPath,
+               size_t maxFileSize, size_t readBytesPerSecond, double pollInterval);
+
+    bool isRunning() const;
+
+    /**
+     * Files containing every term of the query, best first (tf-idf), at most maxHits.
+     * If accept is set, only files it accepts are candidates, so maxHits is not
+     * used up by files the caller would discard.
+     */
+    std::vector<Hit> search(const std::string& query, size_t maxHits,
+                            const std::function<bool(int file_id)>& accept = nullptr) const;
+
+    // Whether a file name has an extension the indexer reads
+    static bool isTextLike(const std::string& file_name);
+
+    // Stops the worker; pending work is picked up again on the next start
+    void stop();
+
+private:
+    ContentIndex() = default;
+
+    struct Job {
+        bool remove;
+        int file_id;
+        std::string file_name;
+    };
+
+    struct TermInfo {
+        uint64_t offset;      // from the start of the postings area
+        uint32_t length;      // bytes
+        uint32_t docFreq;
+    };
+
+    // An immutable segment file; the dictionary is held in memory
+    struct Segment {
+        uint64_t id = 0;
+        std::string path;
+        int fd = -1;
+        std::unordered_map<std::string, TermInfo> terms;
+        std::vector<int> docs;
+
+        ~Segment();
+    };
+
+    using Postings = std::map<std::string, std::vector<std::pair<int, uint32_t>>>;   // term -> (file_id, tf)
+
+    void run();
+    void process(const Job& job);
+
+    // Reads a file at no more than readBytesPerSecond_
+    bool readThrottled(const std::string& path, std::string& content);
+
+    // Writes the in-memory postings out as a new segment
+    void flushBuffer();
+
+    // Rewrites all segments as one, dropping deleted files
+    void mergeSegments();
+
+    std::string segmentPath(uint64_t id) const;
+    std::shared_ptr<Segment> openSegment(const std::string& path, uint64_t id);
+
+    // Postings of one term in one segment
+    std::vector<std::pair<int, uint32_t>> readPostings(const Segment& segment, const TermInfo& info) const;
+
+    bool loadSegments();
+    void saveTombstones();
+    void loadTombstones();
+
+    // Queues every text-like file that is not indexed yet
+    void catchUp();
+
+    void enqueue(Job job);
+
+    bool listen();
+    void pollNotifications();
+
+    std::string storagePath_;
+    std::string indexPath_;
+    size_t maxFileSize_ = 0;
+    size_t readBytesPerSecond_ = 0;
+
+    // Searchable state; written by the worker only
+    std::vector<std::shared_ptr<const Segment>> segments_;
+    Postings buffer_;
+    size_t bufferPostings_ = 0;
+    std::unordered_set<int> indexed_;      // files with postings in a segment or the buffer
+    std::unordered_set<int> deleted_;      // tombstones not yet merged away
+    uint64_t nextSegmentId_ = 1;
+    mutable std::shared_mutex stateMutex_;
+
+    // Throttling of file reads: bytes read since throttleEpoch_
+    std::chrono::steady_clock::time_point throttleEpoch_;
+    size_t throttledBytes_ = 0;
+
+    std::deque<Job> jobs_;
+    std::mutex jobsMutex_;
+    std::condition_variable jobsReady_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    // Dedicated connection used only for LISTEN
+    PGconn *listenConn_ = nullptr;
+};
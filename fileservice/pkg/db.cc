@@ -3,6 +3,9 @@
 #include <vector>
 #include <tuple>
 #include <optional>
+#include <algorithm>
+#include <iterator>
+#include <ctime>
 
 std::shared_ptr<DB> DB::instance_ = nullptr;
 
@@ -39,6 +42,10 @@ DB::DB(const std::string& host, const std::string& port,
 
 DB::~DB()
 {
+    for (PGconn* conn : idle_)
+    {
+        PQfinish(conn);
+    }
     if (conn_)
     {
         PQfinish(conn_);
@@ -49,21 +56,383 @@ void DB::connect()
 {
     if (!conn_)
     {
-        std::string connInfo =
-                "host=" + host_ +
-                " port=" + port_ +
-                " dbname=" + dbname_ +
-                " user=" + user_ +
-                " password=" + password_;
-        conn_ = PQconnectdb(connInfo.c_str());
+        conn_ = openConnection();
+    }
+}
+
+PGconn* DB::openConnection()
+{
+    std::string connInfo =
+            "host=" + host_ +
+            " port=" + port_ +
+            " dbname=" + dbname_ +
+            " user=" + user_ +
+            " password=" + password_;
+    PGconn* conn = PQconnectdb(connInfo.c_str());
+
+    if (PQstatus(conn) != CONNECTION_OK)
+    {
+        std::cerr << "Connection to database failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+        return nullptr;
+    }
+
+    return conn;
+}
+
+// ===========================================================================
+//                           Транзакции
+// ===========================================================================
+namespace {
+
+// Выполняет служебную команду без параметров
+bool execCommand(PGconn* conn, const std::string& command)
+{
+    PGresult* res = PQexec(conn, command.c_str());
+    bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ok)
+    {
+        std::cerr << "Failed to execute " << command << ": " << PQerrorMessage(conn) << std::endl;
+    }
+    PQclear(res);
+    return ok;
+}
+
+// Массив целых в текстовом формате PostgreSQL: {1,2,3}
+template <typename T>
+std::string toPgIntArray(const std::vector<T>& values)
+{
+    std::string array = "{";
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (i > 0) array += ",";
+        array += std::to_string(values[i]);
+    }
+    array += "}";
+    return array;
+}
+
+// Массив строк в текстовом формате PostgreSQL: {"a","b \"c\""}
+std::string toPgTextArray(const std::vector<std::string>& values)
+{
+    std::string array = "{";
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (i > 0) array += ",";
+        array += '"';
+        for (char c : values[i])
+        {
+            if (c == '"' || c == '\\') array += '\\';
+            array += c;
+        }
+        array += '"';
+    }
+    array += "}";
+    return array;
+}
+
+// Таблица отсчётов истории использования для заданной детализации
+const char* usageTable(UsageResolution resolution)
+{
+    switch (resolution)
+    {
+        case UsageResolution::Minute: return "usage_samples_minute";
+        case UsageResolution::Hour: return "usage_samples_hour";
+        default: return "usage_samples_day";
+    }
+}
+
+// Дата в UTC: день, в который попадает момент time (секунды Unix), в заданном формате
+std::string utcDay(long long time, const char* format)
+{
+    std::time_t t = static_cast<std::time_t>(time);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), format, &tm);
+    return buffer;
+}
+
+// Scope pinned by DB::GroupScope on this thread
+thread_local const DB::GroupScope* pinnedGroups = nullptr;
+
+// Transaction pinned by DB::Transaction on this thread
+thread_local DB::Transaction* pinnedTransaction = nullptr;
+
+// Idle dedicated connections kept for transactions
+const size_t MAX_IDLE_CONNECTIONS = 8;
+
+} // namespace
+
+DB::Transaction::Transaction(DB& db)
+    : db_(db), outer_(pinnedTransaction)
+{
+    if (outer_)
+    {
+        // Nested: a savepoint in the transaction of the thread
+        if (outer_->open_)
+        {
+            conn_ = outer_->conn_;
+            depth_ = outer_->depth_ + 1;
+            savepoint_ = "sp_" + std::to_string(depth_);
+            open_ = execCommand(conn_, "SAVEPOINT " + savepoint_);
+        }
+    }
+    else
+    {
+        conn_ = db_.acquireConnection();
+        open_ = conn_ && execCommand(conn_, "BEGIN");
+    }
+    pinnedTransaction = this;
+}
+
+DB::Transaction::~Transaction()
+{
+    if (open_)
+    {
+        execCommand(conn_, outer_ ? "ROLLBACK TO SAVEPOINT " + savepoint_ : std::string("ROLLBACK"));
+    }
+    pinnedTransaction = outer_;
+    if (!outer_ && conn_)
+    {
+        db_.releaseConnection(conn_);
+    }
+}
+
+bool DB::Transaction::commit()
+{
+    if (!open_)
+    {
+        return false;
+    }
+    open_ = false;
+    return execCommand(conn_, outer_ ? "RELEASE SAVEPOINT " + savepoint_ : std::string("COMMIT"));
+}
+
+PGconn* DB::conn() const
+{
+    return pinnedTransaction ? pinnedTransaction->conn_ : conn_;
+}
+
+PGconn* DB::acquireConnection()
+{
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        while (!idle_.empty())
+        {
+            PGconn* conn = idle_.back();
+            idle_.pop_back();
+            if (PQstatus(conn) == CONNECTION_OK)
+            {
+                return conn;
+            }
+            PQfinish(conn);
+        }
+    }
+    return openConnection();
+}
+
+void DB::releaseConnection(PGconn* conn)
+{
+    // A connection left inside a transaction (e.g. a failed ROLLBACK) is not reused
+    if (PQstatus(conn) == CONNECTION_OK && PQtransactionStatus(conn) == PQTRANS_IDLE)
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        if (idle_.size() < MAX_IDLE_CONNECTIONS)
+        {
+            idle_.push_back(conn);
+            return;
+        }
+    }
+    PQfinish(conn);
+}
+
+DB::GroupScope::GroupScope(const std::string& user_id, const std::vector<int>& group_ids)
+    : previous_(pinnedGroups), user_id_(user_id), group_ids_(group_ids)
+{
+    pinnedGroups = this;
+}
+
+DB::GroupScope::~GroupScope()
+{
+    pinnedGroups = previous_;
+}
+
+// ===========================================================================
+//                           RowCursor
+// ===========================================================================
+RowCursor::RowCursor(PGconn* conn, bool ownsConnection)
+    : conn_(conn), ownsConnection_(ownsConnection)
+{
+}
+
+RowCursor::~RowCursor()
+{
+    discard();
+    if (ownsConnection_ && conn_)
+    {
+        PQfinish(conn_);
+    }
+}
+
+bool RowCursor::start(const std::string& query, int nParams, const char* const* paramValues)
+{
+    if (!conn_) return false;
+
+    if (!PQsendQueryParams(conn_, query.c_str(), nParams, nullptr, paramValues, nullptr, nullptr, 0))
+    {
+        std::cerr << "Failed to send query: " << PQerrorMessage(conn_) << std::endl;
+        failed_ = true;
+        return false;
+    }
+    active_ = true;
+
+    // Без single-row mode строки придут одним результатом, next() справится и с этим
+    if (!PQsetSingleRowMode(conn_))
+    {
+        std::cerr << "Single-row mode is unavailable, reading the whole result" << std::endl;
+    }
+    return true;
+}
+
+bool RowCursor::next()
+{
+    if (result_ && ++row_ < rowCount_)
+    {
+        return true;
+    }
+
+    while (active_)
+    {
+        if (result_)
+        {
+            PQclear(result_);
+            result_ = nullptr;
+        }
+
+        result_ = PQgetResult(conn_);
+        if (!result_)
+        {
+            active_ = false;
+            break;
+        }
+
+        ExecStatusType status = PQresultStatus(result_);
+        if (status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK)
+        {
+            row_ = 0;
+            rowCount_ = PQntuples(result_);
+            if (rowCount_ > 0)
+            {
+                return true;
+            }
+            // Завершающий пустой результат single-row mode
+            continue;
+        }
+
+        std::cerr << "Query failed: " << PQresultErrorMessage(result_) << std::endl;
+        failed_ = true;
+        discard();
+    }
+
+    return false;
+}
+
+void RowCursor::discard()
+{
+    if (result_)
+    {
+        PQclear(result_);
+        result_ = nullptr;
+    }
+
+    if (!active_) return;
+    active_ = false;
+
+    // The connection can be closed outright; a shared one has to be drained
+    if (ownsConnection_) return;
+
+    if (PGcancel* cancel = PQgetCancel(conn_))
+    {
+        char errbuf[256];
+        PQcancel(cancel, errbuf, sizeof(errbuf));
+        PQfreeCancel(cancel);
+    }
+    while (PGresult* res = PQgetResult(conn_))
+    {
+        PQclear(res);
+    }
+}
+
+CopyOutReader::CopyOutReader(PGconn* conn)
+    : conn_(conn)
+{
+}
+
+CopyOutReader::~CopyOutReader()
+{
+    if (buffer_)
+    {
+        PQfreemem(buffer_);
+    }
+    // Закрытие соединения прерывает незавершённый COPY
+    if (conn_)
+    {
+        PQfinish(conn_);
+    }
+}
+
+bool CopyOutReader::start(const std::string& query)
+{
+    if (!conn_) return false;
+
+    PGresult* res = PQexec(conn_, query.c_str());
+    bool ok = (PQresultStatus(res) == PGRES_COPY_OUT);
+    if (!ok)
+    {
+        std::cerr << "Failed to start COPY: " << PQerrorMessage(conn_) << std::endl;
+        failed_ = true;
+    }
+    PQclear(res);
+    active_ = ok;
+    return ok;
+}
+
+bool CopyOutReader::next(const char*& data, int& size)
+{
+    if (buffer_)
+    {
+        PQfreemem(buffer_);
+        buffer_ = nullptr;
+    }
+    if (!active_) return false;
+
+    size = PQgetCopyData(conn_, &buffer_, 0);
+    if (size > 0)
+    {
+        data = buffer_;
+        return true;
+    }
+
+    active_ = false;
+    if (size == -2)
+    {
+        std::cerr << "Failed to read COPY data: " << PQerrorMessage(conn_) << std::endl;
+        failed_ = true;
+        return false;
+    }
 
-        if (PQstatus(conn_) != CONNECTION_OK)
+    // Конец данных: итоговый результат команды
+    while (PGresult* res = PQgetResult(conn_))
+    {
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
         {
-            std::cerr << "Connection to database failed: " << PQerrorMessage(conn_) << std::endl;
-            PQfinish(conn_);
-            conn_ = nullptr;
+            std::cerr << "COPY failed: " << PQerrorMessage(conn_) << std::endl;
+            failed_ = true;
         }
+        PQclear(res);
     }
+    return false;
 }
 
 bool DB::init()
@@ -150,14 +519,28 @@ bool DB::init()
             );
         )",
 
-                    // Таблица логов активности пользователей
+                    // Журнал действий пользователей (ActivityLog; вход и изменения прав пишет сервис
+                    // аутентификации). Секции по дням в UTC создаются при записи и удаляются по истечении
+                    // срока хранения. Внешнего ключа на users нет: записи переживают пользователя,
+                    // а проверка ключа замедляла бы COPY. Индексы родителя создаются в каждой секции.
                     R"(
-            CREATE TABLE IF NOT EXISTS user_activity_logs (
-                log_id SERIAL PRIMARY KEY,
-                user_id INT REFERENCES users(user_id) ON DELETE SET NULL,
-                action VARCHAR(100) NOT NULL,
-                timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-            );
+            CREATE TABLE IF NOT EXISTS activity_log (
+                event_id BIGSERIAL,
+                occurred_at TIMESTAMP NOT NULL,
+                user_id INT,
+                action VARCHAR(32) NOT NULL,
+                object_id BIGINT,
+                detail TEXT
+            ) PARTITION BY RANGE (occurred_at);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS activity_log_time_idx ON activity_log (occurred_at, event_id);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS activity_log_user_idx ON activity_log (user_id, occurred_at, event_id);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS activity_log_action_idx ON activity_log (action, occurred_at, event_id);
         )",
 
                     // Таблица групп
@@ -176,36 +559,824 @@ bool DB::init()
                 group_id INT REFERENCES groups(group_id) ON DELETE CASCADE,
                 PRIMARY KEY (user_id, group_id)
             );
-        )"
-            };
+        )",
 
-    for (const auto& query : queries)
-    {
-        PGresult* res = PQexec(conn_, query.c_str());
-        if (PQresultStatus(res) != PGRES_COMMAND_OK)
-        {
-            std::cerr << "Failed to execute query: " << PQerrorMessage(conn_) << std::endl;
-            PQclear(res);
-            return false;
-        }
-        PQclear(res);
-    }
+                    // Уведомление об изменениях RBAC-таблиц (канал rbac_changed)
+                    R"(
+            CREATE OR REPLACE FUNCTION notify_rbac_change() RETURNS trigger AS $$
+            BEGIN
+                PERFORM pg_notify('rbac_changed', TG_TABLE_NAME);
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER rbac_changed_roles
+            AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON roles
+            FOR EACH STATEMENT EXECUTE FUNCTION notify_rbac_change();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER rbac_changed_permissions
+            AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON permissions
+            FOR EACH STATEMENT EXECUTE FUNCTION notify_rbac_change();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER rbac_changed_user_roles
+            AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON user_roles
+            FOR EACH STATEMENT EXECUTE FUNCTION notify_rbac_change();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER rbac_changed_role_permissions
+            AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON role_permissions
+            FOR EACH STATEMENT EXECUTE FUNCTION notify_rbac_change();
+        )",
 
-    return true;
-}
+                    // Журнал изменений файлов и папок для инкрементальной синхронизации.
+                    // Последний seq каждой области хранится в journal_heads; строка блокируется
+                    // до конца транзакции, поэтому внутри области seq фиксируются строго по порядку.
+                    R"(
+            CREATE TABLE IF NOT EXISTS journal_heads (
+                scope_type CHAR(1) NOT NULL,
+                scope_id INT NOT NULL,
+                seq BIGINT NOT NULL,
+                PRIMARY KEY (scope_type, scope_id)
+            );
+        )",
+                    R"(
+            CREATE TABLE IF NOT EXISTS change_journal (
+                scope_type CHAR(1) NOT NULL,
+                scope_id INT NOT NULL,
+                seq BIGINT NOT NULL,
+                entity VARCHAR(6) NOT NULL,
+                entity_id INT NOT NULL,
+                op VARCHAR(6) NOT NULL,
+                parent_id INT,
+                name VARCHAR(255),
+                file_size INT,
+                changed_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+                PRIMARY KEY (scope_type, scope_id, seq)
+            );
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION journal_append(item JSONB, entity TEXT, op TEXT) RETURNS void AS $$
+            DECLARE
+                st CHAR(1);
+                sid INT;
+                next_seq BIGINT;
+            BEGIN
+                IF item->>'group_id' IS NOT NULL THEN
+                    st := 'g';
+                    sid := (item->>'group_id')::INT;
+                ELSE
+                    st := 'u';
+                    sid := (item->>'user_id')::INT;
+                END IF;
+                IF sid IS NULL THEN
+                    RETURN;
+                END IF;
+
+                INSERT INTO journal_heads (scope_type, scope_id, seq) VALUES (st, sid, 1)
+                ON CONFLICT (scope_type, scope_id) DO UPDATE SET seq = journal_heads.seq + 1
+                RETURNING seq INTO next_seq;
+
+                INSERT INTO change_journal (scope_type, scope_id, seq, entity, entity_id, op, parent_id, name, file_size)
+                VALUES (st, sid, next_seq, entity, (item->>(entity || '_id'))::INT, op,
+                        (CASE WHEN entity = 'file' THEN item->>'folder_id' ELSE item->>'parent_folder_id' END)::INT,
+                        CASE WHEN op = 'upsert' THEN COALESCE(item->>'file_name', item->>'folder_name') END,
+                        CASE WHEN op = 'upsert' THEN (item->>'file_size')::INT END);
+
+                -- Индекс имён (NameIndex) обновляется по уведомлениям, доставляемым после COMMIT
+                PERFORM pg_notify('name_changes', json_build_object(
+                    'e', entity, 'op', op, 'id', (item->>(entity || '_id'))::INT,
+                    'u', (item->>'user_id')::INT, 'g', COALESCE((item->>'group_id')::INT, 0),
+                    'p', COALESCE((CASE WHEN entity = 'file' THEN item->>'folder_id' ELSE item->>'parent_folder_id' END)::INT, 0),
+                    'n', COALESCE(item->>'file_name', item->>'folder_name'))::TEXT);
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    // Версии списков для ETag: scope 'd' — содержимое папки (key — folder_id), 'u' и 'g' —
+                    // корень пользователя или группы, 'v' — избранное пользователя. Счётчики только растут,
+                    // так что сумма версий списка меняется при любом изменении одной из них.
+                    R"(
+            CREATE TABLE IF NOT EXISTS listing_versions (
+                scope_type CHAR(1) NOT NULL,
+                scope_id INT NOT NULL,
+                version BIGINT NOT NULL,
+                PRIMARY KEY (scope_type, scope_id)
+            );
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION listing_touch(p_scope CHAR(1), p_id INT) RETURNS void AS $$
+                INSERT INTO listing_versions (scope_type, scope_id, version) VALUES (p_scope, p_id, 1)
+                ON CONFLICT (scope_type, scope_id) DO UPDATE SET version = listing_versions.version + 1;
+            $$ LANGUAGE sql;
+        )",
+                    // Личный объект в корне виден в корне владельца, общий — ещё и в корне группы
+                    R"(
+            CREATE OR REPLACE FUNCTION listing_touch_item(item JSONB, entity TEXT) RETURNS void AS $$
+            DECLARE
+                parent INT := (CASE WHEN entity = 'file' THEN item->>'folder_id' ELSE item->>'parent_folder_id' END)::INT;
+            BEGIN
+                IF parent IS NOT NULL THEN
+                    PERFORM listing_touch('d', parent);
+                ELSE
+                    PERFORM listing_touch('u', (item->>'user_id')::INT);
+                    IF item->>'group_id' IS NOT NULL THEN
+                        PERFORM listing_touch('g', (item->>'group_id')::INT);
+                    END IF;
+                END IF;
+                IF COALESCE((item->>'is_favorite')::BOOLEAN, FALSE) THEN
+                    PERFORM listing_touch('v', (item->>'user_id')::INT);
+                END IF;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION journal_change() RETURNS trigger AS $$
+            DECLARE
+                entity TEXT := CASE WHEN TG_TABLE_NAME = 'files' THEN 'file' ELSE 'folder' END;
+                old_item JSONB := CASE WHEN TG_OP <> 'INSERT' THEN to_jsonb(OLD) END;
+                new_item JSONB := CASE WHEN TG_OP <> 'DELETE' THEN to_jsonb(NEW) END;
+            BEGIN
+                -- Объект, сменивший область (например, группа удалена), удаляется из старой
+                IF old_item IS NOT NULL AND (new_item IS NULL
+                        OR old_item->'group_id' IS DISTINCT FROM new_item->'group_id'
+                        OR old_item->'user_id' IS DISTINCT FROM new_item->'user_id') THEN
+                    PERFORM journal_append(old_item, entity, 'delete');
+                END IF;
+                IF new_item IS NOT NULL THEN
+                    PERFORM journal_append(new_item, entity, 'upsert');
+                END IF;
+                -- Списки, в которых объект был и стал виден
+                IF old_item IS NOT NULL THEN
+                    PERFORM listing_touch_item(old_item, entity);
+                END IF;
+                IF new_item IS NOT NULL THEN
+                    PERFORM listing_touch_item(new_item, entity);
+                END IF;
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER journal_files
+            AFTER INSERT OR UPDATE OR DELETE ON files
+            FOR EACH ROW EXECUTE FUNCTION journal_change();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER journal_folders
+            AFTER INSERT OR UPDATE OR DELETE ON folders
+            FOR EACH ROW EXECUTE FUNCTION journal_change();
+        )",
 
-PGconn* DB::getConnection()
-{
-    return conn_;
-}
+                    // Поиск по пути: дочерний элемент по (родитель, имя); корень хранится как NULL
+                    R"(
+            CREATE INDEX IF NOT EXISTS folders_parent_name_idx
+            ON folders ((COALESCE(parent_folder_id, 0)), folder_name);
+        )",
+                    // Постраничные списки администратора: (user_id, id)
+                    R"(
+            CREATE INDEX IF NOT EXISTS files_user_file_idx ON files (user_id, file_id);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS folders_user_folder_idx ON folders (user_id, folder_id);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS files_folder_name_idx
+            ON files ((COALESCE(folder_id, 0)), file_name);
+        )",
+                    // Прежняя версия получала группы пользователя параметром
+                    R"(
+            DROP FUNCTION IF EXISTS ensure_folder_path(INT, TEXT[], INT[], INT);
+        )",
+                    // mkdir -p: находит или создаёт каждую папку пути. Одноимённые папки, созданные
+                    // параллельно под одним родителем, исключаются advisory-блокировкой на (родитель, имя).
+                    // Группы пользователя читаются здесь же; если он не состоит в p_group_id, строк нет.
+                    R"(
+            CREATE OR REPLACE FUNCTION ensure_folder_path(p_user_id INT, p_names TEXT[], p_group_id INT)
+            RETURNS TABLE(component INT, resolved_id INT, resolved_group INT, was_created BOOLEAN) AS $$
+            DECLARE
+                parent INT := 0;
+                parent_group INT := NULL;
+                new_group INT;
+                user_group_ids INT[];
+            BEGIN
+                SELECT COALESCE(array_agg(ug.group_id), '{}') INTO user_group_ids
+                FROM user_groups ug
+                WHERE ug.user_id = p_user_id;
+
+                IF p_group_id > 0 AND NOT p_group_id = ANY(user_group_ids) THEN
+                    RETURN;
+                END IF;
+
+                FOR i IN 1 .. COALESCE(cardinality(p_names), 0) LOOP
+                    component := i;
+                    was_created := FALSE;
+                    resolved_id := NULL;
+
+                    SELECT f.folder_id, f.group_id INTO resolved_id, resolved_group
+                    FROM folders f
+                    WHERE COALESCE(f.parent_folder_id, 0) = parent AND f.folder_name = p_names[i]
+                      AND (f.user_id = p_user_id OR f.group_id = ANY(user_group_ids))
+                    ORDER BY (f.user_id = p_user_id) DESC, f.folder_id
+                    LIMIT 1;
+
+                    IF resolved_id IS NULL THEN
+                        -- Корень у каждого пользователя свой
+                        PERFORM pg_advisory_xact_lock(CASE WHEN parent = 0 THEN -p_user_id ELSE parent END,
+                                                      hashtext(p_names[i]));
+                        SELECT f.folder_id, f.group_id INTO resolved_id, resolved_group
+                        FROM folders f
+                        WHERE COALESCE(f.parent_folder_id, 0) = parent AND f.folder_name = p_names[i]
+                          AND (f.user_id = p_user_id OR f.group_id = ANY(user_group_ids))
+                        ORDER BY (f.user_id = p_user_id) DESC, f.folder_id
+                        LIMIT 1;
+                    END IF;
+
+                    IF resolved_id IS NULL THEN
+                        -- Новые папки наследуют группу родителя, если группа не задана явно
+                        new_group := COALESCE(NULLIF(p_group_id, 0), parent_group);
+                        INSERT INTO folders (user_id, folder_name, parent_folder_id, folder_type, group_id)
+                        VALUES (p_user_id, p_names[i], NULLIF(parent, 0),
+                                CASE WHEN new_group IS NOT NULL THEN 'shared' ELSE 'personal' END, new_group)
+                        RETURNING folders.folder_id INTO resolved_id;
+                        resolved_group := new_group;
+                        was_created := TRUE;
+                    END IF;
+
+                    RETURN NEXT;
+                    parent := resolved_id;
+                    parent_group := resolved_group;
+                END LOOP;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
 
-// ===========================================================================
-//                           Методы для работы с файлами
-// ===========================================================================
-std::vector<std::tuple<int, std::string, int, std::string>> DB::getFiles(const std::string& user_id, int folder_id)
-{
+                    // Счётчики для статистики администратора, обновляются триггерами в той же транзакции.
+                    // scope: 'f' все файлы, 'u' файлы пользователя, 'p' его личные файлы (не в группе),
+                    // 'g' файлы группы, 'e' файлы по расширению (key — user_id, group_id или расширение),
+                    // 'd' папки, 'a' пользователи.
+                    // Общие строки разбиты на slot по backend, чтобы параллельные загрузки не ждали одну строку;
+                    // строки пользователей не разбиваются (slot 0), топ по объёму берётся по индексу.
+                    R"(
+            CREATE TABLE IF NOT EXISTS storage_stats (
+                scope CHAR(1) NOT NULL,
+                key TEXT NOT NULL,
+                slot SMALLINT NOT NULL DEFAULT 0,
+                item_count BIGINT NOT NULL DEFAULT 0,
+                byte_count BIGINT NOT NULL DEFAULT 0,
+                PRIMARY KEY (scope, key, slot)
+            );
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS storage_stats_user_bytes_idx
+            ON storage_stats (byte_count DESC) WHERE scope = 'u';
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION file_extension(name TEXT) RETURNS TEXT AS $$
+                SELECT COALESCE(LOWER(substring(name FROM '\.([^.]*)$')), 'no_extension');
+            $$ LANGUAGE sql IMMUTABLE;
+        )",
+                    // Один запрос на оператор: изменения агрегируются по transition-таблицам,
+                    // так что удаление папки с тысячами файлов обновляет каждый счётчик один раз
+                    R"(
+            CREATE OR REPLACE FUNCTION storage_stats_files() RETURNS trigger AS $$
+            DECLARE
+                changed TEXT := CASE TG_OP
+                    WHEN 'INSERT' THEN 'SELECT user_id, group_id, file_name, file_size, 1 AS sign FROM new_rows'
+                    WHEN 'DELETE' THEN 'SELECT user_id, group_id, file_name, file_size, -1 AS sign FROM old_rows'
+                    ELSE 'SELECT user_id, group_id, file_name, file_size, 1 AS sign FROM new_rows
+                          UNION ALL SELECT user_id, group_id, file_name, file_size, -1 FROM old_rows'
+                END;
+            BEGIN
+                EXECUTE format($q$
+                    WITH changed AS (%s),
+                    delta AS (
+                        SELECT 'f' AS scope, '' AS key, SUM(sign) AS items,
+                               SUM(sign * COALESCE(file_size, 0)::BIGINT) AS bytes
+                        FROM changed
+                        UNION ALL
+                        SELECT 'u', user_id::TEXT, SUM(sign), SUM(sign * COALESCE(file_size, 0)::BIGINT)
+                        FROM changed GROUP BY user_id
+                        UNION ALL
+                        SELECT 'p', user_id::TEXT, SUM(sign), SUM(sign * COALESCE(file_size, 0)::BIGINT)
+                        FROM changed WHERE group_id IS NULL GROUP BY user_id
+                        UNION ALL
+                        SELECT 'g', group_id::TEXT, SUM(sign), SUM(sign * COALESCE(file_size, 0)::BIGINT)
+                        FROM changed WHERE group_id IS NOT NULL GROUP BY group_id
+                        UNION ALL
+                        SELECT 'e', file_extension(file_name), SUM(sign), SUM(sign * COALESCE(file_size, 0)::BIGINT)
+                        FROM changed GROUP BY 2
+                    )
+                    INSERT INTO storage_stats AS s (scope, key, slot, item_count, byte_count)
+                    SELECT scope, key, CASE WHEN scope = 'u' THEN 0 ELSE mod(pg_backend_pid(), 8) END, items, bytes
+                    FROM delta
+                    WHERE items <> 0 OR bytes <> 0
+                    ORDER BY scope, key
+                    ON CONFLICT (scope, key, slot) DO UPDATE
+                    SET item_count = s.item_count + EXCLUDED.item_count,
+                        byte_count = s.byte_count + EXCLUDED.byte_count
+                $q$, changed);
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_files_insert
+            AFTER INSERT ON files REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_files();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_files_update
+            AFTER UPDATE ON files REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_files();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_files_delete
+            AFTER DELETE ON files REFERENCING OLD TABLE AS old_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_files();
+        )",
+                    // Количество строк папок и пользователей; TG_ARGV[0] — scope
+                    R"(
+            CREATE OR REPLACE FUNCTION storage_stats_count() RETURNS trigger AS $$
+            DECLARE
+                delta BIGINT;
+            BEGIN
+                IF TG_OP = 'INSERT' THEN
+                    SELECT COUNT(*) INTO delta FROM new_rows;
+                ELSE
+                    SELECT -COUNT(*) INTO delta FROM old_rows;
+                END IF;
+                IF delta <> 0 THEN
+                    INSERT INTO storage_stats AS s (scope, key, slot, item_count)
+                    VALUES (TG_ARGV[0], '', mod(pg_backend_pid(), 8), delta)
+                    ON CONFLICT (scope, key, slot) DO UPDATE SET item_count = s.item_count + EXCLUDED.item_count;
+                END IF;
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_folders_insert
+            AFTER INSERT ON folders REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_count('d');
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_folders_delete
+            AFTER DELETE ON folders REFERENCING OLD TABLE AS old_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_count('d');
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_users_insert
+            AFTER INSERT ON users REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_count('a');
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER storage_stats_users_delete
+            AFTER DELETE ON users REFERENCING OLD TABLE AS old_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION storage_stats_count('a');
+        )",
+
+                    // История использования (UsageSampler): поминутные отсчёты в дневных секциях,
+                    // которые удаляются целиком по истечении срока хранения, и свёртки по часам и дням.
+                    // scope: 's' вся система (key 0), 'u' пользователь, 'g' группа; bucket — начало интервала в UTC
+                    R"(
+            CREATE TABLE IF NOT EXISTS usage_samples_minute (
+                bucket TIMESTAMP NOT NULL,
+                scope CHAR(1) NOT NULL,
+                key INT NOT NULL,
+                storage_bytes BIGINT NOT NULL,
+                files_count BIGINT NOT NULL,
+                active_users INT NOT NULL,
+                upload_bytes BIGINT NOT NULL,
+                download_bytes BIGINT NOT NULL,
+                PRIMARY KEY (scope, key, bucket)
+            ) PARTITION BY RANGE (bucket);
+        )",
+                    R"(
+            CREATE TABLE IF NOT EXISTS usage_samples_hour (
+                bucket TIMESTAMP NOT NULL,
+                scope CHAR(1) NOT NULL,
+                key INT NOT NULL,
+                storage_bytes BIGINT NOT NULL,
+                files_count BIGINT NOT NULL,
+                active_users INT NOT NULL,
+                upload_bytes BIGINT NOT NULL,
+                download_bytes BIGINT NOT NULL,
+                PRIMARY KEY (scope, key, bucket)
+            );
+        )",
+                    R"(
+            CREATE TABLE IF NOT EXISTS usage_samples_day (
+                bucket TIMESTAMP NOT NULL,
+                scope CHAR(1) NOT NULL,
+                key INT NOT NULL,
+                storage_bytes BIGINT NOT NULL,
+                files_count BIGINT NOT NULL,
+                active_users INT NOT NULL,
+                upload_bytes BIGINT NOT NULL,
+                download_bytes BIGINT NOT NULL,
+                PRIMARY KEY (scope, key, bucket)
+            );
+        )",
+                    // Свёртки и удаление старых отсчётов выбирают строки по времени
+                    R"(
+            CREATE INDEX IF NOT EXISTS usage_samples_minute_bucket_idx ON usage_samples_minute (bucket);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS usage_samples_hour_bucket_idx ON usage_samples_hour (bucket);
+        )",
+
+                    // Контрольные точки скетчей аналитики (Analytics): число различных пользователей
+                    // (HyperLogLog) и самые популярные файлы и папки (Space-Saving) текущего
+                    // и предыдущего часа и дня, общие для всех экземпляров: каждый добавляет свои данные
+                    R"(
+            CREATE TABLE IF NOT EXISTS analytics_checkpoints (
+                name VARCHAR(32) PRIMARY KEY,
+                period_start BIGINT NOT NULL,
+                users BYTEA NOT NULL,
+                files BYTEA NOT NULL,
+                folders BYTEA NOT NULL,
+                saved_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+            );
+        )",
+
+                    // Хэши содержимого файлов на диске (DuplicateScanner), по одному на имя файла;
+                    // размер и время изменения позволяют не читать неизменившиеся файлы повторно
+                    R"(
+            CREATE TABLE IF NOT EXISTS file_digests (
+                file_name TEXT PRIMARY KEY,
+                file_size BIGINT NOT NULL,
+                mtime BIGINT NOT NULL,
+                digest BYTEA NOT NULL,
+                hashed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+            );
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS file_digests_digest_idx ON file_digests (digest);
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS files_file_name_idx ON files (file_name);
+        )",
+                    // Ход последнего поиска дубликатов; finished_at = 0, пока он не завершён
+                    R"(
+            CREATE TABLE IF NOT EXISTS duplicate_scan_state (
+                id INT PRIMARY KEY CHECK (id = 1),
+                started_at BIGINT NOT NULL,
+                finished_at BIGINT NOT NULL,
+                candidates BIGINT NOT NULL,
+                hashed BIGINT NOT NULL,
+                bytes_hashed BIGINT NOT NULL
+            );
+        )",
+
+                    // Квоты на объём (QuotaManager): scope 'u' — пользователь, 'g' — группа; 0 — без ограничения.
+                    // Без строки действует квота по умолчанию из config.json
+                    R"(
+            CREATE TABLE IF NOT EXISTS storage_quotas (
+                scope CHAR(1) NOT NULL CHECK (scope IN ('u', 'g')),
+                key INT NOT NULL,
+                byte_limit BIGINT NOT NULL CHECK (byte_limit >= 0),
+                updated_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+                PRIMARY KEY (scope, key)
+            );
+        )",
+
+                    // Очередь фоновых задач (JobQueue). state: queued, running, done, failed, cancelled;
+                    // locked_by — процесс, выполняющий задачу, heartbeat_at — его последний отклик
+                    R"(
+            CREATE TABLE IF NOT EXISTS jobs (
+                job_id BIGSERIAL PRIMARY KEY,
+                kind VARCHAR(64) NOT NULL,
+                payload JSONB NOT NULL DEFAULT '{}',
+                priority INT NOT NULL DEFAULT 0,
+                singleton BOOLEAN NOT NULL DEFAULT FALSE,
+                state VARCHAR(16) NOT NULL DEFAULT 'queued',
+                attempts INT NOT NULL DEFAULT 0,
+                max_attempts INT NOT NULL DEFAULT 5,
+                run_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+                locked_by TEXT,
+                heartbeat_at TIMESTAMP,
+                progress_done BIGINT NOT NULL DEFAULT 0,
+                progress_total BIGINT NOT NULL DEFAULT 0,
+                message TEXT,
+                last_error TEXT,
+                created_by INT,
+                created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+                started_at TIMESTAMP,
+                finished_at TIMESTAMP
+            );
+        )",
+                    // Готовые к выполнению задачи в порядке выборки
+                    R"(
+            CREATE INDEX IF NOT EXISTS jobs_ready_idx ON jobs (priority DESC, run_at, job_id) WHERE state = 'queued';
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS jobs_running_idx ON jobs (locked_by) WHERE state = 'running';
+        )",
+                    // Не больше одной ожидающей или выполняемой задачи каждого одиночного вида
+                    R"(
+            CREATE UNIQUE INDEX IF NOT EXISTS jobs_singleton_idx ON jobs (kind)
+            WHERE singleton AND state IN ('queued', 'running');
+        )",
+                    R"(
+            CREATE INDEX IF NOT EXISTS jobs_state_idx ON jobs (state, job_id);
+        )",
+
+                    // Размеры папок с учётом вложенных (FolderSizes). Триггеры только дописывают события
+                    // в folder_size_events, поэтому параллельные загрузки не блокируют строки предков;
+                    // apply_folder_size_events применяет их пачками. folder_stats хранит собственную копию
+                    // дерева (parent_id на момент последнего применённого события), так что события
+                    // удалённых и перемещённых папок применяются независимо от порядка фиксации.
+                    R"(
+            CREATE TABLE IF NOT EXISTS folder_stats (
+                folder_id INT PRIMARY KEY,
+                parent_id INT,
+                total_bytes BIGINT NOT NULL DEFAULT 0,
+                file_count BIGINT NOT NULL DEFAULT 0,
+                subfolder_count BIGINT NOT NULL DEFAULT 0
+            );
+        )",
+                    // kind: 'c' папка создана, 'd' удалена, 'm' перемещена (parent_id — новый родитель),
+                    // 's' изменение файлов непосредственно в папке
+                    R"(
+            CREATE TABLE IF NOT EXISTS folder_size_events (
+                event_id BIGSERIAL PRIMARY KEY,
+                kind CHAR(1) NOT NULL,
+                folder_id INT NOT NULL,
+                parent_id INT,
+                bytes BIGINT NOT NULL DEFAULT 0,
+                files BIGINT NOT NULL DEFAULT 0
+            );
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION folder_size_files() RETURNS trigger AS $$
+            DECLARE
+                changed TEXT := CASE TG_OP
+                    WHEN 'INSERT' THEN 'SELECT folder_id, file_size, 1 AS sign FROM new_rows'
+                    WHEN 'DELETE' THEN 'SELECT folder_id, file_size, -1 AS sign FROM old_rows'
+                    ELSE 'SELECT folder_id, file_size, 1 AS sign FROM new_rows
+                          UNION ALL SELECT folder_id, file_size, -1 FROM old_rows'
+                END;
+            BEGIN
+                EXECUTE format($q$
+                    INSERT INTO folder_size_events (kind, folder_id, bytes, files)
+                    SELECT 's', folder_id, SUM(sign * COALESCE(file_size, 0)::BIGINT), SUM(sign)
+                    FROM (%s) changed
+                    WHERE folder_id IS NOT NULL
+                    GROUP BY folder_id
+                    HAVING SUM(sign) <> 0 OR SUM(sign * COALESCE(file_size, 0)::BIGINT) <> 0
+                $q$, changed);
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_files_insert
+            AFTER INSERT ON files REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_files();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_files_update
+            AFTER UPDATE ON files REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_files();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_files_delete
+            AFTER DELETE ON files REFERENCING OLD TABLE AS old_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_files();
+        )",
+                    R"(
+            CREATE OR REPLACE FUNCTION folder_size_folders() RETURNS trigger AS $$
+            BEGIN
+                IF TG_OP = 'INSERT' THEN
+                    INSERT INTO folder_size_events (kind, folder_id, parent_id)
+                    SELECT 'c', folder_id, parent_folder_id FROM new_rows ORDER BY folder_id;
+                ELSIF TG_OP = 'DELETE' THEN
+                    INSERT INTO folder_size_events (kind, folder_id)
+                    SELECT 'd', folder_id FROM old_rows ORDER BY folder_id;
+                ELSE
+                    INSERT INTO folder_size_events (kind, folder_id, parent_id)
+                    SELECT 'm', n.folder_id, n.parent_folder_id
+                    FROM new_rows n
+                    JOIN old_rows o ON o.folder_id = n.folder_id
+                    WHERE n.parent_folder_id IS DISTINCT FROM o.parent_folder_id
+                    ORDER BY n.folder_id;
+                END IF;
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_folders_insert
+            AFTER INSERT ON folders REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_folders();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_folders_update
+            AFTER UPDATE ON folders REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_folders();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER folder_size_folders_delete
+            AFTER DELETE ON folders REFERENCING OLD TABLE AS old_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION folder_size_folders();
+        )",
+                    // Размеры папок видны в списке их родителя (и в избранном владельца)
+                    R"(
+            CREATE OR REPLACE FUNCTION listing_touch_stats() RETURNS trigger AS $$
+            BEGIN
+                INSERT INTO listing_versions (scope_type, scope_id, version)
+                SELECT DISTINCT k.scope_type, k.scope_id, 1
+                FROM new_rows s
+                JOIN folders f ON f.folder_id = s.folder_id
+                CROSS JOIN LATERAL (VALUES
+                    (CASE WHEN f.parent_folder_id IS NOT NULL THEN 'd' ELSE 'u' END,
+                     COALESCE(f.parent_folder_id, f.user_id)),
+                    (CASE WHEN f.parent_folder_id IS NULL AND f.group_id IS NOT NULL THEN 'g' END, f.group_id),
+                    (CASE WHEN f.is_favorite THEN 'v' END, f.user_id)
+                ) AS k(scope_type, scope_id)
+                WHERE k.scope_type IS NOT NULL
+                ORDER BY 1, 2
+                ON CONFLICT (scope_type, scope_id) DO UPDATE SET version = listing_versions.version + 1;
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER listing_touch_stats_insert
+            AFTER INSERT ON folder_stats REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION listing_touch_stats();
+        )",
+                    R"(
+            CREATE OR REPLACE TRIGGER listing_touch_stats_update
+            AFTER UPDATE ON folder_stats REFERENCING NEW TABLE AS new_rows
+            FOR EACH STATEMENT EXECUTE FUNCTION listing_touch_stats();
+        )",
+                    // Прибавляет значения к папке и всем её предкам; возвращает папки, чьи списки изменились
+                    R"(
+            CREATE OR REPLACE FUNCTION folder_stats_add(p_start INT, p_bytes BIGINT, p_files BIGINT, p_folders BIGINT)
+            RETURNS SETOF INT AS $$
+                WITH RECURSIVE chain AS (
+                    SELECT folder_id, parent_id FROM folder_stats WHERE folder_id = p_start
+                    UNION
+                    SELECT s.folder_id, s.parent_id FROM folder_stats s JOIN chain c ON s.folder_id = c.parent_id
+                )
+                UPDATE folder_stats s
+                SET total_bytes = s.total_bytes + p_bytes,
+                    file_count = s.file_count + p_files,
+                    subfolder_count = s.subfolder_count + p_folders
+                FROM chain
+                WHERE s.folder_id = chain.folder_id
+                RETURNING COALESCE(s.parent_id, 0);
+            $$ LANGUAGE sql;
+        )",
+                    // Структурные события применяются по порядку, изменения файлов суммируются по папкам
+                    // и поднимаются к предкам одним UPDATE на папку. Такой порядок даёт тот же результат,
+                    // что и последовательное применение: изменения удалённой папки вычитаются вместе с ней
+                    // или пропускаются, перемещение переносит итоги папки вместе с её изменениями.
+                    R"(
+            CREATE OR REPLACE FUNCTION apply_folder_size_events(max_events INT) RETURNS SETOF INT AS $$
+            DECLARE
+                batch BIGINT[];
+                ev RECORD;
+                st folder_stats%ROWTYPE;
+            BEGIN
+                -- Один применяющий на базу
+                IF NOT pg_try_advisory_xact_lock(hashtext('folder_size_events')) THEN
+                    RETURN;
+                END IF;
+
+                batch := ARRAY(SELECT event_id FROM folder_size_events ORDER BY event_id LIMIT max_events);
+                IF cardinality(batch) = 0 THEN
+                    RETURN;
+                END IF;
+
+                FOR ev IN SELECT * FROM folder_size_events
+                          WHERE event_id = ANY(batch) AND kind <> 's' ORDER BY event_id LOOP
+                    IF ev.kind = 'c' THEN
+                        INSERT INTO folder_stats (folder_id, parent_id) VALUES (ev.folder_id, ev.parent_id)
+                        ON CONFLICT (folder_id) DO NOTHING;
+                        IF FOUND THEN
+                            RETURN QUERY SELECT folder_stats_add(ev.parent_id, 0, 0, 1);
+                        END IF;
+                    ELSE
+                        SELECT * INTO st FROM folder_stats WHERE folder_id = ev.folder_id;
+                        IF NOT FOUND THEN
+                            CONTINUE;
+                        END IF;
+                        IF ev.kind = 'd' THEN
+                            RETURN QUERY SELECT folder_stats_add(st.parent_id, -st.total_bytes, -st.file_count,
+                                                                 -(st.subfolder_count + 1));
+                            DELETE FROM folder_stats WHERE folder_id = ev.folder_id;
+                        ELSIF st.parent_id IS DISTINCT FROM ev.parent_id THEN
+                            RETURN QUERY SELECT folder_stats_add(st.parent_id, -st.total_bytes, -st.file_count,
+                                                                 -(st.subfolder_count + 1));
+                            UPDATE folder_stats SET parent_id = ev.parent_id WHERE folder_id = ev.folder_id;
+                            RETURN QUERY SELECT folder_stats_add(ev.parent_id, st.total_bytes, st.file_count,
+                                                                 st.subfolder_count + 1);
+                        END IF;
+                    END IF;
+                END LOOP;
+
+                RETURN QUERY
+                WITH RECURSIVE delta AS (
+                    SELECT folder_id, SUM(bytes) AS bytes, SUM(files) AS files
+                    FROM folder_size_events
+                    WHERE event_id = ANY(batch) AND kind = 's'
+                    GROUP BY folder_id
+                ),
+                chain AS (
+                    SELECT s.folder_id AS origin, s.folder_id, s.parent_id
+                    FROM delta d JOIN folder_stats s ON s.folder_id = d.folder_id
+                    UNION
+                    SELECT c.origin, s.folder_id, s.parent_id
+                    FROM chain c JOIN folder_stats s ON s.folder_id = c.parent_id
+                ),
+                totals AS (
+                    SELECT c.folder_id, SUM(d.bytes) AS bytes, SUM(d.files) AS files
+                    FROM chain c JOIN delta d ON d.folder_id = c.origin
+                    GROUP BY c.folder_id
+                ),
+                updated AS (
+                    UPDATE folder_stats s
+                    SET total_bytes = s.total_bytes + t.bytes, file_count = s.file_count + t.files
+                    FROM totals t
+                    WHERE s.folder_id = t.folder_id
+                    RETURNING COALESCE(s.parent_id, 0) AS listing_id
+                )
+                SELECT listing_id FROM updated;
+
+                DELETE FROM folder_size_events WHERE event_id = ANY(batch);
+            END;
+            $$ LANGUAGE plpgsql;
+        )",
+                    // Полный пересчёт; вызывается в транзакции REPEATABLE READ, так что удаляются ровно
+                    // те события, которые уже учтены в снимке
+                    R"(
+            CREATE OR REPLACE FUNCTION rebuild_folder_stats() RETURNS BOOLEAN AS $$
+            BEGIN
+                IF NOT pg_try_advisory_xact_lock(hashtext('folder_size_events')) THEN
+                    RETURN FALSE;
+                END IF;
+
+                DELETE FROM folder_size_events;
+                DELETE FROM folder_stats;
+
+                INSERT INTO folder_stats (folder_id, parent_id, total_bytes, file_count, subfolder_count)
+                WITH RECURSIVE closure AS (
+                    SELECT folder_id AS ancestor, folder_id AS descendant FROM folders
+                    UNION ALL
+                    SELECT c.ancestor, f.folder_id FROM closure c JOIN folders f ON f.parent_folder_id = c.descendant
+                ),
+                direct AS (
+                    SELECT folder_id, SUM(COALESCE(file_size, 0)::BIGINT) AS bytes, COUNT(*) AS files
+                    FROM files
+                    WHERE folder_id IS NOT NULL
+                    GROUP BY folder_id
+                ),
+                subtree AS (
+                    SELECT c.ancestor, SUM(COALESCE(d.bytes, 0)) AS bytes, SUM(COALESCE(d.files, 0)) AS files,
+                           COUNT(*) - 1 AS folders
+                    FROM closure c LEFT JOIN direct d ON d.folder_id = c.descendant
+                    GROUP BY c.ancestor
+                )
+                SELECT f.folder_id, f.parent_folder_id, t.bytes, t.files, t.folders
+                FROM folders f JOIN subtree t ON t.ancestor = f.folder_id;
+
+                RETURN TRUE;
+            END;
+            $$ LANGUAGE plpgsql;
+        )"
+            };
+
+    for (const auto& query : queries)
+    {
+        PGresult* res = PQexec(conn_, query.c_str());
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            std::cerr << "Failed to execute query: " << PQerrorMessage(conn_) << std::endl;
+            PQclear(res);
+            return false;
+        }
+        PQclear(res);
+    }
+
+    return true;
+}
+
+PGconn* DB::getConnection()
+{
+    return conn_;
+}
+
+// ===========================================================================
+//                           Методы для работы с файлами
+// ===========================================================================
+std::vector<std::tuple<int, std::string, int, std::string>> DB::getFiles(const std::string& user_id, int folder_id)
+{
     std::vector<std::tuple<int, std::string, int, std::string>> files;
-    if (!conn_) return files;
+    if (!conn()) return files;
 
     // Если folder_id == 0 => folder_id IS NULL
     // Иначе folder_id = $2
@@ -247,10 +1418,10 @@ std::vector<std::tuple<int, std::string, int, std::string>> DB::getFiles(const s
 
     int paramCount = (folder_id == 0) ? 1 : 2;
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Query failed: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Query failed: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return files;
     }
@@ -272,7 +1443,7 @@ std::vector<std::tuple<int, std::string, int, std::string>> DB::getFiles(const s
 
 bool DB::insertFile(const std::string& user_id, int folder_id, const std::string& file_name, int file_size)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Если folder_id > 0 => проверяем, что такая папка существует
     // Если folder_id == 0 => трактуем как NULL (корневая директория)
@@ -286,10 +1457,10 @@ bool DB::insertFile(const std::string& user_id, int folder_id, const std::string
         folderParamValues[0] = folderIdStr.c_str();
         folderParamValues[1] = user_id.c_str();
 
-        PGresult* folderRes = PQexecParams(conn_, checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
+        PGresult* folderRes = PQexecParams(conn(), checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
         if (PQresultStatus(folderRes) != PGRES_TUPLES_OK)
         {
-            std::cerr << "Failed to check folder: " << PQerrorMessage(conn_) << std::endl;
+            std::cerr << "Failed to check folder: " << PQerrorMessage(conn()) << std::endl;
             PQclear(folderRes);
             return false;
         }
@@ -328,10 +1499,10 @@ bool DB::insertFile(const std::string& user_id, int folder_id, const std::string
     std::string fileSizeStr = std::to_string(file_size);
     paramValues[3] = fileSizeStr.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 4, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 4, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to insert file: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to insert file: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -342,7 +1513,7 @@ bool DB::insertFile(const std::string& user_id, int folder_id, const std::string
 
 bool DB::deleteFile(const std::string& user_id, int file_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     std::string query = R"(
         DELETE FROM files
@@ -353,10 +1524,10 @@ bool DB::deleteFile(const std::string& user_id, int file_id)
     paramValues[0] = fileIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to delete file: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to delete file: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -365,12 +1536,12 @@ bool DB::deleteFile(const std::string& user_id, int file_id)
     return true;
 }
 
-std::optional<std::string> DB::getFilePath(const std::string& user_id, int file_id)
+std::optional<std::string> DB::getFilePath(const std::string& user_id, int file_id, int* group_id)
 {
-    if (!conn_) return std::nullopt;
+    if (!conn()) return std::nullopt;
 
     std::string query = R"(
-        SELECT f.file_name
+        SELECT f.file_name, COALESCE(f.group_id, 0)
         FROM files f
         WHERE f.file_id = $1 AND f.user_id = $2;
     )";
@@ -379,10 +1550,10 @@ std::optional<std::string> DB::getFilePath(const std::string& user_id, int file_
     paramValues[0] = fileIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get file path: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get file path: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return std::nullopt;
     }
@@ -390,6 +1561,10 @@ std::optional<std::string> DB::getFilePath(const std::string& user_id, int file_
     if (PQntuples(res) > 0)
     {
         std::string file_name = PQgetvalue(res, 0, 0);
+        if (group_id)
+        {
+            *group_id = std::stoi(PQgetvalue(res, 0, 1));
+        }
         PQclear(res);
         return file_name;
     }
@@ -406,7 +1581,7 @@ std::optional<std::string> DB::getFilePath(const std::string& user_id, int file_
 std::vector<std::tuple<int, std::string, int, std::string>> DB::getFolders(const std::string& user_id, int parent_folder_id)
 {
     std::vector<std::tuple<int, std::string, int, std::string>> folders;
-    if (!conn_) return folders;
+    if (!conn()) return folders;
 
     // Если parent_folder_id == 0 => parent_folder_id IS NULL
     // Иначе parent_folder_id = $2
@@ -440,10 +1615,10 @@ std::vector<std::tuple<int, std::string, int, std::string>> DB::getFolders(const
 
     int paramCount = (parent_folder_id == 0) ? 1 : 2;
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get folders: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get folders: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return folders;
     }
@@ -468,7 +1643,7 @@ std::vector<std::tuple<int, std::string, int, std::string>> DB::getFolders(const
 
 bool DB::createFolder(const std::string& user_id, const std::string& folder_name, int parent_folder_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Если parent_folder_id > 0 => проверяем, что такая папка существует
     // Если parent_folder_id == 0 => трактуем как NULL
@@ -483,10 +1658,10 @@ bool DB::createFolder(const std::string& user_id, const std::string& folder_name
         parentFolderParamValues[0] = parentIdStr.c_str();
         parentFolderParamValues[1] = user_id.c_str();
 
-        PGresult* parentFolderRes = PQexecParams(conn_, checkParentFolderQuery.c_str(), 2, nullptr, parentFolderParamValues, nullptr, nullptr, 0);
+        PGresult* parentFolderRes = PQexecParams(conn(), checkParentFolderQuery.c_str(), 2, nullptr, parentFolderParamValues, nullptr, nullptr, 0);
         if (PQresultStatus(parentFolderRes) != PGRES_TUPLES_OK)
         {
-            std::cerr << "Failed to check parent folder: " << PQerrorMessage(conn_) << std::endl;
+            std::cerr << "Failed to check parent folder: " << PQerrorMessage(conn()) << std::endl;
             PQclear(parentFolderRes);
             return false;
         }
@@ -510,607 +1685,1915 @@ bool DB::createFolder(const std::string& user_id, const std::string& folder_name
         );
     )";
 
-    const char* paramValues[3];
-    paramValues[0] = user_id.c_str();
-    paramValues[1] = folder_name.c_str();
-    std::string parentIdStr2 = std::to_string(parent_folder_id);
-    paramValues[2] = parentIdStr2.c_str();
+    const char* paramValues[3];
+    paramValues[0] = user_id.c_str();
+    paramValues[1] = folder_name.c_str();
+    std::string parentIdStr2 = std::to_string(parent_folder_id);
+    paramValues[2] = parentIdStr2.c_str();
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        std::cerr << "Failed to create folder: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return false;
+    }
+
+    PQclear(res);
+    return true;
+}
+
+bool DB::deleteFolder(const std::string& user_id, int folder_id)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        DELETE FROM folders
+        WHERE folder_id = $1 AND user_id = $2;
+    )";
+    const char* paramValues[2];
+    std::string folderIdStr = std::to_string(folder_id);
+    paramValues[0] = folderIdStr.c_str();
+    paramValues[1] = user_id.c_str();
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        std::cerr << "Failed to delete folder: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return false;
+    }
+
+    PQclear(res);
+    return true;
+}
+
+bool DB::moveFile(const std::string& user_id, int file_id, int target_folder_id)
+{
+    if (!conn()) return false;
+
+    // Check if the file exists and belongs to the user
+    std::string checkFileQuery = R"(
+        SELECT 1 FROM files WHERE file_id = $1 AND user_id = $2;
+    )";
+    const char* fileParamValues[2];
+    std::string fileIdStr = std::to_string(file_id);
+    fileParamValues[0] = fileIdStr.c_str();
+    fileParamValues[1] = user_id.c_str();
+
+    PGresult* fileRes = PQexecParams(conn(), checkFileQuery.c_str(), 2, nullptr, fileParamValues, nullptr, nullptr, 0);
+    if (PQresultStatus(fileRes) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to check file: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(fileRes);
+        return false;
+    }
+
+    if (PQntuples(fileRes) == 0)
+    {
+        std::cerr << "File with file_id " << file_id << " does not exist for user " << user_id << std::endl;
+        PQclear(fileRes);
+        return false;
+    }
+    PQclear(fileRes);
+
+    // If target_folder_id > 0, check if the target folder exists and belongs to the user
+    if (target_folder_id > 0)
+    {
+        std::string checkFolderQuery = R"(
+            SELECT 1 FROM folders WHERE folder_id = $1 AND user_id = $2;
+        )";
+        const char* folderParamValues[2];
+        std::string folderIdStr = std::to_string(target_folder_id);
+        folderParamValues[0] = folderIdStr.c_str();
+        folderParamValues[1] = user_id.c_str();
+
+        PGresult* folderRes = PQexecParams(conn(), checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
+        if (PQresultStatus(folderRes) != PGRES_TUPLES_OK)
+        {
+            std::cerr << "Failed to check folder: " << PQerrorMessage(conn()) << std::endl;
+            PQclear(folderRes);
+            return false;
+        }
+
+        if (PQntuples(folderRes) == 0)
+        {
+            std::cerr << "Folder with folder_id " << target_folder_id << " does not exist for user " << user_id << std::endl;
+            PQclear(folderRes);
+            return false;
+        }
+        PQclear(folderRes);
+    }
+
+    // Update the file's folder_id
+    // If target_folder_id == 0, set folder_id to NULL (root directory)
+    std::string updateQuery = R"(
+        UPDATE files
+        SET folder_id = CASE WHEN $2::int = 0 THEN NULL ELSE $2::int END
+        WHERE file_id = $1 AND user_id = $3;
+    )";
+
+    const char* updateParamValues[3];
+    updateParamValues[0] = fileIdStr.c_str();
+    std::string targetFolderIdStr = std::to_string(target_folder_id);
+    updateParamValues[1] = targetFolderIdStr.c_str();
+    updateParamValues[2] = user_id.c_str();
+
+    PGresult* updateRes = PQexecParams(conn(), updateQuery.c_str(), 3, nullptr, updateParamValues, nullptr, nullptr, 0);
+    if (PQresultStatus(updateRes) != PGRES_COMMAND_OK)
+    {
+        std::cerr << "Failed to move file: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(updateRes);
+        return false;
+    }
+
+    PQclear(updateRes);
+    return true;
+}
+
+bool DB::lockOwnedFiles(const std::string& user_id, const std::vector<int>& ids, const std::string& idArray,
+                        FileSetResult& result)
+{
+    // Одна проверка на все файлы; FOR UPDATE не даёт им измениться до конца транзакции
+    std::string query = R"(
+        SELECT file_id, user_id = $2::int AS owned
+        FROM files
+        WHERE file_id = ANY($1::int[])
+        FOR UPDATE;
+    )";
+
+    const char* paramValues[2] = { idArray.c_str(), user_id.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to check files: " << PQerrorMessage(conn()) << std::endl;
+        result.error = "Failed to check files";
+        PQclear(res);
+        return false;
+    }
+
+    std::vector<int> found;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        int file_id = std::stoi(PQgetvalue(res, i, 0));
+        found.push_back(file_id);
+        if (PQgetvalue(res, i, 1)[0] != 't')
+        {
+            result.denied.push_back(file_id);
+        }
+    }
+    PQclear(res);
+
+    if (found.size() < ids.size())
+    {
+        // ids отсортированы и без повторов
+        std::sort(found.begin(), found.end());
+        std::set_difference(ids.begin(), ids.end(), found.begin(), found.end(),
+                            std::back_inserter(result.not_found));
+    }
+
+    std::sort(result.denied.begin(), result.denied.end());
+    return result.denied.empty() && result.not_found.empty();
+}
+
+FileSetResult DB::deleteFiles(const std::string& user_id, const std::vector<int>& file_ids)
+{
+    FileSetResult result;
+    if (!conn())
+    {
+        result.error = "Database is not connected";
+        return result;
+    }
+
+    std::vector<int> ids(file_ids);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (ids.empty())
+    {
+        result.ok = true;
+        return result;
+    }
+    std::string idArray = toPgIntArray(ids);
+
+    Transaction transaction(*this);
+    if (!transaction.ok())
+    {
+        result.error = "Failed to start transaction";
+        return result;
+    }
+
+    if (!lockOwnedFiles(user_id, ids, idArray, result))
+    {
+        return result;
+    }
+
+    std::string deleteQuery = R"(
+        DELETE FROM files
+        WHERE file_id = ANY($1::int[]) AND user_id = $2::int
+        RETURNING file_id, file_name, COALESCE(folder_id, 0);
+    )";
+
+    const char* paramValues[2] = { idArray.c_str(), user_id.c_str() };
+
+    PGresult* res = PQexecParams(conn(), deleteQuery.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to delete files: " << PQerrorMessage(conn()) << std::endl;
+        result.error = "Failed to delete files from database";
+        PQclear(res);
+        return result;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        result.files.emplace_back(std::stoi(PQgetvalue(res, i, 0)),
+                                  PQgetvalue(res, i, 1),
+                                  std::stoi(PQgetvalue(res, i, 2)));
+    }
+    PQclear(res);
+
+    if (!transaction.commit())
+    {
+        result.error = "Failed to commit transaction";
+        result.files.clear();
+        return result;
+    }
+
+    result.ok = true;
+    return result;
+}
+
+FileSetResult DB::moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id)
+{
+    FileSetResult result;
+    if (!conn())
+    {
+        result.error = "Database is not connected";
+        return result;
+    }
+
+    std::vector<int> ids(file_ids);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (ids.empty())
+    {
+        result.ok = true;
+        return result;
+    }
+    std::string idArray = toPgIntArray(ids);
+
+    Transaction transaction(*this);
+    if (!transaction.ok())
+    {
+        result.error = "Failed to start transaction";
+        return result;
+    }
+
+    // If target_folder_id > 0, check if the target folder exists and belongs to the user
+    if (target_folder_id > 0)
+    {
+        std::string checkFolderQuery = R"(
+            SELECT 1 FROM folders WHERE folder_id = $1 AND user_id = $2;
+        )";
+        const char* folderParamValues[2];
+        std::string folderIdStr = std::to_string(target_folder_id);
+        folderParamValues[0] = folderIdStr.c_str();
+        folderParamValues[1] = user_id.c_str();
+
+        PGresult* folderRes = PQexecParams(conn(), checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
+        if (PQresultStatus(folderRes) != PGRES_TUPLES_OK || PQntuples(folderRes) == 0)
+        {
+            std::cerr << "Folder with folder_id " << target_folder_id << " does not exist for user " << user_id << std::endl;
+            result.error = "Target folder not found";
+            PQclear(folderRes);
+            return result;
+        }
+        PQclear(folderRes);
+    }
+
+    if (!lockOwnedFiles(user_id, ids, idArray, result))
+    {
+        return result;
+    }
+
+    // The old folder comes from a snapshot of the rows, since RETURNING only sees new values
+    std::string updateQuery = R"(
+        UPDATE files f
+        SET folder_id = CASE WHEN $2::int = 0 THEN NULL ELSE $2::int END
+        FROM (SELECT file_id, folder_id FROM files WHERE file_id = ANY($1::int[])) old
+        WHERE f.file_id = old.file_id AND f.user_id = $3::int
+        RETURNING f.file_id, f.file_name, COALESCE(old.folder_id, 0);
+    )";
+
+    const char* updateParamValues[3];
+    std::string targetFolderIdStr = std::to_string(target_folder_id);
+    updateParamValues[0] = idArray.c_str();
+    updateParamValues[1] = targetFolderIdStr.c_str();
+    updateParamValues[2] = user_id.c_str();
+
+    PGresult* updateRes = PQexecParams(conn(), updateQuery.c_str(), 3, nullptr, updateParamValues, nullptr, nullptr, 0);
+    if (PQresultStatus(updateRes) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to move files: " << PQerrorMessage(conn()) << std::endl;
+        result.error = "Failed to move files";
+        PQclear(updateRes);
+        return result;
+    }
+
+    int rows = PQntuples(updateRes);
+    for (int i = 0; i < rows; ++i)
+    {
+        result.files.emplace_back(std::stoi(PQgetvalue(updateRes, i, 0)),
+                                  PQgetvalue(updateRes, i, 1),
+                                  std::stoi(PQgetvalue(updateRes, i, 2)));
+    }
+    PQclear(updateRes);
+
+    if (!transaction.commit())
+    {
+        result.error = "Failed to commit transaction";
+        result.files.clear();
+        return result;
+    }
+
+    result.ok = true;
+    return result;
+}
+
+// Get all users with their IDs and emails
+std::vector<std::tuple<int, std::string, std::string>> DB::getAllUsers()
+{
+    std::vector<std::tuple<int, std::string, std::string>> users;
+    if (!conn()) return users;
+
+    std::string query = R"(
+        SELECT user_id, email, created_at
+        FROM users
+        ORDER BY user_id;
+    )";
+
+    PGresult* res = PQexec(conn(), query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get all users: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return users;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        int user_id = std::stoi(PQgetvalue(res, i, 0));
+        std::string email = PQgetvalue(res, i, 1);
+        std::string created_at = PQgetvalue(res, i, 2);
+
+        users.emplace_back(user_id, email, created_at);
+    }
+
+    PQclear(res);
+    return users;
+}
+
+// Get all files from all users
+std::unique_ptr<RowCursor> DB::openAllFilesAdminCursor()
+{
+    // Отдельное соединение: курсор читается по частям, пока общий conn() занят другими запросами
+    PGconn* conn = openConnection();
+    if (!conn) return nullptr;
+
+    std::string query = R"(
+        SELECT f.file_id, f.file_name, COALESCE(f.file_size, 0), COALESCE(f.folder_id, 0) as folder_id,
+               f.user_id, u.email, f.created_at
+        FROM files f
+        JOIN users u ON f.user_id = u.user_id
+        ORDER BY f.user_id, f.file_id;
+    )";
+
+    auto cursor = std::make_unique<RowCursor>(conn, true);
+    if (!cursor->start(query, 0, nullptr))
+    {
+        return nullptr;
+    }
+    return cursor;
+}
+
+std::unique_ptr<RowCursor> DB::openAllNamesCursor()
+{
+    PGconn* conn = openConnection();
+    if (!conn) return nullptr;
+
+    std::string query = R"(
+        SELECT 'file', file_id, user_id, COALESCE(group_id, 0), COALESCE(folder_id, 0), file_name
+        FROM files
+        UNION ALL
+        SELECT 'folder', folder_id, COALESCE(user_id, 0), COALESCE(group_id, 0), COALESCE(parent_folder_id, 0), folder_name
+        FROM folders;
+    )";
+
+    auto cursor = std::make_unique<RowCursor>(conn, true);
+    if (!cursor->start(query, 0, nullptr))
+    {
+        return nullptr;
+    }
+    return cursor;
+}
+
+std::unique_ptr<RowCursor> DB::openAllFoldersAdminCursor()
+{
+    PGconn* conn = openConnection();
+    if (!conn) return nullptr;
+
+    std::string query = R"(
+        SELECT f.folder_id, f.folder_name, COALESCE(f.parent_folder_id, 0) as parent_folder_id,
+               f.user_id, u.email, f.created_at
+        FROM folders f
+        JOIN users u ON f.user_id = u.user_id
+        ORDER BY f.user_id, f.folder_id;
+    )";
+
+    auto cursor = std::make_unique<RowCursor>(conn, true);
+    if (!cursor->start(query, 0, nullptr))
+    {
+        return nullptr;
+    }
+    return cursor;
+}
+
+bool DB::forEachFileAdminPage(int after_user_id, int after_file_id, int limit,
+                              const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    // Keyset-пагинация по индексу (user_id, file_id): страница не зависит от смещения
+    std::string query = R"(
+        SELECT f.file_id, f.file_name, COALESCE(f.file_size, 0), COALESCE(f.folder_id, 0) as folder_id,
+               f.user_id, u.email, f.created_at
+        FROM files f
+        JOIN users u ON f.user_id = u.user_id
+        WHERE (f.user_id, f.file_id) > ($1::int, $2::int)
+        ORDER BY f.user_id, f.file_id
+        LIMIT $3;
+    )";
+
+    std::string afterUserStr = std::to_string(after_user_id);
+    std::string afterIdStr = std::to_string(after_file_id);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[3] = { afterUserStr.c_str(), afterIdStr.c_str(), limitStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 3, paramValues))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+bool DB::forEachFolderAdminPage(int after_user_id, int after_folder_id, int limit,
+                                const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        SELECT f.folder_id, f.folder_name, COALESCE(f.parent_folder_id, 0) as parent_folder_id,
+               f.user_id, u.email, f.created_at
+        FROM folders f
+        JOIN users u ON f.user_id = u.user_id
+        WHERE (f.user_id, f.folder_id) > ($1::int, $2::int)
+        ORDER BY f.user_id, f.folder_id
+        LIMIT $3;
+    )";
+
+    std::string afterUserStr = std::to_string(after_user_id);
+    std::string afterIdStr = std::to_string(after_folder_id);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[3] = { afterUserStr.c_str(), afterIdStr.c_str(), limitStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 3, paramValues))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+std::unique_ptr<CopyOutReader> DB::openAdminExport(bool folders)
+{
+    // COPY не принимает параметров; запросы фиксированы
+    std::string query = folders ? R"(
+        COPY (
+            SELECT f.folder_id, f.folder_name, COALESCE(f.parent_folder_id, 0) as parent_folder_id,
+                   f.user_id, u.email, f.created_at
+            FROM folders f
+            JOIN users u ON f.user_id = u.user_id
+            ORDER BY f.user_id, f.folder_id
+        ) TO STDOUT WITH (FORMAT csv, HEADER);
+    )" : R"(
+        COPY (
+            SELECT f.file_id, f.file_name, f.file_size, COALESCE(f.folder_id, 0) as folder_id,
+                   f.user_id, u.email, f.created_at
+            FROM files f
+            JOIN users u ON f.user_id = u.user_id
+            ORDER BY f.user_id, f.file_id
+        ) TO STDOUT WITH (FORMAT csv, HEADER);
+    )";
+
+    PGconn* conn = openConnection();
+    if (!conn) return nullptr;
+
+    auto reader = std::make_unique<CopyOutReader>(conn);
+    if (!reader->start(query))
+    {
+        return nullptr;
+    }
+    return reader;
+}
+
+std::optional<std::tuple<std::string, int, int, long long, int, long long>> DB::getUserContentSummary(const std::string& user_id)
+{
+    if (!conn()) return std::nullopt;
+
+    // Поиск пользователя по первичному ключу и агрегаты только по его строкам (индексы по user_id)
+    std::string query = R"(
+        SELECT u.email, t.files_count, t.total_bytes, t.root_files, t.root_bytes,
+               (SELECT COUNT(*) FROM folders f WHERE f.user_id = u.user_id) AS folders_count
+        FROM users u
+        CROSS JOIN LATERAL (
+            SELECT COUNT(*) AS files_count,
+                   COALESCE(SUM(file_size), 0) AS total_bytes,
+                   COUNT(*) FILTER (WHERE folder_id IS NULL) AS root_files,
+                   COALESCE(SUM(file_size) FILTER (WHERE folder_id IS NULL), 0) AS root_bytes
+            FROM files
+            WHERE user_id = u.user_id
+        ) t
+        WHERE u.user_id = $1;
+    )";
+
+    const char* paramValues[1] = { user_id.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get content summary for user " << user_id << ": " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    if (PQntuples(res) == 0)
+    {
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    auto summary = std::make_tuple(std::string(PQgetvalue(res, 0, 0)),
+                                   std::stoi(PQgetvalue(res, 0, 1)),
+                                   std::stoi(PQgetvalue(res, 0, 5)),
+                                   std::stoll(PQgetvalue(res, 0, 2)),
+                                   std::stoi(PQgetvalue(res, 0, 3)),
+                                   std::stoll(PQgetvalue(res, 0, 4)));
+    PQclear(res);
+    return summary;
+}
+
+bool DB::forEachUserFilePage(const std::string& user_id, int after_file_id, int limit,
+                             const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        SELECT file_id, file_name, COALESCE(file_size, 0), COALESCE(folder_id, 0) as folder_id, created_at
+        FROM files
+        WHERE user_id = $1 AND file_id > $2
+        ORDER BY file_id
+        LIMIT $3;
+    )";
+
+    std::string afterIdStr = std::to_string(after_file_id);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[3] = { user_id.c_str(), afterIdStr.c_str(), limitStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 3, paramValues))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+bool DB::forEachUserFolderPage(const std::string& user_id, int after_folder_id, int limit,
+                               const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    // Итоги по файлам, лежащим непосредственно в папке (индекс по COALESCE(folder_id, 0))
+    std::string query = R"(
+        SELECT f.folder_id, f.folder_name, COALESCE(f.parent_folder_id, 0) as parent_folder_id, f.created_at,
+               t.files_count, t.total_bytes
+        FROM folders f
+        CROSS JOIN LATERAL (
+            SELECT COUNT(*) AS files_count, COALESCE(SUM(fi.file_size), 0) AS total_bytes
+            FROM files fi
+            WHERE COALESCE(fi.folder_id, 0) = f.folder_id
+        ) t
+        WHERE f.user_id = $1 AND f.folder_id > $2
+        ORDER BY f.folder_id
+        LIMIT $3;
+    )";
+
+    std::string afterIdStr = std::to_string(after_folder_id);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[3] = { user_id.c_str(), afterIdStr.c_str(), limitStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 3, paramValues))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+// Get system statistics: total_users, total_files, total_folders, total_storage_bytes
+std::tuple<int, int, int, long long> DB::getSystemStats()
+{
+    int total_users = 0;
+    int total_files = 0;
+    int total_folders = 0;
+    long long total_storage_bytes = 0;
+
+    if (!conn()) return std::make_tuple(0, 0, 0, 0);
+
+    // Счётчики storage_stats: несколько строк по первичному ключу вместо подсчёта таблиц
+    std::string query = R"(
+        SELECT scope, SUM(item_count), SUM(byte_count)
+        FROM storage_stats
+        WHERE scope IN ('a', 'f', 'd') AND key = ''
+        GROUP BY scope;
+    )";
+
+    PGresult* res = PQexec(conn(), query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get system stats: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::make_tuple(0, 0, 0, 0);
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        char scope = PQgetvalue(res, i, 0)[0];
+        int count = std::stoi(PQgetvalue(res, i, 1));
+        if (scope == 'a') {
+            total_users = count;
+        } else if (scope == 'f') {
+            total_files = count;
+            total_storage_bytes = std::stoll(PQgetvalue(res, i, 2));
+        } else {
+            total_folders = count;
+        }
+    }
+
+    PQclear(res);
+    return std::make_tuple(total_users, total_files, total_folders, total_storage_bytes);
+}
+
+// Get file type distribution (for admin dashboard)
+std::vector<std::pair<std::string, int>> DB::getFileTypeDistribution()
+{
+    std::vector<std::pair<std::string, int>> distribution;
+    if (!conn()) return distribution;
+
+    // Расширения уже посчитаны триггерами (см. file_extension)
+    std::string query = R"(
+        SELECT key AS extension, SUM(item_count) AS count
+        FROM storage_stats
+        WHERE scope = 'e'
+        GROUP BY key
+        HAVING SUM(item_count) > 0
+        ORDER BY count DESC
+        LIMIT 10;
+    )";
+
+    PGresult* res = PQexec(conn(), query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get file type distribution: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return distribution;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        std::string extension = PQgetvalue(res, i, 0);
+        int count = std::stoi(PQgetvalue(res, i, 1));
+        distribution.emplace_back(extension, count);
+    }
+
+    PQclear(res);
+    return distribution;
+}
+
+// Get top users by storage usage
+std::vector<std::tuple<std::string, std::string, long long>> DB::getTopUsersByStorage(int limit)
+{
+    std::vector<std::tuple<std::string, std::string, long long>> topUsers;
+    if (!conn()) return topUsers;
+
+    // Строки пользователей не разбиты по slot, поэтому первые limit берутся из storage_stats_user_bytes_idx
+    std::string query = R"(
+        SELECT u.user_id, u.email, s.byte_count
+        FROM (
+            SELECT key, byte_count
+            FROM storage_stats
+            WHERE scope = 'u' AND byte_count > 0
+            ORDER BY byte_count DESC
+            LIMIT $1
+        ) s
+        JOIN users u ON u.user_id = s.key::INT
+        ORDER BY s.byte_count DESC;
+    )";
+
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[1] = { limitStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get top users by storage: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return topUsers;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        std::string userId = PQgetvalue(res, i, 0);
+        std::string email = PQgetvalue(res, i, 1);
+        long long storageBytes = std::stoll(PQgetvalue(res, i, 2));
+
+        topUsers.emplace_back(userId, email, storageBytes);
+    }
+
+    PQclear(res);
+    return topUsers;
+}
+
+// Get top groups by storage usage: group_id, group_name, files, bytes
+std::vector<std::tuple<int, std::string, long long, long long>> DB::getTopGroupsByStorage(int limit)
+{
+    std::vector<std::tuple<int, std::string, long long, long long>> topGroups;
+    if (!conn()) return topGroups;
+
+    std::string query = R"(
+        SELECT g.group_id, g.group_name, s.files, s.bytes
+        FROM (
+            SELECT key, SUM(item_count) AS files, SUM(byte_count) AS bytes
+            FROM storage_stats
+            WHERE scope = 'g'
+            GROUP BY key
+            HAVING SUM(item_count) > 0
+            ORDER BY bytes DESC
+            LIMIT $1
+        ) s
+        JOIN groups g ON g.group_id = s.key::INT
+        ORDER BY s.bytes DESC;
+    )";
+
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[1] = { limitStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get top groups by storage: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return topGroups;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        topGroups.emplace_back(std::stoi(PQgetvalue(res, i, 0)), PQgetvalue(res, i, 1),
+                               std::stoll(PQgetvalue(res, i, 2)), std::stoll(PQgetvalue(res, i, 3)));
+    }
+
+    PQclear(res);
+    return topGroups;
+}
+
+bool DB::reconcileStorageStats(int& corrected, const std::function<void(size_t done, size_t total)>& progress)
+{
+    corrected = 0;
+
+    // Отдельное соединение: полный просмотр files не должен занимать общий conn()
+    PGconn* conn = openConnection();
+    if (!conn) return false;
+
+    // Настоящие значения и счётчики читаются одним запросом, то есть в одном снимке; разница
+    // переносится в счётчики прибавлением, поэтому изменения, зафиксированные после снимка, не теряются
+    const char* steps[] = {
+        R"(
+        CREATE TEMP TABLE storage_stats_drift AS
+        WITH actual AS (
+            SELECT 'f' AS scope, '' AS key, COUNT(*) AS items, COALESCE(SUM(file_size), 0) AS bytes
+            FROM files
+            UNION ALL
+            SELECT 'u', user_id::TEXT, COUNT(*), COALESCE(SUM(file_size), 0)
+            FROM files GROUP BY user_id
+            UNION ALL
+            SELECT 'p', user_id::TEXT, COUNT(*), COALESCE(SUM(file_size), 0)
+            FROM files WHERE group_id IS NULL GROUP BY user_id
+            UNION ALL
+            SELECT 'g', group_id::TEXT, COUNT(*), COALESCE(SUM(file_size), 0)
+            FROM files WHERE group_id IS NOT NULL GROUP BY group_id
+            UNION ALL
+            SELECT 'e', file_extension(file_name), COUNT(*), COALESCE(SUM(file_size), 0)
+            FROM files GROUP BY 2
+            UNION ALL
+            SELECT 'd', '', COUNT(*), 0 FROM folders
+            UNION ALL
+            SELECT 'a', '', COUNT(*), 0 FROM users
+        ),
+        counted AS (
+            SELECT scope::TEXT AS scope, key, SUM(item_count) AS items, SUM(byte_count) AS bytes
+            FROM storage_stats
+            GROUP BY scope, key
+        )
+        SELECT COALESCE(a.scope, c.scope) AS scope, COALESCE(a.key, c.key) AS key,
+               COALESCE(a.items, 0) - COALESCE(c.items, 0) AS items,
+               COALESCE(a.bytes, 0) - COALESCE(c.bytes, 0) AS bytes
+        FROM actual a
+        FULL JOIN counted c ON c.scope = a.scope AND c.key = a.key
+        WHERE COALESCE(a.items, 0) <> COALESCE(c.items, 0) OR COALESCE(a.bytes, 0) <> COALESCE(c.bytes, 0);
+        )",
+        "BEGIN;",
+        R"(
+        INSERT INTO storage_stats AS s (scope, key, slot, item_count, byte_count)
+        SELECT scope, key, 0, items, bytes
+        FROM storage_stats_drift
+        ORDER BY scope, key
+        ON CONFLICT (scope, key, slot) DO UPDATE
+        SET item_count = s.item_count + EXCLUDED.item_count,
+            byte_count = s.byte_count + EXCLUDED.byte_count;
+        )",
+        // Пустые строки удалённых пользователей, групп и расширений
+        "DELETE FROM storage_stats WHERE item_count = 0 AND byte_count = 0 AND scope IN ('u', 'p', 'g', 'e');",
+        "COMMIT;"
+    };
+
+    const size_t applyStep = 2;
+    const size_t stepCount = sizeof(steps) / sizeof(steps[0]);
+
+    for (size_t i = 0; i < stepCount; ++i)
+    {
+        PGresult* res = PQexec(conn, steps[i]);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            std::cerr << "Failed to reconcile storage stats: " << PQerrorMessage(conn) << std::endl;
+            PQclear(res);
+            PQfinish(conn);
+            return false;
+        }
+        if (i == applyStep)
+        {
+            corrected = std::atoi(PQcmdTuples(res));
+        }
+        PQclear(res);
+
+        if (progress)
+        {
+            progress(i + 1, stepCount);
+        }
+    }
+
+    PQfinish(conn);
+    return true;
+}
+
+bool DB::recordUsageSamples(long long bucket, const std::vector<UsageActivity>& activity)
+{
+    if (activity.empty()) return true;
+
+    // Отдельное соединение: вызывается из фонового потока
+    PGconn* conn = openConnection();
+    if (!conn) return false;
+
+    // Секции на день отсчёта и на следующий, чтобы переход через полночь не ждал создания секции
+    const long long DAY = 24 * 60 * 60;
+    for (long long day : {bucket, bucket + DAY})
+    {
+        std::string query = "CREATE TABLE IF NOT EXISTS usage_samples_minute_" + utcDay(day, "%Y%m%d") +
+                            " PARTITION OF usage_samples_minute FOR VALUES FROM ('" + utcDay(day, "%Y-%m-%d") +
+                            "') TO ('" + utcDay(day + DAY, "%Y-%m-%d") + "');";
+        if (!execCommand(conn, query))
+        {
+            PQfinish(conn);
+            return false;
+        }
+    }
+
+    // Объём и число файлов берутся из счётчиков storage_stats на момент отсчёта
+    std::string query = R"(
+        INSERT INTO usage_samples_minute AS m
+            (bucket, scope, key, storage_bytes, files_count, active_users, upload_bytes, download_bytes)
+        SELECT to_timestamp($1) AT TIME ZONE 'UTC', a.scope, a.key, COALESCE(s.bytes, 0), COALESCE(s.items, 0),
+               a.active, a.up, a.down
+        FROM unnest($2::TEXT[], $3::INT[], $4::INT[], $5::BIGINT[], $6::BIGINT[]) AS a(scope, key, active, up, down)
+        LEFT JOIN LATERAL (
+            SELECT SUM(item_count) AS items, SUM(byte_count) AS bytes
+            FROM storage_stats
+            WHERE scope = (CASE a.scope WHEN 's' THEN 'f' ELSE a.scope END)::CHAR(1)
+              AND key = CASE a.scope WHEN 's' THEN '' ELSE a.key::TEXT END
+        ) s ON TRUE
+        ON CONFLICT (scope, key, bucket) DO UPDATE
+        SET storage_bytes = EXCLUDED.storage_bytes,
+            files_count = EXCLUDED.files_count,
+            active_users = GREATEST(m.active_users, EXCLUDED.active_users),
+            upload_bytes = m.upload_bytes + EXCLUDED.upload_bytes,
+            download_bytes = m.download_bytes + EXCLUDED.download_bytes;
+    )";
+
+    std::string scopes = "{";
+    std::vector<int> keys, active;
+    std::vector<long long> uploads, downloads;
+    for (const auto& item : activity)
+    {
+        if (scopes.size() > 1) scopes += ",";
+        scopes += item.scope;
+        keys.push_back(item.key);
+        active.push_back(item.active_users);
+        uploads.push_back(item.upload_bytes);
+        downloads.push_back(item.download_bytes);
+    }
+    scopes += "}";
+
+    std::string bucketStr = std::to_string(bucket);
+    std::string keysStr = toPgIntArray(keys);
+    std::string activeStr = toPgIntArray(active);
+    std::string uploadsStr = toPgIntArray(uploads);
+    std::string downloadsStr = toPgIntArray(downloads);
+    const char* paramValues[6] = { bucketStr.c_str(), scopes.c_str(), keysStr.c_str(), activeStr.c_str(),
+                                   uploadsStr.c_str(), downloadsStr.c_str() };
+
+    PGresult* res = PQexecParams(conn, query.c_str(), 6, nullptr, paramValues, nullptr, nullptr, 0);
+    bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ok)
+    {
+        std::cerr << "Failed to record usage samples: " << PQerrorMessage(conn) << std::endl;
+    }
+    PQclear(res);
+    PQfinish(conn);
+    return ok;
+}
+
+bool DB::rollupUsage(UsageResolution target, long long from, long long to)
+{
+    if (target == UsageResolution::Minute) return false;
+
+    PGconn* conn = openConnection();
+    if (!conn) return false;
+
+    // Объём и число файлов — последнее значение интервала, трафик суммируется. Для системы число
+    // активных пользователей — различные пользователи за интервал по поминутным строкам (пока они
+    // хранятся), для групп — максимум за интервал. Пересчёт заменяет строки, его можно повторять.
+    bool toDays = target == UsageResolution::Day;
+    std::string unit = toDays ? "day" : "hour";
+    std::string source = usageTable(toDays ? UsageResolution::Hour : UsageResolution::Minute);
+    std::string query = R"(
+        WITH distinct_users AS (
+            SELECT date_trunc(')" + unit + R"(', bucket) AS period, COUNT(DISTINCT key) AS users
+            FROM usage_samples_minute
+            WHERE scope = 'u' AND active_users > 0
+              AND bucket >= to_timestamp($1) AT TIME ZONE 'UTC' AND bucket < to_timestamp($2) AT TIME ZONE 'UTC'
+            GROUP BY 1
+        ),
+        rolled AS (
+            SELECT date_trunc(')" + unit + R"(', bucket) AS period, scope, key,
+                   (array_agg(storage_bytes ORDER BY bucket DESC))[1] AS storage_bytes,
+                   (array_agg(files_count ORDER BY bucket DESC))[1] AS files_count,
+                   MAX(active_users) AS active_users,
+                   SUM(upload_bytes) AS upload_bytes,
+                   SUM(download_bytes) AS download_bytes
+            FROM )" + source + R"(
+            WHERE bucket >= to_timestamp($1) AT TIME ZONE 'UTC' AND bucket < to_timestamp($2) AT TIME ZONE 'UTC'
+            GROUP BY 1, scope, key
+        )
+        INSERT INTO )" + std::string(usageTable(target)) + R"( AS r
+            (bucket, scope, key, storage_bytes, files_count, active_users, upload_bytes, download_bytes)
+        SELECT rolled.period, rolled.scope, rolled.key, rolled.storage_bytes, rolled.files_count,
+               CASE WHEN rolled.scope = 's' THEN GREATEST(rolled.active_users, COALESCE(d.users, 0))
+                    ELSE rolled.active_users END,
+               rolled.upload_bytes, rolled.download_bytes
+        FROM rolled
+        LEFT JOIN distinct_users d ON d.period = rolled.period
+        ON CONFLICT (scope, key, bucket) DO UPDATE
+        SET storage_bytes = EXCLUDED.storage_bytes,
+            files_count = EXCLUDED.files_count,
+            active_users = GREATEST(r.active_users, EXCLUDED.active_users),
+            upload_bytes = EXCLUDED.upload_bytes,
+            download_bytes = EXCLUDED.download_bytes;
+    )";
+
+    std::string fromStr = std::to_string(from);
+    std::string toStr = std::to_string(to);
+    const char* paramValues[2] = { fromStr.c_str(), toStr.c_str() };
+
+    PGresult* res = PQexecParams(conn, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ok)
+    {
+        std::cerr << "Failed to roll up usage samples: " << PQerrorMessage(conn) << std::endl;
+    }
+    PQclear(res);
+    PQfinish(conn);
+    return ok;
+}
+
+bool DB::pruneUsage(long long minutesBefore, long long hoursBefore)
+{
+    PGconn* conn = openConnection();
+    if (!conn) return false;
+
+    // Поминутные отсчёты удаляются секциями целиком; имя секции содержит её день
+    std::string oldest = "usage_samples_minute_" + utcDay(minutesBefore, "%Y%m%d");
+    std::string query = R"(
+        SELECT c.relname
+        FROM pg_inherits i
+        JOIN pg_class c ON c.oid = i.inhrelid
+        WHERE i.inhparent = 'usage_samples_minute'::regclass AND c.relname < $1
+        ORDER BY c.relname;
+    )";
+    const char* paramValues[1] = { oldest.c_str() };
+
+    PGresult* res = PQexecParams(conn, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to list usage partitions: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        PQfinish(conn);
+        return false;
+    }
+
+    std::vector<std::string> partitions;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        partitions.emplace_back(PQgetvalue(res, i, 0));
+    }
+    PQclear(res);
+
+    bool ok = true;
+    for (const auto& partition : partitions)
+    {
+        ok = execCommand(conn, "DROP TABLE IF EXISTS " + partition + ";") && ok;
+    }
+
+    std::string hoursStr = std::to_string(hoursBefore);
+    const char* hourParams[1] = { hoursStr.c_str() };
+    res = PQexecParams(conn, "DELETE FROM usage_samples_hour WHERE bucket < to_timestamp($1) AT TIME ZONE 'UTC';",
+                       1, nullptr, hourParams, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        std::cerr << "Failed to prune hourly usage samples: " << PQerrorMessage(conn) << std::endl;
+        ok = false;
+    }
+    PQclear(res);
+
+    PQfinish(conn);
+    return ok;
+}
+
+bool DB::forEachUsageSample(UsageResolution resolution, char scope, int key, long long from, long long to, int limit,
+                            const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    // Диапазон по первичному ключу (scope, key, bucket); для поминутных — только секции диапазона
+    std::string query = R"(
+        SELECT EXTRACT(EPOCH FROM bucket)::BIGINT, storage_bytes, files_count, active_users,
+               upload_bytes, download_bytes
+        FROM )" + std::string(usageTable(resolution)) + R"(
+        WHERE scope = $1 AND key = $2
+          AND bucket >= to_timestamp($3) AT TIME ZONE 'UTC' AND bucket < to_timestamp($4) AT TIME ZONE 'UTC'
+        ORDER BY bucket
+        LIMIT $5;
+    )";
+
+    std::string scopeStr(1, scope);
+    std::string keyStr = std::to_string(key);
+    std::string fromStr = std::to_string(from);
+    std::string toStr = std::to_string(to);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[5] = { scopeStr.c_str(), keyStr.c_str(), fromStr.c_str(), toStr.c_str(), limitStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 5, paramValues))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+bool DB::forEachActivity(const ActivityFilter& filter, long long before_us, long long before_id, int limit,
+                         const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    // Границы задаются как 'epoch' + интервал: в отличие от to_timestamp это неизменяемое выражение,
+    // поэтому лишние дневные секции отсекаются уже при планировании. Условия на пользователя и
+    // действие добавляются только заданные, чтобы планировщик выбрал соответствующий индекс.
+    std::vector<std::string> params = { std::to_string(filter.from), std::to_string(filter.to) };
+    std::string query = R"(
+        SELECT event_id, (EXTRACT(EPOCH FROM occurred_at) * 1000000)::BIGINT, user_id, action, object_id, detail
+        FROM activity_log
+        WHERE occurred_at >= 'epoch'::TIMESTAMP + $1 * INTERVAL '1 second'
+          AND occurred_at < 'epoch'::TIMESTAMP + $2 * INTERVAL '1 second'
+    )";
+    if (filter.user_id > 0)
+    {
+        params.push_back(std::to_string(filter.user_id));
+        query += " AND user_id = $" + std::to_string(params.size());
+    }
+    if (!filter.action.empty())
+    {
+        params.push_back(filter.action);
+        query += " AND action = $" + std::to_string(params.size());
+    }
+    if (before_id > 0)
+    {
+        params.push_back(std::to_string(before_us));
+        params.push_back(std::to_string(before_id));
+        query += " AND (occurred_at, event_id) < ('epoch'::TIMESTAMP + $" + std::to_string(params.size() - 1) +
+                 " * INTERVAL '1 microsecond', $" + std::to_string(params.size()) + ")";
+    }
+    params.push_back(std::to_string(limit));
+    query += " ORDER BY occurred_at DESC, event_id DESC LIMIT $" + std::to_string(params.size()) + ";";
+
+    std::vector<const char*> paramValues;
+    for (const auto& param : params)
+    {
+        paramValues.push_back(param.c_str());
+    }
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, static_cast<int>(paramValues.size()), paramValues.data()))
+    {
+        return false;
+    }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
+
+std::optional<std::vector<AnalyticsCheckpoint>> DB::lockAnalyticsCheckpoints()
+{
+    if (!conn()) return std::nullopt;
+
+    // Блокировка до конца транзакции, в том числе пока строк ещё нет
+    PGresult* res = PQexec(conn(), "SELECT pg_advisory_xact_lock(hashtext('analytics_checkpoints'));");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to lock analytics checkpoints: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+    PQclear(res);
+
+    return loadAnalyticsCheckpoints();
+}
+
+bool DB::saveAnalyticsCheckpoints(const std::vector<AnalyticsCheckpoint>& checkpoints)
+{
+    // Все точки в одной транзакции, чтобы после сбоя не смешались периоды разных моментов
+    Transaction transaction(*this);
+    if (!transaction.ok()) return false;
+
+    std::string query = R"(
+        INSERT INTO analytics_checkpoints (name, period_start, users, files, folders, saved_at)
+        VALUES ($1, $2, $3, $4, $5, CURRENT_TIMESTAMP)
+        ON CONFLICT (name) DO UPDATE
+        SET period_start = EXCLUDED.period_start,
+            users = EXCLUDED.users,
+            files = EXCLUDED.files,
+            folders = EXCLUDED.folders,
+            saved_at = EXCLUDED.saved_at;
+    )";
+
+    bool ok = true;
+    for (const auto& checkpoint : checkpoints)
+    {
+        if (!ok) break;
+
+        std::string startStr = std::to_string(checkpoint.period_start);
+        const char* paramValues[5] = { checkpoint.name.c_str(), startStr.c_str(), checkpoint.users.data(),
+                                       checkpoint.files.data(), checkpoint.folders.data() };
+        int paramLengths[5] = { 0, 0, static_cast<int>(checkpoint.users.size()),
+                                static_cast<int>(checkpoint.files.size()), static_cast<int>(checkpoint.folders.size()) };
+        int paramFormats[5] = { 0, 0, 1, 1, 1 };
+
+        PGresult* res = PQexecParams(conn(), query.c_str(), 5, nullptr, paramValues, paramLengths, paramFormats, 0);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            std::cerr << "Failed to save analytics checkpoint: " << PQerrorMessage(conn()) << std::endl;
+            ok = false;
+        }
+        PQclear(res);
+    }
+    return ok && transaction.commit();
+}
+
+std::optional<std::vector<AnalyticsCheckpoint>> DB::loadAnalyticsCheckpoints()
+{
+    if (!conn()) return std::nullopt;
+
+    // Результат в двоичном формате: bytea без экранирования, period_start — int8 в сетевом порядке
+    PGresult* res = PQexecParams(conn(), "SELECT name, period_start, users, files, folders FROM analytics_checkpoints;",
+                                 0, nullptr, nullptr, nullptr, nullptr, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to load analytics checkpoints: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    auto bytes = [res](int row, int column) {
+        return std::string(PQgetvalue(res, row, column), PQgetlength(res, row, column));
+    };
+
+    std::vector<AnalyticsCheckpoint> checkpoints;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        const unsigned char* start = reinterpret_cast<const unsigned char*>(PQgetvalue(res, i, 1));
+        uint64_t value = 0;
+        for (int b = 0; b < 8; ++b)
+        {
+            value = (value << 8) | start[b];
+        }
+        checkpoints.push_back({bytes(i, 0), static_cast<long long>(value), bytes(i, 2), bytes(i, 3), bytes(i, 4)});
+    }
+    PQclear(res);
+    return checkpoints;
+}
+
+std::unordered_map<int, std::string> DB::getItemNames(bool folders, const std::vector<int>& ids)
+{
+    std::unordered_map<int, std::string> names;
+    if (!conn() || ids.empty()) return names;
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    std::string query = folders
+        ? "SELECT folder_id, folder_name FROM folders WHERE folder_id = ANY($1::INT[]);"
+        : "SELECT file_id, file_name FROM files WHERE file_id = ANY($1::INT[]);";
+
+    std::string idsStr = toPgIntArray(ids);
+    const char* paramValues[1] = { idsStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to create folder: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get item names: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return false;
+        return names;
     }
 
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        names[std::stoi(PQgetvalue(res, i, 0))] = PQgetvalue(res, i, 1);
+    }
     PQclear(res);
-    return true;
+    return names;
 }
 
-bool DB::deleteFolder(const std::string& user_id, int folder_id)
+std::optional<std::pair<long long, long long>> DB::getDuplicateTotals()
 {
-    if (!conn_) return false;
+    if (!conn()) return std::nullopt;
 
+    // Набор — хэш, общий для нескольких ещё существующих файлов на диске
     std::string query = R"(
-        DELETE FROM folders
-        WHERE folder_id = $1 AND user_id = $2;
+        WITH sets AS (
+            SELECT MAX(d.file_size) AS file_size, COUNT(*) AS copies
+            FROM file_digests d
+            WHERE EXISTS (SELECT 1 FROM files f WHERE f.file_name = d.file_name)
+            GROUP BY d.digest
+            HAVING COUNT(*) > 1
+        )
+        SELECT COUNT(*), COALESCE(SUM((copies - 1) * file_size), 0) FROM sets;
     )";
-    const char* paramValues[2];
-    std::string folderIdStr = std::to_string(folder_id);
-    paramValues[0] = folderIdStr.c_str();
-    paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    PGresult* res = PQexec(conn(), query.c_str());
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to delete folder: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get duplicate totals: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return false;
+        return std::nullopt;
     }
 
+    std::pair<long long, long long> totals(std::stoll(PQgetvalue(res, 0, 0)), std::stoll(PQgetvalue(res, 0, 1)));
     PQclear(res);
-    return true;
+    return totals;
 }
 
-bool DB::moveFile(const std::string& user_id, int file_id, int target_folder_id)
+bool DB::forEachDuplicateFile(int maxSets, int maxFilesPerSet, const std::function<void(const RowCursor&)>& visitor)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
-    // Check if the file exists and belongs to the user
-    std::string checkFileQuery = R"(
-        SELECT 1 FROM files WHERE file_id = $1 AND user_id = $2;
+    // Наборы по убыванию освобождаемого места, в каждом — не больше maxFilesPerSet записей files
+    std::string query = R"(
+        WITH sets AS (
+            SELECT d.digest, MAX(d.file_size) AS file_size, COUNT(*) AS copies
+            FROM file_digests d
+            WHERE EXISTS (SELECT 1 FROM files f WHERE f.file_name = d.file_name)
+            GROUP BY d.digest
+            HAVING COUNT(*) > 1
+            ORDER BY (COUNT(*) - 1) * MAX(d.file_size) DESC, d.digest
+            LIMIT $1
+        ),
+        members AS (
+            SELECT s.digest, s.file_size, s.copies, f.file_id, f.file_name, f.user_id,
+                   ROW_NUMBER() OVER (PARTITION BY s.digest ORDER BY f.file_id) AS n
+            FROM sets s
+            JOIN file_digests d ON d.digest = s.digest
+            JOIN files f ON f.file_name = d.file_name
+        )
+        SELECT encode(m.digest, 'hex'), m.file_size, m.copies, (m.copies - 1) * m.file_size,
+               m.file_id, m.file_name, m.user_id, u.email
+        FROM members m
+        LEFT JOIN users u ON u.user_id = m.user_id
+        WHERE m.n <= $2
+        ORDER BY (m.copies - 1) * m.file_size DESC, m.digest, m.file_id;
     )";
-    const char* fileParamValues[2];
-    std::string fileIdStr = std::to_string(file_id);
-    fileParamValues[0] = fileIdStr.c_str();
-    fileParamValues[1] = user_id.c_str();
 
-    PGresult* fileRes = PQexecParams(conn_, checkFileQuery.c_str(), 2, nullptr, fileParamValues, nullptr, nullptr, 0);
-    if (PQresultStatus(fileRes) != PGRES_TUPLES_OK)
+    std::string setsStr = std::to_string(maxSets);
+    std::string filesStr = std::to_string(maxFilesPerSet);
+    const char* paramValues[2] = { setsStr.c_str(), filesStr.c_str() };
+
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 2, paramValues))
     {
-        std::cerr << "Failed to check file: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(fileRes);
         return false;
     }
+    while (cursor.next())
+    {
+        visitor(cursor);
+    }
+    return !cursor.failed();
+}
 
-    if (PQntuples(fileRes) == 0)
+bool DB::loadStorageQuotas(StorageQuotaSnapshot& snapshot)
+{
+    // Отдельное соединение: вызывается из фонового потока
+    PGconn* conn = openConnection();
+    if (!conn) return false;
+
+    // Объём — из счётчиков storage_stats (строки 'p' и 'g' по всем slot), без просмотра files
+    const char* query = R"(
+        SELECT scope, key::INT, SUM(byte_count)::BIGINT
+        FROM storage_stats
+        WHERE scope IN ('p', 'g')
+        GROUP BY scope, key
+        HAVING SUM(byte_count) <> 0
+        UNION ALL
+        SELECT CASE scope WHEN 'u' THEN 'U' ELSE 'G' END, key, byte_limit
+        FROM storage_quotas;
+    )";
+
+    PGresult* res = PQexec(conn, query);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "File with file_id " << file_id << " does not exist for user " << user_id << std::endl;
-        PQclear(fileRes);
+        std::cerr << "Failed to load storage quotas: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        PQfinish(conn);
         return false;
     }
-    PQclear(fileRes);
 
-    // If target_folder_id > 0, check if the target folder exists and belongs to the user
-    if (target_folder_id > 0)
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
     {
-        std::string checkFolderQuery = R"(
-            SELECT 1 FROM folders WHERE folder_id = $1 AND user_id = $2;
-        )";
-        const char* folderParamValues[2];
-        std::string folderIdStr = std::to_string(target_folder_id);
-        folderParamValues[0] = folderIdStr.c_str();
-        folderParamValues[1] = user_id.c_str();
-
-        PGresult* folderRes = PQexecParams(conn_, checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
-        if (PQresultStatus(folderRes) != PGRES_TUPLES_OK)
+        int key = std::atoi(PQgetvalue(res, i, 1));
+        long long bytes = std::atoll(PQgetvalue(res, i, 2));
+        switch (PQgetvalue(res, i, 0)[0])
         {
-            std::cerr << "Failed to check folder: " << PQerrorMessage(conn_) << std::endl;
-            PQclear(folderRes);
-            return false;
-        }
-
-        if (PQntuples(folderRes) == 0)
-        {
-            std::cerr << "Folder with folder_id " << target_folder_id << " does not exist for user " << user_id << std::endl;
-            PQclear(folderRes);
-            return false;
+            case 'p': snapshot.user_bytes[key] = bytes; break;
+            case 'g': snapshot.group_bytes[key] = bytes; break;
+            case 'U': snapshot.user_limits[key] = bytes; break;
+            case 'G': snapshot.group_limits[key] = bytes; break;
         }
-        PQclear(folderRes);
     }
 
-    // Update the file's folder_id
-    // If target_folder_id == 0, set folder_id to NULL (root directory)
-    std::string updateQuery = R"(
-        UPDATE files
-        SET folder_id = CASE WHEN $2::int = 0 THEN NULL ELSE $2::int END
-        WHERE file_id = $1 AND user_id = $3;
+    PQclear(res);
+    PQfinish(conn);
+    return true;
+}
+
+bool DB::setStorageQuota(char scope, int key, long long byte_limit)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        INSERT INTO storage_quotas (scope, key, byte_limit)
+        VALUES ($1, $2, $3)
+        ON CONFLICT (scope, key) DO UPDATE
+        SET byte_limit = EXCLUDED.byte_limit, updated_at = CURRENT_TIMESTAMP;
     )";
 
-    const char* updateParamValues[3];
-    updateParamValues[0] = fileIdStr.c_str();
-    std::string targetFolderIdStr = std::to_string(target_folder_id);
-    updateParamValues[1] = targetFolderIdStr.c_str();
-    updateParamValues[2] = user_id.c_str();
+    std::string scopeStr(1, scope);
+    std::string keyStr = std::to_string(key);
+    std::string limitStr = std::to_string(byte_limit);
+    const char* paramValues[3] = { scopeStr.c_str(), keyStr.c_str(), limitStr.c_str() };
 
-    PGresult* updateRes = PQexecParams(conn_, updateQuery.c_str(), 3, nullptr, updateParamValues, nullptr, nullptr, 0);
-    if (PQresultStatus(updateRes) != PGRES_COMMAND_OK)
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to move file: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(updateRes);
+        std::cerr << "Failed to set storage quota: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
         return false;
     }
 
-    PQclear(updateRes);
+    PQclear(res);
     return true;
 }
 
-bool DB::moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id)
+bool DB::deleteStorageQuota(char scope, int key)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
+
+    std::string query = "DELETE FROM storage_quotas WHERE scope = $1 AND key = $2;";
 
-    // Start a transaction
-    PGresult* transRes = PQexec(conn_, "BEGIN");
-    if (PQresultStatus(transRes) != PGRES_COMMAND_OK)
+    std::string scopeStr(1, scope);
+    std::string keyStr = std::to_string(key);
+    const char* paramValues[2] = { scopeStr.c_str(), keyStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to start transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(transRes);
+        std::cerr << "Failed to delete storage quota: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
         return false;
     }
-    PQclear(transRes);
 
-    // If target_folder_id > 0, check if the target folder exists and belongs to the user
-    if (target_folder_id > 0)
-    {
-        std::string checkFolderQuery = R"(
-            SELECT 1 FROM folders WHERE folder_id = $1 AND user_id = $2;
-        )";
-        const char* folderParamValues[2];
-        std::string folderIdStr = std::to_string(target_folder_id);
-        folderParamValues[0] = folderIdStr.c_str();
-        folderParamValues[1] = user_id.c_str();
+    PQclear(res);
+    return true;
+}
 
-        PGresult* folderRes = PQexecParams(conn_, checkFolderQuery.c_str(), 2, nullptr, folderParamValues, nullptr, nullptr, 0);
-        if (PQresultStatus(folderRes) != PGRES_TUPLES_OK)
-        {
-            std::cerr << "Failed to check folder: " << PQerrorMessage(conn_) << std::endl;
-            PQclear(folderRes);
-            PQexec(conn_, "ROLLBACK");
-            return false;
-        }
+std::optional<long long> DB::enqueueJob(PGconn* conn, const std::string& kind, const std::string& payload,
+                                     int priority, bool singleton, int max_attempts, int created_by)
+{
+    if (!conn) return std::nullopt;
 
-        if (PQntuples(folderRes) == 0)
-        {
-            std::cerr << "Folder with folder_id " << target_folder_id << " does not exist for user " << user_id << std::endl;
-            PQclear(folderRes);
-            PQexec(conn_, "ROLLBACK");
-            return false;
-        }
-        PQclear(folderRes);
-    }
+    // Повторная одиночная задача отсекается уникальным индексом jobs_singleton_idx
+    std::string query = R"(
+        INSERT INTO jobs (kind, payload, priority, singleton, max_attempts, created_by)
+        VALUES ($1, $2::JSONB, $3, $4, $5, NULLIF($6, 0))
+        ON CONFLICT DO NOTHING
+        RETURNING job_id;
+    )";
 
-    // Check if all files exist and belong to the user
-    for (int file_id : file_ids)
+    std::string priorityStr = std::to_string(priority);
+    std::string singletonStr = singleton ? "true" : "false";
+    std::string attemptsStr = std::to_string(max_attempts);
+    std::string createdByStr = std::to_string(created_by);
+    const char* paramValues[6] = { kind.c_str(), payload.c_str(), priorityStr.c_str(), singletonStr.c_str(),
+                                   attemptsStr.c_str(), createdByStr.c_str() };
+
+    PGresult* res = PQexecParams(conn, query.c_str(), 6, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::string checkFileQuery = R"(
-            SELECT 1 FROM files WHERE file_id = $1 AND user_id = $2;
-        )";
-        const char* fileParamValues[2];
-        std::string fileIdStr = std::to_string(file_id);
-        fileParamValues[0] = fileIdStr.c_str();
-        fileParamValues[1] = user_id.c_str();
+        std::cerr << "Failed to enqueue job: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
 
-        PGresult* fileRes = PQexecParams(conn_, checkFileQuery.c_str(), 2, nullptr, fileParamValues, nullptr, nullptr, 0);
-        if (PQresultStatus(fileRes) != PGRES_TUPLES_OK)
-        {
-            std::cerr << "Failed to check file: " << PQerrorMessage(conn_) << std::endl;
-            PQclear(fileRes);
-            PQexec(conn_, "ROLLBACK");
-            return false;
-        }
+    long long job_id = PQntuples(res) > 0 ? std::stoll(PQgetvalue(res, 0, 0)) : 0;
+    PQclear(res);
+    return job_id;
+}
 
-        if (PQntuples(fileRes) == 0)
-        {
-            std::cerr << "File with file_id " << file_id << " does not exist for user " << user_id << std::endl;
-            PQclear(fileRes);
-            PQexec(conn_, "ROLLBACK");
-            return false;
-        }
-        PQclear(fileRes);
-    }
+bool DB::cancelJob(long long job_id)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        UPDATE jobs SET state = 'cancelled', finished_at = CURRENT_TIMESTAMP
+        WHERE job_id = $1 AND state = 'queued';
+    )";
 
-    // Build a query to update all files at once with a single SQL statement
-    std::string fileIdsList;
-    for (size_t i = 0; i < file_ids.size(); ++i)
+    std::string idStr = std::to_string(job_id);
+    const char* paramValues[1] = { idStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        if (i > 0) fileIdsList += ",";
-        fileIdsList += std::to_string(file_ids[i]);
+        std::cerr << "Failed to cancel job: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return false;
     }
 
-    std::string updateQuery = R"(
-        UPDATE files
-        SET folder_id = CASE WHEN $1::int = 0 THEN NULL ELSE $1::int END
-        WHERE file_id IN ()" + fileIdsList + R"() AND user_id = $2;
+    bool cancelled = std::string(PQcmdTuples(res)) == "1";
+    PQclear(res);
+    return cancelled;
+}
+
+bool DB::forEachJob(const JobFilter& filter, long long before_id, int limit,
+                    const std::function<void(const RowCursor&)>& visitor)
+{
+    if (!conn()) return false;
+
+    std::string query = R"(
+        SELECT job_id, kind, payload::TEXT, priority, state, attempts, max_attempts,
+               progress_done, progress_total, message, last_error, locked_by, created_by,
+               EXTRACT(EPOCH FROM created_at)::BIGINT, EXTRACT(EPOCH FROM run_at)::BIGINT,
+               EXTRACT(EPOCH FROM started_at)::BIGINT, EXTRACT(EPOCH FROM finished_at)::BIGINT
+        FROM jobs
+        WHERE ($1::BIGINT = 0 OR job_id = $1::BIGINT)
+          AND ($2::TEXT = '' OR state = $2::TEXT)
+          AND ($3::TEXT = '' OR kind = $3::TEXT)
+          AND ($4::BIGINT = 0 OR job_id < $4::BIGINT)
+        ORDER BY job_id DESC
+        LIMIT $5;
     )";
 
-    const char* updateParamValues[2];
-    std::string targetFolderIdStr = std::to_string(target_folder_id);
-    updateParamValues[0] = targetFolderIdStr.c_str();
-    updateParamValues[1] = user_id.c_str();
+    std::string idStr = std::to_string(filter.job_id);
+    std::string beforeStr = std::to_string(before_id);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[5] = { idStr.c_str(), filter.state.c_str(), filter.kind.c_str(), beforeStr.c_str(),
+                                   limitStr.c_str() };
 
-    PGresult* updateRes = PQexecParams(conn_, updateQuery.c_str(), 2, nullptr, updateParamValues, nullptr, nullptr, 0);
-    if (PQresultStatus(updateRes) != PGRES_COMMAND_OK)
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, 5, paramValues))
     {
-        std::cerr << "Failed to move files: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(updateRes);
-        PQexec(conn_, "ROLLBACK");
         return false;
     }
-    PQclear(updateRes);
-
-    // Commit the transaction
-    PGresult* commitRes = PQexec(conn_, "COMMIT");
-    if (PQresultStatus(commitRes) != PGRES_COMMAND_OK)
+    while (cursor.next())
     {
-        std::cerr << "Failed to commit transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(commitRes);
-        return false;
+        visitor(cursor);
     }
-    PQclear(commitRes);
-
-    return true;
+    return !cursor.failed();
 }
 
-// Get all users with their IDs and emails
-std::vector<std::tuple<int, std::string, std::string>> DB::getAllUsers()
+bool DB::loadRbacTables(PGconn* conn, RbacTables& tables)
 {
-    std::vector<std::tuple<int, std::string, std::string>> users;
-    if (!conn_) return users;
+    tables = RbacTables();
+    if (!conn) return false;
 
-    std::string query = R"(
-        SELECT user_id, email, created_at
-        FROM users
-        ORDER BY user_id;
-    )";
+    if (!execCommand(conn, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY;"))
+    {
+        return false;
+    }
 
-    PGresult* res = PQexec(conn_, query.c_str());
+    PGresult* res = PQexec(conn, R"(
+        SELECT rp.role_id, p.permission_name
+        FROM role_permissions rp
+        INNER JOIN permissions p ON rp.permission_id = p.permission_id;
+    )");
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get all users: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get role permissions: " << PQerrorMessage(conn) << std::endl;
         PQclear(res);
-        return users;
+        execCommand(conn, "ROLLBACK;");
+        return false;
     }
 
     int rows = PQntuples(res);
+    tables.role_permissions.reserve(rows);
     for (int i = 0; i < rows; ++i)
     {
-        int user_id = std::stoi(PQgetvalue(res, i, 0));
-        std::string email = PQgetvalue(res, i, 1);
-        std::string created_at = PQgetvalue(res, i, 2);
+        tables.role_permissions.emplace_back(std::stoi(PQgetvalue(res, i, 0)), PQgetvalue(res, i, 1));
+    }
+    PQclear(res);
 
-        users.emplace_back(user_id, email, created_at);
+    res = PQexec(conn, "SELECT user_id, role_id FROM user_roles;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to get user roles: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        execCommand(conn, "ROLLBACK;");
+        return false;
     }
 
+    rows = PQntuples(res);
+    tables.user_roles.reserve(rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        tables.user_roles.emplace_back(std::stoi(PQgetvalue(res, i, 0)), std::stoi(PQgetvalue(res, i, 1)));
+    }
     PQclear(res);
-    return users;
+
+    return execCommand(conn, "COMMIT;");
 }
 
-// Get all files from all users
-std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> DB::getAllFilesAdmin()
+std::vector<int> DB::getUserGroupIds(const std::string& user_id)
 {
-    std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> files;
-    if (!conn_) return files;
+    std::vector<int> group_ids;
+
+    if (pinnedGroups && pinnedGroups->user_id_ == user_id)
+    {
+        return pinnedGroups->group_ids_;
+    }
+
+    if (!conn()) return group_ids;
 
-    // Query to get all files with user information
     std::string query = R"(
-        SELECT f.file_id, f.file_name, f.file_size, COALESCE(f.folder_id, 0) as folder_id,
-               f.user_id, u.email, f.created_at
-        FROM files f
-        JOIN users u ON f.user_id = u.user_id
-        ORDER BY f.user_id, f.file_id;
+        SELECT ug.group_id
+        FROM user_groups ug
+        WHERE ug.user_id = $1;
     )";
 
-    PGresult* res = PQexec(conn_, query.c_str());
+    const char* paramValues[1] = { user_id.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get all files: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get user groups: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return files;
+        return group_ids;
     }
 
     int rows = PQntuples(res);
     for (int i = 0; i < rows; ++i)
     {
-        int file_id = std::stoi(PQgetvalue(res, i, 0));
-        std::string file_name = PQgetvalue(res, i, 1);
-        int file_size = std::stoi(PQgetvalue(res, i, 2));
-        int folder_id = std::stoi(PQgetvalue(res, i, 3));
-        int user_id = std::stoi(PQgetvalue(res, i, 4));
-        std::string email = PQgetvalue(res, i, 5);
-        std::string created_at = PQgetvalue(res, i, 6);
-
-        files.emplace_back(file_id, file_name, file_size, created_at, user_id, email);
+        int group_id = std::stoi(PQgetvalue(res, i, 0));
+        group_ids.push_back(group_id);
     }
 
     PQclear(res);
-    return files;
+    return group_ids;
 }
 
-// Get all folders from all users
-std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> DB::getAllFoldersAdmin()
+std::vector<int> DB::getFileFolderIds(const std::vector<int>& file_ids)
 {
-    std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> folders;
-    if (!conn_) return folders;
+    std::vector<int> folder_ids;
+    if (!conn() || file_ids.empty()) return folder_ids;
+
+    // Массив передаём одним параметром
+    std::string idArray = toPgIntArray(file_ids);
 
-    // Query to get all folders with user information
     std::string query = R"(
-        SELECT f.folder_id, f.folder_name, COALESCE(f.parent_folder_id, 0) as parent_folder_id,
-               f.user_id, u.email, f.created_at
-        FROM folders f
-        JOIN users u ON f.user_id = u.user_id
-        ORDER BY f.user_id, f.folder_id;
+        SELECT DISTINCT COALESCE(folder_id, 0)
+        FROM files
+        WHERE file_id = ANY($1::int[]);
     )";
 
-    PGresult* res = PQexec(conn_, query.c_str());
+    const char* paramValues[1] = { idArray.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get all folders: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get file folders: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return folders;
+        return folder_ids;
     }
 
     int rows = PQntuples(res);
     for (int i = 0; i < rows; ++i)
     {
-        int folder_id = std::stoi(PQgetvalue(res, i, 0));
-        std::string folder_name = PQgetvalue(res, i, 1);
-
-        bool is_parent_null = PQgetisnull(res, i, 2);
-        int parent_folder_id = is_parent_null ? 0 : std::stoi(PQgetvalue(res, i, 2));
-
-        int user_id = std::stoi(PQgetvalue(res, i, 3));
-        std::string email = PQgetvalue(res, i, 4);
-        std::string created_at = PQgetvalue(res, i, 5);
-
-        folders.emplace_back(folder_id, folder_name, parent_folder_id, created_at, user_id, email);
+        folder_ids.push_back(std::stoi(PQgetvalue(res, i, 0)));
     }
 
     PQclear(res);
-    return folders;
+    return folder_ids;
 }
 
-// Get files for a specific user (admin view)
-std::vector<std::tuple<int, std::string, int, std::string>> DB::getFilesForUser(const std::string& user_id)
+bool DB::resolvePath(const std::string& user_id, const std::vector<std::string>& components, PathLookup& lookup)
 {
-    std::vector<std::tuple<int, std::string, int, std::string>> files;
-    if (!conn_) return files;
+    lookup = PathLookup();
+    if (!conn()) return false;
+    if (components.empty()) return true;
 
-    // Query to get all files for the specified user
+    std::string names = toPgTextArray(components);
+
+    // Один запрос: группы пользователя, затем рекурсивный спуск по компонентам, по шагу
+    // индекса на уровень; если не хватает только последнего компонента, он ищется среди файлов
     std::string query = R"(
-        SELECT file_id, file_name, file_size, COALESCE(folder_id, 0) as folder_id, created_at
-        FROM files
-        WHERE user_id = $1
-        ORDER BY file_id;
+        WITH RECURSIVE user_group_ids AS (
+            SELECT group_id FROM user_groups WHERE user_id = $1::int
+        ),
+        walk(depth, folder_id) AS (
+            SELECT 0, 0
+            UNION ALL
+            SELECT w.depth + 1, child.folder_id
+            FROM walk w
+            CROSS JOIN LATERAL (
+                SELECT f.folder_id
+                FROM folders f
+                WHERE COALESCE(f.parent_folder_id, 0) = w.folder_id
+                  AND f.folder_name = ($2::text[])[w.depth + 1]
+                  AND (f.user_id = $1 OR f.group_id IN (SELECT group_id FROM user_group_ids))
+                ORDER BY (f.user_id = $1) DESC, f.folder_id
+                LIMIT 1
+            ) child
+            WHERE w.depth < cardinality($2::text[])
+        ),
+        deepest AS (
+            SELECT depth, folder_id FROM walk ORDER BY depth DESC LIMIT 1
+        )
+        SELECT d.depth, d.folder_id, COALESCE(leaf.file_id, 0)
+        FROM deepest d
+        LEFT JOIN LATERAL (
+            SELECT fi.file_id
+            FROM files fi
+            WHERE d.depth = cardinality($2::text[]) - 1
+              AND COALESCE(fi.folder_id, 0) = d.folder_id
+              AND fi.file_name = ($2::text[])[d.depth + 1]
+              AND (fi.user_id = $1 OR fi.group_id IN (SELECT group_id FROM user_group_ids))
+            ORDER BY (fi.user_id = $1) DESC, fi.file_id
+            LIMIT 1
+        ) leaf ON TRUE;
     )";
 
-    const char* paramValues[1] = { user_id.c_str() };
+    const char* paramValues[2] = { user_id.c_str(), names.c_str() };
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get files for user " << user_id << ": " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to resolve path: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return files;
+        return false;
     }
 
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i)
+    if (PQntuples(res) > 0)
     {
-        int file_id = std::stoi(PQgetvalue(res, i, 0));
-        std::string file_name = PQgetvalue(res, i, 1);
-        int file_size = std::stoi(PQgetvalue(res, i, 2));
-        int folder_id = std::stoi(PQgetvalue(res, i, 3));
-        std::string created_at = PQgetvalue(res, i, 4);
-
-        files.emplace_back(file_id, file_name, file_size, created_at);
+        lookup.depth = std::stoi(PQgetvalue(res, 0, 0));
+        lookup.folder_id = std::stoi(PQgetvalue(res, 0, 1));
+        lookup.file_id = std::stoi(PQgetvalue(res, 0, 2));
     }
 
     PQclear(res);
-    return files;
+    return true;
 }
 
-// Get folders for a specific user (admin view)
-std::vector<std::tuple<int, std::string, int, std::string>> DB::getFoldersForUser(const std::string& user_id)
+bool DB::ensureFolderPath(const std::string& user_id, const std::vector<std::string>& components, int group_id,
+                          std::vector<PathFolder>& folders)
 {
-    std::vector<std::tuple<int, std::string, int, std::string>> folders;
-    if (!conn_) return folders;
+    folders.clear();
+    if (!conn()) return false;
+
+    std::string names = toPgTextArray(components);
+    std::string groupIdStr = std::to_string(group_id);
 
-    // Query to get all folders for the specified user
     std::string query = R"(
-        SELECT folder_id, folder_name, COALESCE(parent_folder_id, 0) as parent_folder_id, created_at
-        FROM folders
-        WHERE user_id = $1
-        ORDER BY folder_id;
+        SELECT resolved_id, COALESCE(resolved_group, 0), was_created
+        FROM ensure_folder_path($1::int, $2::text[], $3::int)
+        ORDER BY component;
     )";
 
-    const char* paramValues[1] = { user_id.c_str() };
+    const char* paramValues[3] = { user_id.c_str(), names.c_str(), groupIdStr.c_str() };
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get folders for user " << user_id << ": " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to create folder path: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return folders;
+        return false;
     }
 
     int rows = PQntuples(res);
     for (int i = 0; i < rows; ++i)
     {
-        int folder_id = std::stoi(PQgetvalue(res, i, 0));
-        std::string folder_name = PQgetvalue(res, i, 1);
-
-        bool is_parent_null = PQgetisnull(res, i, 2);
-        int parent_folder_id = is_parent_null ? 0 : std::stoi(PQgetvalue(res, i, 2));
-
-        std::string created_at = PQgetvalue(res, i, 3);
-
-        folders.emplace_back(folder_id, folder_name, parent_folder_id, created_at);
+        folders.push_back({std::stoi(PQgetvalue(res, i, 0)), std::stoi(PQgetvalue(res, i, 1)),
+                           PQgetvalue(res, i, 2)[0] == 't'});
     }
 
     PQclear(res);
-    return folders;
+    return true;
 }
 
-// Get system statistics: total_users, total_files, total_folders, total_storage_bytes
-std::tuple<int, int, int, long long> DB::getSystemStats()
+std::vector<std::tuple<int, std::string, int, int>> DB::getAccessibleFiles(const std::string& user_id, const std::vector<int>& file_ids)
 {
-    int total_users = 0;
-    int total_files = 0;
-    int total_folders = 0;
-    long long total_storage_bytes = 0;
-
-    if (!conn_) return std::make_tuple(0, 0, 0, 0);
-
-    // Get total users count
-    std::string userCountQuery = "SELECT COUNT(*) FROM users;";
-    PGresult* userCountRes = PQexec(conn_, userCountQuery.c_str());
-    if (PQresultStatus(userCountRes) == PGRES_TUPLES_OK && PQntuples(userCountRes) > 0) {
-        total_users = std::stoi(PQgetvalue(userCountRes, 0, 0));
-    }
-    PQclear(userCountRes);
-
-    // Get total files count and storage size
-    std::string fileStatsQuery = "SELECT COUNT(*), COALESCE(SUM(file_size), 0) FROM files;";
-    PGresult* fileStatsRes = PQexec(conn_, fileStatsQuery.c_str());
-    if (PQresultStatus(fileStatsRes) == PGRES_TUPLES_OK && PQntuples(fileStatsRes) > 0) {
-        total_files = std::stoi(PQgetvalue(fileStatsRes, 0, 0));
-        total_storage_bytes = std::stoll(PQgetvalue(fileStatsRes, 0, 1));
-    }
-    PQclear(fileStatsRes);
+    std::vector<std::tuple<int, std::string, int, int>> files;
+    if (!conn() || file_ids.empty()) return files;
 
-    // Get total folders count
-    std::string folderCountQuery = "SELECT COUNT(*) FROM folders;";
-    PGresult* folderCountRes = PQexec(conn_, folderCountQuery.c_str());
-    if (PQresultStatus(folderCountRes) == PGRES_TUPLES_OK && PQntuples(folderCountRes) > 0) {
-        total_folders = std::stoi(PQgetvalue(folderCountRes, 0, 0));
-    }
-    PQclear(folderCountRes);
-
-    return std::make_tuple(total_users, total_files, total_folders, total_storage_bytes);
-}
+    auto user_groups = getUserGroupIds(user_id);
 
-// Get file type distribution (for admin dashboard)
-std::vector<std::pair<std::string, int>> DB::getFileTypeDistribution()
-{
-    std::vector<std::pair<std::string, int>> distribution;
-    if (!conn_) return distribution;
+    std::string idArray = toPgIntArray(file_ids);
+    std::string groupArray = toPgIntArray(user_groups);
 
-    // Query to get file extension distribution
+    // Same rule as canUserAccessFile, for a whole batch of ids
     std::string query = R"(
-        SELECT
-            CASE
-                WHEN RIGHT(file_name, POSITION('.' IN REVERSE(file_name))) = '' THEN 'no_extension'
-                ELSE LOWER(RIGHT(file_name, POSITION('.' IN REVERSE(file_name)) - 1))
-            END AS extension,
-            COUNT(*) as count
+        SELECT file_id, file_name, COALESCE(folder_id, 0), file_size
         FROM files
-        GROUP BY extension
-        ORDER BY count DESC
-        LIMIT 10;
+        WHERE file_id = ANY($1::int[])
+          AND (user_id = $2 OR group_id = ANY($3::int[]));
     )";
 
-    PGresult* res = PQexec(conn_, query.c_str());
+    const char* paramValues[3] = { idArray.c_str(), user_id.c_str(), groupArray.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get file type distribution: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to filter accessible files: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return distribution;
+        return files;
     }
 
     int rows = PQntuples(res);
     for (int i = 0; i < rows; ++i)
     {
-        std::string extension = PQgetvalue(res, i, 0);
-        int count = std::stoi(PQgetvalue(res, i, 1));
-        distribution.emplace_back(extension, count);
+        files.emplace_back(std::stoi(PQgetvalue(res, i, 0)), PQgetvalue(res, i, 1),
+                           std::stoi(PQgetvalue(res, i, 2)), std::stoi(PQgetvalue(res, i, 3)));
     }
 
     PQclear(res);
-    return distribution;
+    return files;
 }
 
-// Get top users by storage usage
-std::vector<std::tuple<std::string, std::string, long long>> DB::getTopUsersByStorage(int limit)
+std::vector<int> DB::getAccessibleFileIds(const std::string& user_id)
 {
-    std::vector<std::tuple<std::string, std::string, long long>> topUsers;
-    if (!conn_) return topUsers;
+    std::vector<int> ids;
+    if (!conn()) return ids;
+
+    std::string groupArray = toPgIntArray(getUserGroupIds(user_id));
 
-    // Build query with the requested limit
     std::string query = R"(
-        SELECT
-            u.user_id,
-            u.email,
-            COALESCE(SUM(f.file_size), 0) as total_storage
-        FROM
-            users u
-        LEFT JOIN
-            files f ON u.user_id = f.user_id
-        GROUP BY
-            u.user_id, u.email
-        ORDER BY
-            total_storage DESC
-        LIMIT
-    )" + std::to_string(limit) + ";";
+        SELECT file_id
+        FROM files
+        WHERE user_id = $1 OR group_id = ANY($2::int[]);
+    )";
 
-    PGresult* res = PQexec(conn_, query.c_str());
+    const char* paramValues[2] = { user_id.c_str(), groupArray.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get top users by storage: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to list accessible files: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
-        return topUsers;
+        return ids;
     }
 
     int rows = PQntuples(res);
+    ids.reserve(rows);
     for (int i = 0; i < rows; ++i)
     {
-        std::string userId = PQgetvalue(res, i, 0);
-        std::string email = PQgetvalue(res, i, 1);
-        long long storageBytes = std::stoll(PQgetvalue(res, i, 2));
-
-        topUsers.emplace_back(userId, email, storageBytes);
+        ids.push_back(std::stoi(PQgetvalue(res, i, 0)));
     }
 
     PQclear(res);
-    return topUsers;
+    return ids;
 }
 
-std::vector<int> DB::getUserGroupIds(const std::string& user_id)
+std::optional<int> DB::getParentFolderId(int folder_id)
 {
-    std::vector<int> group_ids;
-    if (!conn_) return group_ids;
+    if (!conn()) return std::nullopt;
 
     std::string query = R"(
-        SELECT ug.group_id
-        FROM user_groups ug
-        WHERE ug.user_id = $1;
+        SELECT COALESCE(parent_folder_id, 0)
+        FROM folders
+        WHERE folder_id = $1;
     )";
 
-    const char* paramValues[1] = { user_id.c_str() };
+    std::string folderIdStr = std::to_string(folder_id);
+    const char* paramValues[1] = { folderIdStr.c_str() };
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0)
     {
-        std::cerr << "Failed to get user groups: " << PQerrorMessage(conn_) << std::endl;
         PQclear(res);
-        return group_ids;
-    }
-
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i)
-    {
-        int group_id = std::stoi(PQgetvalue(res, i, 0));
-        group_ids.push_back(group_id);
+        return std::nullopt;
     }
 
+    int parent_id = std::stoi(PQgetvalue(res, 0, 0));
     PQclear(res);
-    return group_ids;
+    return parent_id;
 }
 
 std::vector<ExtendedFileInfo> DB::getExtendedFiles(const std::string& user_id, int folder_id)
 {
     std::vector<ExtendedFileInfo> files;
-    if (!conn_) return files;
+    forEachExtendedFile(user_id, folder_id, [&files](const ExtendedFileInfo& file) {
+        files.push_back(file);
+    });
+    return files;
+}
+
+bool DB::forEachExtendedFile(const std::string& user_id, int folder_id,
+                             const std::function<void(const ExtendedFileInfo&)>& visitor)
+{
+    if (!conn()) return false;
 
     auto user_groups = getUserGroupIds(user_id);
 
@@ -1156,46 +3639,53 @@ std::vector<ExtendedFileInfo> DB::getExtendedFiles(const std::string& user_id, i
               AND (f.user_id = $1 OR f.group_id IN ()" + group_list + R"())
             ORDER BY f.file_type DESC, f.file_id;
         )";
-        std::string folderIdStr = std::to_string(folder_id);
-        paramValues[1] = folderIdStr.c_str();
     }
 
+    std::string folderIdStr = std::to_string(folder_id);
+    paramValues[1] = folderIdStr.c_str();
+
     int paramCount = (folder_id == 0) ? 1 : 2;
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, paramCount, paramValues))
     {
-        std::cerr << "Query failed: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(res);
-        return files;
+        return false;
     }
 
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i)
+    // Один объект на все строки: строки переиспользуют выделенную память
+    ExtendedFileInfo file;
+    while (cursor.next())
     {
-        ExtendedFileInfo file;
-        file.file_id = std::stoi(PQgetvalue(res, i, 0));
-        file.file_name = PQgetvalue(res, i, 1);
-        file.file_size = std::stoi(PQgetvalue(res, i, 2));
-        file.created_at = PQgetvalue(res, i, 3);
-        file.file_type = PQgetvalue(res, i, 4);
-        file.owner_id = std::stoi(PQgetvalue(res, i, 5));
-        file.owner_email = PQgetvalue(res, i, 6);
-        file.group_id = std::stoi(PQgetvalue(res, i, 7));
-        file.group_name = PQgetvalue(res, i, 8);
-        file.is_favorite = (std::string(PQgetvalue(res, i, 9)) == "t");
-
-        files.push_back(file);
+        file.file_id = std::stoi(cursor.get(0));
+        file.file_name = cursor.get(1);
+        file.file_size = std::stoi(cursor.get(2));
+        file.created_at = cursor.get(3);
+        file.file_type = cursor.get(4);
+        file.owner_id = std::stoi(cursor.get(5));
+        file.owner_email = cursor.get(6);
+        file.group_id = std::stoi(cursor.get(7));
+        file.group_name = cursor.get(8);
+        file.is_favorite = (cursor.get(9)[0] == 't');
+
+        visitor(file);
     }
 
-    PQclear(res);
-    return files;
+    return !cursor.failed();
 }
 
 std::vector<ExtendedFolderInfo> DB::getExtendedFolders(const std::string& user_id, int parent_folder_id)
 {
     std::vector<ExtendedFolderInfo> folders;
-    if (!conn_) return folders;
+    forEachExtendedFolder(user_id, parent_folder_id, [&folders](const ExtendedFolderInfo& folder) {
+        folders.push_back(folder);
+    });
+    return folders;
+}
+
+bool DB::forEachExtendedFolder(const std::string& user_id, int parent_folder_id,
+                               const std::function<void(const ExtendedFolderInfo&)>& visitor)
+{
+    if (!conn()) return false;
 
     auto user_groups = getUserGroupIds(user_id);
 
@@ -1216,10 +3706,12 @@ std::vector<ExtendedFolderInfo> DB::getExtendedFolders(const std::string& user_i
                    f.user_id as owner_id, u.email as owner_email,
                    COALESCE(f.group_id, 0) as group_id,
                    COALESCE(g.group_name, '') as group_name,
-                   COALESCE(f.is_favorite, FALSE) as is_favorite
+                   COALESCE(f.is_favorite, FALSE) as is_favorite,
+                   COALESCE(fs.total_bytes, 0), COALESCE(fs.file_count, 0), COALESCE(fs.subfolder_count, 0)
             FROM folders f
             JOIN users u ON f.user_id = u.user_id
             LEFT JOIN groups g ON f.group_id = g.group_id
+            LEFT JOIN folder_stats fs ON fs.folder_id = f.folder_id
             WHERE f.parent_folder_id IS NULL
               AND (f.user_id = $1 OR f.group_id IN ()" + group_list + R"())
             ORDER BY f.folder_type DESC, f.folder_id;
@@ -1233,56 +3725,55 @@ std::vector<ExtendedFolderInfo> DB::getExtendedFolders(const std::string& user_i
                    f.user_id as owner_id, u.email as owner_email,
                    COALESCE(f.group_id, 0) as group_id,
                    COALESCE(g.group_name, '') as group_name,
-                   COALESCE(f.is_favorite, FALSE) as is_favorite
+                   COALESCE(f.is_favorite, FALSE) as is_favorite,
+                   COALESCE(fs.total_bytes, 0), COALESCE(fs.file_count, 0), COALESCE(fs.subfolder_count, 0)
             FROM folders f
             JOIN users u ON f.user_id = u.user_id
             LEFT JOIN groups g ON f.group_id = g.group_id
+            LEFT JOIN folder_stats fs ON fs.folder_id = f.folder_id
             WHERE f.parent_folder_id = $2
               AND (f.user_id = $1 OR f.group_id IN ()" + group_list + R"())
             ORDER BY f.folder_type DESC, f.folder_id;
         )";
-        std::string parentIdStr = std::to_string(parent_folder_id);
-        paramValues[1] = parentIdStr.c_str();
     }
 
+    std::string parentIdStr = std::to_string(parent_folder_id);
+    paramValues[1] = parentIdStr.c_str();
+
     int paramCount = (parent_folder_id == 0) ? 1 : 2;
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), paramCount, nullptr, paramValues, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    RowCursor cursor(conn(), false);
+    if (!cursor.start(query, paramCount, paramValues))
     {
-        std::cerr << "Failed to get folders: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(res);
-        return folders;
+        return false;
     }
 
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i)
+    ExtendedFolderInfo folder;
+    while (cursor.next())
     {
-        ExtendedFolderInfo folder;
-        folder.folder_id = std::stoi(PQgetvalue(res, i, 0));
-        folder.folder_name = PQgetvalue(res, i, 1);
-
-        bool is_parent_null = PQgetisnull(res, i, 2);
-        folder.parent_folder_id = is_parent_null ? 0 : std::stoi(PQgetvalue(res, i, 2));
-
-        folder.created_at = PQgetvalue(res, i, 3);
-        folder.folder_type = PQgetvalue(res, i, 4);
-        folder.owner_id = std::stoi(PQgetvalue(res, i, 5));
-        folder.owner_email = PQgetvalue(res, i, 6);
-        folder.group_id = std::stoi(PQgetvalue(res, i, 7));
-        folder.group_name = PQgetvalue(res, i, 8);
-        folder.is_favorite = (std::string(PQgetvalue(res, i, 9)) == "t");
-
-        folders.push_back(folder);
+        folder.folder_id = std::stoi(cursor.get(0));
+        folder.folder_name = cursor.get(1);
+        folder.parent_folder_id = cursor.isNull(2) ? 0 : std::stoi(cursor.get(2));
+        folder.created_at = cursor.get(3);
+        folder.folder_type = cursor.get(4);
+        folder.owner_id = std::stoi(cursor.get(5));
+        folder.owner_email = cursor.get(6);
+        folder.group_id = std::stoi(cursor.get(7));
+        folder.group_name = cursor.get(8);
+        folder.is_favorite = (cursor.get(9)[0] == 't');
+        folder.total_bytes = std::stoll(cursor.get(10));
+        folder.file_count = std::stoll(cursor.get(11));
+        folder.subfolder_count = std::stoll(cursor.get(12));
+
+        visitor(folder);
     }
 
-    PQclear(res);
-    return folders;
+    return !cursor.failed();
 }
 
 bool DB::canUserAccessFile(const std::string& user_id, int file_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     auto user_groups = getUserGroupIds(user_id);
 
@@ -1303,10 +3794,10 @@ bool DB::canUserAccessFile(const std::string& user_id, int file_id)
     paramValues[0] = fileIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to check file access: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to check file access: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1318,7 +3809,7 @@ bool DB::canUserAccessFile(const std::string& user_id, int file_id)
 
 bool DB::canUserModifyFile(const std::string& user_id, int file_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     std::string query = R"(
         SELECT 1 FROM files
@@ -1331,10 +3822,10 @@ bool DB::canUserModifyFile(const std::string& user_id, int file_id)
     paramValues[0] = fileIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to check file modify permission: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to check file modify permission: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1346,7 +3837,7 @@ bool DB::canUserModifyFile(const std::string& user_id, int file_id)
 
 bool DB::canUserAccessFolder(const std::string& user_id, int folder_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     auto user_groups = getUserGroupIds(user_id);
 
@@ -1367,10 +3858,10 @@ bool DB::canUserAccessFolder(const std::string& user_id, int folder_id)
     paramValues[0] = folderIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to check folder access: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to check folder access: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1382,7 +3873,7 @@ bool DB::canUserAccessFolder(const std::string& user_id, int folder_id)
 
 bool DB::canUserModifyFolder(const std::string& user_id, int folder_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     std::string query = R"(
         SELECT 1 FROM folders
@@ -1395,10 +3886,10 @@ bool DB::canUserModifyFolder(const std::string& user_id, int folder_id)
     paramValues[0] = folderIdStr.c_str();
     paramValues[1] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to check folder modify permission: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to check folder modify permission: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1410,7 +3901,7 @@ bool DB::canUserModifyFolder(const std::string& user_id, int folder_id)
 
 bool DB::insertSharedFile(const std::string& user_id, int folder_id, const std::string& file_name, int file_size, int group_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     if (folder_id > 0)
     {
@@ -1449,10 +3940,10 @@ bool DB::insertSharedFile(const std::string& user_id, int folder_id, const std::
     std::string groupIdStr = std::to_string(group_id);
     paramValues[4] = groupIdStr.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 5, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 5, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to insert shared file: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to insert shared file: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1463,7 +3954,7 @@ bool DB::insertSharedFile(const std::string& user_id, int folder_id, const std::
 
 bool DB::createSharedFolder(const std::string& user_id, const std::string& folder_name, int parent_folder_id, int group_id)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     if (parent_folder_id > 0)
     {
@@ -1494,10 +3985,10 @@ bool DB::createSharedFolder(const std::string& user_id, const std::string& folde
     std::string groupIdStr = std::to_string(group_id);
     paramValues[3] = groupIdStr.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 4, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 4, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to create shared folder: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to create shared folder: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1509,7 +4000,7 @@ bool DB::createSharedFolder(const std::string& user_id, const std::string& folde
 std::vector<std::pair<int, std::string>> DB::getUserGroups(int user_id)
 {
     std::vector<std::pair<int, std::string>> groups;
-    if (!conn_) return groups;
+    if (!conn()) return groups;
 
     std::string query = R"(
         SELECT g.group_id, g.group_name
@@ -1523,10 +4014,10 @@ std::vector<std::pair<int, std::string>> DB::getUserGroups(int user_id)
     std::string userIdStr = std::to_string(user_id);
     paramValues[0] = userIdStr.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get user groups: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get user groups: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return groups;
     }
@@ -1545,17 +4036,14 @@ std::vector<std::pair<int, std::string>> DB::getUserGroups(int user_id)
 
 bool DB::syncUserGroups(int user_id, const std::vector<std::pair<int, std::string>>& groups)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Начинаем транзакцию
-    PGresult* transRes = PQexec(conn_, "BEGIN");
-    if (PQresultStatus(transRes) != PGRES_COMMAND_OK)
+    Transaction transaction(*this);
+    if (!transaction.ok())
     {
-        std::cerr << "Failed to start transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(transRes);
         return false;
     }
-    PQclear(transRes);
 
     // Удаляем все старые связи пользователя с группами
     std::string deleteQuery = "DELETE FROM user_groups WHERE user_id = $1;";
@@ -1563,12 +4051,11 @@ bool DB::syncUserGroups(int user_id, const std::vector<std::pair<int, std::strin
     std::string userIdStr = std::to_string(user_id);
     deleteParams[0] = userIdStr.c_str();
 
-    PGresult* deleteRes = PQexecParams(conn_, deleteQuery.c_str(), 1, nullptr, deleteParams, nullptr, nullptr, 0);
+    PGresult* deleteRes = PQexecParams(conn(), deleteQuery.c_str(), 1, nullptr, deleteParams, nullptr, nullptr, 0);
     if (PQresultStatus(deleteRes) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to delete old user groups: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to delete old user groups: " << PQerrorMessage(conn()) << std::endl;
         PQclear(deleteRes);
-        PQexec(conn_, "ROLLBACK");
         return false;
     }
     PQclear(deleteRes);
@@ -1587,43 +4074,35 @@ bool DB::syncUserGroups(int user_id, const std::vector<std::pair<int, std::strin
         insertParams[0] = userIdStr.c_str();
         insertParams[1] = groupIdStr.c_str();
 
-        PGresult* insertRes = PQexecParams(conn_, insertQuery.c_str(), 2, nullptr, insertParams, nullptr, nullptr, 0);
+        PGresult* insertRes = PQexecParams(conn(), insertQuery.c_str(), 2, nullptr, insertParams, nullptr, nullptr, 0);
         if (PQresultStatus(insertRes) != PGRES_COMMAND_OK)
         {
-            std::cerr << "Failed to insert user group: " << PQerrorMessage(conn_) << std::endl;
+            std::cerr << "Failed to insert user group: " << PQerrorMessage(conn()) << std::endl;
             PQclear(insertRes);
-            PQexec(conn_, "ROLLBACK");
             return false;
         }
         PQclear(insertRes);
     }
 
     // Коммитим транзакцию
-    PGresult* commitRes = PQexec(conn_, "COMMIT");
-    if (PQresultStatus(commitRes) != PGRES_COMMAND_OK)
+    if (!transaction.commit())
     {
-        std::cerr << "Failed to commit transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(commitRes);
         return false;
     }
-    PQclear(commitRes);
 
     return true;
 }
 
 bool DB::syncAllGroups(const std::vector<std::pair<int, std::string>>& groups)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Начинаем транзакцию
-    PGresult* transRes = PQexec(conn_, "BEGIN");
-    if (PQresultStatus(transRes) != PGRES_COMMAND_OK)
+    Transaction transaction(*this);
+    if (!transaction.ok())
     {
-        std::cerr << "Failed to start transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(transRes);
         return false;
     }
-    PQclear(transRes);
 
     // Обновляем или вставляем группы
     for (const auto& group : groups)
@@ -1640,32 +4119,27 @@ bool DB::syncAllGroups(const std::vector<std::pair<int, std::string>>& groups)
         params[0] = groupIdStr.c_str();
         params[1] = group.second.c_str();
 
-        PGresult* res = PQexecParams(conn_, upsertQuery.c_str(), 2, nullptr, params, nullptr, nullptr, 0);
+        PGresult* res = PQexecParams(conn(), upsertQuery.c_str(), 2, nullptr, params, nullptr, nullptr, 0);
         if (PQresultStatus(res) != PGRES_COMMAND_OK)
         {
-            std::cerr << "Failed to sync group: " << PQerrorMessage(conn_) << std::endl;
+            std::cerr << "Failed to sync group: " << PQerrorMessage(conn()) << std::endl;
             PQclear(res);
-            PQexec(conn_, "ROLLBACK");
             return false;
         }
         PQclear(res);
     }
 
-    PGresult* commitRes = PQexec(conn_, "COMMIT");
-    if (PQresultStatus(commitRes) != PGRES_COMMAND_OK)
+    if (!transaction.commit())
     {
-        std::cerr << "Failed to commit transaction: " << PQerrorMessage(conn_) << std::endl;
-        PQclear(commitRes);
         return false;
     }
-    PQclear(commitRes);
 
     return true;
 }
 
 bool DB::toggleFileFavorite(const std::string& user_id, int file_id, bool is_favorite)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Проверяем права доступа к файлу
     if (!canUserAccessFile(user_id, file_id)) {
@@ -1686,10 +4160,10 @@ bool DB::toggleFileFavorite(const std::string& user_id, int file_id, bool is_fav
     paramValues[1] = fileIdStr.c_str();
     paramValues[2] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to toggle file favorite: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to toggle file favorite: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1703,7 +4177,7 @@ bool DB::toggleFileFavorite(const std::string& user_id, int file_id, bool is_fav
 
 bool DB::toggleFolderFavorite(const std::string& user_id, int folder_id, bool is_favorite)
 {
-    if (!conn_) return false;
+    if (!conn()) return false;
 
     // Проверяем права доступа к папке
     if (!canUserAccessFolder(user_id, folder_id)) {
@@ -1724,10 +4198,10 @@ bool DB::toggleFolderFavorite(const std::string& user_id, int folder_id, bool is
     paramValues[1] = folderIdStr.c_str();
     paramValues[2] = user_id.c_str();
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 3, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
     {
-        std::cerr << "Failed to toggle folder favorite: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to toggle folder favorite: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return false;
     }
@@ -1742,7 +4216,7 @@ bool DB::toggleFolderFavorite(const std::string& user_id, int folder_id, bool is
 std::vector<ExtendedFileInfo> DB::getFavoriteFiles(const std::string& user_id)
 {
     std::vector<ExtendedFileInfo> files;
-    if (!conn_) return files;
+    if (!conn()) return files;
 
     auto user_groups = getUserGroupIds(user_id);
 
@@ -1767,10 +4241,10 @@ std::vector<ExtendedFileInfo> DB::getFavoriteFiles(const std::string& user_id)
 
     const char* paramValues[1] = { user_id.c_str() };
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get favorite files: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get favorite files: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return files;
     }
@@ -1799,17 +4273,19 @@ std::vector<ExtendedFileInfo> DB::getFavoriteFiles(const std::string& user_id)
 std::vector<ExtendedFolderInfo> DB::getFavoriteFolders(const std::string& user_id)
 {
     std::vector<ExtendedFolderInfo> folders;
-    if (!conn_) return folders;
+    if (!conn()) return folders;
 
     std::string query = R"(
         SELECT f.folder_id, f.folder_name, f.parent_folder_id, f.created_at,
                COALESCE(f.folder_type, 'personal') as folder_type,
                f.user_id as owner_id, u.email as owner_email,
                COALESCE(f.group_id, 0) as group_id,
-               COALESCE(g.group_name, '') as group_name
+               COALESCE(g.group_name, '') as group_name,
+               COALESCE(fs.total_bytes, 0), COALESCE(fs.file_count, 0), COALESCE(fs.subfolder_count, 0)
         FROM folders f
         JOIN users u ON f.user_id = u.user_id
         LEFT JOIN groups g ON f.group_id = g.group_id
+        LEFT JOIN folder_stats fs ON fs.folder_id = f.folder_id
         WHERE f.user_id = $1
           AND f.is_favorite = TRUE
         ORDER BY f.created_at DESC;
@@ -1817,10 +4293,10 @@ std::vector<ExtendedFolderInfo> DB::getFavoriteFolders(const std::string& user_i
 
     const char* paramValues[1] = { user_id.c_str() };
 
-    PGresult* res = PQexecParams(conn_, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK)
     {
-        std::cerr << "Failed to get favorite folders: " << PQerrorMessage(conn_) << std::endl;
+        std::cerr << "Failed to get favorite folders: " << PQerrorMessage(conn()) << std::endl;
         PQclear(res);
         return folders;
     }
@@ -1841,10 +4317,198 @@ std::vector<ExtendedFolderInfo> DB::getFavoriteFolders(const std::string& user_i
         folder.owner_email = PQgetvalue(res, i, 6);
         folder.group_id = std::stoi(PQgetvalue(res, i, 7));
         folder.group_name = PQgetvalue(res, i, 8);
+        folder.is_favorite = true;
+        folder.total_bytes = std::stoll(PQgetvalue(res, i, 9));
+        folder.file_count = std::stoll(PQgetvalue(res, i, 10));
+        folder.subfolder_count = std::stoll(PQgetvalue(res, i, 11));
 
         folders.push_back(folder);
     }
 
     PQclear(res);
     return folders;
-}
\ No newline at end of file
+}
+
+// ===========================================================================
+//                           Журнал изменений
+// ===========================================================================
+namespace {
+
+// Области позиций в виде трёх параллельных массивов PostgreSQL
+void toPgScopeArrays(const std::vector<JournalPosition>& positions,
+                     std::string& types, std::string& ids, std::string& seqs)
+{
+    types = "{";
+    ids = "{";
+    seqs = "{";
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        if (i > 0)
+        {
+            types += ",";
+            ids += ",";
+            seqs += ",";
+        }
+        types += positions[i].scope_type;
+        ids += std::to_string(positions[i].scope_id);
+        seqs += std::to_string(positions[i].seq);
+    }
+    types += "}";
+    ids += "}";
+    seqs += "}";
+}
+
+} // namespace
+
+bool DB::readJournal(const std::vector<JournalPosition>& positions, int limit, std::vector<JournalEntry>& entries)
+{
+    if (!conn()) return false;
+    if (positions.empty()) return true;
+
+    // Each scope is read as a range scan of the primary key, starting after its position
+    std::string query = R"(
+        SELECT j.scope_type, j.scope_id, j.seq, j.entity, j.entity_id, j.op,
+               COALESCE(j.parent_id, 0), COALESCE(j.name, ''), COALESCE(j.file_size, -1), j.changed_at
+        FROM unnest($1::text[], $2::int[], $3::bigint[]) AS c(scope_type, scope_id, pos)
+        CROSS JOIN LATERAL (
+            SELECT *
+            FROM change_journal cj
+            WHERE cj.scope_type = c.scope_type
+              AND cj.scope_id = c.scope_id
+              AND cj.seq > c.pos
+            ORDER BY cj.seq
+            LIMIT $4
+        ) j
+        ORDER BY j.scope_type, j.scope_id, j.seq
+        LIMIT $4;
+    )";
+
+    std::string types, ids, seqs;
+    toPgScopeArrays(positions, types, ids, seqs);
+    std::string limitStr = std::to_string(limit);
+    const char* paramValues[4] = { types.c_str(), ids.c_str(), seqs.c_str(), limitStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 4, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to read change journal: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return false;
+    }
+
+    int rows = PQntuples(res);
+    entries.reserve(entries.size() + rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        JournalEntry entry;
+        entry.scope_type = PQgetvalue(res, i, 0)[0];
+        entry.scope_id = std::stoi(PQgetvalue(res, i, 1));
+        entry.seq = std::stoll(PQgetvalue(res, i, 2));
+        entry.entity = PQgetvalue(res, i, 3);
+        entry.entity_id = std::stoi(PQgetvalue(res, i, 4));
+        entry.op = PQgetvalue(res, i, 5);
+        entry.parent_id = std::stoi(PQgetvalue(res, i, 6));
+        entry.name = PQgetvalue(res, i, 7);
+        entry.file_size = std::stoi(PQgetvalue(res, i, 8));
+        entry.changed_at = PQgetvalue(res, i, 9);
+        entries.push_back(std::move(entry));
+    }
+
+    PQclear(res);
+    return true;
+}
+
+bool DB::getJournalHeads(std::vector<JournalPosition>& positions)
+{
+    if (!conn()) return false;
+    if (positions.empty()) return true;
+
+    std::string query = R"(
+        SELECT c.ord, COALESCE(h.seq, 0)
+        FROM unnest($1::text[], $2::int[]) WITH ORDINALITY AS c(scope_type, scope_id, ord)
+        LEFT JOIN journal_heads h ON h.scope_type = c.scope_type AND h.scope_id = c.scope_id;
+    )";
+
+    std::string types, ids, seqs;
+    toPgScopeArrays(positions, types, ids, seqs);
+    const char* paramValues[2] = { types.c_str(), ids.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::cerr << "Failed to read change journal heads: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return false;
+    }
+
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        size_t index = std::stoul(PQgetvalue(res, i, 0)) - 1;
+        if (index < positions.size())
+        {
+            positions[index].seq = std::stoll(PQgetvalue(res, i, 1));
+        }
+    }
+
+    PQclear(res);
+    return true;
+}
+
+// ===========================================================================
+//                           Версии списков (ETag)
+// ===========================================================================
+std::optional<std::string> DB::getListingVersion(const std::string& user_id, int folder_id)
+{
+    if (!conn()) return std::nullopt;
+
+    // Счётчики списка и состав групп пользователя одним запросом: от групп зависит, что видно в списке
+    std::string query = R"(
+        SELECT COALESCE(SUM(v.version), 0)::TEXT
+               || COALESCE((SELECT string_agg('.' || group_id, '' ORDER BY group_id)
+                            FROM user_groups WHERE user_id = $1), '')
+        FROM listing_versions v
+        WHERE ($2 > 0 AND v.scope_type = 'd' AND v.scope_id = $2)
+           OR ($2 = 0 AND v.scope_type = 'u' AND v.scope_id = $1)
+           OR ($2 = 0 AND v.scope_type = 'g'
+               AND v.scope_id IN (SELECT group_id FROM user_groups WHERE user_id = $1));
+    )";
+
+    std::string folderIdStr = std::to_string(std::max(folder_id, 0));
+    const char* paramValues[2] = { user_id.c_str(), folderIdStr.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0)
+    {
+        std::cerr << "Failed to read listing version: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    std::string version = PQgetvalue(res, 0, 0);
+    PQclear(res);
+    return version;
+}
+
+std::optional<std::string> DB::getFavoritesVersion(const std::string& user_id)
+{
+    if (!conn()) return std::nullopt;
+
+    std::string query = R"(
+        SELECT COALESCE((SELECT version FROM listing_versions WHERE scope_type = 'v' AND scope_id = $1), 0);
+    )";
+
+    const char* paramValues[1] = { user_id.c_str() };
+
+    PGresult* res = PQexecParams(conn(), query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0)
+    {
+        std::cerr << "Failed to read favorites version: " << PQerrorMessage(conn()) << std::endl;
+        PQclear(res);
+        return std::nullopt;
+    }
+
+    std::string version = PQgetvalue(res, 0, 0);
+    PQclear(res);
+    return version;
+}
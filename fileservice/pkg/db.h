@@ -6,6 +6,9 @@
 #include <optional>
 #include <libpq-fe.h>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 
 struct ExtendedFileInfo {
     int file_id;
@@ -31,6 +34,184 @@ struct ExtendedFolderInfo {
     int group_id; // 0 если личная папка
     std::string group_name;
     bool is_favorite;
+    // Whole subtree, maintained by FolderSizes (may trail the latest writes briefly)
+    long long total_bytes;
+    long long file_count;
+    long long subfolder_count;
+};
+
+/**
+ * Reads a query result one row at a time (libpq single-row mode), so the
+ * whole result set is never held in memory at once.
+ */
+class RowCursor {
+public:
+    /**
+     * @param conn Connection to run the query on
+     * @param ownsConnection Close the connection when the cursor is destroyed
+     */
+    RowCursor(PGconn* conn, bool ownsConnection);
+    ~RowCursor();
+
+    RowCursor(const RowCursor&) = delete;
+    RowCursor& operator=(const RowCursor&) = delete;
+
+    // Sends the query; rows are then read with next()
+    bool start(const std::string& query, int nParams, const char* const* paramValues);
+
+    // Advances to the next row; false at the end of the result or on error
+    bool next();
+
+    const char* get(int column) const { return PQgetvalue(result_, row_, column); }
+    bool isNull(int column) const { return PQgetisnull(result_, row_, column); }
+
+    // Whether the query failed (next() returned false because of an error)
+    bool failed() const { return failed_; }
+
+private:
+    // Cancels the running query and discards whatever is left of its result
+    void discard();
+
+    PGconn* conn_;
+    bool ownsConnection_;
+    PGresult* result_ = nullptr;
+    int row_ = 0;
+    int rowCount_ = 0;
+    bool active_ = false;
+    bool failed_ = false;
+};
+
+/**
+ * Output of a COPY ... TO STDOUT, read one data row at a time on a dedicated
+ * connection, which the reader closes.
+ */
+class CopyOutReader {
+public:
+    explicit CopyOutReader(PGconn* conn);
+    ~CopyOutReader();
+
+    CopyOutReader(const CopyOutReader&) = delete;
+    CopyOutReader& operator=(const CopyOutReader&) = delete;
+
+    bool start(const std::string& query);
+
+    // Next data row (with its line terminator), valid until the following call;
+    // false at the end of the data or on error
+    bool next(const char*& data, int& size);
+
+    bool failed() const { return failed_; }
+
+private:
+    PGconn* conn_;
+    char* buffer_ = nullptr;
+    bool active_ = false;
+    bool failed_ = false;
+};
+
+/**
+ * Outcome of a set-based operation over many files. Either every file was
+ * processed (ok) or nothing was, and the ids that blocked it are listed.
+ */
+struct FileSetResult {
+    bool ok = false;
+    std::vector<int> not_found;   // ids that do not exist
+    std::vector<int> denied;      // ids the user is not allowed to modify
+    std::string error;            // other failures (database error, bad target folder)
+
+    // Processed files: file_id, file_name, folder_id before the operation (0 = root)
+    std::vector<std::tuple<int, std::string, int>> files;
+};
+
+/**
+ * Position in one scope of the change journal. Personal files and folders are
+ * journaled under their owner ('u', user_id), shared ones under their group
+ * ('g', group_id); seq grows by one per change within a scope.
+ */
+struct JournalPosition {
+    char scope_type;
+    int scope_id;
+    long long seq;
+};
+
+struct JournalEntry {
+    char scope_type;
+    int scope_id;
+    long long seq;
+    std::string entity;       // file / folder
+    int entity_id;
+    std::string op;           // upsert / delete
+    int parent_id;            // folder of a file, parent of a folder (0 = root)
+    std::string name;         // empty for deletes
+    int file_size;            // -1 unless a file upsert
+    std::string changed_at;
+};
+
+// Result of walking a path from the root (see DB::resolvePath)
+struct PathLookup {
+    int depth = 0;        // components resolved to folders
+    int folder_id = 0;    // last resolved folder (0 = root)
+    int file_id = 0;      // set if the last component is a file in that folder
+};
+
+// One component of a path made by DB::ensureFolderPath
+struct PathFolder {
+    int folder_id;
+    int group_id;         // 0 = personal
+    bool created;
+};
+
+// Detail of the usage history (see UsageSampler)
+enum class UsageResolution {
+    Minute,
+    Hour,
+    Day
+};
+
+// Activity of one scope during one sampling interval
+struct UsageActivity {
+    char scope;                 // 's' system (key 0), 'u' user, 'g' group
+    int key;
+    int active_users;
+    long long upload_bytes;
+    long long download_bytes;
+};
+
+// Filter of an activity log query (see ActivityLog)
+struct ActivityFilter {
+    int user_id = 0;            // 0 = any user
+    std::string action;         // empty = any action
+    long long from = 0;         // Unix seconds, inclusive
+    long long to = 0;           // Unix seconds, exclusive
+};
+
+// RBAC tables shared with the auth service, read in one snapshot (see RbacMatrix)
+struct RbacTables {
+    std::vector<std::pair<int, std::string>> role_permissions;     // role_id, permission_name
+    std::vector<std::pair<int, int>> user_roles;                    // user_id, role_id
+};
+
+// Serialized sketches of one analytics period (see Analytics)
+struct AnalyticsCheckpoint {
+    std::string name;           // "hour", "hour_previous", "day", "day_previous"
+    long long period_start;     // Unix seconds
+    std::string users;
+    std::string files;
+    std::string folders;
+};
+
+// Stored bytes and quota limits by user_id and group_id (see QuotaManager)
+struct StorageQuotaSnapshot {
+    std::unordered_map<int, long long> user_bytes;      // personal files, shared ones count for the group
+    std::unordered_map<int, long long> group_bytes;
+    std::unordered_map<int, long long> user_limits;
+    std::unordered_map<int, long long> group_limits;
+};
+
+// Filter of the background job listing; empty or 0 fields match anything
+struct JobFilter {
+    long long job_id = 0;
+    std::string state;
+    std::string kind;
 };
 
 class DB {
@@ -48,17 +229,81 @@ public:
     bool init();
     PGconn* getConnection();
 
+    // Opens a separate connection with the same parameters (caller owns it)
+    PGconn* openConnection();
+
+    /**
+     * Scoped transaction, rolled back on destruction unless committed.
+     *
+     * The outermost one on a thread runs on a dedicated connection and pins it:
+     * while the scope is alive every DB method called on the thread uses that
+     * connection, so requests on other threads never join the transaction.
+     * A nested one is a SAVEPOINT in it, so methods with a transaction of their
+     * own can run inside an outer one.
+     */
+    class Transaction {
+    public:
+        explicit Transaction(DB& db);
+        ~Transaction();
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        // false if the transaction could not be started
+        bool ok() const { return open_; }
+
+        bool commit();
+
+    private:
+        friend class DB;
+
+        DB& db_;
+        Transaction* outer_;
+        PGconn* conn_ = nullptr;        // borrowed from outer_ when nested
+        std::string savepoint_;
+        int depth_ = 0;                 // 0 for the outermost
+        bool open_ = false;
+    };
+
+    /**
+     * Pins the group ids of a user for the current thread: while the scope is
+     * alive getUserGroupIds() answers from it instead of querying user_groups,
+     * so a request that runs many access checks resolves membership once.
+     */
+    class GroupScope {
+    public:
+        GroupScope(const std::string& user_id, const std::vector<int>& group_ids);
+        ~GroupScope();
+
+        GroupScope(const GroupScope&) = delete;
+        GroupScope& operator=(const GroupScope&) = delete;
+
+    private:
+        friend class DB;
+
+        const GroupScope* previous_;
+        const std::string& user_id_;
+        const std::vector<int>& group_ids_;
+    };
+
     // Методы для работы с файлами и папками
     std::vector<std::tuple<int, std::string, int, std::string>> getFiles(const std::string& user_id, int folder_id);
     bool insertFile(const std::string& user_id, int folder_id, const std::string& file_name, int file_size);
     bool deleteFile(const std::string& user_id, int file_id);
-    std::optional<std::string> getFilePath(const std::string& user_id, int file_id);
+    std::optional<std::string> getFilePath(const std::string& user_id, int file_id, int* group_id = nullptr);
     bool moveFile(const std::string& user_id, int file_id, int target_folder_id);
-    bool moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id);
+    // Set-based, all-or-nothing: one ownership check, one DELETE/UPDATE ... RETURNING
+    FileSetResult deleteFiles(const std::string& user_id, const std::vector<int>& file_ids);
+    FileSetResult moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id);
 
     // Методы для работы с групповыми файлами.
     std::vector<ExtendedFileInfo> getExtendedFiles(const std::string& user_id, int folder_id);
     std::vector<ExtendedFolderInfo> getExtendedFolders(const std::string& user_id, int parent_folder_id = -1);
+    // Row-by-row variants: the visitor gets each row as it arrives (the object is reused between calls)
+    bool forEachExtendedFile(const std::string& user_id, int folder_id,
+                             const std::function<void(const ExtendedFileInfo&)>& visitor);
+    bool forEachExtendedFolder(const std::string& user_id, int parent_folder_id,
+                               const std::function<void(const ExtendedFolderInfo&)>& visitor);
     bool insertSharedFile(const std::string& user_id, int folder_id, const std::string& file_name, int file_size, int group_id);
     bool createSharedFolder(const std::string& user_id, const std::string& folder_name, int parent_folder_id, int group_id);
     bool canUserAccessFile(const std::string& user_id, int file_id);
@@ -66,6 +311,22 @@ public:
     bool canUserAccessFolder(const std::string& user_id, int folder_id);
     bool canUserModifyFolder(const std::string& user_id, int folder_id);
     std::vector<int> getUserGroupIds(const std::string& user_id);
+    // Folders (0 = root) that currently contain the given files / the given folder
+    std::vector<int> getFileFolderIds(const std::vector<int>& file_ids);
+    std::optional<int> getParentFolderId(int folder_id);
+    // Пути: компоненты разрешаются по (родитель, имя) среди папок, доступных пользователю;
+    // при совпадении имён предпочтение отдаётся своим папкам, затем меньшему id.
+    // Walks as far as the components exist; false only on a database error
+    bool resolvePath(const std::string& user_id, const std::vector<std::string>& components, PathLookup& lookup);
+    // Finds or creates every folder of the path in one call (mkdir -p); created folders belong to the
+    // user and get group_id, or their parent's group if group_id is 0. Group membership is checked
+    // in the same call: no folders if the user is not a member of group_id
+    bool ensureFolderPath(const std::string& user_id, const std::vector<std::string>& components, int group_id,
+                          std::vector<PathFolder>& folders);
+    // Those of file_ids the user can access (any order): file_id, file_name, folder_id (0 = root), file_size
+    std::vector<std::tuple<int, std::string, int, int>> getAccessibleFiles(const std::string& user_id, const std::vector<int>& file_ids);
+    // Ids of every file the user can access (own and of the user's groups)
+    std::vector<int> getAccessibleFileIds(const std::string& user_id);
 
     std::vector<std::tuple<int, std::string, int, std::string>> getFolders(const std::string& user_id, int parent_folder_id = -1);
     bool createFolder(const std::string& user_id, const std::string& folder_name, int parent_folder_id = -1);
@@ -77,17 +338,116 @@ public:
     std::vector<ExtendedFileInfo> getFavoriteFiles(const std::string& user_id);
     std::vector<ExtendedFolderInfo> getFavoriteFolders(const std::string& user_id);
 
+    // Журнал изменений (заполняется триггерами на files и folders в той же транзакции)
+    // Changes after each position, ordered by scope and seq, at most limit rows in total
+    bool readJournal(const std::vector<JournalPosition>& positions, int limit, std::vector<JournalEntry>& entries);
+    // Sets seq of every position to the latest seq of its scope (0 if nothing was journaled)
+    bool getJournalHeads(std::vector<JournalPosition>& positions);
+
+    // Версии списков для ETag (listing_versions, обновляются триггерами в той же транзакции).
+    // The text changes whenever the listing may have: "<sum of counters>[.<group_id>...]";
+    // folder_id 0 = root. nullopt on a database error
+    std::optional<std::string> getListingVersion(const std::string& user_id, int folder_id);
+    std::optional<std::string> getFavoritesVersion(const std::string& user_id);
+
     // Admin methods
     std::vector<std::tuple<int, std::string, std::string>> getAllUsers();
-    std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> getAllFilesAdmin();
-    std::vector<std::tuple<int, std::string, int, std::string, int, std::string>> getAllFoldersAdmin();
-    std::vector<std::tuple<int, std::string, int, std::string>> getFilesForUser(const std::string& user_id);
-    std::vector<std::tuple<int, std::string, int, std::string>> getFoldersForUser(const std::string& user_id);
+    // All files of all users ordered by user_id, read on a dedicated connection
+    // Columns: file_id, file_name, file_size, folder_id, user_id, email, created_at
+    std::unique_ptr<RowCursor> openAllFilesAdminCursor();
+    // Names of all files and folders, read on a dedicated connection (for NameIndex)
+    // Columns: kind (file/folder), id, user_id, group_id, parent_id (0 = root), name
+    std::unique_ptr<RowCursor> openAllNamesCursor();
+    // All folders of all users ordered by user_id, read on a dedicated connection
+    // Columns: folder_id, folder_name, parent_folder_id, user_id, email, created_at
+    std::unique_ptr<RowCursor> openAllFoldersAdminCursor();
+    // Pages of the same listings after (after_user_id, after_id), on the shared connection
+    bool forEachFileAdminPage(int after_user_id, int after_file_id, int limit,
+                              const std::function<void(const RowCursor&)>& visitor);
+    bool forEachFolderAdminPage(int after_user_id, int after_folder_id, int limit,
+                                const std::function<void(const RowCursor&)>& visitor);
+    // The same listings as CSV with a header row (COPY ... TO STDOUT)
+    std::unique_ptr<CopyOutReader> openAdminExport(bool folders);
+    // One user: email, files_count, folders_count, total_bytes, root_files, root_bytes;
+    // nullopt if there is no such user
+    std::optional<std::tuple<std::string, int, int, long long, int, long long>> getUserContentSummary(const std::string& user_id);
+    // Pages of one user's files / folders by id
+    // Files: file_id, file_name, file_size, folder_id (0 = root), created_at
+    bool forEachUserFilePage(const std::string& user_id, int after_file_id, int limit,
+                             const std::function<void(const RowCursor&)>& visitor);
+    // Folders: folder_id, folder_name, parent_folder_id, created_at, files_count, total_bytes (files directly inside)
+    bool forEachUserFolderPage(const std::string& user_id, int after_folder_id, int limit,
+                               const std::function<void(const RowCursor&)>& visitor);
 
-    // System statistics
+    // System statistics, read from the storage_stats counters that triggers on files,
+    // folders and users keep up to date
     std::tuple<int, int, int, long long> getSystemStats();
     std::vector<std::pair<std::string, int>> getFileTypeDistribution();
     std::vector<std::tuple<std::string, std::string, long long>> getTopUsersByStorage(int limit = 5);
+    // group_id, group_name, files, bytes
+    std::vector<std::tuple<int, std::string, long long, long long>> getTopGroupsByStorage(int limit = 5);
+    // Recounts everything on a dedicated connection and corrects the counters that drifted
+    // (or were never filled, e.g. rows that predate the triggers); corrected = counters changed
+    // progress, if set, is called after each step with the steps done and their total
+    bool reconcileStorageStats(int& corrected,
+                               const std::function<void(size_t done, size_t total)>& progress = nullptr);
+
+    // Usage history (each write runs on its own connection, for the sampler thread)
+    // One sample per scope for the interval starting at bucket (Unix seconds); storage comes from storage_stats
+    bool recordUsageSamples(long long bucket, const std::vector<UsageActivity>& activity);
+    // Recomputes the hour (from minutes) or day (from hours) rows of [from, to); safe to repeat
+    bool rollupUsage(UsageResolution target, long long from, long long to);
+    // Drops the minute partitions of days before minutesBefore and hour rows before hoursBefore
+    bool pruneUsage(long long minutesBefore, long long hoursBefore);
+    // Samples of one scope in [from, to), oldest first
+    // Columns: bucket (Unix seconds), storage_bytes, files_count, active_users, upload_bytes, download_bytes
+    bool forEachUsageSample(UsageResolution resolution, char scope, int key, long long from, long long to, int limit,
+                            const std::function<void(const RowCursor&)>& visitor);
+
+    // Activity log events matching the filter, newest first, starting after the event
+    // (before_us, before_id); before_id 0 starts at the newest
+    // Columns: event_id, occurred_at (microseconds since the epoch), user_id, action, object_id, detail
+    // (user_id, object_id and detail may be NULL)
+    bool forEachActivity(const ActivityFilter& filter, long long before_us, long long before_id, int limit,
+                         const std::function<void(const RowCursor&)>& visitor);
+
+    // Analytics checkpoints, shared by all processes; the checkpoint thread writes them within
+    // a Transaction, which also gives it a dedicated connection.
+    // Waits for the checkpoints of other processes, then loads the stored ones
+    std::optional<std::vector<AnalyticsCheckpoint>> lockAnalyticsCheckpoints();
+    bool saveAnalyticsCheckpoints(const std::vector<AnalyticsCheckpoint>& checkpoints);
+    std::optional<std::vector<AnalyticsCheckpoint>> loadAnalyticsCheckpoints();
+    // Names of existing files (or folders) among ids; deleted ones are missing from the map
+    std::unordered_map<int, std::string> getItemNames(bool folders, const std::vector<int>& ids);
+
+    // Content duplicates found by DuplicateScanner: (number of sets, bytes freed by keeping one copy of each)
+    std::optional<std::pair<long long, long long>> getDuplicateTotals();
+    // Duplicate sets by reclaimable bytes, largest first, one row per files row (at most maxFilesPerSet per set)
+    // Columns: digest (hex), file_size, copies (stored files), reclaimable_bytes, file_id, file_name, user_id, email
+    // (email may be NULL)
+    bool forEachDuplicateFile(int maxSets, int maxFilesPerSet, const std::function<void(const RowCursor&)>& visitor);
+
+    // Storage quotas; scope 'u' (user) or 'g' (group). loadStorageQuotas uses a dedicated connection
+    bool loadStorageQuotas(StorageQuotaSnapshot& snapshot);
+    bool setStorageQuota(char scope, int key, long long byte_limit);
+    bool deleteStorageQuota(char scope, int key);
+
+    // Background jobs (see JobQueue). enqueueJob runs on the given connection, the queue's own, and
+    // returns 0 for a singleton kind already queued or running
+    std::optional<long long> enqueueJob(PGconn* conn, const std::string& kind, const std::string& payload,
+                                        int priority, bool singleton, int max_attempts, int created_by);
+    // Cancels a job that has not started yet
+    bool cancelJob(long long job_id);
+    // Jobs matching the filter, newest first, with job_id below before_id (0 = from the newest)
+    // Columns: job_id, kind, payload (JSON), priority, state, attempts, max_attempts, progress_done,
+    // progress_total, message, last_error, locked_by, created_by, created_at, run_at, started_at, finished_at
+    // (Unix seconds; message, last_error, locked_by, created_by, started_at and finished_at may be NULL)
+    bool forEachJob(const JobFilter& filter, long long before_id, int limit,
+                    const std::function<void(const RowCursor&)>& visitor);
+
+    // RBAC tables shared with the auth service, read on the given connection (the caller's own)
+    // in one REPEATABLE READ transaction, so roles and assignments come from the same snapshot
+    bool loadRbacTables(PGconn* conn, RbacTables& tables);
 
     // Group methods
     std::vector<std::pair<int, std::string>> getUserGroups(int user_id);
@@ -109,5 +469,20 @@ private:
     std::string password_;
     PGconn* conn_;
 
+    // Свободные выделенные соединения для транзакций
+    std::vector<PGconn*> idle_;
+    std::mutex idleMutex_;
+
     void connect();
+
+    // Connection of the transaction pinned on this thread, conn_ otherwise
+    PGconn* conn() const;
+
+    PGconn* acquireConnection();
+    void releaseConnection(PGconn* conn);
+
+    // Locks the requested files and sorts out missing and foreign ids; caller holds a transaction
+    // ids must be sorted and unique; idArray is the same list as a PostgreSQL array literal
+    bool lockOwnedFiles(const std::string& user_id, const std::vector<int>& ids, const std::string& idArray,
+                        FileSetResult& result);
 };
\ No newline at end of file
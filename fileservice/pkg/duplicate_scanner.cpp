@@ -0,0 +1,478 @@
+#include "duplicate_scanner.h"
+#include <drogon/drogon.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "db.h"
+#include "job_queue.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t READ_CHUNK = 1 << 20;
+
+// Session advisory lock held by the process that is scanning ("dups")
+const long long SCAN_LOCK = 0x64757073;
+
+// How often finished digests are written while the workers run
+const std::chrono::seconds FLUSH_INTERVAL(2);
+
+long long unixNow()
+{
+    return static_cast<long long>(std::time(nullptr));
+}
+
+bool exec(PGconn* conn, const char* query)
+{
+    PGresult* res = PQexec(conn, query);
+    bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+    return ok;
+}
+
+// Released when the connection is closed
+bool tryLock(PGconn* conn)
+{
+    std::string lockStr = std::to_string(SCAN_LOCK);
+    const char* paramValues[1] = { lockStr.c_str() };
+    PGresult* res = PQexecParams(conn, "SELECT pg_try_advisory_lock($1);", 1, nullptr, paramValues, nullptr, nullptr, 0);
+    bool locked = PQresultStatus(res) == PGRES_TUPLES_OK && PQgetvalue(res, 0, 0)[0] == 't';
+    PQclear(res);
+    return locked;
+}
+
+} // namespace
+
+std::shared_ptr<DuplicateScanner> DuplicateScanner::instance()
+{
+    static std::shared_ptr<DuplicateScanner> instance(new DuplicateScanner());
+    return instance;
+}
+
+void DuplicateScanner::start(const std::string& storagePath, size_t threads, size_t readBytesPerSecond, double interval)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    storagePath_ = storagePath;
+    threads_ = std::max<size_t>(1, threads);
+    readBytesPerSecond_ = readBytesPerSecond;
+
+    bool interrupted = false;
+    if (PGconn* conn = DB::instance()->openConnection())
+    {
+        interrupted = loadState(conn);
+        PQfinish(conn);
+    }
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("DuplicateScanner");
+    thread_->run();
+    thread_->getLoop()->runEvery(interval, [this]() { requestScan(); });
+
+    if (interrupted)
+    {
+        LOG_INFO << "Resuming the interrupted duplicate scan";
+        requestScan();
+    }
+}
+
+bool DuplicateScanner::requestScan()
+{
+    if (!thread_)
+    {
+        return false;
+    }
+
+    auto jobs = JobQueue::instance();
+    if (jobs->isRunning())
+    {
+        // 0: already queued or running, possibly in another process
+        auto id = jobs->enqueue(JOB_KIND, Json::Value(Json::objectValue));
+        return id && *id > 0;
+    }
+
+    if (scanning_.exchange(true))
+    {
+        return false;
+    }
+    thread_->getLoop()->queueInLoop([this]() {
+        std::string error;
+        if (!scan(error, nullptr))
+        {
+            LOG_WARN << "Duplicate scan failed: " << error;
+        }
+    });
+    return true;
+}
+
+bool DuplicateScanner::runScan(std::string& error, const Progress& progress)
+{
+    if (!thread_)
+    {
+        error = "Duplicate detection is disabled";
+        return false;
+    }
+    if (scanning_.exchange(true))
+    {
+        error = "A duplicate scan is already running";
+        return false;
+    }
+    return scan(error, progress);
+}
+
+DuplicateScanner::Status DuplicateScanner::status()
+{
+    return {scanning_.load(), startedAt_.load(), finishedAt_.load(), candidates_.load(), hashed_.load(),
+            bytesHashed_.load()};
+}
+
+bool DuplicateScanner::scan(std::string& error, const Progress& progress)
+{
+    PGconn* conn = DB::instance()->openConnection();
+    if (!conn)
+    {
+        error = "No database connection";
+        scanning_ = false;
+        return false;
+    }
+
+    // One scan at a time across all processes: they share file_digests and duplicate_scan_state
+    if (!tryLock(conn))
+    {
+        error = "Another process is scanning";
+        loadState(conn);
+        PQfinish(conn);
+        scanning_ = false;
+        return false;
+    }
+
+    startedAt_ = unixNow();
+    finishedAt_ = 0;
+    candidates_ = 0;
+    hashed_ = 0;
+    bytesHashed_ = 0;
+
+    std::vector<Candidate> candidates;
+    long long total = 0;
+    if (!collectCandidates(conn, candidates, total))
+    {
+        error = "Failed to collect duplicate candidates";
+        PQfinish(conn);
+        scanning_ = false;
+        return false;
+    }
+    candidates_ = total;
+    saveState(conn, false);
+
+    LOG_INFO << "Duplicate scan started: " << total << " candidates, " << candidates.size() << " to hash";
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(threads_, candidates.size()); ++i)
+    {
+        workers.emplace_back(&DuplicateScanner::hashWorker, this, std::cref(candidates), std::ref(next),
+                             std::ref(done));
+    }
+
+    // Each flush is a checkpoint: written digests are not read again if the scan is interrupted
+    bool ok = true;
+    auto flush = [&]() {
+        if (progress)
+        {
+            progress(static_cast<long long>(std::min(next.load(), candidates.size())),
+                     static_cast<long long>(candidates.size()));
+        }
+
+        std::vector<Digest> digests;
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex_);
+            digests.swap(finished_);
+        }
+        if (!digests.empty())
+        {
+            ok = saveDigests(conn, digests) && ok;
+            saveState(conn, false);
+        }
+    };
+    while (done < workers.size())
+    {
+        std::this_thread::sleep_for(FLUSH_INTERVAL);
+        flush();
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    flush();
+
+    // Digests of stored files that are gone
+    if (!exec(conn, "DELETE FROM file_digests d WHERE NOT EXISTS (SELECT 1 FROM files f WHERE f.file_name = d.file_name);"))
+    {
+        LOG_ERROR << "Failed to prune file digests: " << PQerrorMessage(conn);
+    }
+
+    // A scan whose digests were not all written is resumed on the next start
+    if (ok)
+    {
+        finishedAt_ = unixNow();
+    }
+    saveState(conn, ok);
+    PQfinish(conn);
+    scanning_ = false;
+
+    LOG_INFO << "Duplicate scan " << (ok ? "finished" : "incomplete") << ": " << hashed_ << " files, "
+             << bytesHashed_ << " bytes hashed";
+    if (!ok)
+    {
+        error = "Failed to save file digests";
+    }
+    return ok;
+}
+
+bool DuplicateScanner::collectCandidates(PGconn* conn, std::vector<Candidate>& candidates, long long& total)
+{
+    // Один файл на диске на имя; кандидаты - файлы, размер которых встречается больше одного раза
+    const char* query = R"(
+        WITH stored AS (
+            SELECT file_name, MAX(file_size) AS file_size
+            FROM files
+            WHERE file_size > 0
+            GROUP BY file_name
+        ),
+        shared_sizes AS (
+            SELECT file_size FROM stored GROUP BY file_size HAVING COUNT(*) > 1
+        )
+        SELECT s.file_name, d.file_size, d.mtime
+        FROM stored s
+        JOIN shared_sizes USING (file_size)
+        LEFT JOIN file_digests d ON d.file_name = s.file_name;
+    )";
+
+    PGresult* res = PQexec(conn, query);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOG_ERROR << "Failed to collect duplicate candidates: " << PQerrorMessage(conn);
+        PQclear(res);
+        return false;
+    }
+
+    total = 0;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        std::string name = PQgetvalue(res, i, 0);
+        std::error_code ec;
+        fs::path path = fs::path(storagePath_) / name;
+        auto size = fs::file_size(path, ec);
+        if (ec)
+        {
+            continue;
+        }
+        auto mtime = fs::last_write_time(path, ec);
+        if (ec)
+        {
+            continue;
+        }
+
+        ++total;
+        long long sizeValue = static_cast<long long>(size);
+        long long mtimeValue = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+        // Unchanged since it was hashed
+        if (!PQgetisnull(res, i, 1) && std::atoll(PQgetvalue(res, i, 1)) == sizeValue &&
+            std::atoll(PQgetvalue(res, i, 2)) == mtimeValue)
+        {
+            continue;
+        }
+        candidates.push_back({std::move(name), sizeValue, mtimeValue});
+    }
+    PQclear(res);
+    return true;
+}
+
+void DuplicateScanner::hashWorker(const std::vector<Candidate>& candidates, std::atomic<size_t>& next,
+                                  std::atomic<size_t>& done)
+{
+    for (size_t i = next++; i < candidates.size(); i = next++)
+    {
+        const Candidate& candidate = candidates[i];
+        std::string hex;
+        if (!hashFile(storagePath_ + "/" + candidate.file_name, hex))
+        {
+            continue;
+        }
+
+        ++hashed_;
+        bytesHashed_ += candidate.size;
+        std::lock_guard<std::mutex> lock(finishedMutex_);
+        finished_.push_back({candidate.file_name, candidate.size, candidate.mtime, std::move(hex)});
+    }
+    ++done;
+}
+
+bool DuplicateScanner::hashFile(const std::string& path, std::string& hex)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        LOG_WARN << "Failed to open " << path << " for hashing";
+        return false;
+    }
+
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx || EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1)
+    {
+        EVP_MD_CTX_free(ctx);
+        return false;
+    }
+
+    std::vector<char> buffer(READ_CHUNK);
+    bool ok = true;
+    while (ok)
+    {
+        throttle(buffer.size());
+        file.read(buffer.data(), buffer.size());
+        std::streamsize count = file.gcount();
+        if (count > 0)
+        {
+            ok = EVP_DigestUpdate(ctx, buffer.data(), static_cast<size_t>(count)) == 1;
+        }
+        if (!file)
+        {
+            ok = ok && file.eof();
+            break;
+        }
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &length) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok)
+    {
+        LOG_WARN << "Failed to hash " << path;
+        return false;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    hex.clear();
+    hex.reserve(length * 2);
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        hex += digits[digest[i] >> 4];
+        hex += digits[digest[i] & 0x0f];
+    }
+    return true;
+}
+
+void DuplicateScanner::throttle(size_t bytes)
+{
+    if (readBytesPerSecond_ == 0)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point wakeAt;
+    {
+        std::lock_guard<std::mutex> lock(throttleMutex_);
+        auto now = std::chrono::steady_clock::now();
+        // Idle time is not saved up for a later burst
+        nextRead_ = std::max(nextRead_, now);
+        wakeAt = nextRead_;
+        nextRead_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / readBytesPerSecond_));
+    }
+    std::this_thread::sleep_until(wakeAt);
+}
+
+bool DuplicateScanner::saveDigests(PGconn* conn, const std::vector<Digest>& digests)
+{
+    const char* query = R"(
+        INSERT INTO file_digests (file_name, file_size, mtime, digest, hashed_at)
+        VALUES ($1, $2, $3, decode($4, 'hex'), CURRENT_TIMESTAMP)
+        ON CONFLICT (file_name) DO UPDATE
+        SET file_size = EXCLUDED.file_size, mtime = EXCLUDED.mtime,
+            digest = EXCLUDED.digest, hashed_at = EXCLUDED.hashed_at;
+    )";
+
+    if (!exec(conn, "BEGIN;"))
+    {
+        LOG_ERROR << "Failed to save file digests: " << PQerrorMessage(conn);
+        return false;
+    }
+    for (const auto& digest : digests)
+    {
+        std::string sizeStr = std::to_string(digest.size);
+        std::string mtimeStr = std::to_string(digest.mtime);
+        const char* paramValues[4] = { digest.file_name.c_str(), sizeStr.c_str(), mtimeStr.c_str(), digest.hex.c_str() };
+
+        PGresult* res = PQexecParams(conn, query, 4, nullptr, paramValues, nullptr, nullptr, 0);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            LOG_ERROR << "Failed to save file digests: " << PQerrorMessage(conn);
+            PQclear(res);
+            exec(conn, "ROLLBACK;");
+            return false;
+        }
+        PQclear(res);
+    }
+    if (!exec(conn, "COMMIT;"))
+    {
+        LOG_ERROR << "Failed to save file digests: " << PQerrorMessage(conn);
+        return false;
+    }
+    return true;
+}
+
+bool DuplicateScanner::saveState(PGconn* conn, bool finished)
+{
+    const char* query = R"(
+        INSERT INTO duplicate_scan_state (id, started_at, finished_at, candidates, hashed, bytes_hashed)
+        VALUES (1, $1, $2, $3, $4, $5)
+        ON CONFLICT (id) DO UPDATE
+        SET started_at = EXCLUDED.started_at, finished_at = EXCLUDED.finished_at,
+            candidates = EXCLUDED.candidates, hashed = EXCLUDED.hashed, bytes_hashed = EXCLUDED.bytes_hashed;
+    )";
+
+    std::string startedStr = std::to_string(startedAt_.load());
+    std::string finishedStr = std::to_string(finished ? finishedAt_.load() : 0);
+    std::string candidatesStr = std::to_string(candidates_.load());
+    std::string hashedStr = std::to_string(hashed_.load());
+    std::string bytesStr = std::to_string(bytesHashed_.load());
+    const char* paramValues[5] = { startedStr.c_str(), finishedStr.c_str(), candidatesStr.c_str(), hashedStr.c_str(),
+                                   bytesStr.c_str() };
+
+    PGresult* res = PQexecParams(conn, query, 5, nullptr, paramValues, nullptr, nullptr, 0);
+    bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    if (!ok)
+    {
+        LOG_ERROR << "Failed to save the duplicate scan state: " << PQerrorMessage(conn);
+    }
+    PQclear(res);
+    return ok;
+}
+
+bool DuplicateScanner::loadState(PGconn* conn)
+{
+    PGresult* res = PQexec(conn, "SELECT started_at, finished_at, candidates, hashed, bytes_hashed FROM duplicate_scan_state WHERE id = 1;");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0)
+    {
+        PQclear(res);
+        return false;
+    }
+
+    startedAt_ = std::atoll(PQgetvalue(res, 0, 0));
+    finishedAt_ = std::atoll(PQgetvalue(res, 0, 1));
+    candidates_ = std::atoll(PQgetvalue(res, 0, 2));
+    hashed_ = std::atoll(PQgetvalue(res, 0, 3));
+    bytesHashed_ = std::atoll(PQgetvalue(res, 0, 4));
+    PQclear(res);
+    return startedAt_ > 0 && finishedAt_ == 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <libpq-fe.h>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Finds stored files with identical content.
+ *
+ * A scan first groups the stored files by size; only files that share
+ * their size with another file are read. These are hashed (SHA-256) by a
+ * pool of worker threads whose combined reads are throttled to a
+ * configurable byte rate. Digests are written to file_digests in batches
+ * as they complete, together with the file's size and modification time,
+ * so an interrupted scan resumes where it stopped and later scans only read
+ * new or changed files. Progress is kept in duplicate_scan_state.
+ *
+ * With the job queue running, each scan is a singleton job (JOB_KIND),
+ * so one process scans at a time and the job reports the progress; without
+ * it the scanner runs scans on its own thread. Either way scans are also
+ * serialized by an advisory lock: a scan that finds another process
+ * scanning fails without reading anything.
+ *
+ * Files are stored by name, so rows of files sharing a name share one
+ * stored file and are hashed once; duplicates are distinct stored files.
+ * The report itself is read with DB::forEachDuplicateFile.
+ */
+class DuplicateScanner {
+public:
+    struct Status {
+        bool running;
+        long long started_at;       // Unix seconds, 0 if never
+        long long finished_at;      // 0 if the last scan did not finish
+        long long candidates;       // files sharing their size with another file
+        long long hashed;           // files read by the current or last scan
+        long long bytes_hashed;
+    };
+
+    // Job kind of a scan; registered by AdminService::registerJobs
+    static constexpr const char* JOB_KIND = "duplicate_scan";
+
+    // Files hashed so far and files to hash
+    using Progress = std::function<void(long long done, long long total)>;
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<DuplicateScanner> instance();
+
+    /**
+     * Request a scan every interval seconds (immediately if the last scan was interrupted).
+     * Must be called once, after DB::initInstance() and JobQueue::start().
+     *
+     * @param storagePath Directory the uploaded files are stored in
+     * @param threads Number of hashing threads
+     * @param readBytesPerSecond Upper bound for the combined reads of all threads (0 = unlimited)
+     */
+    void start(const std::string& storagePath, size_t threads, size_t readBytesPerSecond, double interval);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    // Queues a scan job, or without the job queue starts a scan on the scanner's thread;
+    // false if one is already queued or running, or on a database error
+    bool requestScan();
+
+    // Scans on the calling thread (the job handler); false with error if disabled, already
+    // scanning or the scan did not finish
+    bool runScan(std::string& error, const Progress& progress);
+
+    Status status();
+
+private:
+    DuplicateScanner() = default;
+
+    struct Candidate {
+        std::string file_name;
+        long long size;
+        long long mtime;
+    };
+
+    struct Digest {
+        std::string file_name;
+        long long size;
+        long long mtime;
+        std::string hex;
+    };
+
+    // Called with scanning_ set, which it clears
+    bool scan(std::string& error, const Progress& progress);
+
+    // Stored files that share their size with another one and have no current digest
+    bool collectCandidates(PGconn* conn, std::vector<Candidate>& candidates, long long& total);
+
+    // Hashes candidates[next..] until none are left, then increments done; results go to finished_
+    void hashWorker(const std::vector<Candidate>& candidates, std::atomic<size_t>& next, std::atomic<size_t>& done);
+    bool hashFile(const std::string& path, std::string& hex);
+
+    // Blocks until bytes more may be read under the rate limit
+    void throttle(size_t bytes);
+
+    bool saveDigests(PGconn* conn, const std::vector<Digest>& digests);
+    bool saveState(PGconn* conn, bool finished);
+    // The state of the last scan; true if it was interrupted
+    bool loadState(PGconn* conn);
+
+    std::string storagePath_;
+    size_t threads_ = 2;
+    size_t readBytesPerSecond_ = 0;
+
+    // Shared rate limit of the hashing threads: the moment the next read may start
+    std::chrono::steady_clock::time_point nextRead_;
+    std::mutex throttleMutex_;
+
+    // Digests computed but not yet written
+    std::vector<Digest> finished_;
+    std::mutex finishedMutex_;
+
+    std::atomic<bool> scanning_{false};
+    std::atomic<long long> startedAt_{0};
+    std::atomic<long long> finishedAt_{0};
+    std::atomic<long long> candidates_{0};
+    std::atomic<long long> hashed_{0};
+    std::atomic<long long> bytesHashed_{0};
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+
+namespace EtagUtils {
+
+// Weak comparison (RFC 7232): the W/ prefix is ignored
+    inline std::string_view opaqueTag(std::string_view etag) {
+        if (etag.size() >= 2 && etag[0] == 'W' && etag[1] == '/') {
+            etag.remove_prefix(2);
+        }
+        return etag;
+    }
+
+// Whether the client's If-None-Match already names the current ETag
+    inline bool isNotModified(const drogon::HttpRequestPtr& req, const std::string& etag) {
+        const std::string& header = req->getHeader("if-none-match");
+        if (header.empty() || etag.empty()) {
+            return false;
+        }
+
+        std::string_view current = opaqueTag(etag);
+        std::string_view list = header;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view item = list.substr(0, comma);
+            list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+
+            while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+
+            if (item == "*" || opaqueTag(item) == current) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+// Marks a listing response as revalidatable with the given ETag (none if the version was unavailable)
+    inline void setValidator(const drogon::HttpResponsePtr& resp, const std::string& etag) {
+        if (etag.empty()) {
+            return;
+        }
+        resp->addHeader("ETag", etag);
+        resp->addHeader("Cache-Control", "private, no-cache");
+    }
+
+// Empty 304 response for an unchanged listing
+    inline drogon::HttpResponsePtr notModified(const std::string& etag) {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::k304NotModified);
+        setValidator(resp, etag);
+        return resp;
+    }
+
+} // namespace EtagUtils
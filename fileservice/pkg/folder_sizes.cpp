@@ -0,0 +1,136 @@
+#include "folder_sizes.h"
+#include <drogon/drogon.h>
+#include <string>
+#include "db.h"
+
+namespace {
+
+// Events applied per transaction
+const int APPLY_BATCH = 20000;
+
+} // namespace
+
+std::shared_ptr<FolderSizes> FolderSizes::instance()
+{
+    static std::shared_ptr<FolderSizes> instance(new FolderSizes());
+    return instance;
+}
+
+FolderSizes::~FolderSizes()
+{
+    if (conn_)
+    {
+        PQfinish(conn_);
+    }
+}
+
+void FolderSizes::start(double interval)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("FolderSizes");
+    thread_->run();
+
+    auto loop = thread_->getLoop();
+    loop->queueInLoop([this]() { rebuildIfEmpty(); });
+    loop->runEvery(interval, [this]() { apply(); });
+}
+
+bool FolderSizes::connect()
+{
+    if (conn_ && PQstatus(conn_) == CONNECTION_OK)
+    {
+        return true;
+    }
+    if (conn_)
+    {
+        PQfinish(conn_);
+    }
+    conn_ = DB::instance()->openConnection();
+    return conn_ != nullptr;
+}
+
+void FolderSizes::rebuildIfEmpty()
+{
+    if (built_ || !connect())
+    {
+        return;
+    }
+
+    PGresult *res = PQexec(conn_, "SELECT NOT EXISTS (SELECT 1 FROM folder_stats) AND EXISTS (SELECT 1 FROM folders);");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOG_ERROR << "Failed to check folder sizes: " << PQerrorMessage(conn_);
+        PQclear(res);
+        return;
+    }
+    bool needed = PQgetvalue(res, 0, 0)[0] == 't';
+    PQclear(res);
+
+    if (!needed)
+    {
+        built_ = true;
+        return;
+    }
+
+    LOG_INFO << "Computing folder sizes for existing folders";
+
+    // REPEATABLE READ: the events that the rebuild deletes are exactly those its snapshot includes
+    const char *steps[] = {
+        "BEGIN ISOLATION LEVEL REPEATABLE READ;",
+        "SELECT rebuild_folder_stats();",
+        "COMMIT;"
+    };
+    for (const char *step : steps)
+    {
+        res = PQexec(conn_, step);
+        ExecStatusType status = PQresultStatus(res);
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+        {
+            LOG_ERROR << "Failed to rebuild folder sizes: " << PQerrorMessage(conn_);
+            PQclear(res);
+            PQclear(PQexec(conn_, "ROLLBACK;"));
+            return;
+        }
+        if (status == PGRES_TUPLES_OK && PQgetvalue(res, 0, 0)[0] != 't')
+        {
+            // Another instance is applying events right now; try again on the next tick
+            PQclear(res);
+            PQclear(PQexec(conn_, "ROLLBACK;"));
+            return;
+        }
+        PQclear(res);
+    }
+
+    built_ = true;
+    LOG_INFO << "Folder sizes computed";
+}
+
+void FolderSizes::apply()
+{
+    if (!built_)
+    {
+        // Events are applied on top of a complete table only
+        rebuildIfEmpty();
+        return;
+    }
+    if (!connect())
+    {
+        return;
+    }
+
+    std::string batchStr = std::to_string(APPLY_BATCH);
+    const char *paramValues[1] = { batchStr.c_str() };
+
+    // Listings of the folders whose sizes change are bumped by a trigger on folder_stats
+    PGresult *res = PQexecParams(conn_, "SELECT apply_folder_size_events($1);", 1, nullptr, paramValues,
+                                 nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOG_ERROR << "Failed to apply folder size events: " << PQerrorMessage(conn_);
+    }
+    PQclear(res);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <libpq-fe.h>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Keeps the recursive size of every folder (bytes, files and subfolders,
+ * descendants included) in folder_stats.
+ *
+ * Triggers on files and folders only append to folder_size_events, so an
+ * upload never waits for a lock on its ancestors. A background thread
+ * applies the events in batches: changes to the files of one folder are
+ * summed and propagated up the ancestor chain with one update per folder.
+ * Sizes therefore trail writes by about one apply interval.
+ *
+ * On the first start (folder_stats empty) the table is rebuilt from scratch
+ * in one snapshot.
+ */
+class FolderSizes {
+public:
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<FolderSizes> instance();
+
+    ~FolderSizes();
+
+    /**
+     * Start applying events every interval seconds. Must be called once, after DB::initInstance().
+     */
+    void start(double interval);
+
+private:
+    FolderSizes() = default;
+
+    bool connect();
+
+    // Rebuilds folder_stats if it has never been filled
+    void rebuildIfEmpty();
+
+    void apply();
+
+    // Only used on the applying thread
+    PGconn *conn_ = nullptr;
+    bool built_ = false;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
@@ -0,0 +1,457 @@
+#include "job_queue.h"
+#include <drogon/drogon.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include "db.h"
+
+namespace {
+
+// Session advisory lock held by the leader ("jobs")
+const long long LEADER_LOCK = 0x6a6f6273;
+
+// Retry backoff: BACKOFF_BASE * 2^(attempt - 1) seconds, at most BACKOFF_MAX, halved by up to 50% at random
+const double BACKOFF_BASE = 5.0;
+const double BACKOFF_MAX = 3600.0;
+
+const std::chrono::seconds PROGRESS_INTERVAL(1);
+
+double backoffSeconds(int attempt)
+{
+    thread_local std::mt19937 rng(std::random_device{}());
+    double delay = std::min(BACKOFF_MAX, BACKOFF_BASE * std::ldexp(1.0, std::min(attempt, 20) - 1));
+    return delay * std::uniform_real_distribution<double>(0.5, 1.0)(rng);
+}
+
+bool execParams(PGconn* conn, const char* query, int nParams, const char* const* paramValues, const char* what)
+{
+    PGresult* res = PQexecParams(conn, query, nParams, nullptr, paramValues, nullptr, nullptr, 0);
+    ExecStatusType status = PQresultStatus(res);
+    bool ok = status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+    if (!ok)
+    {
+        LOG_ERROR << "Failed to " << what << ": " << PQerrorMessage(conn);
+    }
+    PQclear(res);
+    return ok;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+void JobQueue::Job::progress(long long done, long long total, const std::string& message)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastProgress_ < PROGRESS_INTERVAL)
+    {
+        return;
+    }
+    lastProgress_ = now;
+
+    const char* query = R"(
+        UPDATE jobs SET progress_done = $2, progress_total = $3, message = $4
+        WHERE job_id = $1;
+    )";
+
+    std::string idStr = std::to_string(id_);
+    std::string doneStr = std::to_string(done);
+    std::string totalStr = std::to_string(total);
+    const char* paramValues[4] = { idStr.c_str(), doneStr.c_str(), totalStr.c_str(), message.c_str() };
+    execParams(conn_, query, 4, paramValues, "report job progress");
+}
+
+// ---------------------------------------------------------------------------
+
+std::shared_ptr<JobQueue> JobQueue::instance()
+{
+    static std::shared_ptr<JobQueue> instance(new JobQueue());
+    return instance;
+}
+
+JobQueue::~JobQueue()
+{
+    stopping_ = true;
+    wake_.notify_all();
+    for (auto& worker : workers_)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+        if (worker->conn)
+        {
+            PQfinish(worker->conn);
+        }
+    }
+    // The loop thread has to stop before its connection is closed
+    thread_.reset();
+    if (conn_)
+    {
+        PQfinish(conn_);
+    }
+    if (enqueueConn_)
+    {
+        PQfinish(enqueueConn_);
+    }
+}
+
+void JobQueue::registerHandler(const std::string& kind, Handler handler, bool singleton, int maxAttempts)
+{
+    if (thread_)
+    {
+        LOG_ERROR << "Job handler '" << kind << "' registered after the queue started";
+        return;
+    }
+    handlers_[kind] = {std::move(handler), singleton, std::max(1, maxAttempts)};
+}
+
+void JobQueue::start(size_t workers, double pollInterval, double heartbeatInterval, double staleAfter,
+                     int retentionDays)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    owner_ = std::string(host) + ":" + std::to_string(getpid());
+    pollInterval_ = pollInterval;
+    staleAfter_ = std::max(staleAfter, 2 * heartbeatInterval);
+    retentionDays_ = retentionDays;
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("JobQueue");
+    thread_->run();
+    auto loop = thread_->getLoop();
+    loop->queueInLoop([this]() { maintain(); });
+    loop->runEvery(heartbeatInterval, [this]() { maintain(); });
+
+    for (size_t i = 0; i < std::max<size_t>(1, workers); ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        workers_[i]->thread = std::thread(&JobQueue::workerLoop, this, i);
+    }
+
+    LOG_INFO << "Job queue started with " << workers_.size() << " workers as " << owner_;
+}
+
+std::optional<long long> JobQueue::enqueue(const std::string& kind, const Json::Value& payload, int priority,
+                                           int created_by)
+{
+    auto registration = handlers_.find(kind);
+    if (registration == handlers_.end())
+    {
+        return std::nullopt;
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::string payloadStr = Json::writeString(builder, payload);
+
+    std::optional<long long> id;
+    {
+        std::lock_guard<std::mutex> lock(enqueueMutex_);
+        if (!connect(enqueueConn_))
+        {
+            return std::nullopt;
+        }
+        id = DB::instance()->enqueueJob(enqueueConn_, kind, payloadStr, priority, registration->second.singleton,
+                                        registration->second.maxAttempts, created_by);
+    }
+    if (id && *id > 0)
+    {
+        wake_.notify_one();
+    }
+    return id;
+}
+
+bool JobQueue::connect(PGconn*& conn)
+{
+    if (conn && PQstatus(conn) == CONNECTION_OK)
+    {
+        return true;
+    }
+    if (conn)
+    {
+        PQfinish(conn);
+    }
+    conn = DB::instance()->openConnection();
+    return conn != nullptr;
+}
+
+void JobQueue::workerLoop(size_t index)
+{
+    while (!stopping_)
+    {
+        Claimed job;
+        if (takeOwn(index, job) || steal(index, job))
+        {
+            run(index, job);
+            continue;
+        }
+
+        ++idle_;
+        bool claimed = claim(index, job);
+        if (claimed)
+        {
+            --idle_;
+            run(index, job);
+            continue;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait_for(lock, std::chrono::duration<double>(pollInterval_));
+        }
+        --idle_;
+    }
+}
+
+bool JobQueue::takeOwn(size_t index, Claimed& job)
+{
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty())
+    {
+        return false;
+    }
+    job = std::move(worker.jobs.front());
+    worker.jobs.pop_front();
+    return true;
+}
+
+bool JobQueue::steal(size_t index, Claimed& job)
+{
+    // Victims in a rotating order, starting after this worker
+    for (size_t offset = 1; offset < workers_.size(); ++offset)
+    {
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobQueue::claim(size_t index, Claimed& job)
+{
+    Worker& worker = *workers_[index];
+    if (!connect(worker.conn))
+    {
+        return false;
+    }
+
+    // Очередь упорядочена частичным индексом jobs_ready_idx; одиночные задачи берёт только лидер
+    const char* query = R"(
+        UPDATE jobs
+        SET state = 'running', attempts = attempts + 1, locked_by = $1,
+            started_at = CURRENT_TIMESTAMP, heartbeat_at = CURRENT_TIMESTAMP
+        WHERE job_id IN (
+            SELECT job_id FROM jobs
+            WHERE state = 'queued' AND run_at <= CURRENT_TIMESTAMP AND (NOT singleton OR $2)
+            ORDER BY priority DESC, run_at, job_id
+            LIMIT $3
+            FOR UPDATE SKIP LOCKED
+        )
+        RETURNING job_id, kind, payload, priority, attempts, max_attempts;
+    )";
+
+    std::string leaderStr = leader_ ? "true" : "false";
+    std::string limitStr = std::to_string(std::max<size_t>(1, idle_.load()));
+    const char* paramValues[3] = { owner_.c_str(), leaderStr.c_str(), limitStr.c_str() };
+
+    PGresult* res = PQexecParams(worker.conn, query, 3, nullptr, paramValues, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOG_ERROR << "Failed to claim jobs: " << PQerrorMessage(worker.conn);
+        PQclear(res);
+        return false;
+    }
+
+    std::vector<Claimed> claimed;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i)
+    {
+        claimed.push_back({std::atoll(PQgetvalue(res, i, 0)), PQgetvalue(res, i, 1), PQgetvalue(res, i, 2),
+                           std::atoi(PQgetvalue(res, i, 3)), std::atoi(PQgetvalue(res, i, 4)),
+                           std::atoi(PQgetvalue(res, i, 5))});
+    }
+    PQclear(res);
+    if (claimed.empty())
+    {
+        return false;
+    }
+
+    // RETURNING has no order
+    std::sort(claimed.begin(), claimed.end(), [](const Claimed& a, const Claimed& b) {
+        return a.priority != b.priority ? a.priority > b.priority : a.id < b.id;
+    });
+    job = std::move(claimed.front());
+    if (claimed.size() > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            for (size_t i = 1; i < claimed.size(); ++i)
+            {
+                worker.jobs.push_back(std::move(claimed[i]));
+            }
+        }
+        wake_.notify_all();
+    }
+    return true;
+}
+
+void JobQueue::run(size_t index, const Claimed& claimed)
+{
+    Worker& worker = *workers_[index];
+
+    std::string error;
+    bool ok = false;
+    auto registration = handlers_.find(claimed.kind);
+    if (registration == handlers_.end())
+    {
+        error = "No handler for job kind '" + claimed.kind + "'";
+    }
+    else
+    {
+        Job job;
+        job.id_ = claimed.id;
+        job.kind_ = claimed.kind;
+        job.attempt_ = claimed.attempts;
+
+        Json::CharReaderBuilder builder;
+        std::istringstream input(claimed.payload);
+        std::string errors;
+        if (!Json::parseFromStream(builder, input, &job.payload_, &errors))
+        {
+            error = "Invalid payload: " + errors;
+        }
+        else if (connect(worker.conn))
+        {
+            job.conn_ = worker.conn;
+            try
+            {
+                ok = registration->second.handler(job, error);
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+            }
+        }
+        else
+        {
+            error = "No database connection";
+        }
+    }
+
+    if (!ok)
+    {
+        LOG_WARN << "Job " << claimed.id << " (" << claimed.kind << ") attempt " << claimed.attempts
+                 << " failed: " << error;
+    }
+    if (connect(worker.conn))
+    {
+        finish(worker.conn, claimed, ok, error);
+    }
+}
+
+void JobQueue::finish(PGconn* conn, const Claimed& claimed, bool ok, const std::string& error)
+{
+    std::string idStr = std::to_string(claimed.id);
+
+    // locked_by: a job that was queued again while it stalled belongs to someone else now
+    if (ok)
+    {
+        const char* query = R"(
+            UPDATE jobs SET state = 'done', finished_at = CURRENT_TIMESTAMP, locked_by = NULL, last_error = NULL
+            WHERE job_id = $1 AND locked_by = $2;
+        )";
+        const char* paramValues[2] = { idStr.c_str(), owner_.c_str() };
+        execParams(conn, query, 2, paramValues, "finish job");
+        return;
+    }
+
+    const char* query = R"(
+        UPDATE jobs
+        SET state = CASE WHEN attempts < max_attempts THEN 'queued' ELSE 'failed' END,
+            run_at = CURRENT_TIMESTAMP + $3 * INTERVAL '1 second',
+            finished_at = CASE WHEN attempts < max_attempts THEN NULL ELSE CURRENT_TIMESTAMP END,
+            locked_by = NULL, last_error = $4
+        WHERE job_id = $1 AND locked_by = $2;
+    )";
+    std::string delayStr = std::to_string(backoffSeconds(claimed.attempts));
+    const char* paramValues[4] = { idStr.c_str(), owner_.c_str(), delayStr.c_str(), error.c_str() };
+    if (execParams(conn, query, 4, paramValues, "finish job") && claimed.attempts < claimed.maxAttempts)
+    {
+        LOG_INFO << "Job " << claimed.id << " will be retried in " << delayStr << " s";
+    }
+}
+
+void JobQueue::maintain()
+{
+    // The advisory lock goes away with the connection
+    if (!conn_ || PQstatus(conn_) != CONNECTION_OK)
+    {
+        leader_ = false;
+    }
+    if (!connect(conn_))
+    {
+        return;
+    }
+
+    if (!leader_)
+    {
+        std::string lockStr = std::to_string(LEADER_LOCK);
+        const char* paramValues[1] = { lockStr.c_str() };
+        PGresult* res = PQexecParams(conn_, "SELECT pg_try_advisory_lock($1);", 1, nullptr, paramValues,
+                                     nullptr, nullptr, 0);
+        if (PQresultStatus(res) == PGRES_TUPLES_OK && PQgetvalue(res, 0, 0)[0] == 't')
+        {
+            leader_ = true;
+            LOG_INFO << "Job queue leader is " << owner_;
+        }
+        PQclear(res);
+    }
+
+    // Heartbeat
+    const char* paramValues[1] = { owner_.c_str() };
+    execParams(conn_, "UPDATE jobs SET heartbeat_at = CURRENT_TIMESTAMP WHERE state = 'running' AND locked_by = $1;",
+               1, paramValues, "update job heartbeats");
+
+    if (!leader_)
+    {
+        return;
+    }
+
+    // Jobs of stopped processes; the lost attempt counts
+    const char* staleQuery = R"(
+        UPDATE jobs
+        SET state = CASE WHEN attempts < max_attempts THEN 'queued' ELSE 'failed' END,
+            run_at = CURRENT_TIMESTAMP,
+            finished_at = CASE WHEN attempts < max_attempts THEN NULL ELSE CURRENT_TIMESTAMP END,
+            last_error = 'Worker ' || locked_by || ' stopped responding', locked_by = NULL
+        WHERE state = 'running' AND heartbeat_at < CURRENT_TIMESTAMP - $1 * INTERVAL '1 second';
+    )";
+    std::string staleStr = std::to_string(staleAfter_);
+    const char* staleParams[1] = { staleStr.c_str() };
+    execParams(conn_, staleQuery, 1, staleParams, "requeue stale jobs");
+
+    const char* pruneQuery = R"(
+        DELETE FROM jobs
+        WHERE state IN ('done', 'failed', 'cancelled') AND finished_at < CURRENT_TIMESTAMP - $1 * INTERVAL '1 day';
+    )";
+    std::string retentionStr = std::to_string(retentionDays_);
+    const char* pruneParams[1] = { retentionStr.c_str() };
+    execParams(conn_, pruneQuery, 1, pruneParams, "prune finished jobs");
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <json/json.h>
+#include <libpq-fe.h>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Persistent queue of background jobs in the jobs table, run by a pool of
+ * worker threads in every fileservice process that shares the database.
+ *
+ * An idle worker first takes a job from its own deque, then steals one from
+ * the back of another worker's deque, and only then claims ready jobs from
+ * the table (highest priority first, FOR UPDATE SKIP LOCKED, one per idle
+ * worker), so long jobs do not hold back short ones claimed with them and
+ * several processes never claim the same job.
+ *
+ * A failed attempt is retried after an exponential backoff with jitter until
+ * the job's max_attempts. Running jobs are kept alive by a heartbeat; jobs of
+ * a process that stopped heartbeating are queued again.
+ *
+ * Singleton kinds have at most one queued or running job and are only run by
+ * the leader, the process holding a session advisory lock, so they run in one
+ * process at a time.
+ */
+class JobQueue {
+public:
+    class Job {
+    public:
+        long long id() const { return id_; }
+        const std::string& kind() const { return kind_; }
+        const Json::Value& payload() const { return payload_; }
+        // 1 for the first attempt
+        int attempt() const { return attempt_; }
+
+        // Reports progress; written to the jobs table at most once a second
+        void progress(long long done, long long total, const std::string& message = "");
+
+    private:
+        friend class JobQueue;
+
+        long long id_ = 0;
+        std::string kind_;
+        Json::Value payload_;
+        int attempt_ = 0;
+        PGconn* conn_ = nullptr;
+        std::chrono::steady_clock::time_point lastProgress_;
+    };
+
+    // Returns false with error (or throws) to fail the attempt
+    using Handler = std::function<bool(Job& job, std::string& error)>;
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<JobQueue> instance();
+
+    ~JobQueue();
+
+    /**
+     * Register the handler of a job kind. Must be called before start().
+     *
+     * @param singleton At most one job of the kind is queued or running, and only the leader runs it
+     * @param maxAttempts Attempts before the job is marked failed
+     */
+    void registerHandler(const std::string& kind, Handler handler, bool singleton = false, int maxAttempts = 5);
+
+    /**
+     * Start the workers and the heartbeat. Must be called once, after DB::initInstance().
+     *
+     * @param workers Number of worker threads
+     * @param pollInterval Seconds idle workers wait before looking for ready jobs again
+     * @param heartbeatInterval Seconds between heartbeats and leader election attempts
+     * @param staleAfter Seconds without a heartbeat after which a running job is queued again
+     * @param retentionDays Finished jobs are deleted after this many days
+     */
+    void start(size_t workers, double pollInterval, double heartbeatInterval, double staleAfter, int retentionDays);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    bool isLeader() const { return leader_; }
+
+    size_t workerCount() const { return workers_.size(); }
+
+    bool hasHandler(const std::string& kind) const { return handlers_.count(kind) > 0; }
+
+    /**
+     * Queue a job of a registered kind; higher priorities run first.
+     *
+     * @return job_id, 0 if the kind is a singleton that is already queued or running,
+     *         nullopt for an unknown kind or a database error
+     */
+    std::optional<long long> enqueue(const std::string& kind, const Json::Value& payload, int priority = 0,
+                                     int created_by = 0);
+
+private:
+    JobQueue() = default;
+
+    struct Registration {
+        Handler handler;
+        bool singleton;
+        int maxAttempts;
+    };
+
+    struct Claimed {
+        long long id;
+        std::string kind;
+        std::string payload;
+        int priority;
+        int attempts;
+        int maxAttempts;
+    };
+
+    struct Worker {
+        std::deque<Claimed> jobs;
+        std::mutex mutex;
+        PGconn* conn = nullptr;
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index);
+
+    bool takeOwn(size_t index, Claimed& job);
+    bool steal(size_t index, Claimed& job);
+    // Claims up to one ready job per idle worker; the first is returned, the rest go to the worker's deque
+    bool claim(size_t index, Claimed& job);
+
+    void run(size_t index, const Claimed& claimed);
+    void finish(PGconn* conn, const Claimed& claimed, bool ok, const std::string& error);
+
+    // Heartbeat, leader election, stale jobs and pruning; runs on thread_
+    void maintain();
+
+    static bool connect(PGconn*& conn);
+
+    std::unordered_map<std::string, Registration> handlers_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> idle_{0};
+    std::atomic<bool> stopping_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+
+    std::string owner_;             // host:pid, stored in locked_by
+    double pollInterval_ = 1.0;
+    double staleAfter_ = 60.0;
+    int retentionDays_ = 7;
+
+    // Only used on thread_
+    PGconn* conn_ = nullptr;
+    std::atomic<bool> leader_{false};
+
+    // enqueue() runs on any thread, background ones included, so it has a connection of its own
+    PGconn* enqueueConn_ = nullptr;
+    std::mutex enqueueMutex_;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
@@ -0,0 +1,142 @@
+#include "json_writer.h"
+
+JsonWriter::JsonWriter(std::string &out) : out_(out)
+{
+    first_.reserve(8);
+}
+
+void JsonWriter::separator()
+{
+    if (afterKey_)
+    {
+        afterKey_ = false;
+        return;
+    }
+
+    if (!first_.empty())
+    {
+        if (first_.back())
+        {
+            first_.back() = false;
+        }
+        else
+        {
+            out_ += ',';
+        }
+    }
+}
+
+void JsonWriter::startObject()
+{
+    separator();
+    out_ += '{';
+    first_.push_back(true);
+}
+
+void JsonWriter::endObject()
+{
+    out_ += '}';
+    first_.pop_back();
+}
+
+void JsonWriter::startArray()
+{
+    separator();
+    out_ += '[';
+    first_.push_back(true);
+}
+
+void JsonWriter::endArray()
+{
+    out_ += ']';
+    first_.pop_back();
+}
+
+void JsonWriter::key(std::string_view name)
+{
+    separator();
+    writeEscaped(name);
+    out_ += ':';
+    afterKey_ = true;
+}
+
+void JsonWriter::value(std::string_view str)
+{
+    separator();
+    writeEscaped(str);
+}
+
+void JsonWriter::value(long long number)
+{
+    separator();
+
+    // Formatted on the stack to avoid a temporary std::string
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    unsigned long long magnitude = number < 0 ? 0ULL - static_cast<unsigned long long>(number)
+                                              : static_cast<unsigned long long>(number);
+    do
+    {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (number < 0)
+    {
+        *--p = '-';
+    }
+    out_.append(p, end - p);
+}
+
+void JsonWriter::value(bool flag)
+{
+    separator();
+    out_ += flag ? "true" : "false";
+}
+
+void JsonWriter::null()
+{
+    separator();
+    out_ += "null";
+}
+
+void JsonWriter::writeEscaped(std::string_view str)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out_ += '"';
+
+    // Copy runs of characters that need no escaping in one go
+    size_t runStart = 0;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        out_.append(str.data() + runStart, i - runStart);
+        runStart = i + 1;
+
+        switch (c)
+        {
+        case '"': out_ += "\\\""; break;
+        case '\\': out_ += "\\\\"; break;
+        case '\b': out_ += "\\b"; break;
+        case '\f': out_ += "\\f"; break;
+        case '\n': out_ += "\\n"; break;
+        case '\r': out_ += "\\r"; break;
+        case '\t': out_ += "\\t"; break;
+        default:
+        {
+            char esc[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            out_.append(esc, sizeof(esc));
+            break;
+        }
+        }
+    }
+    out_.append(str.data() + runStart, str.size() - runStart);
+
+    out_ += '"';
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "structured_writer.h"
+
+/**
+ * Minimal streaming JSON encoder.
+ *
+ * Appends JSON text straight to a caller-owned buffer instead of building a
+ * Json::Value tree first, so large listings are serialized in a single pass
+ * with no per-field allocations.
+ */
+class JsonWriter final : public StructuredWriter {
+public:
+    explicit JsonWriter(std::string &out);
+
+    using StructuredWriter::value;
+
+    void startObject() override;
+    void endObject() override;
+    void startArray() override;
+    void endArray() override;
+    void key(std::string_view name) override;
+    void value(std::string_view str) override;
+    void value(long long number) override;
+    void value(bool flag) override;
+    void null() override;
+
+private:
+    // Emits the comma that separates this element from the previous one
+    void separator();
+
+    void writeEscaped(std::string_view str);
+
+    std::string &out_;
+
+    // One entry per open container: true until its first element is written
+    std::vector<bool> first_;
+
+    // Set between key() and the value that follows it
+    bool afterKey_ = false;
+};
@@ -0,0 +1,42 @@
+#include "listing_rows.h"
+
+namespace ListingRows {
+
+void writeFile(StructuredWriter& writer, const ExtendedFileInfo& file, int requester_id)
+{
+    writer.startObject();
+    writer.field("file_id", file.file_id);
+    writer.field("file_name", file.file_name);
+    writer.field("file_size", file.file_size);
+    writer.field("created_at", file.created_at);
+    writer.field("file_type", file.file_type);
+    writer.field("owner_id", file.owner_id);
+    writer.field("owner_email", file.owner_email);
+    writer.field("group_id", file.group_id);
+    writer.field("group_name", file.group_name);
+    writer.field("can_modify", file.owner_id == requester_id);
+    writer.field("is_favorite", file.is_favorite);
+    writer.endObject();
+}
+
+void writeFolder(StructuredWriter& writer, const ExtendedFolderInfo& folder, int requester_id)
+{
+    writer.startObject();
+    writer.field("folder_id", folder.folder_id);
+    writer.field("folder_name", folder.folder_name);
+    writer.field("parent_folder_id", folder.parent_folder_id);
+    writer.field("created_at", folder.created_at);
+    writer.field("folder_type", folder.folder_type);
+    writer.field("owner_id", folder.owner_id);
+    writer.field("owner_email", folder.owner_email);
+    writer.field("group_id", folder.group_id);
+    writer.field("group_name", folder.group_name);
+    writer.field("can_modify", folder.owner_id == requester_id);
+    writer.field("is_favorite", folder.is_favorite);
+    writer.field("total_bytes", folder.total_bytes);
+    writer.field("file_count", folder.file_count);
+    writer.field("subfolder_count", folder.subfolder_count);
+    writer.endObject();
+}
+
+} // namespace ListingRows
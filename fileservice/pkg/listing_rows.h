@@ -0,0 +1,18 @@
+#pragma once
+
+#include "db.h"
+#include "structured_writer.h"
+
+/**
+ * Row emitters for file and folder listings, shared by every endpoint and
+ * every wire format that returns them.
+ */
+namespace ListingRows {
+
+// One file of /files or /favorites; can_modify is computed for requester_id
+    void writeFile(StructuredWriter& writer, const ExtendedFileInfo& file, int requester_id);
+
+// One folder of /folders or /favorites
+    void writeFolder(StructuredWriter& writer, const ExtendedFolderInfo& folder, int requester_id);
+
+} // namespace ListingRows
@@ -0,0 +1,415 @@
+#include "name_index.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <sstream>
+#include "db.h"
+#include "text_utils.h"
+
+namespace {
+
+// Below this many candidates the remaining posting lists are not intersected;
+// comparing the names directly is cheaper
+const size_t INTERSECTION_CUTOFF = 256;
+
+// Compaction starts once at least this many entries are dead and they outnumber the live ones
+const size_t MIN_DEAD_FOR_COMPACTION = 10000;
+
+// Marks the start of a name, so short queries can match prefixes through a trigram
+const char NAME_START = '\x01';
+
+uint32_t trigramKey(const char* p)
+{
+    return (static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8) |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[2]));
+}
+
+// Distinct trigrams of a folded name, including the two anchored at its start
+std::vector<uint32_t> nameTrigrams(const std::string& folded)
+{
+    std::string padded;
+    padded.reserve(folded.size() + 2);
+    padded += NAME_START;
+    padded += NAME_START;
+    padded += folded;
+
+    std::vector<uint32_t> keys;
+    for (size_t i = 0; i + 3 <= padded.size(); ++i)
+    {
+        keys.push_back(trigramKey(padded.data() + i));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+bool isWordBoundary(char c)
+{
+    return c == ' ' || c == '_' || c == '-' || c == '.' || c == '(' || c == '[';
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+void NameIndex::Index::add(Entry entry)
+{
+    uint32_t slot = static_cast<uint32_t>(entries.size());
+    for (uint32_t key : nameTrigrams(entry.folded))
+    {
+        postings[key].push_back(slot);
+    }
+    (entry.is_folder ? folderSlots : fileSlots)[entry.id] = slot;
+    entries.push_back(std::move(entry));
+}
+
+void NameIndex::Index::remove(bool is_folder, int id)
+{
+    auto& slots = is_folder ? folderSlots : fileSlots;
+    auto it = slots.find(id);
+    if (it == slots.end())
+    {
+        return;
+    }
+    entries[it->second].alive = false;
+    slots.erase(it);
+    ++deadEntries;
+}
+
+void NameIndex::Index::upsert(Entry entry)
+{
+    auto& slots = entry.is_folder ? folderSlots : fileSlots;
+    auto it = slots.find(entry.id);
+    if (it != slots.end())
+    {
+        // Same name (a move or a change of owner/group): posting lists stay as they are
+        Entry& existing = entries[it->second];
+        if (existing.folded == entry.folded)
+        {
+            existing.parent_id = entry.parent_id;
+            existing.owner_id = entry.owner_id;
+            existing.group_id = entry.group_id;
+            existing.name = std::move(entry.name);
+            return;
+        }
+        remove(entry.is_folder, entry.id);
+    }
+    add(std::move(entry));
+}
+
+// ---------------------------------------------------------------------------
+
+std::shared_ptr<NameIndex> NameIndex::instance()
+{
+    static std::shared_ptr<NameIndex> instance(new NameIndex());
+    return instance;
+}
+
+NameIndex::NameIndex()
+{
+    LOG_INFO << "Initializing NameIndex";
+}
+
+NameIndex::~NameIndex()
+{
+    if (listenConn_)
+    {
+        PQfinish(listenConn_);
+    }
+}
+
+bool NameIndex::start(double pollInterval)
+{
+    // LISTEN first, so nothing committed during the build is missed
+    if (!listen())
+    {
+        LOG_WARN << "Name change notifications are unavailable, search results will not follow changes";
+    }
+
+    bool loaded = rebuild();
+
+    drogon::app().getLoop()->runEvery(pollInterval, [this]() { pollNotifications(); });
+
+    return loaded;
+}
+
+bool NameIndex::isLoaded() const
+{
+    std::shared_lock<std::shared_mutex> lock(indexMutex_);
+    return index_ != nullptr;
+}
+
+bool NameIndex::rebuild()
+{
+    std::lock_guard<std::mutex> lock(updateMutex_);
+
+    auto cursor = DB::instance()->openAllNamesCursor();
+    if (!cursor)
+    {
+        LOG_ERROR << "Failed to query names, keeping the previous index";
+        return false;
+    }
+
+    auto index = std::make_unique<Index>();
+    while (cursor->next())
+    {
+        Entry entry;
+        entry.is_folder = std::string(cursor->get(0)) == "folder";
+        entry.alive = true;
+        entry.id = std::stoi(cursor->get(1));
+        entry.owner_id = std::stoi(cursor->get(2));
+        entry.group_id = std::stoi(cursor->get(3));
+        entry.parent_id = std::stoi(cursor->get(4));
+        entry.name = cursor->get(5);
+        entry.folded = TextUtils::foldCase(entry.name);
+        index->add(std::move(entry));
+    }
+
+    if (cursor->failed())
+    {
+        LOG_ERROR << "Failed to read names, keeping the previous index";
+        return false;
+    }
+
+    LOG_INFO << "Built name index: " << index->entries.size() << " names, "
+             << index->postings.size() << " trigrams";
+
+    std::unique_lock<std::shared_mutex> indexLock(indexMutex_);
+    index_ = std::move(index);
+    return true;
+}
+
+std::vector<NameIndex::Match> NameIndex::search(const std::string& query, int user_id,
+                                                const std::vector<int>& group_ids,
+                                                Kind kind, size_t limit) const
+{
+    std::vector<Match> matches;
+
+    std::string folded = TextUtils::foldCase(query);
+    if (folded.empty() || limit == 0)
+    {
+        return matches;
+    }
+
+    // Posting lists to intersect
+    std::vector<uint32_t> keys;
+    bool prefixOnly = folded.size() < 3;
+    if (prefixOnly)
+    {
+        std::string anchored = std::string(3 - folded.size(), NAME_START) + folded;
+        keys.push_back(trigramKey(anchored.data()));
+    }
+    else
+    {
+        for (size_t i = 0; i + 3 <= folded.size(); ++i)
+        {
+            keys.push_back(trigramKey(folded.data() + i));
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    std::vector<int> groups = group_ids;
+    std::sort(groups.begin(), groups.end());
+
+    std::shared_lock<std::shared_mutex> lock(indexMutex_);
+    if (!index_)
+    {
+        return matches;
+    }
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (uint32_t key : keys)
+    {
+        auto it = index_->postings.find(key);
+        if (it == index_->postings.end())
+        {
+            return matches;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+    // Rarest trigram first; every further list can only shrink the candidate set
+    std::vector<uint32_t> candidates = *lists[0];
+    for (size_t i = 1; i < lists.size() && candidates.size() > INTERSECTION_CUTOFF; ++i)
+    {
+        const auto& list = *lists[i];
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&list](uint32_t slot) {
+            return !std::binary_search(list.begin(), list.end(), slot);
+        }), candidates.end());
+    }
+
+    // rank: 0 exact, 1 prefix, 2 word start, 3 substring
+    struct Ranked {
+        int rank;
+        size_t length;
+        uint32_t slot;
+    };
+    std::vector<Ranked> ranked;
+
+    for (uint32_t slot : candidates)
+    {
+        const Entry& entry = index_->entries[slot];
+        if (!entry.alive ||
+            (kind == Kind::File && entry.is_folder) ||
+            (kind == Kind::Folder && !entry.is_folder))
+        {
+            continue;
+        }
+
+        if (entry.owner_id != user_id &&
+            (entry.group_id == 0 || !std::binary_search(groups.begin(), groups.end(), entry.group_id)))
+        {
+            continue;
+        }
+
+        size_t position = entry.folded.find(folded);
+        if (position == std::string::npos || (prefixOnly && position != 0))
+        {
+            continue;
+        }
+
+        int rank;
+        if (position == 0)
+        {
+            rank = entry.folded.size() == folded.size() ? 0 : 1;
+        }
+        else
+        {
+            rank = isWordBoundary(entry.folded[position - 1]) ? 2 : 3;
+        }
+        ranked.push_back({rank, entry.folded.size(), slot});
+    }
+
+    size_t count = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [](const Ranked& a, const Ranked& b) {
+        if (a.rank != b.rank) return a.rank < b.rank;
+        if (a.length != b.length) return a.length < b.length;
+        return a.slot < b.slot;
+    });
+
+    matches.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Entry& entry = index_->entries[ranked[i].slot];
+        matches.push_back({entry.is_folder, entry.id, entry.parent_id, entry.owner_id, entry.group_id, entry.name});
+    }
+    return matches;
+}
+
+void NameIndex::compactIfNeeded()
+{
+    if (index_->deadEntries < MIN_DEAD_FOR_COMPACTION || index_->deadEntries * 2 < index_->entries.size())
+    {
+        return;
+    }
+
+    auto compacted = std::make_unique<Index>();
+    for (auto& entry : index_->entries)
+    {
+        if (entry.alive)
+        {
+            compacted->add(std::move(entry));
+        }
+    }
+    index_ = std::move(compacted);
+}
+
+bool NameIndex::listen()
+{
+    if (!listenConn_)
+    {
+        listenConn_ = DB::instance()->openConnection();
+        if (!listenConn_)
+        {
+            return false;
+        }
+    }
+
+    PGresult *res = PQexec(listenConn_, "LISTEN name_changes;");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        LOG_ERROR << "Failed to LISTEN on name_changes: " << PQerrorMessage(listenConn_);
+        PQclear(res);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return false;
+    }
+    PQclear(res);
+    return true;
+}
+
+void NameIndex::pollNotifications()
+{
+    if (!listenConn_ || PQstatus(listenConn_) != CONNECTION_OK)
+    {
+        // Reconnect and rebuild, since notifications may have been missed meanwhile
+        if (listenConn_)
+        {
+            PQfinish(listenConn_);
+            listenConn_ = nullptr;
+        }
+        if (listen())
+        {
+            rebuild();
+        }
+        return;
+    }
+
+    if (!PQconsumeInput(listenConn_))
+    {
+        LOG_ERROR << "Lost name change notification connection: " << PQerrorMessage(listenConn_);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return;
+    }
+
+    std::vector<std::pair<bool, Entry>> changes;   // (upsert, entry)
+    Json::CharReaderBuilder builder;
+    while (PGnotify *notify = PQnotifies(listenConn_))
+    {
+        Json::Value payload;
+        std::string errors;
+        std::istringstream input(notify->extra);
+        if (Json::parseFromStream(builder, input, &payload, &errors) && payload.isObject())
+        {
+            Entry entry;
+            entry.is_folder = payload["e"].asString() == "folder";
+            entry.alive = true;
+            entry.id = payload["id"].asInt();
+            entry.owner_id = payload["u"].asInt();
+            entry.group_id = payload["g"].asInt();
+            entry.parent_id = payload["p"].asInt();
+            entry.name = payload["n"].asString();
+            entry.folded = TextUtils::foldCase(entry.name);
+            changes.emplace_back(payload["op"].asString() == "upsert", std::move(entry));
+        }
+        PQfreemem(notify);
+    }
+
+    if (changes.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(updateMutex_);
+    std::unique_lock<std::shared_mutex> indexLock(indexMutex_);
+    if (!index_)
+    {
+        return;
+    }
+
+    for (auto& [upsert, entry] : changes)
+    {
+        if (upsert)
+        {
+            index_->upsert(std::move(entry));
+        }
+        else
+        {
+            index_->remove(entry.is_folder, entry.id);
+        }
+    }
+    compactIfNeeded();
+}
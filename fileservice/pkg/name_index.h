@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <libpq-fe.h>
+
+/**
+ * In-memory trigram index over the names of all files and folders.
+ *
+ * Names are case-folded (ASCII and Cyrillic) and split into byte trigrams;
+ * each trigram maps to the sorted list of entries containing it. A query
+ * intersects the lists of its trigrams, starting from the rarest, and only
+ * the surviving candidates are compared with the query and checked against
+ * the user's access. Queries shorter than three bytes match name prefixes,
+ * through trigrams anchored at the start of the name.
+ *
+ * The index is built from the database at startup and kept up to date from
+ * the name_changes channel, which the change journal triggers notify after
+ * every committed insert, rename, move or delete.
+ */
+class NameIndex {
+public:
+    enum class Kind {
+        Any,
+        File,
+        Folder
+    };
+
+    struct Match {
+        bool is_folder;
+        int id;
+        int parent_id;
+        int owner_id;
+        int group_id;
+        std::string name;
+    };
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<NameIndex> instance();
+
+    ~NameIndex();
+
+    /**
+     * Subscribe to name_changes and build the index.
+     * Must be called once, after DB::initInstance().
+     *
+     * @param pollInterval Seconds between checks for change notifications
+     * @return true if the initial build succeeded
+     */
+    bool start(double pollInterval);
+
+    bool isLoaded() const;
+
+    /**
+     * Names containing the query that the user may see (owned by the user or
+     * shared with one of group_ids), best first: exact, prefix, word start,
+     * then any substring; shorter names first within a class.
+     */
+    std::vector<Match> search(const std::string& query, int user_id, const std::vector<int>& group_ids,
+                              Kind kind, size_t limit) const;
+
+    /**
+     * Rebuild the index from the database
+     */
+    bool rebuild();
+
+private:
+    NameIndex();
+
+    struct Entry {
+        bool is_folder;
+        bool alive;
+        int id;
+        int parent_id;
+        int owner_id;
+        int group_id;
+        std::string name;
+        std::string folded;
+    };
+
+    // Entries live in a vector and are never moved, so posting lists of slot
+    // numbers stay sorted as long as new entries are appended
+    struct Index {
+        std::vector<Entry> entries;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> postings;   // trigram -> slots
+        std::unordered_map<int, uint32_t> fileSlots;                    // file_id -> slot
+        std::unordered_map<int, uint32_t> folderSlots;                  // folder_id -> slot
+        size_t deadEntries = 0;
+
+        void add(Entry entry);
+        void remove(bool is_folder, int id);
+        void upsert(Entry entry);
+    };
+
+    // Copies the live entries into fresh posting lists once too many are dead;
+    // caller holds the write lock
+    void compactIfNeeded();
+
+    // Subscribes the listener connection to the name_changes channel
+    bool listen();
+
+    // Applies pending notifications
+    void pollNotifications();
+
+    std::unique_ptr<Index> index_;
+    mutable std::shared_mutex indexMutex_;
+
+    // Dedicated connection used only for LISTEN
+    PGconn *listenConn_ = nullptr;
+
+    // Serializes rebuilds and notification handling
+    std::mutex updateMutex_;
+};
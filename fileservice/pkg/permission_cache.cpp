@@ -0,0 +1,161 @@
+#include "permission_cache.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+namespace {
+
+std::atomic<uint64_t> nextCacheId{1};
+
+} // namespace
+
+struct PermissionCache::ReaderState {
+    uint64_t cacheId = 0;
+    std::array<ReaderCopy<EntryMap>, kShardCount> shards;
+    ReaderCopy<IndexMap> index;
+};
+
+PermissionCache::PermissionCache(time_t ttl, time_t staleTtl, size_t maxEntries)
+        : id_(nextCacheId.fetch_add(1)), ttl_(ttl), staleTtl_(staleTtl),
+          maxEntriesPerShard_(std::max<size_t>(1, (maxEntries + kShardCount - 1) / kShardCount))
+{
+}
+
+template <typename Map>
+void PermissionCache::Published<Map>::publish(std::shared_ptr<const Map> map)
+{
+    current = std::move(map);
+    version.fetch_add(1, std::memory_order_release);
+}
+
+template <typename Map>
+const Map &PermissionCache::read(const Published<Map> &published, ReaderCopy<Map> &copy) const
+{
+    // Writers bump the version after replacing the map, so an unchanged version means
+    // the copy is still current
+    if (!copy.map || copy.version != published.version.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(published.mutex);
+        copy.map = published.current;
+        copy.version = published.version.load(std::memory_order_relaxed);
+    }
+    return *copy.map;
+}
+
+PermissionCache::ReaderState &PermissionCache::readerState() const
+{
+    thread_local ReaderState state;
+    if (state.cacheId != id_) {
+        state = ReaderState();
+        state.cacheId = id_;
+    }
+    return state;
+}
+
+size_t PermissionCache::shardOf(const std::string &userId) const
+{
+    return std::hash<std::string>{}(userId) % kShardCount;
+}
+
+PermissionCache::Lookup PermissionCache::get(const std::string &userId) const
+{
+    size_t shard = shardOf(userId);
+    const auto &entries = read(shards_[shard], readerState().shards[shard]);
+
+    auto it = entries.find(userId);
+    if (it == entries.end()) {
+        return {Freshness::Missing, {}};
+    }
+
+    const auto &entry = it->second;
+    time_t now = std::time(nullptr);
+    entry->lastAccess.store(now, std::memory_order_relaxed);
+
+    time_t age = now - entry->fetchedAt;
+    if (age <= ttl_) {
+        return {Freshness::Fresh, entry->permissions};
+    }
+    if (age <= ttl_ + staleTtl_) {
+        return {Freshness::Stale, entry->permissions};
+    }
+    return {Freshness::Missing, {}};
+}
+
+void PermissionCache::put(const std::string &userId, const std::vector<std::string> &permissions)
+{
+    PermissionBits bits;
+    for (const auto &permission : permissions) {
+        int index = internPermission(permission);
+        if (index >= 0) {
+            bits.set(index);
+        }
+    }
+
+    auto entry = std::make_shared<const Entry>(bits, std::time(nullptr));
+
+    auto &shard = shards_[shardOf(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto updated = std::make_shared<EntryMap>(*shard.current);
+    (*updated)[userId] = std::move(entry);
+
+    // Evict the least recently read users once the shard is over capacity
+    while (updated->size() > maxEntriesPerShard_) {
+        auto victim = updated->end();
+        time_t oldest = std::numeric_limits<time_t>::max();
+        for (auto it = updated->begin(); it != updated->end(); ++it) {
+            if (it->first == userId) continue;
+            time_t lastAccess = it->second->lastAccess.load(std::memory_order_relaxed);
+            if (lastAccess < oldest) {
+                oldest = lastAccess;
+                victim = it;
+            }
+        }
+        if (victim == updated->end()) break;
+        updated->erase(victim);
+    }
+
+    shard.publish(std::move(updated));
+}
+
+void PermissionCache::clear()
+{
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.publish(std::make_shared<const EntryMap>());
+    }
+}
+
+int PermissionCache::permissionIndex(const std::string &permission) const
+{
+    const auto &index = read(permissionIndex_, readerState().index);
+    auto it = index.find(permission);
+    return it == index.end() ? -1 : it->second;
+}
+
+int PermissionCache::internPermission(const std::string &permission)
+{
+    int existing = permissionIndex(permission);
+    if (existing >= 0) {
+        return existing;
+    }
+
+    std::lock_guard<std::mutex> lock(permissionIndex_.mutex);
+    const auto &current = permissionIndex_.current;
+    auto it = current->find(permission);
+    if (it != current->end()) {
+        return it->second;
+    }
+
+    if (current->size() >= kMaxPermissions) {
+        LOG_ERROR << "Permission cache is limited to " << kMaxPermissions
+                  << " distinct permissions, ignoring " << permission;
+        return -1;
+    }
+
+    auto updated = std::make_shared<IndexMap>(*current);
+    int index = static_cast<int>(updated->size());
+    (*updated)[permission] = index;
+    permissionIndex_.publish(std::move(updated));
+    return index;
+}
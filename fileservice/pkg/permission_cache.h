@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Read-mostly cache of user permissions.
+ *
+ * Every user maps to an immutable permission bitset with a single fetch
+ * timestamp. The cache is split into shards; each shard publishes an
+ * immutable snapshot of its map together with an atomic version. Every
+ * thread keeps its own reference to the snapshot it last read, so a lookup
+ * is one atomic load of the version and a hash lookup; the shard's mutex is
+ * only taken to pick up a new snapshot, once per thread after each write.
+ *
+ * Writers copy the shard, modify it and publish the new version, so a put
+ * costs O(shard size), i.e. up to maxEntries / kShardCount entries; puts
+ * only follow a fetch from the auth service. When a shard grows over its
+ * capacity the least recently read entry, found by a scan of the copy, is
+ * evicted.
+ */
+class PermissionCache {
+public:
+    static constexpr size_t kMaxPermissions = 256;
+    using PermissionBits = std::bitset<kMaxPermissions>;
+
+    enum class Freshness {
+        Missing,  // Not cached or too old to be served
+        Stale,    // Can be served, but should be refreshed in the background
+        Fresh
+    };
+
+    struct Lookup {
+        Freshness freshness;
+        PermissionBits permissions;
+    };
+
+    /**
+     * @param ttl Seconds during which an entry is considered fresh
+     * @param staleTtl Extra seconds during which an expired entry may still be served
+     * @param maxEntries Upper bound on the number of cached users
+     */
+    PermissionCache(time_t ttl, time_t staleTtl, size_t maxEntries);
+
+    /**
+     * Lookup of a user's permission set; lock-free unless the shard changed
+     * since this thread last read it
+     */
+    Lookup get(const std::string &userId) const;
+
+    /**
+     * Replace the permission set of a user
+     */
+    void put(const std::string &userId, const std::vector<std::string> &permissions);
+
+    /**
+     * Drop all cached users
+     */
+    void clear();
+
+    /**
+     * Bit index of a permission name, or -1 if the name was never seen.
+     * Lock-free like get().
+     */
+    int permissionIndex(const std::string &permission) const;
+
+private:
+    struct Entry {
+        PermissionBits permissions;
+        time_t fetchedAt;
+        mutable std::atomic<time_t> lastAccess;
+
+        Entry(const PermissionBits &bits, time_t now) : permissions(bits), fetchedAt(now), lastAccess(now) {}
+    };
+
+    using EntryMap = std::unordered_map<std::string, std::shared_ptr<const Entry>>;
+    using IndexMap = std::unordered_map<std::string, int>;
+
+    // An immutable map replaced by writers; version changes with every replacement
+    template <typename Map>
+    struct Published {
+        std::shared_ptr<const Map> current = std::make_shared<const Map>();
+        std::atomic<uint64_t> version{0};
+        mutable std::mutex mutex;           // writers, and readers picking up a new version
+
+        // Called with mutex held
+        void publish(std::shared_ptr<const Map> map);
+    };
+
+    // A thread's reference to the snapshot it last read, and its version
+    template <typename Map>
+    struct ReaderCopy {
+        uint64_t version = 0;
+        std::shared_ptr<const Map> map;
+    };
+
+    // The snapshots the calling thread last read from this cache
+    struct ReaderState;
+
+    static constexpr size_t kShardCount = 16;
+
+    size_t shardOf(const std::string &userId) const;
+
+    // The current snapshot; valid until this thread reads the same map again
+    template <typename Map>
+    const Map &read(const Published<Map> &published, ReaderCopy<Map> &copy) const;
+
+    ReaderState &readerState() const;
+
+    // Returns the bit index of a permission, registering it if needed
+    int internPermission(const std::string &permission);
+
+    // Tells the per-thread copies of different caches apart
+    const uint64_t id_;
+
+    std::array<Published<EntryMap>, kShardCount> shards_;
+
+    // Permission name -> bit index, published the same way as the shards
+    Published<IndexMap> permissionIndex_;
+
+    const time_t ttl_;
+    const time_t staleTtl_;
+    const size_t maxEntriesPerShard_;
+};
@@ -5,34 +5,49 @@
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <functional>
+#include <drogon/HttpClient.h>
+#include "permission_cache.h"
 
 /**
  * Utility class for permission checks
  */
 class PermissionUtils {
 public:
+    /**
+     * Callback invoked with the result of an asynchronous permission operation
+     */
+    using ResultCallback = std::function<void(bool)>;
+
     /**
      * Get singleton instance
      */
     static std::shared_ptr<PermissionUtils> instance();
 
     /**
-     * Check if a user has a specific permission
+     * Check if a user has a specific permission.
+     * Answered from the local RBAC matrix when it is loaded; otherwise the
+     * auth service is used. Never blocks the calling thread: cached (even
+     * slightly stale) permission sets are answered immediately, stale ones
+     * are refreshed in the background. On a cache miss the permissions are
+     * fetched from the auth service and the callback is invoked afterwards.
      *
      * @param userId User ID to check
      * @param permission Permission name to check
-     * @return true if the user has the permission, false otherwise
+     * @param callback Receives true if the user has the permission, false otherwise
      */
-    bool hasPermission(const std::string &userId, const std::string &permission);
+    void hasPermission(const std::string &userId, const std::string &permission, ResultCallback &&callback);
 
     /**
-     * Fetch user permissions from auth service and cache them
-     * 
+     * Fetch user permissions from auth service and cache them.
+     * Concurrent fetches for the same user are coalesced into a single
+     * upstream request; every caller receives the same result.
+     *
      * @param userId User ID to fetch permissions for
+     * @param callback Receives true if permissions were successfully fetched, false otherwise
      * @param forceRefresh Force a refresh of the cached permissions
-     * @return true if permissions were successfully fetched, false otherwise
      */
-    bool fetchUserPermissions(const std::string &userId, bool forceRefresh = false);
+    void fetchUserPermissions(const std::string &userId, ResultCallback &&callback, bool forceRefresh = false);
 
     /**
      * Clear all cached permissions
@@ -42,12 +57,30 @@ public:
 private:
     PermissionUtils();
 
-    // Cache structure: userId -> (permission -> timestamp)
-    std::unordered_map<std::string, std::unordered_map<std::string, time_t>> permissionCache_;
+    // Returns the keep-alive client bound to the current event loop
+    drogon::HttpClientPtr getClient();
+
+    // Tests a permission bit of a cached permission set
+    bool containsPermission(const PermissionCache::PermissionBits &permissions, const std::string &permission) const;
+
+    // Parses the auth service response and fills the cache
+    bool storePermissions(const std::string &userId, drogon::ReqResult result, const drogon::HttpResponsePtr &response);
+
+    // Wakes up every caller waiting on the in-flight request for the user
+    void completeFetch(const std::string &userId, bool success);
+
+    // Sharded read-mostly cache: userId -> permission bitset
+    std::unique_ptr<PermissionCache> cache_;
+
+    // In-flight requests: userId -> callbacks waiting for the response
+    std::unordered_map<std::string, std::vector<ResultCallback>> inflightFetches_;
+    std::mutex inflightMutex_;
 
-    // Cache mutex for thread safety
-    std::mutex cacheMutex_;
+    // One persistent client per event loop, so connections to auth are reused
+    std::unordered_map<trantor::EventLoop *, drogon::HttpClientPtr> clients_;
+    std::mutex clientsMutex_;
 
-    // Cache expiration time in seconds (default: 5 minutes)
-    const time_t cacheExpirationTime_ = 300;
-};
\ No newline at end of file
+    // Auth service location and request timeout (from config.json)
+    std::string authServiceUrl_;
+    double requestTimeout_;
+};
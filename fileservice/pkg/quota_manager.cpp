@@ -0,0 +1,193 @@
+#include "quota_manager.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include "db.h"
+
+std::shared_ptr<QuotaManager> QuotaManager::instance()
+{
+    static std::shared_ptr<QuotaManager> instance(new QuotaManager());
+    return instance;
+}
+
+bool QuotaManager::start(const std::string& storagePath, long long defaultUserBytes, long long defaultGroupBytes,
+                         long long minFreeBytes, double reconcileInterval)
+{
+    if (thread_)
+    {
+        return true;
+    }
+
+    storagePath_ = storagePath;
+    defaultUserBytes_ = std::max(0LL, defaultUserBytes);
+    defaultGroupBytes_ = std::max(0LL, defaultGroupBytes);
+    minFreeBytes_ = std::max(0LL, minFreeBytes);
+    if (!reload())
+    {
+        return false;
+    }
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("QuotaManager");
+    thread_->run();
+    thread_->getLoop()->runEvery(reconcileInterval, [this]() { reload(); });
+
+    LOG_INFO << "Storage quotas enforced, " << users_.size() << " users and " << groups_.size()
+             << " groups with stored files";
+    return true;
+}
+
+bool QuotaManager::reserve(int user_id, int group_id, long long bytes, std::string& errorMsg)
+{
+    if (!thread_)
+    {
+        return true;
+    }
+    bytes = std::max(0LL, bytes);
+
+    // Outside the lock: statvfs of the storage volume
+    std::error_code ec;
+    auto space = std::filesystem::space(storagePath_, ec);
+
+    // bytes comes from the client's Content-Length, so it is never added to anything:
+    // each check compares it with what is left
+    std::lock_guard<std::mutex> lock(mutex_);
+    long long available = static_cast<long long>(std::min<uintmax_t>(space.available, LLONG_MAX));
+    if (!ec && (available - minFreeBytes_ < reservedTotal_ || bytes > available - minFreeBytes_ - reservedTotal_))
+    {
+        errorMsg = "Insufficient storage on the server";
+        return false;
+    }
+
+    Scope scope = group_id > 0 ? Scope::Group : Scope::User;
+    int id = group_id > 0 ? group_id : user_id;
+    Account& account = (scope == Scope::Group ? groups_ : users_)[id];
+    long long limit = limitOf(scope, id);
+    if (limit > 0 && bytes > limit - account.used - account.reserved)
+    {
+        errorMsg = std::string("Quota exceeded: the ") + (scope == Scope::Group ? "group" : "user") + " uses " +
+                   std::to_string(account.used + account.reserved) + " of " + std::to_string(limit) + " bytes";
+        return false;
+    }
+
+    account.reserved += bytes;
+    reservedTotal_ += bytes;
+    return true;
+}
+
+void QuotaManager::finish(int user_id, int group_id, long long reserved, long long stored)
+{
+    if (!thread_)
+    {
+        return;
+    }
+    reserved = std::max(0LL, reserved);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Account& account = (group_id > 0 ? groups_ : users_)[group_id > 0 ? group_id : user_id];
+    account.reserved = std::max(0LL, account.reserved - reserved);
+    account.used += stored;
+    account.added += stored;
+    reservedTotal_ = std::max(0LL, reservedTotal_ - reserved);
+}
+
+QuotaManager::Usage QuotaManager::usage(Scope scope, int id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto& accounts = scope == Scope::Group ? groups_ : users_;
+    const auto& limits = scope == Scope::Group ? groupLimits_ : userLimits_;
+
+    Usage usage{0, 0, limitOf(scope, id), limits.count(id) > 0};
+    auto it = accounts.find(id);
+    if (it != accounts.end())
+    {
+        usage.used = it->second.used;
+        usage.reserved = it->second.reserved;
+    }
+    return usage;
+}
+
+bool QuotaManager::setLimit(Scope scope, int id, long long bytes)
+{
+    if (!DB::instance()->setStorageQuota(scope == Scope::Group ? 'g' : 'u', id, bytes))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    (scope == Scope::Group ? groupLimits_ : userLimits_)[id] = bytes;
+    return true;
+}
+
+bool QuotaManager::removeLimit(Scope scope, int id)
+{
+    if (!DB::instance()->deleteStorageQuota(scope == Scope::Group ? 'g' : 'u', id))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    (scope == Scope::Group ? groupLimits_ : userLimits_).erase(id);
+    return true;
+}
+
+bool QuotaManager::reload()
+{
+    // Uploads stored while the counters are read are added on top of them; the ones the read
+    // already includes are counted twice until the next reload, which errs on the safe side
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto* accounts : {&users_, &groups_})
+        {
+            for (auto& entry : *accounts)
+            {
+                entry.second.added = 0;
+            }
+        }
+    }
+
+    StorageQuotaSnapshot snapshot;
+    if (!DB::instance()->loadStorageQuotas(snapshot))
+    {
+        LOG_ERROR << "Failed to reload storage quotas";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto apply = [](std::unordered_map<int, Account>& accounts, const std::unordered_map<int, long long>& used) {
+        for (auto it = accounts.begin(); it != accounts.end();)
+        {
+            auto stored = used.find(it->first);
+            it->second.used = (stored != used.end() ? stored->second : 0) + it->second.added;
+            if (it->second.used == 0 && it->second.reserved == 0)
+            {
+                it = accounts.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (const auto& [id, bytes] : used)
+        {
+            if (accounts.count(id) == 0)
+            {
+                accounts[id].used = bytes;
+            }
+        }
+    };
+    apply(users_, snapshot.user_bytes);
+    apply(groups_, snapshot.group_bytes);
+    userLimits_ = std::move(snapshot.user_limits);
+    groupLimits_ = std::move(snapshot.group_limits);
+    return true;
+}
+
+long long QuotaManager::limitOf(Scope scope, int id) const
+{
+    const auto& limits = scope == Scope::Group ? groupLimits_ : userLimits_;
+    auto it = limits.find(id);
+    if (it != limits.end())
+    {
+        return it->second;
+    }
+    return scope == Scope::Group ? defaultGroupBytes_ : defaultUserBytes_;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Storage quotas of users and groups, checked when an upload is admitted.
+ *
+ * Usage is kept in memory: loaded from the storage_stats counters ('p'
+ * personal files of a user, 'g' files of a group), increased as uploads
+ * complete and reloaded every reconcile interval, which also picks up
+ * deletions and uploads through other processes. An admitted upload
+ * reserves its size until it completes, so concurrent uploads cannot
+ * overshoot a quota together.
+ *
+ * Uploads into a group (shared files) are charged to the group only.
+ * Limits come from storage_quotas, or the configured defaults for users and
+ * groups without one; a limit of 0 means unlimited.
+ */
+class QuotaManager {
+public:
+    enum class Scope {
+        User,
+        Group
+    };
+
+    struct Usage {
+        long long used;
+        long long reserved;         // admitted uploads not yet stored
+        long long limit;            // 0 = unlimited
+        bool custom;                // limit from storage_quotas rather than the default
+    };
+
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<QuotaManager> instance();
+
+    /**
+     * Load usage and limits and reload them every reconcileInterval seconds.
+     * Must be called once, after DB::initInstance().
+     *
+     * @param storagePath Directory the uploaded files are stored in
+     * @param defaultUserBytes Quota of users without their own (0 = unlimited)
+     * @param defaultGroupBytes Quota of groups without their own (0 = unlimited)
+     * @param minFreeBytes Free disk space that uploads must leave
+     */
+    bool start(const std::string& storagePath, long long defaultUserBytes, long long defaultGroupBytes,
+               long long minFreeBytes, double reconcileInterval);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    /**
+     * Admit an upload of at most bytes (its Content-Length) by user_id, into group_id if > 0,
+     * and reserve them. Everything is admitted until started.
+     *
+     * @return false with errorMsg "Quota exceeded ..." or "Insufficient storage ..."
+     */
+    bool reserve(int user_id, int group_id, long long bytes, std::string& errorMsg);
+
+    // Ends a reservation; stored is the size of the file recorded (0 if the upload failed)
+    void finish(int user_id, int group_id, long long reserved, long long stored);
+
+    Usage usage(Scope scope, int id);
+
+    // A limit of its own for the user or group; false on a database error
+    bool setLimit(Scope scope, int id, long long bytes);
+    // Back to the default limit
+    bool removeLimit(Scope scope, int id);
+
+private:
+    QuotaManager() = default;
+
+    struct Account {
+        long long used = 0;
+        long long reserved = 0;
+        long long added = 0;        // stored since the running reload started
+    };
+
+    bool reload();
+
+    // Called with mutex_ held
+    long long limitOf(Scope scope, int id) const;
+
+    std::string storagePath_;
+    long long defaultUserBytes_ = 0;
+    long long defaultGroupBytes_ = 0;
+    long long minFreeBytes_ = 0;
+
+    std::unordered_map<int, Account> users_;
+    std::unordered_map<int, Account> groups_;
+    std::unordered_map<int, long long> userLimits_;
+    std::unordered_map<int, long long> groupLimits_;
+    long long reservedTotal_ = 0;
+    std::mutex mutex_;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
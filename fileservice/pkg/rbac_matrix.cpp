@@ -0,0 +1,192 @@
+#include "rbac_matrix.h"
+#include <drogon/drogon.h>
+#include "db.h"
+
+std::shared_ptr<RbacMatrix> RbacMatrix::instance()
+{
+    static std::shared_ptr<RbacMatrix> instance(new RbacMatrix());
+    return instance;
+}
+
+RbacMatrix::RbacMatrix()
+{
+    LOG_INFO << "Initializing RbacMatrix";
+}
+
+RbacMatrix::~RbacMatrix()
+{
+    if (listenConn_)
+    {
+        PQfinish(listenConn_);
+    }
+    if (reloadConn_)
+    {
+        PQfinish(reloadConn_);
+    }
+}
+
+bool RbacMatrix::start(double pollInterval, double reloadInterval)
+{
+    if (!listen())
+    {
+        LOG_WARN << "RBAC change notifications are unavailable, relying on periodic reloads";
+    }
+
+    bool loaded = reload();
+
+    auto *loop = drogon::app().getLoop();
+    loop->runEvery(pollInterval, [this]() { pollNotifications(); });
+    if (reloadInterval > 0)
+    {
+        loop->runEvery(reloadInterval, [this]() { reload(); });
+    }
+
+    return loaded;
+}
+
+bool RbacMatrix::isLoaded() const
+{
+    return std::atomic_load(&snapshot_) != nullptr;
+}
+
+bool RbacMatrix::hasPermission(int userId, const std::string &permission) const
+{
+    auto snapshot = std::atomic_load(&snapshot_);
+    if (!snapshot)
+    {
+        return false;
+    }
+
+    auto permIt = snapshot->permissionIndex.find(permission);
+    if (permIt == snapshot->permissionIndex.end())
+    {
+        return false;
+    }
+
+    auto userIt = snapshot->userPermissions.find(userId);
+    return userIt != snapshot->userPermissions.end() && userIt->second.test(permIt->second);
+}
+
+bool RbacMatrix::reload()
+{
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+
+    // Not the shared connection: reloads run on timers while requests use it
+    if (reloadConn_ && PQstatus(reloadConn_) != CONNECTION_OK)
+    {
+        PQfinish(reloadConn_);
+        reloadConn_ = nullptr;
+    }
+    if (!reloadConn_)
+    {
+        reloadConn_ = DB::instance()->openConnection();
+    }
+
+    RbacTables tables;
+    if (!DB::instance()->loadRbacTables(reloadConn_, tables))
+    {
+        LOG_ERROR << "Failed to load RBAC tables, keeping the previous matrix";
+        return false;
+    }
+
+    auto snapshot = std::make_shared<Snapshot>();
+
+    // Role -> permission bitset
+    std::unordered_map<int, PermissionCache::PermissionBits> roleBits;
+    for (const auto &[roleId, permissionName] : tables.role_permissions)
+    {
+        auto it = snapshot->permissionIndex.find(permissionName);
+        if (it == snapshot->permissionIndex.end())
+        {
+            if (snapshot->permissionIndex.size() >= PermissionCache::kMaxPermissions)
+            {
+                LOG_ERROR << "Too many distinct permissions, ignoring " << permissionName;
+                continue;
+            }
+            int index = static_cast<int>(snapshot->permissionIndex.size());
+            it = snapshot->permissionIndex.emplace(permissionName, index).first;
+        }
+        roleBits[roleId].set(it->second);
+    }
+
+    // User -> effective permissions (union of the user's roles)
+    for (const auto &[userId, roleId] : tables.user_roles)
+    {
+        auto roleIt = roleBits.find(roleId);
+        auto &bits = snapshot->userPermissions[userId];
+        if (roleIt != roleBits.end())
+        {
+            bits |= roleIt->second;
+        }
+    }
+
+    LOG_INFO << "Loaded RBAC matrix: " << snapshot->permissionIndex.size() << " permissions, "
+             << roleBits.size() << " roles, " << snapshot->userPermissions.size() << " users";
+
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(snapshot)));
+    return true;
+}
+
+bool RbacMatrix::listen()
+{
+    if (!listenConn_)
+    {
+        listenConn_ = DB::instance()->openConnection();
+        if (!listenConn_)
+        {
+            return false;
+        }
+    }
+
+    PGresult *res = PQexec(listenConn_, "LISTEN rbac_changed;");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        LOG_ERROR << "Failed to LISTEN on rbac_changed: " << PQerrorMessage(listenConn_);
+        PQclear(res);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return false;
+    }
+    PQclear(res);
+    return true;
+}
+
+void RbacMatrix::pollNotifications()
+{
+    if (!listenConn_ || PQstatus(listenConn_) != CONNECTION_OK)
+    {
+        // Reconnect and reload, since notifications may have been missed meanwhile
+        if (listenConn_)
+        {
+            PQfinish(listenConn_);
+            listenConn_ = nullptr;
+        }
+        if (listen())
+        {
+            reload();
+        }
+        return;
+    }
+
+    if (!PQconsumeInput(listenConn_))
+    {
+        LOG_ERROR << "Lost RBAC notification connection: " << PQerrorMessage(listenConn_);
+        PQfinish(listenConn_);
+        listenConn_ = nullptr;
+        return;
+    }
+
+    // Several changes in a row are folded into a single reload
+    int received = 0;
+    while (PGnotify *notify = PQnotifies(listenConn_))
+    {
+        ++received;
+        PQfreemem(notify);
+    }
+
+    if (received > 0)
+    {
+        LOG_INFO << "RBAC tables changed (" << received << " notifications), reloading matrix";
+        reload();
+    }
+}
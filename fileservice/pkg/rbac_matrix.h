@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <libpq-fe.h>
+#include "permission_cache.h"
+
+/**
+ * In-memory copy of the RBAC tables shared with the auth service
+ * (roles, permissions, user_roles, role_permissions).
+ *
+ * The matrix is loaded at startup and reloaded whenever the database
+ * signals a change on the rbac_changed channel, so permission checks are
+ * answered locally without asking the auth service.
+ */
+class RbacMatrix {
+public:
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<RbacMatrix> instance();
+
+    ~RbacMatrix();
+
+    /**
+     * Load the matrix and subscribe to change notifications.
+     * Must be called once, after DB::initInstance().
+     *
+     * @param pollInterval Seconds between checks for change notifications
+     * @param reloadInterval Seconds between unconditional reloads (0 disables them)
+     * @return true if the initial load succeeded
+     */
+    bool start(double pollInterval, double reloadInterval);
+
+    /**
+     * Whether a matrix has been loaded and can answer permission checks
+     */
+    bool isLoaded() const;
+
+    /**
+     * Check if a user has a specific permission. Lock-free.
+     */
+    bool hasPermission(int userId, const std::string &permission) const;
+
+    /**
+     * Rebuild the matrix from the database
+     *
+     * @return true if the new matrix was published
+     */
+    bool reload();
+
+private:
+    RbacMatrix();
+
+    struct Snapshot {
+        std::unordered_map<std::string, int> permissionIndex;
+        std::unordered_map<int, PermissionCache::PermissionBits> userPermissions;
+    };
+
+    // Subscribes the listener connection to the rbac_changed channel
+    bool listen();
+
+    // Drains pending notifications and reloads the matrix if there were any
+    void pollNotifications();
+
+    std::shared_ptr<const Snapshot> snapshot_;
+
+    // Dedicated connection used only for LISTEN
+    PGconn *listenConn_ = nullptr;
+
+    // Serializes reloads triggered by notifications and timers
+    std::mutex reloadMutex_;
+
+    // Dedicated connection for the reload queries, guarded by reloadMutex_
+    PGconn *reloadConn_ = nullptr;
+};
@@ -0,0 +1,239 @@
+#include "sketches.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const size_t REGISTERS = size_t(1) << HyperLogLog::PRECISION;
+
+// Little-endian fixed-width integers for the checkpoint format
+void appendInt(std::string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+bool readInt(const std::string& data, size_t& offset, int bytes, uint64_t& value)
+{
+    if (offset + bytes > data.size())
+    {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+    }
+    offset += bytes;
+    return true;
+}
+
+// splitmix64 finalizer: consecutive ids become well-spread 64-bit hashes
+uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+HyperLogLog::HyperLogLog()
+    : registers_(REGISTERS, 0)
+{
+}
+
+void HyperLogLog::add(uint64_t value)
+{
+    uint64_t hash = mix(value);
+    size_t index = hash >> (64 - PRECISION);
+    uint64_t rest = hash << PRECISION;
+    uint8_t rank = rest == 0 ? 64 - PRECISION + 1 : static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other)
+{
+    for (size_t i = 0; i < REGISTERS; ++i)
+    {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+}
+
+long long HyperLogLog::estimate() const
+{
+    double m = static_cast<double>(REGISTERS);
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t value : registers_)
+    {
+        sum += std::ldexp(1.0, -value);
+        zeros += value == 0;
+    }
+
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Small ranges: linear counting over the empty registers is more accurate
+    if (estimate <= 2.5 * m && zeros > 0)
+    {
+        estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+    return std::llround(estimate);
+}
+
+std::string HyperLogLog::serialize() const
+{
+    std::string data;
+    data += static_cast<char>(PRECISION);
+    data.append(registers_.begin(), registers_.end());
+    return data;
+}
+
+bool HyperLogLog::deserialize(const std::string& data)
+{
+    if (data.size() != REGISTERS + 1 || data[0] != PRECISION)
+    {
+        return false;
+    }
+    registers_.assign(data.begin() + 1, data.end());
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+SpaceSaving::SpaceSaving(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity))
+{
+    counters_.reserve(capacity_);
+}
+
+void SpaceSaving::add(int id, long long weight)
+{
+    auto it = counters_.find(id);
+    if (it != counters_.end())
+    {
+        byCount_.erase({it->second.first, id});
+        it->second.first += weight;
+        byCount_.insert({it->second.first, id});
+        return;
+    }
+
+    if (counters_.size() < capacity_)
+    {
+        counters_[id] = {weight, 0};
+        byCount_.insert({weight, id});
+        return;
+    }
+
+    // Replace the smallest counter; its count becomes the error bound of the new id
+    auto smallest = byCount_.begin();
+    long long count = smallest->first;
+    counters_.erase(smallest->second);
+    byCount_.erase(smallest);
+    counters_[id] = {count + weight, count};
+    byCount_.insert({count + weight, id});
+}
+
+std::vector<SpaceSaving::Item> SpaceSaving::top(size_t n) const
+{
+    std::vector<Item> items;
+    items.reserve(std::min(n, byCount_.size()));
+    for (auto it = byCount_.rbegin(); it != byCount_.rend() && items.size() < n; ++it)
+    {
+        items.push_back({it->second, it->first, counters_.at(it->second).second});
+    }
+    return items;
+}
+
+void SpaceSaving::merge(const SpaceSaving& other)
+{
+    // An id tracked on one side only may have been counted up to the other side's floor
+    // (Agarwal et al., mergeable summaries)
+    long long ownFloor = floor();
+    long long otherFloor = other.floor();
+
+    std::vector<Item> items;
+    items.reserve(counters_.size() + other.counters_.size());
+    for (const auto& [id, counter] : counters_)
+    {
+        auto it = other.counters_.find(id);
+        if (it != other.counters_.end())
+        {
+            items.push_back({id, counter.first + it->second.first, counter.second + it->second.second});
+        }
+        else
+        {
+            items.push_back({id, counter.first + otherFloor, counter.second + otherFloor});
+        }
+    }
+    for (const auto& [id, counter] : other.counters_)
+    {
+        if (counters_.count(id) == 0)
+        {
+            items.push_back({id, counter.first + ownFloor, counter.second + ownFloor});
+        }
+    }
+    assign(items);
+}
+
+std::string SpaceSaving::serialize() const
+{
+    std::string data;
+    appendInt(data, counters_.size(), 4);
+    for (const auto& [id, counter] : counters_)
+    {
+        appendInt(data, static_cast<uint32_t>(id), 4);
+        appendInt(data, static_cast<uint64_t>(counter.first), 8);
+        appendInt(data, static_cast<uint64_t>(counter.second), 8);
+    }
+    return data;
+}
+
+bool SpaceSaving::deserialize(const std::string& data)
+{
+    size_t offset = 0;
+    uint64_t size;
+    if (!readInt(data, offset, 4, size))
+    {
+        return false;
+    }
+
+    std::vector<Item> items;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        uint64_t id, count, error;
+        if (!readInt(data, offset, 4, id) || !readInt(data, offset, 8, count) || !readInt(data, offset, 8, error))
+        {
+            return false;
+        }
+        items.push_back({static_cast<int>(static_cast<uint32_t>(id)), static_cast<long long>(count),
+                         static_cast<long long>(error)});
+    }
+
+    // A checkpoint written with a larger capacity keeps its largest counters
+    assign(items);
+    return true;
+}
+
+void SpaceSaving::assign(std::vector<Item>& items)
+{
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.count > b.count; });
+    items.resize(std::min(items.size(), capacity_));
+
+    counters_.clear();
+    byCount_.clear();
+    for (const auto& item : items)
+    {
+        counters_[item.id] = {item.count, item.error};
+        byCount_.insert({item.count, item.id});
+    }
+}
+
+long long SpaceSaving::floor() const
+{
+    return counters_.size() < capacity_ || byCount_.empty() ? 0 : byCount_.begin()->first;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Distinct-count estimate in fixed memory (HyperLogLog, 2^PRECISION one-byte
+ * registers, about 1.6% standard error). Not thread-safe.
+ */
+class HyperLogLog {
+public:
+    static const int PRECISION = 12;
+
+    HyperLogLog();
+
+    void add(uint64_t value);
+
+    // Takes the register-wise maximum, i.e. the estimate of the union
+    void merge(const HyperLogLog& other);
+
+    long long estimate() const;
+
+    std::string serialize() const;
+    bool deserialize(const std::string& data);
+
+private:
+    std::vector<uint8_t> registers_;
+};
+
+/**
+ * Approximate heavy hitters over a stream of ids (Space-Saving).
+ *
+ * Holds at most capacity counters. An id that is not tracked takes over the
+ * smallest counter and inherits its count as the error bound, so every id
+ * whose true count exceeds total / capacity is guaranteed to be tracked, and
+ * count - error <= true count <= count. Not thread-safe.
+ */
+class SpaceSaving {
+public:
+    struct Item {
+        int id;
+        long long count;
+        long long error;        // overestimation bound
+    };
+
+    explicit SpaceSaving(size_t capacity);
+
+    void add(int id, long long weight = 1);
+
+    // Largest counters first, at most n
+    std::vector<Item> top(size_t n) const;
+
+    // Combines the counts of another stream; the bounds on each count still hold
+    void merge(const SpaceSaving& other);
+
+    std::string serialize() const;
+    bool deserialize(const std::string& data);
+
+private:
+    // Keeps the largest capacity of items
+    void assign(std::vector<Item>& items);
+
+    // Count an id that is not tracked may have reached: the smallest counter once all are taken
+    long long floor() const;
+
+    size_t capacity_;
+    std::unordered_map<int, std::pair<long long, long long>> counters_;    // id -> (count, error)
+    std::set<std::pair<long long, int>> byCount_;                          // (count, id)
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * Streaming encoder interface shared by the wire formats (JSON, CBOR).
+ *
+ * Row emitters are written once against this interface, so every format
+ * carries the same fields in the same order. The caller is responsible for
+ * a well-formed sequence of calls (keys only inside objects, balanced
+ * start/end).
+ */
+class StructuredWriter {
+public:
+    virtual ~StructuredWriter() = default;
+
+    virtual void startObject() = 0;
+    virtual void endObject() = 0;
+    virtual void startArray() = 0;
+    virtual void endArray() = 0;
+
+    /**
+     * Write an object key; must be followed by exactly one value or container
+     */
+    virtual void key(std::string_view name) = 0;
+
+    virtual void value(std::string_view str) = 0;
+    virtual void value(long long number) = 0;
+    virtual void value(bool flag) = 0;
+    virtual void null() = 0;
+
+    void value(const char *str) { value(std::string_view(str)); }
+    void value(const std::string &str) { value(std::string_view(str)); }
+    void value(int number) { value(static_cast<long long>(number)); }
+
+    /**
+     * Shorthand for key(name) followed by value(v)
+     */
+    template <typename T>
+    void field(std::string_view name, const T &v)
+    {
+        key(name);
+        value(v);
+    }
+};
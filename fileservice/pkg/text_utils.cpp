@@ -0,0 +1,47 @@
+#include "text_utils.h"
+
+namespace TextUtils {
+
+std::string foldCase(const std::string& text)
+{
+    std::string folded;
+    folded.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        unsigned char c = text[i];
+        if (c >= 'A' && c <= 'Z')
+        {
+            folded += static_cast<char>(c + ('a' - 'A'));
+        }
+        else if (c == 0xD0 && i + 1 < text.size())
+        {
+            unsigned char next = text[++i];
+            if (next >= 0x90 && next <= 0x9F)            // А-П -> а-п
+            {
+                folded += '\xD0';
+                folded += static_cast<char>(next + 0x20);
+            }
+            else if (next >= 0xA0 && next <= 0xAF)       // Р-Я -> р-я
+            {
+                folded += '\xD1';
+                folded += static_cast<char>(next - 0x20);
+            }
+            else if (next == 0x81)                       // Ё -> ё
+            {
+                folded += "\xD1\x91";
+            }
+            else
+            {
+                folded += static_cast<char>(c);
+                folded += static_cast<char>(next);
+            }
+        }
+        else
+        {
+            folded += static_cast<char>(c);
+        }
+    }
+    return folded;
+}
+
+} // namespace TextUtils
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+namespace TextUtils {
+
+// Lower case for ASCII and Cyrillic (UTF-8); other bytes are kept as they are
+    std::string foldCase(const std::string& text);
+
+} // namespace TextUtils
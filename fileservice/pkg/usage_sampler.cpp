@@ -0,0 +1,160 @@
+#include "usage_sampler.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "db.h"
+
+namespace {
+
+const time_t HOUR = 60 * 60;
+const time_t DAY = 24 * HOUR;
+
+// Rollups redone after a restart, in case the previous run stopped before finishing them
+const time_t CATCH_UP = 2 * DAY;
+
+} // namespace
+
+std::shared_ptr<UsageSampler> UsageSampler::instance()
+{
+    static std::shared_ptr<UsageSampler> instance(new UsageSampler());
+    return instance;
+}
+
+void UsageSampler::start(int minuteRetentionDays, int hourRetentionDays)
+{
+    if (thread_)
+    {
+        return;
+    }
+
+    minuteRetentionDays_ = std::max(2, minuteRetentionDays);
+    hourRetentionDays_ = std::max(minuteRetentionDays_, hourRetentionDays);
+
+    time_t now = std::time(nullptr);
+    rolledHours_ = now / HOUR * HOUR - CATCH_UP;
+    rolledDays_ = now / DAY * DAY - CATCH_UP;
+
+    thread_ = std::make_unique<trantor::EventLoopThread>("UsageSampler");
+    thread_->run();
+    thread_->getLoop()->runEvery(SAMPLE_INTERVAL, [this]() { sample(); });
+
+    LOG_INFO << "Usage sampler started, keeping minute samples for " << minuteRetentionDays_
+             << " days and hourly rollups for " << hourRetentionDays_ << " days";
+}
+
+void UsageSampler::recordRequest(const std::string& user_id)
+{
+    int id = std::atoi(user_id.c_str());
+    if (!thread_ || id <= 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(activityMutex_);
+    users_[id].active = true;
+}
+
+void UsageSampler::recordUpload(const std::string& user_id, int group_id, long long bytes)
+{
+    recordTransfer(user_id, group_id, bytes, 0);
+}
+
+void UsageSampler::recordDownload(const std::string& user_id, int group_id, long long bytes)
+{
+    recordTransfer(user_id, group_id, 0, bytes);
+}
+
+void UsageSampler::recordTransfer(const std::string& user_id, int group_id, long long uploaded, long long downloaded)
+{
+    int id = std::atoi(user_id.c_str());
+    if (!thread_ || id <= 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(activityMutex_);
+    Activity& user = users_[id];
+    user.active = true;
+    user.upload_bytes += uploaded;
+    user.download_bytes += downloaded;
+
+    if (group_id > 0)
+    {
+        Activity& group = groups_[group_id];
+        group.upload_bytes += uploaded;
+        group.download_bytes += downloaded;
+        group.users.insert(id);
+    }
+}
+
+void UsageSampler::sample()
+{
+    time_t now = std::time(nullptr);
+    time_t bucket = now / SAMPLE_INTERVAL * SAMPLE_INTERVAL - SAMPLE_INTERVAL;
+
+    std::unordered_map<int, Activity> users;
+    std::unordered_map<int, Activity> groups;
+    {
+        std::lock_guard<std::mutex> lock(activityMutex_);
+        users.swap(users_);
+        groups.swap(groups_);
+    }
+
+    // The system row is written every interval, so the totals form a continuous series
+    std::vector<UsageActivity> activity;
+    activity.reserve(1 + users.size() + groups.size());
+    activity.push_back({'s', 0, 0, 0, 0});
+    for (const auto& [id, user] : users)
+    {
+        activity.push_back({'u', id, user.active ? 1 : 0, user.upload_bytes, user.download_bytes});
+        activity[0].active_users += user.active ? 1 : 0;
+        activity[0].upload_bytes += user.upload_bytes;
+        activity[0].download_bytes += user.download_bytes;
+    }
+    for (const auto& [id, group] : groups)
+    {
+        activity.push_back({'g', id, static_cast<int>(group.users.size()), group.upload_bytes, group.download_bytes});
+    }
+
+    auto db = DB::instance();
+    if (!db->recordUsageSamples(bucket, activity))
+    {
+        LOG_ERROR << "Failed to record usage samples, activity of this interval is lost";
+    }
+
+    // Hours whose last minute has been written
+    time_t hoursEnd = (bucket + SAMPLE_INTERVAL) / HOUR * HOUR;
+    if (hoursEnd > rolledHours_)
+    {
+        rollup(rolledHours_, hoursEnd);
+    }
+}
+
+void UsageSampler::rollup(time_t from, time_t to)
+{
+    auto db = DB::instance();
+    if (!db->rollupUsage(UsageResolution::Hour, from, to))
+    {
+        LOG_ERROR << "Failed to roll up usage samples into hours";
+        return;
+    }
+    rolledHours_ = to;
+
+    time_t daysEnd = to / DAY * DAY;
+    if (daysEnd <= rolledDays_)
+    {
+        return;
+    }
+    if (!db->rollupUsage(UsageResolution::Day, rolledDays_, daysEnd))
+    {
+        LOG_ERROR << "Failed to roll up usage samples into days";
+        return;
+    }
+    rolledDays_ = daysEnd;
+
+    if (!db->pruneUsage(daysEnd - minuteRetentionDays_ * DAY, daysEnd - hourRetentionDays_ * DAY))
+    {
+        LOG_WARN << "Failed to remove expired usage samples";
+    }
+}
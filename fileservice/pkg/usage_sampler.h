@@ -0,0 +1,89 @@
+#pragma once
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <trantor/net/EventLoopThread.h>
+
+/**
+ * Records usage history for capacity planning.
+ *
+ * Request handlers report activity (authenticated requests, upload and
+ * download volume) into in-memory counters. Once a minute a background
+ * thread writes one sample per active user and group, plus one for the whole
+ * system. Each sample holds the current storage from the storage_stats
+ * counters and the transfer volume since the previous sample.
+ *
+ * Minute samples live in daily partitions that are dropped once they are
+ * older than the retention period. Completed hours and days are rolled up
+ * into usage_samples_hour and usage_samples_day. Rollups can be repeated,
+ * so a restart only has to redo the recent ones.
+ *
+ * active_users is the number of distinct users that made requests (system),
+ * 1 (user), or the number of distinct users with transfers in the group.
+ * Group rollups keep the per-minute peak.
+ */
+class UsageSampler {
+public:
+    /**
+     * Get singleton instance
+     */
+    static std::shared_ptr<UsageSampler> instance();
+
+    /**
+     * Start sampling once a minute. Must be called once, after DB::initInstance().
+     *
+     * @param minuteRetentionDays Days of minute samples to keep (at least 2, the day rollup reads them)
+     * @param hourRetentionDays Days of hourly rollups to keep; daily rollups are kept indefinitely
+     */
+    void start(int minuteRetentionDays, int hourRetentionDays);
+
+    bool isRunning() const { return thread_ != nullptr; }
+
+    int minuteRetentionDays() const { return minuteRetentionDays_; }
+    int hourRetentionDays() const { return hourRetentionDays_; }
+
+    // An authenticated request by user_id
+    void recordRequest(const std::string& user_id);
+
+    // A completed upload or download; group_id is 0 for personal files
+    void recordUpload(const std::string& user_id, int group_id, long long bytes);
+    void recordDownload(const std::string& user_id, int group_id, long long bytes);
+
+    static const int SAMPLE_INTERVAL = 60;
+
+private:
+    UsageSampler() = default;
+
+    struct Activity {
+        bool active = false;
+        long long upload_bytes = 0;
+        long long download_bytes = 0;
+        std::unordered_set<int> users;     // groups only
+    };
+
+    void recordTransfer(const std::string& user_id, int group_id, long long uploaded, long long downloaded);
+
+    // Writes the sample of the interval that just ended, then rolls up and prunes as needed
+    void sample();
+
+    // Recomputes the rollups of [from, to)
+    void rollup(time_t from, time_t to);
+
+    int minuteRetentionDays_ = 7;
+    int hourRetentionDays_ = 180;
+
+    // Activity since the last sample
+    std::unordered_map<int, Activity> users_;
+    std::unordered_map<int, Activity> groups_;
+    std::mutex activityMutex_;
+
+    // Start of the hour / day up to which rollups are done; only used on the sampler thread
+    time_t rolledHours_ = 0;
+    time_t rolledDays_ = 0;
+
+    std::unique_ptr<trantor::EventLoopThread> thread_;
+};
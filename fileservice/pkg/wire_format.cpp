@@ -0,0 +1,56 @@
+#include "wire_format.h"
+#include "json_writer.h"
+#include "cbor_writer.h"
+
+namespace WireFormat {
+
+Format negotiate(const drogon::HttpRequestPtr& req)
+{
+    const std::string& accept = req->getHeader("accept");
+    if (accept.find("application/cbor") != std::string::npos)
+    {
+        return Format::Cbor;
+    }
+    return Format::Json;
+}
+
+const char* contentType(Format format)
+{
+    return format == Format::Cbor ? "application/cbor" : "application/json; charset=utf-8";
+}
+
+std::unique_ptr<StructuredWriter> makeWriter(Format format, std::string& out)
+{
+    if (format == Format::Cbor)
+    {
+        return std::make_unique<CborWriter>(out);
+    }
+    return std::make_unique<JsonWriter>(out);
+}
+
+drogon::HttpResponsePtr makeResponse(Format format, std::string&& body)
+{
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setContentTypeString(contentType(format));
+    resp->setBody(std::move(body));
+    setVary(resp);
+    return resp;
+}
+
+std::string etag(Format format, const std::string& listingETag)
+{
+    if (format == Format::Json || listingETag.empty() || listingETag.back() != '"')
+    {
+        return listingETag;
+    }
+    std::string tagged = listingETag;
+    tagged.insert(tagged.size() - 1, "-cbor");
+    return tagged;
+}
+
+void setVary(const drogon::HttpResponsePtr& resp)
+{
+    resp->addHeader("Vary", "Accept");
+}
+
+} // namespace WireFormat
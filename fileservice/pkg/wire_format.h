@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+#include "structured_writer.h"
+
+/**
+ * Response formats for listing and admin endpoints, chosen from the
+ * request's Accept header. JSON stays the default.
+ */
+namespace WireFormat {
+
+    enum class Format {
+        Json,
+        Cbor
+    };
+
+// Picks the format from the Accept header (application/cbor, otherwise JSON)
+    Format negotiate(const drogon::HttpRequestPtr& req);
+
+    const char* contentType(Format format);
+
+// Encoder for the format that appends to out
+    std::unique_ptr<StructuredWriter> makeWriter(Format format, std::string& out);
+
+// 200 response carrying an encoded body
+    drogon::HttpResponsePtr makeResponse(Format format, std::string&& body);
+
+// Listing ETag for the format; CBOR bodies get their own validator
+    std::string etag(Format format, const std::string& listingETag);
+
+// Marks a response as dependent on the Accept header
+    void setVary(const drogon::HttpResponsePtr& resp);
+
+} // namespace WireFormat
@@ -1,8 +1,16 @@
 #include "AdminService.h"
 #include <drogon/drogon.h>
 #include <algorithm>
-#include <unordered_map>
 #include <filesystem>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include "json_writer.h"
+#include "usage_sampler.h"
+#include "analytics.h"
+#include "duplicate_scanner.h"
+#include "job_queue.h"
+#include "quota_manager.h"
 
 std::shared_ptr<AdminService> AdminService::instance()
 {
@@ -22,166 +30,482 @@ AdminService::AdminService()
     }
 }
 
-std::vector<UserFilesData> AdminService::getAllFiles()
+namespace {
+
+// Rows of the admin listing queries (see DB::openAllFilesAdminCursor / openAllFoldersAdminCursor)
+struct ListingColumns {
+    const char* listKey;
+    const char* countKey;
+    const char* totalKey;
+    const char* idKey;
+    int userColumn;
+    int emailColumn;
+    // Writes the fields of one item (without the enclosing object)
+    void (*writeItem)(StructuredWriter& writer, const RowCursor& row);
+};
+
+void writeFileItem(StructuredWriter& writer, const RowCursor& row)
+{
+    writer.field("file_id", std::stoi(row.get(0)));
+    writer.field("file_name", row.get(1));
+    writer.field("file_size", std::stoi(row.get(2)));
+    writer.field("folder_id", std::stoi(row.get(3)));
+    writer.field("created_at", row.get(6));
+}
+
+void writeFolderItem(StructuredWriter& writer, const RowCursor& row)
 {
-    LOG_INFO << "Getting all files for all users";
+    writer.field("folder_id", std::stoi(row.get(0)));
+    writer.field("folder_name", row.get(1));
+    writer.field("parent_folder_id", std::stoi(row.get(2)));
+    writer.field("created_at", row.get(5));
+}
 
-    std::vector<UserFilesData> result;
+const ListingColumns FILE_COLUMNS = {"files", "files_count", "total_files", "file_id", 4, 5, writeFileItem};
+const ListingColumns FOLDER_COLUMNS = {"folders", "folders_count", "total_folders", "folder_id", 3, 4, writeFolderItem};
 
-    try {
-        // Get all users
-        auto users = db_->getAllUsers();
+const ListingColumns& columnsOf(AdminListing listing)
+{
+    return listing == AdminListing::Folders ? FOLDER_COLUMNS : FILE_COLUMNS;
+}
+
+/**
+ * Encodes listing rows ordered by user as
+ * {"users":[{"user_id":"..","email":"..","files":[...],"files_count":N},...],
+ *  "total_users":U,"total_files":F}
+ * Counts follow the lists they describe, since they are only known once the
+ * rows have been read.
+ */
+class UserGroupedEncoder {
+public:
+    UserGroupedEncoder(StructuredWriter& writer, const ListingColumns& columns)
+        : writer_(writer), columns_(columns)
+    {
+        writer_.startObject();
+        writer_.key("users");
+        writer_.startArray();
+    }
+
+    void row(const RowCursor& row)
+    {
+        int userId = std::stoi(row.get(columns_.userColumn));
+        if (userId != lastUserId)
+        {
+            closeUser();
+            lastUserId = userId;
+            ++totalUsers_;
+            writer_.startObject();
+            writer_.field("user_id", row.get(columns_.userColumn));
+            writer_.field("email", row.get(columns_.emailColumn));
+            writer_.key(columns_.listKey);
+            writer_.startArray();
+        }
 
-        // Use the user data to create a map for easy access
-        std::unordered_map<int, std::string> userEmailMap;
-        for (const auto& [userId, email, _] : users) {
-            userEmailMap[userId] = email;
+        writer_.startObject();
+        columns_.writeItem(writer_, row);
+        writer_.endObject();
+
+        lastItemId = std::stoi(row.get(0));
+        ++userItems_;
+        ++totalItems_;
+    }
+
+    // Closes the document; `trailer` may add fields to the top-level object
+    void finish(const std::function<void(StructuredWriter&)>& trailer = nullptr)
+    {
+        closeUser();
+        writer_.endArray();
+        writer_.field("total_users", totalUsers_);
+        writer_.field(columns_.totalKey, totalItems_);
+        if (trailer)
+        {
+            trailer(writer_);
         }
+        writer_.endObject();
+    }
+
+    // Key of the last row encoded, for keyset pagination
+    int lastUserId = -1;
+    int lastItemId = 0;
+
+private:
+    void closeUser()
+    {
+        if (lastUserId < 0) return;
+
+        writer_.endArray();
+        writer_.field(columns_.countKey, userItems_);
+        writer_.endObject();
+        userItems_ = 0;
+    }
+
+    StructuredWriter& writer_;
+    const ListingColumns& columns_;
+    int userItems_ = 0;
+    int totalUsers_ = 0;
+    int totalItems_ = 0;
+};
+
+/**
+ * Source of a chunked response: output is produced on demand, about one
+ * buffer at a time, so memory use does not grow with the size of the result.
+ */
+class BufferedStream {
+public:
+    virtual ~BufferedStream() = default;
+
+    std::size_t read(char *buffer, std::size_t size)
+    {
+        // Connection closed by the client
+        if (!buffer)
+        {
+            close();
+            return 0;
+        }
+
+        while (pending_.size() - offset_ < size && !exhausted_)
+        {
+            if (!produce(size - (pending_.size() - offset_)))
+            {
+                exhausted_ = true;
+                close();
+            }
+        }
+
+        std::size_t n = std::min(size, pending_.size() - offset_);
+        std::memcpy(buffer, pending_.data() + offset_, n);
+        offset_ += n;
+
+        // Start over at the beginning of the buffer to keep its capacity bounded
+        if (offset_ == pending_.size())
+        {
+            pending_.clear();
+            offset_ = 0;
+        }
+        return n;
+    }
+
+protected:
+    // Appends at least some output to pending_ (aiming for `wanted` bytes); false once there is no more
+    virtual bool produce(std::size_t wanted) = 0;
+
+    // Releases the database connection
+    virtual void close() = 0;
 
-        // Get all files with user information
-        auto allFiles = db_->getAllFilesAdmin();
+    std::string pending_;
 
-        // Group files by user
-        std::unordered_map<int, std::vector<FileInfo>> userFilesMap;
+private:
+    std::size_t offset_ = 0;
+    bool exhausted_ = false;
+};
 
-        for (const auto& [fileId, fileName, fileSize, createdAt, userId, _] : allFiles) {
-            FileInfo file;
-            file.file_id = fileId;
-            file.file_name = fileName;
-            file.file_size = fileSize;
-            file.folder_id = 0; // This should be updated if folder information is needed
-            file.created_at = createdAt;
+// A whole listing in the grouped format of /admin/files and /admin/folders
+class GroupedListingStream : public BufferedStream {
+public:
+    GroupedListingStream(std::unique_ptr<RowCursor> cursor, WireFormat::Format format, const ListingColumns& columns)
+        : cursor_(std::move(cursor)), writer_(WireFormat::makeWriter(format, pending_)), encoder_(*writer_, columns)
+    {
+    }
 
-            userFilesMap[userId].push_back(file);
+protected:
+    bool produce(std::size_t wanted) override
+    {
+        std::size_t target = pending_.size() + wanted;
+        while (pending_.size() < target)
+        {
+            if (!cursor_->next())
+            {
+                if (cursor_->failed())
+                {
+                    LOG_ERROR << "Failed to read the admin listing, response is truncated";
+                }
+                encoder_.finish();
+                return false;
+            }
+            encoder_.row(*cursor_);
         }
+        return true;
+    }
 
-        // Convert the map to the result format
-        for (const auto& [userId, files] : userFilesMap) {
-            if (userEmailMap.find(userId) != userEmailMap.end()) {
-                UserFilesData userData;
-                userData.user_id = std::to_string(userId);
-                userData.email = userEmailMap[userId];
-                userData.files = files;
+    void close() override
+    {
+        cursor_.reset();
+    }
+
+private:
+    std::unique_ptr<RowCursor> cursor_;
+    std::unique_ptr<StructuredWriter> writer_;
+    UserGroupedEncoder encoder_;
+};
+
+// One JSON object per line: {"user_id":..,"email":"..","file_id":..,...}
+class NdjsonExportStream : public BufferedStream {
+public:
+    NdjsonExportStream(std::unique_ptr<RowCursor> cursor, const ListingColumns& columns)
+        : cursor_(std::move(cursor)), columns_(columns)
+    {
+    }
 
-                result.push_back(userData);
+protected:
+    bool produce(std::size_t wanted) override
+    {
+        std::size_t target = pending_.size() + wanted;
+        while (pending_.size() < target)
+        {
+            if (!cursor_->next())
+            {
+                if (cursor_->failed())
+                {
+                    LOG_ERROR << "Failed to read the admin export, response is truncated";
+                }
+                return false;
             }
+
+            JsonWriter writer(pending_);
+            writer.startObject();
+            writer.field("user_id", std::stoi(cursor_->get(columns_.userColumn)));
+            writer.field("email", cursor_->get(columns_.emailColumn));
+            columns_.writeItem(writer, *cursor_);
+            writer.endObject();
+            pending_ += '\n';
         }
+        return true;
+    }
+
+    void close() override
+    {
+        cursor_.reset();
+    }
 
-        LOG_INFO << "Retrieved files for " << result.size() << " users";
+private:
+    std::unique_ptr<RowCursor> cursor_;
+    const ListingColumns& columns_;
+};
 
-    } catch (const std::exception& e) {
-        LOG_ERROR << "Error in getAllFiles: " << e.what();
+// CSV rows exactly as COPY produces them
+class CsvExportStream : public BufferedStream {
+public:
+    explicit CsvExportStream(std::unique_ptr<CopyOutReader> reader)
+        : reader_(std::move(reader))
+    {
     }
 
-    return result;
+protected:
+    bool produce(std::size_t wanted) override
+    {
+        std::size_t target = pending_.size() + wanted;
+        const char* data;
+        int size;
+        while (pending_.size() < target)
+        {
+            if (!reader_->next(data, size))
+            {
+                if (reader_->failed())
+                {
+                    LOG_ERROR << "Failed to read the admin export, response is truncated";
+                }
+                return false;
+            }
+            pending_.append(data, static_cast<std::size_t>(size));
+        }
+        return true;
+    }
+
+    void close() override
+    {
+        reader_.reset();
+    }
+
+private:
+    std::unique_ptr<CopyOutReader> reader_;
+};
+
+std::function<std::size_t(char *, std::size_t)> makeProducer(std::shared_ptr<BufferedStream> stream)
+{
+    return [stream](char *buffer, std::size_t size) {
+        try {
+            return stream->read(buffer, size);
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Error while streaming an admin listing: " << e.what();
+            return std::size_t(0);
+        }
+    };
 }
 
-std::vector<UserFoldersData> AdminService::getAllFolders()
+// Page cursor text: "<user_id>:<id>" of the last row of the previous page
+bool parsePageCursor(const std::string& cursor, int& after_user_id, int& after_id)
 {
-    LOG_INFO << "Getting all folders for all users";
+    after_user_id = 0;
+    after_id = 0;
+    if (cursor.empty())
+    {
+        return true;
+    }
 
-    std::vector<UserFoldersData> result;
+    size_t colon = cursor.find(':');
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        size_t userEnd = 0, idEnd = 0;
+        std::string userText = cursor.substr(0, colon);
+        std::string idText = cursor.substr(colon + 1);
+        after_user_id = std::stoi(userText, &userEnd);
+        after_id = std::stoi(idText, &idEnd);
+        return userEnd == userText.size() && idEnd == idText.size();
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
 
-    try {
-        // Get all users
-        auto users = db_->getAllUsers();
+} // namespace
 
-        // Use the user data to create a map for easy access
-        std::unordered_map<int, std::string> userEmailMap;
-        for (const auto& [userId, email, _] : users) {
-            userEmailMap[userId] = email;
-        }
+std::function<std::size_t(char *, std::size_t)> AdminService::streamListing(AdminListing listing, WireFormat::Format format)
+{
+    LOG_INFO << "Streaming all " << columnsOf(listing).listKey << " for all users";
+
+    auto cursor = listing == AdminListing::Folders ? db_->openAllFoldersAdminCursor() : db_->openAllFilesAdminCursor();
+    if (!cursor)
+    {
+        LOG_ERROR << "Failed to query all " << columnsOf(listing).listKey;
+        return {};
+    }
 
-        // Get all folders with user information
-        auto allFolders = db_->getAllFoldersAdmin();
+    return makeProducer(std::make_shared<GroupedListingStream>(std::move(cursor), format, columnsOf(listing)));
+}
 
-        // Group folders by user
-        std::unordered_map<int, std::vector<FolderInfo>> userFoldersMap;
+bool AdminService::getListingPage(AdminListing listing, const std::string& cursor, int limit,
+                                  WireFormat::Format format, std::string& body, std::string& errorMsg)
+{
+    int after_user_id, after_id;
+    if (!parsePageCursor(cursor, after_user_id, after_id))
+    {
+        errorMsg = "Invalid cursor";
+        return false;
+    }
 
-        for (const auto& [folderId, folderName, parentFolderId, createdAt, userId, _] : allFolders) {
-            FolderInfo folder;
-            folder.folder_id = folderId;
-            folder.folder_name = folderName;
-            folder.parent_folder_id = parentFolderId;
-            folder.created_at = createdAt;
+    const ListingColumns& columns = columnsOf(listing);
+    auto writer = WireFormat::makeWriter(format, body);
+    UserGroupedEncoder encoder(*writer, columns);
 
-            userFoldersMap[userId].push_back(folder);
+    // One row more than the page tells whether there is a next page
+    int rows = 0;
+    bool hasMore = false;
+    auto visitor = [&](const RowCursor& row) {
+        if (rows++ < limit)
+        {
+            encoder.row(row);
         }
+        else
+        {
+            hasMore = true;
+        }
+    };
 
-        // Convert the map to the result format
-        for (const auto& [userId, folders] : userFoldersMap) {
-            if (userEmailMap.find(userId) != userEmailMap.end()) {
-                UserFoldersData userData;
-                userData.user_id = std::to_string(userId);
-                userData.email = userEmailMap[userId];
-                userData.folders = folders;
+    bool ok = listing == AdminListing::Folders
+        ? db_->forEachFolderAdminPage(after_user_id, after_id, limit + 1, visitor)
+        : db_->forEachFileAdminPage(after_user_id, after_id, limit + 1, visitor);
+    if (!ok)
+    {
+        errorMsg = std::string("Failed to get ") + columns.listKey;
+        return false;
+    }
 
-                result.push_back(userData);
-            }
+    encoder.finish([&](StructuredWriter& trailer) {
+        trailer.field("has_more", hasMore);
+        if (hasMore)
+        {
+            trailer.field("next_cursor", std::to_string(encoder.lastUserId) + ":" + std::to_string(encoder.lastItemId));
         }
+    });
+    return true;
+}
 
-        LOG_INFO << "Retrieved folders for " << result.size() << " users";
+std::function<std::size_t(char *, std::size_t)> AdminService::exportListing(AdminListing listing, ExportFormat format)
+{
+    LOG_INFO << "Exporting all " << columnsOf(listing).listKey << (format == ExportFormat::Csv ? " as CSV" : " as NDJSON");
 
-    } catch (const std::exception& e) {
-        LOG_ERROR << "Error in getAllFolders: " << e.what();
+    if (format == ExportFormat::Csv)
+    {
+        auto reader = db_->openAdminExport(listing == AdminListing::Folders);
+        if (!reader)
+        {
+            return {};
+        }
+        return makeProducer(std::make_shared<CsvExportStream>(std::move(reader)));
     }
 
-    return result;
+    auto cursor = listing == AdminListing::Folders ? db_->openAllFoldersAdminCursor() : db_->openAllFilesAdminCursor();
+    if (!cursor)
+    {
+        return {};
+    }
+    return makeProducer(std::make_shared<NdjsonExportStream>(std::move(cursor), columnsOf(listing)));
 }
 
-std::optional<UserContentData> AdminService::getUserContent(const std::string& user_id)
+std::optional<UserContentData> AdminService::getUserContent(const std::string& user_id, int files_after, int files_limit,
+                                                            int folders_after, int folders_limit)
 {
     LOG_INFO << "Getting content for user " << user_id;
 
     try {
-        // Check if user exists and get email
-        auto users = db_->getAllUsers();
-
-        // Find user in the list
-        auto userIt = std::find_if(users.begin(), users.end(),
-                                   [&user_id](const auto& user) {
-                                       return std::to_string(std::get<0>(user)) == user_id;
-                                   });
-
-        if (userIt == users.end()) {
+        auto summary = db_->getUserContentSummary(user_id);
+        if (!summary) {
             LOG_ERROR << "User not found: " << user_id;
             return std::nullopt;
         }
 
-        std::string email = std::get<1>(*userIt);
-
-        // Create result
         UserContentData result;
         result.user_id = user_id;
-        result.email = email;
-
-        // Get files for this user
-        auto files = db_->getFilesForUser(user_id);
-        for (const auto& [fileId, fileName, fileSize, createdAt] : files) {
-            FileInfo file;
-            file.file_id = fileId;
-            file.file_name = fileName;
-            file.file_size = fileSize;
-            file.folder_id = 0; // This should be updated if folder information is needed
-            file.created_at = createdAt;
+        std::tie(result.email, result.files_count, result.folders_count, result.total_storage_bytes,
+                 result.root_files_count, result.root_storage_bytes) = *summary;
 
-            result.files.push_back(file);
+        // One row more than the page tells whether there is a next page
+        if (files_limit > 0) {
+            bool ok = db_->forEachUserFilePage(user_id, files_after, files_limit + 1, [&](const RowCursor& row) {
+                if (static_cast<int>(result.files.size()) == files_limit) {
+                    result.more_files = true;
+                    return;
+                }
+                FileInfo file;
+                file.file_id = std::stoi(row.get(0));
+                file.file_name = row.get(1);
+                file.file_size = std::stoi(row.get(2));
+                file.folder_id = std::stoi(row.get(3));
+                file.created_at = row.get(4);
+                result.files.push_back(std::move(file));
+            });
+            if (!ok) {
+                return std::nullopt;
+            }
         }
 
-        // Get folders for this user
-        auto folders = db_->getFoldersForUser(user_id);
-        for (const auto& [folderId, folderName, parentFolderId, createdAt] : folders) {
-            FolderInfo folder;
-            folder.folder_id = folderId;
-            folder.folder_name = folderName;
-            folder.parent_folder_id = parentFolderId;
-            folder.created_at = createdAt;
-
-            result.folders.push_back(folder);
+        if (folders_limit > 0) {
+            bool ok = db_->forEachUserFolderPage(user_id, folders_after, folders_limit + 1, [&](const RowCursor& row) {
+                if (static_cast<int>(result.folders.size()) == folders_limit) {
+                    result.more_folders = true;
+                    return;
+                }
+                FolderInfo folder;
+                folder.folder_id = std::stoi(row.get(0));
+                folder.folder_name = row.get(1);
+                folder.parent_folder_id = std::stoi(row.get(2));
+                folder.created_at = row.get(3);
+                folder.files_count = std::stoi(row.get(4));
+                folder.total_bytes = std::stoll(row.get(5));
+                result.folders.push_back(std::move(folder));
+            });
+            if (!ok) {
+                return std::nullopt;
+            }
         }
 
-        LOG_INFO << "Retrieved " << result.files.size() << " files and " << result.folders.size()
-                 << " folders for user " << user_id;
+        LOG_INFO << "Retrieved " << result.files.size() << " of " << result.files_count << " files and "
+                 << result.folders.size() << " of " << result.folders_count << " folders for user " << user_id;
 
         return result;
 
@@ -217,7 +541,14 @@ SystemStats AdminService::getSystemStats()
         auto topUsers = db_->getTopUsersByStorage(5);
         for (const auto& [userId, email, storageBytes] : topUsers) {
             std::string userDisplay = userId + " (" + email + ")";
-            stats.top_users_by_storage.emplace_back(userDisplay, static_cast<int>(storageBytes));
+            stats.top_users_by_storage.emplace_back(userDisplay, storageBytes);
+        }
+
+        // Get top groups by storage
+        auto topGroups = db_->getTopGroupsByStorage(5);
+        for (const auto& [groupId, groupName, filesCount, storageBytes] : topGroups) {
+            std::string groupDisplay = std::to_string(groupId) + " (" + groupName + ")";
+            stats.top_groups_by_storage.emplace_back(groupDisplay, filesCount, storageBytes);
         }
 
         LOG_INFO << "Retrieved system stats: "
@@ -231,4 +562,663 @@ SystemStats AdminService::getSystemStats()
     }
 
     return stats;
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Upper bound on the points of one usage series
+const long long MAX_USAGE_POINTS = 1500;
+
+const long long SECONDS_PER_DAY = 24 * 60 * 60;
+
+long long resolutionStep(UsageResolution resolution)
+{
+    switch (resolution)
+    {
+        case UsageResolution::Minute: return 60;
+        case UsageResolution::Hour: return 60 * 60;
+        default: return SECONDS_PER_DAY;
+    }
+}
+
+const char* resolutionName(UsageResolution resolution)
+{
+    switch (resolution)
+    {
+        case UsageResolution::Minute: return "minute";
+        case UsageResolution::Hour: return "hour";
+        default: return "day";
+    }
+}
+
+} // namespace
+
+bool AdminService::getUsageHistory(const std::string& scope, int id, long long from, long long to,
+                                   const std::string& resolution, WireFormat::Format format,
+                                   std::string& body, std::string& errorMsg)
+{
+    auto sampler = UsageSampler::instance();
+    if (!sampler->isRunning())
+    {
+        errorMsg = "Usage history is disabled";
+        return false;
+    }
+
+    char scopeType;
+    if (scope == "system") {
+        scopeType = 's';
+        id = 0;
+    } else if (scope == "user" && id > 0) {
+        scopeType = 'u';
+    } else if (scope == "group" && id > 0) {
+        scopeType = 'g';
+    } else {
+        errorMsg = "Invalid scope, expected system, user with id or group with id";
+        return false;
+    }
+
+    if (to <= from)
+    {
+        errorMsg = "Invalid range, from must be before to";
+        return false;
+    }
+
+    long long span = to - from;
+    UsageResolution chosen;
+    if (resolution.empty() || resolution == "auto")
+    {
+        // Finest detail that is still kept for the whole range
+        long long age = static_cast<long long>(std::time(nullptr)) - from;
+        if (span / resolutionStep(UsageResolution::Minute) <= MAX_USAGE_POINTS &&
+            age <= sampler->minuteRetentionDays() * SECONDS_PER_DAY) {
+            chosen = UsageResolution::Minute;
+        } else if (span / resolutionStep(UsageResolution::Hour) <= MAX_USAGE_POINTS &&
+                   age <= sampler->hourRetentionDays() * SECONDS_PER_DAY) {
+            chosen = UsageResolution::Hour;
+        } else {
+            chosen = UsageResolution::Day;
+        }
+    }
+    else if (resolution == "minute") {
+        chosen = UsageResolution::Minute;
+    } else if (resolution == "hour") {
+        chosen = UsageResolution::Hour;
+    } else if (resolution == "day") {
+        chosen = UsageResolution::Day;
+    } else {
+        errorMsg = "Invalid resolution, expected auto, minute, hour or day";
+        return false;
+    }
+
+    if (span / resolutionStep(chosen) > MAX_USAGE_POINTS)
+    {
+        errorMsg = "Invalid range, more than " + std::to_string(MAX_USAGE_POINTS) + " points at " +
+                   resolutionName(chosen) + " resolution";
+        return false;
+    }
+
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->field("scope", scope);
+    writer->field("id", id);
+    writer->field("resolution", resolutionName(chosen));
+    writer->field("from", from);
+    writer->field("to", to);
+    writer->key("points");
+    writer->startArray();
+
+    bool ok = db_->forEachUsageSample(chosen, scopeType, id, from, to, static_cast<int>(MAX_USAGE_POINTS) + 1,
+                                      [&writer](const RowCursor& row) {
+        writer->startObject();
+        writer->field("time", std::atoll(row.get(0)));
+        writer->field("storage_bytes", std::atoll(row.get(1)));
+        writer->field("files_count", std::atoll(row.get(2)));
+        writer->field("active_users", std::atoll(row.get(3)));
+        writer->field("upload_bytes", std::atoll(row.get(4)));
+        writer->field("download_bytes", std::atoll(row.get(5)));
+        writer->endObject();
+    });
+
+    writer->endArray();
+    writer->endObject();
+
+    if (!ok)
+    {
+        body.clear();
+        errorMsg = "Failed to read usage history";
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Activity cursor text: "<occurred_at in microseconds>:<event_id>" of the last event of the previous page
+bool parseActivityCursor(const std::string& cursor, long long& before_us, long long& before_id)
+{
+    before_us = 0;
+    before_id = 0;
+    if (cursor.empty())
+    {
+        return true;
+    }
+
+    size_t colon = cursor.find(':');
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        size_t timeEnd = 0, idEnd = 0;
+        std::string timeText = cursor.substr(0, colon);
+        std::string idText = cursor.substr(colon + 1);
+        before_us = std::stoll(timeText, &timeEnd);
+        before_id = std::stoll(idText, &idEnd);
+        return timeEnd == timeText.size() && idEnd == idText.size() && before_id > 0;
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
+
+} // namespace
+
+bool AdminService::getActivity(const ActivityFilter& filter, const std::string& cursor, int limit,
+                               WireFormat::Format format, std::string& body, std::string& errorMsg)
+{
+    long long before_us, before_id;
+    if (!parseActivityCursor(cursor, before_us, before_id))
+    {
+        errorMsg = "Invalid cursor";
+        return false;
+    }
+    if (filter.to <= filter.from)
+    {
+        errorMsg = "Invalid range, from must be before to";
+        return false;
+    }
+
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("events");
+    writer->startArray();
+
+    // One row more than the page tells whether there is a next page
+    int rows = 0;
+    long long last_us = 0, last_id = 0;
+    bool ok = db_->forEachActivity(filter, before_us, before_id, limit + 1, [&](const RowCursor& row) {
+        if (rows++ == limit)
+        {
+            return;
+        }
+        last_id = std::atoll(row.get(0));
+        last_us = std::atoll(row.get(1));
+        writer->startObject();
+        writer->field("event_id", last_id);
+        writer->field("time", last_us / 1000000);
+        writer->field("time_us", last_us);
+        writer->key("user_id");
+        if (row.isNull(2)) writer->null(); else writer->value(std::atoll(row.get(2)));
+        writer->field("action", row.get(3));
+        writer->key("object_id");
+        if (row.isNull(4)) writer->null(); else writer->value(std::atoll(row.get(4)));
+        writer->key("detail");
+        if (row.isNull(5)) writer->null(); else writer->value(row.get(5));
+        writer->endObject();
+    });
+
+    writer->endArray();
+    bool hasMore = rows > limit;
+    writer->field("has_more", hasMore);
+    if (hasMore)
+    {
+        writer->field("next_cursor", std::to_string(last_us) + ":" + std::to_string(last_id));
+    }
+    writer->endObject();
+
+    if (!ok)
+    {
+        body.clear();
+        errorMsg = "Failed to read the activity log";
+        return false;
+    }
+    return true;
+}
+
+bool AdminService::getAnalytics(const std::string& window, bool previous, int limit,
+                                WireFormat::Format format, std::string& body, std::string& errorMsg)
+{
+    auto analytics = Analytics::instance();
+    if (!analytics->isRunning())
+    {
+        errorMsg = "Analytics are disabled";
+        return false;
+    }
+
+    Analytics::Window chosen;
+    if (window.empty() || window == "hour") {
+        chosen = Analytics::Window::Hour;
+    } else if (window == "day") {
+        chosen = Analytics::Window::Day;
+    } else {
+        errorMsg = "Invalid window, expected hour or day";
+        return false;
+    }
+
+    if (limit <= 0 || static_cast<size_t>(limit) > analytics->topCapacity())
+    {
+        errorMsg = "Invalid limit, expected 1.." + std::to_string(analytics->topCapacity());
+        return false;
+    }
+
+    auto summary = analytics->summary(chosen, previous, static_cast<size_t>(limit));
+
+    std::vector<int> fileIds, folderIds;
+    for (const auto& item : summary.top_files) fileIds.push_back(item.id);
+    for (const auto& item : summary.top_folders) folderIds.push_back(item.id);
+    auto fileNames = db_->getItemNames(false, fileIds);
+    auto folderNames = db_->getItemNames(true, folderIds);
+
+    // count is an upper bound, count - error a lower bound of the true number
+    auto writeTop = [](StructuredWriter& writer, const char* listKey, const char* idKey, const char* nameKey,
+                       const std::vector<SpaceSaving::Item>& items, const std::unordered_map<int, std::string>& names) {
+        writer.key(listKey);
+        writer.startArray();
+        for (const auto& item : items)
+        {
+            auto name = names.find(item.id);
+            writer.startObject();
+            writer.field(idKey, item.id);
+            writer.key(nameKey);
+            if (name == names.end()) writer.null(); else writer.value(name->second);
+            writer.field("count", item.count);
+            writer.field("error", item.error);
+            writer.endObject();
+        }
+        writer.endArray();
+    };
+
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->field("window", chosen == Analytics::Window::Hour ? "hour" : "day");
+    writer->field("start", summary.start);
+    writer->field("distinct_users", summary.distinct_users);
+    writeTop(*writer, "top_files", "file_id", "file_name", summary.top_files, fileNames);
+    writeTop(*writer, "top_folders", "folder_id", "folder_name", summary.top_folders, folderNames);
+    writer->endObject();
+    return true;
+}
+
+bool AdminService::getDuplicateReport(int limit, WireFormat::Format format, std::string& body, std::string& errorMsg)
+{
+    // Files listed per set; copies always has the full count
+    const int MAX_FILES_PER_SET = 100;
+
+    auto scanner = DuplicateScanner::instance();
+    if (!scanner->isRunning())
+    {
+        errorMsg = "Duplicate detection is disabled";
+        return false;
+    }
+
+    auto totals = db_->getDuplicateTotals();
+    if (!totals)
+    {
+        errorMsg = "Failed to read the duplicate report";
+        return false;
+    }
+
+    auto status = scanner->status();
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->key("scan");
+    writer->startObject();
+    writer->field("running", status.running);
+    writer->field("started_at", status.started_at);
+    writer->key("finished_at");
+    if (status.finished_at == 0) writer->null(); else writer->value(status.finished_at);
+    writer->field("candidates", status.candidates);
+    writer->field("hashed", status.hashed);
+    writer->field("bytes_hashed", status.bytes_hashed);
+    writer->endObject();
+    writer->field("duplicate_sets", totals->first);
+    writer->field("reclaimable_bytes", totals->second);
+
+    // Rows come grouped by digest; a set is closed when the digest changes
+    writer->key("sets");
+    writer->startArray();
+    std::string digest;
+    bool ok = db_->forEachDuplicateFile(limit, MAX_FILES_PER_SET, [&](const RowCursor& row) {
+        if (digest != row.get(0))
+        {
+            if (!digest.empty())
+            {
+                writer->endArray();
+                writer->endObject();
+            }
+            digest = row.get(0);
+            writer->startObject();
+            writer->field("digest", digest);
+            writer->field("file_size", std::atoll(row.get(1)));
+            writer->field("copies", std::atoll(row.get(2)));
+            writer->field("reclaimable_bytes", std::atoll(row.get(3)));
+            writer->key("files");
+            writer->startArray();
+        }
+        writer->startObject();
+        writer->field("file_id", std::atoll(row.get(4)));
+        writer->field("file_name", row.get(5));
+        writer->field("user_id", std::atoll(row.get(6)));
+        writer->key("email");
+        if (row.isNull(7)) writer->null(); else writer->value(row.get(7));
+        writer->endObject();
+    });
+    if (!digest.empty())
+    {
+        writer->endArray();
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->endObject();
+
+    if (!ok)
+    {
+        body.clear();
+        errorMsg = "Failed to read the duplicate report";
+        return false;
+    }
+    return true;
+}
+
+bool AdminService::startDuplicateScan(int created_by, long long& job_id, std::string& errorMsg)
+{
+    job_id = 0;
+    auto scanner = DuplicateScanner::instance();
+    if (!scanner->isRunning())
+    {
+        errorMsg = "Duplicate detection is disabled";
+        return false;
+    }
+
+    auto jobs = JobQueue::instance();
+    if (!jobs->isRunning())
+    {
+        if (!scanner->requestScan())
+        {
+            errorMsg = "A duplicate scan is already running";
+            return false;
+        }
+        return true;
+    }
+
+    auto id = jobs->enqueue(DuplicateScanner::JOB_KIND, Json::Value(Json::objectValue), 0, created_by);
+    if (!id)
+    {
+        errorMsg = "Failed to queue the duplicate scan";
+        return false;
+    }
+    if (*id == 0)
+    {
+        errorMsg = "A duplicate scan is already queued or running";
+        return false;
+    }
+    job_id = *id;
+    return true;
+}
+
+bool AdminService::getJobs(const JobFilter& filter, long long before_id, int limit,
+                           WireFormat::Format format, std::string& body, std::string& errorMsg)
+{
+    auto jobs = JobQueue::instance();
+    if (!jobs->isRunning())
+    {
+        errorMsg = "Jobs are disabled";
+        return false;
+    }
+
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->field("leader", jobs->isLeader());
+    writer->field("workers", static_cast<long long>(jobs->workerCount()));
+    writer->key("jobs");
+    writer->startArray();
+
+    // Nullable text and time columns
+    auto nullableText = [&](const RowCursor& row, const char* key, int column) {
+        writer->key(key);
+        if (row.isNull(column)) writer->null(); else writer->value(row.get(column));
+    };
+    auto nullableNumber = [&](const RowCursor& row, const char* key, int column) {
+        writer->key(key);
+        if (row.isNull(column)) writer->null(); else writer->value(std::atoll(row.get(column)));
+    };
+
+    // One row more than the page tells whether there is a next page
+    int rows = 0;
+    long long last_id = 0;
+    bool ok = db_->forEachJob(filter, before_id, limit + 1, [&](const RowCursor& row) {
+        if (rows++ == limit)
+        {
+            return;
+        }
+        last_id = std::atoll(row.get(0));
+        writer->startObject();
+        writer->field("job_id", last_id);
+        writer->field("kind", row.get(1));
+        writer->field("payload", row.get(2));
+        writer->field("priority", std::atoll(row.get(3)));
+        writer->field("state", row.get(4));
+        writer->field("attempts", std::atoll(row.get(5)));
+        writer->field("max_attempts", std::atoll(row.get(6)));
+        writer->field("progress_done", std::atoll(row.get(7)));
+        writer->field("progress_total", std::atoll(row.get(8)));
+        nullableText(row, "message", 9);
+        nullableText(row, "last_error", 10);
+        nullableText(row, "locked_by", 11);
+        nullableNumber(row, "created_by", 12);
+        writer->field("created_at", std::atoll(row.get(13)));
+        writer->field("run_at", std::atoll(row.get(14)));
+        nullableNumber(row, "started_at", 15);
+        nullableNumber(row, "finished_at", 16);
+        writer->endObject();
+    });
+
+    writer->endArray();
+    bool hasMore = rows > limit;
+    writer->field("has_more", hasMore);
+    if (hasMore)
+    {
+        writer->field("next_before", last_id);
+    }
+    writer->endObject();
+
+    if (!ok)
+    {
+        body.clear();
+        errorMsg = "Failed to read the jobs";
+        return false;
+    }
+    if (filter.job_id > 0 && rows == 0)
+    {
+        body.clear();
+        errorMsg = "Job not found";
+        return false;
+    }
+    return true;
+}
+
+bool AdminService::createJob(const std::string& kind, const Json::Value& payload, int priority, int created_by,
+                             long long& job_id, std::string& errorMsg)
+{
+    auto jobs = JobQueue::instance();
+    if (!jobs->isRunning())
+    {
+        errorMsg = "Jobs are disabled";
+        return false;
+    }
+    if (!jobs->hasHandler(kind))
+    {
+        errorMsg = "Invalid kind '" + kind + "'";
+        return false;
+    }
+
+    auto id = jobs->enqueue(kind, payload, priority, created_by);
+    if (!id)
+    {
+        errorMsg = "Failed to queue the job";
+        return false;
+    }
+    if (*id == 0)
+    {
+        errorMsg = "A job of this kind is already queued or running";
+        return false;
+    }
+    job_id = *id;
+    return true;
+}
+
+bool AdminService::cancelJob(long long job_id, std::string& errorMsg)
+{
+    if (!JobQueue::instance()->isRunning())
+    {
+        errorMsg = "Jobs are disabled";
+        return false;
+    }
+    if (!db_->cancelJob(job_id))
+    {
+        errorMsg = "Job not found or already started";
+        return false;
+    }
+    return true;
+}
+
+bool AdminService::getQuota(const std::string& scope, int id, WireFormat::Format format, std::string& body,
+                            std::string& errorMsg)
+{
+    auto quotas = QuotaManager::instance();
+    if (!quotas->isRunning())
+    {
+        errorMsg = "Quotas are disabled";
+        return false;
+    }
+    if ((scope != "user" && scope != "group") || id <= 0)
+    {
+        errorMsg = "Invalid scope or id, expected user or group and a positive id";
+        return false;
+    }
+
+    auto usage = quotas->usage(scope == "group" ? QuotaManager::Scope::Group : QuotaManager::Scope::User, id);
+
+    auto writer = WireFormat::makeWriter(format, body);
+    writer->startObject();
+    writer->field("scope", scope);
+    writer->field("id", static_cast<long long>(id));
+    writer->field("used_bytes", usage.used);
+    writer->field("reserved_bytes", usage.reserved);
+    writer->key("limit_bytes");
+    if (usage.limit == 0) writer->null(); else writer->value(usage.limit);
+    writer->field("custom", usage.custom);
+    writer->endObject();
+    return true;
+}
+
+bool AdminService::setQuota(const std::string& scope, int id, long long byte_limit, bool remove, std::string& errorMsg)
+{
+    auto quotas = QuotaManager::instance();
+    if (!quotas->isRunning())
+    {
+        errorMsg = "Quotas are disabled";
+        return false;
+    }
+    if ((scope != "user" && scope != "group") || id <= 0)
+    {
+        errorMsg = "Invalid scope or id, expected user or group and a positive id";
+        return false;
+    }
+    if (!remove && byte_limit < 0)
+    {
+        errorMsg = "Invalid byte_limit, expected 0 (unlimited) or more";
+        return false;
+    }
+
+    auto chosen = scope == "group" ? QuotaManager::Scope::Group : QuotaManager::Scope::User;
+    if (!(remove ? quotas->removeLimit(chosen, id) : quotas->setLimit(chosen, id, byte_limit)))
+    {
+        errorMsg = "Failed to save the quota";
+        return false;
+    }
+    return true;
+}
+
+void AdminService::registerJobs()
+{
+    auto jobs = JobQueue::instance();
+    jobs->registerHandler("reconcile_stats", [this](JobQueue::Job& job, std::string& error) {
+        auto progress = [&job](size_t done, size_t total) {
+            job.progress(static_cast<long long>(done), static_cast<long long>(total), "Recounting storage statistics");
+        };
+        if (!reconcileStats(progress))
+        {
+            error = "Failed to reconcile storage statistics";
+            return false;
+        }
+        return true;
+    }, true, 3);
+
+    jobs->registerHandler(DuplicateScanner::JOB_KIND, [](JobQueue::Job& job, std::string& error) {
+        auto progress = [&job](long long done, long long total) {
+            job.progress(done, total, "Hashing stored files of equal size");
+        };
+        return DuplicateScanner::instance()->runScan(error, progress);
+    }, true, 3);
+}
+
+void AdminService::startStatsReconciliation(double interval)
+{
+    if (statsThread_)
+    {
+        return;
+    }
+
+    statsThread_ = std::make_unique<trantor::EventLoopThread>("StatsReconciler");
+    statsThread_->run();
+
+    auto loop = statsThread_->getLoop();
+    loop->queueInLoop([this]() { scheduleReconciliation(); });
+    loop->runEvery(interval, [this]() { scheduleReconciliation(); });
+}
+
+void AdminService::scheduleReconciliation()
+{
+    auto jobs = JobQueue::instance();
+    if (!jobs->isRunning())
+    {
+        reconcileStats();
+        return;
+    }
+
+    // 0: the previous one is still queued or running, possibly in another process
+    auto id = jobs->enqueue("reconcile_stats", Json::Value(Json::objectValue));
+    if (!id)
+    {
+        LOG_ERROR << "Failed to queue the statistics reconciliation";
+    }
+}
+
+bool AdminService::reconcileStats(const std::function<void(size_t done, size_t total)>& progress)
+{
+    int corrected = 0;
+    if (!db_->reconcileStorageStats(corrected, progress))
+    {
+        LOG_ERROR << "Failed to reconcile storage statistics";
+        return false;
+    }
+
+    if (corrected > 0)
+    {
+        LOG_WARN << "Storage statistics reconciled, " << corrected << " counters corrected";
+    }
+    return true;
+}
@@ -5,7 +5,11 @@
 #include <vector>
 #include <tuple>
 #include <optional>
+#include <functional>
+#include <json/json.h>
+#include <trantor/net/EventLoopThread.h>
 #include "db.h"
+#include "wire_format.h"
 
 /**
  * Represents a file in the system
@@ -26,34 +30,36 @@ struct FolderInfo {
     std::string folder_name;
     int parent_folder_id;
     std::string created_at;
+    int files_count = 0;          // files directly in the folder
+    long long total_bytes = 0;
 };
 
-/**
- * Represents a user's file data
- */
-struct UserFilesData {
-    std::string user_id;
-    std::string email;
-    std::vector<FileInfo> files;
+// Admin listings that can be paged and exported
+enum class AdminListing {
+    Files,
+    Folders
 };
 
-/**
- * Represents a user's folder data
- */
-struct UserFoldersData {
-    std::string user_id;
-    std::string email;
-    std::vector<FolderInfo> folders;
+enum class ExportFormat {
+    Ndjson,
+    Csv
 };
 
 /**
- * Represents all content for a specific user
+ * One page of a user's content, with totals over all of it
  */
 struct UserContentData {
     std::string user_id;
     std::string email;
+    int files_count = 0;
+    int folders_count = 0;
+    long long total_storage_bytes = 0;
+    int root_files_count = 0;          // files outside any folder
+    long long root_storage_bytes = 0;
     std::vector<FileInfo> files;
     std::vector<FolderInfo> folders;
+    bool more_files = false;
+    bool more_folders = false;
 };
 
 /**
@@ -65,7 +71,8 @@ struct SystemStats {
     int total_folders;
     long long total_storage_bytes;
     std::vector<std::pair<std::string, int>> files_by_type;
-    std::vector<std::pair<std::string, int>> top_users_by_storage;
+    std::vector<std::pair<std::string, long long>> top_users_by_storage;
+    std::vector<std::tuple<std::string, long long, long long>> top_groups_by_storage;   // group, files, bytes
 };
 
 /**
@@ -79,33 +86,162 @@ public:
     static std::shared_ptr<AdminService> instance();
 
     /**
-     * Get all files in the system grouped by user
+     * Producer for a chunked response with all files or folders in the system grouped by user.
+     * Rows are read from the database and encoded in the requested format on demand, one buffer
+     * at a time, so memory use does not grow with the size of the listing.
+     * Returns an empty function if the query could not be started.
+     */
+    std::function<std::size_t(char *, std::size_t)> streamListing(AdminListing listing,
+                                                                  WireFormat::Format format = WireFormat::Format::Json);
+
+    /**
+     * One page of the same listing, in the same format plus has_more and next_cursor.
+     * Pages are keyed by (user_id, id), so each one is an index range scan.
+     *
+     * @param cursor next_cursor of the previous page, empty for the first page
+     * @return false with errorMsg "Invalid cursor" or a database error
      */
-    std::vector<UserFilesData> getAllFiles();
+    bool getListingPage(AdminListing listing, const std::string& cursor, int limit,
+                        WireFormat::Format format, std::string& body, std::string& errorMsg);
 
     /**
-     * Get all folders in the system grouped by user
+     * Producer for a flat export of a listing, one row per line (NDJSON or CSV with a header)
      */
-    std::vector<UserFoldersData> getAllFolders();
+    std::function<std::size_t(char *, std::size_t)> exportListing(AdminListing listing, ExportFormat format);
 
     /**
-     * Get all content (files and folders) for a specific user
+     * Drilldown into one user: totals, plus a page of files and a page of folders
+     * (each by id, after files_after / folders_after). A negative limit skips that list.
+     *
+     * @return nullopt if the user does not exist or the database failed
      */
-    std::optional<UserContentData> getUserContent(const std::string& user_id);
+    std::optional<UserContentData> getUserContent(const std::string& user_id, int files_after, int files_limit,
+                                                  int folders_after, int folders_limit);
 
     /**
-     * Get system-wide statistics
+     * Get system-wide statistics. These come from counters maintained by database triggers,
+     * so the cost does not depend on the number of files.
      */
     SystemStats getSystemStats();
 
+    /**
+     * Usage history of the system, a user or a group (scope "system", "user" or "group") between
+     * from and to (Unix seconds). resolution is "minute", "hour", "day", or empty / "auto" for the
+     * finest one that is still retained and keeps the series within a bounded number of points.
+     *
+     * @return false with errorMsg "Invalid ..." for bad parameters, "Usage history is disabled"
+     *         or a database error
+     */
+    bool getUsageHistory(const std::string& scope, int id, long long from, long long to, const std::string& resolution,
+                         WireFormat::Format format, std::string& body, std::string& errorMsg);
+
+    /**
+     * One page of the activity log matching the filter, newest first, with has_more and next_cursor.
+     * Each day of the range is a partition with its own indexes on time, user and action.
+     *
+     * @param cursor next_cursor of the previous page, empty for the first page
+     * @return false with errorMsg "Invalid ..." for bad parameters or a database error
+     */
+    bool getActivity(const ActivityFilter& filter, const std::string& cursor, int limit,
+                     WireFormat::Format format, std::string& body, std::string& errorMsg);
+
+    /**
+     * Approximate distinct users and the most downloaded files and most active folders of the
+     * current or previous hour or day (window "hour" or "day"), from in-memory sketches.
+     *
+     * @return false with errorMsg "Invalid ..." for bad parameters or "Analytics are disabled"
+     */
+    bool getAnalytics(const std::string& window, bool previous, int limit,
+                      WireFormat::Format format, std::string& body, std::string& errorMsg);
+
+    /**
+     * Stored files with identical content, as found by the last duplicate scan: the sets with
+     * the most reclaimable bytes first (at most limit), their files, the totals and the scan status.
+     *
+     * @return false with errorMsg "Invalid ..." for bad parameters, "Duplicate detection is disabled"
+     *         or a database error
+     */
+    bool getDuplicateReport(int limit, WireFormat::Format format, std::string& body, std::string& errorMsg);
+
+    /**
+     * Start a duplicate scan now: queue a duplicate_scan job, or without the job queue
+     * start it on the scanner's thread (job_id 0).
+     *
+     * @return false with errorMsg "Duplicate detection is disabled", "A duplicate scan is already ..."
+     *         or a database error
+     */
+    bool startDuplicateScan(int created_by, long long& job_id, std::string& errorMsg);
+
+    /**
+     * One page of background jobs matching the filter, newest first, with has_more and next_before,
+     * and the leader status and worker count of this process.
+     *
+     * @param before_id next_before of the previous page, 0 for the first page
+     * @return false with errorMsg "Job not found" (filter.job_id given), "Jobs are disabled" or a database error
+     */
+    bool getJobs(const JobFilter& filter, long long before_id, int limit,
+                 WireFormat::Format format, std::string& body, std::string& errorMsg);
+
+    /**
+     * Queue a job of a registered kind.
+     *
+     * @return false with errorMsg "Invalid kind ...", "A job of this kind is already queued or running"
+     *         (singleton kinds), "Jobs are disabled" or a database error
+     */
+    bool createJob(const std::string& kind, const Json::Value& payload, int priority, int created_by,
+                   long long& job_id, std::string& errorMsg);
+
+    /**
+     * Cancel a queued job.
+     *
+     * @return false with errorMsg "Job not found or already started" or "Jobs are disabled"
+     */
+    bool cancelJob(long long job_id, std::string& errorMsg);
+
+    /**
+     * Storage use, admitted uploads in progress and the quota of a user or group (scope "user" or "group").
+     *
+     * @return false with errorMsg "Invalid ..." for bad parameters or "Quotas are disabled"
+     */
+    bool getQuota(const std::string& scope, int id, WireFormat::Format format, std::string& body,
+                  std::string& errorMsg);
+
+    /**
+     * Give a user or group a quota of its own (0 = unlimited), or with remove, return it to the default.
+     *
+     * @return false with errorMsg "Invalid ..." for bad parameters, "Quotas are disabled" or a database error
+     */
+    bool setQuota(const std::string& scope, int id, long long byte_limit, bool remove, std::string& errorMsg);
+
+    /**
+     * Register the handlers of the admin job kinds (reconcile_stats, duplicate_scan), both
+     * singletons that report their progress. Must be called before JobQueue::start().
+     */
+    void registerJobs();
+
+    /**
+     * Recount the statistics now and then every interval seconds, correcting counters that
+     * drifted (also fills them in on the first start). With the job queue running, each recount
+     * is a singleton job, so one process recounts when several share the database.
+     */
+    void startStatsReconciliation(double interval);
+
 private:
     /**
      * Private constructor for singleton pattern
      */
     AdminService();
 
+    bool reconcileStats(const std::function<void(size_t done, size_t total)>& progress = nullptr);
+
+    // Queues the reconciliation job, or recounts on the calling thread without the job queue
+    void scheduleReconciliation();
+
     /**
      * Database connection
      */
     std::shared_ptr<DB> db_;
+
+    // Schedules the reconciliation, which scans whole tables, off the request threads
+    std::unique_ptr<trantor::EventLoopThread> statsThread_;
 };
\ No newline at end of file
@@ -1,7 +1,53 @@
 #include "FileService.h"
 #include <drogon/drogon.h>
 #include "validation.h"
+#include "usage_sampler.h"
+#include "activity_log.h"
+#include "analytics.h"
+#include "quota_manager.h"
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+// Upper bound of an upload's size known before the body is parsed (includes the multipart framing)
+long long requestedBytes(const drogon::HttpRequestPtr &req)
+{
+    const std::string& contentLength = req->getHeader("content-length");
+    try {
+        if (!contentLength.empty()) {
+            return std::stoll(contentLength);
+        }
+    } catch (const std::exception&) {
+    }
+    return static_cast<long long>(req->body().size());
+}
+
+// Quota reservation of an upload; ended on every return path, with the stored size once recorded
+class UploadReservation {
+public:
+    UploadReservation(int user_id, int group_id, long long bytes)
+        : user_id_(user_id), group_id_(group_id), bytes_(bytes) {}
+    ~UploadReservation() { QuotaManager::instance()->finish(user_id_, group_id_, bytes_, stored_); }
+
+    UploadReservation(const UploadReservation&) = delete;
+    UploadReservation& operator=(const UploadReservation&) = delete;
+
+    void stored(long long bytes) { stored_ = bytes; }
+
+private:
+    int user_id_;
+    int group_id_;
+    long long bytes_;
+    long long stored_ = 0;
+};
+
+} // namespace
 
 std::shared_ptr<FileService> FileService::instance()
 {
@@ -34,6 +80,15 @@ std::vector<std::tuple<int, std::string, int, std::string>> FileService::getFile
 
 bool FileService::uploadFile(const std::string& user_id, int folder_id, const drogon::HttpRequestPtr &req, std::string &errorMsg)
 {
+    // Квота и свободное место проверяются по Content-Length до разбора тела и записи на диск
+    int uid = std::atoi(user_id.c_str());
+    long long requested = requestedBytes(req);
+    if (!QuotaManager::instance()->reserve(uid, 0, requested, errorMsg))
+    {
+        return false;
+    }
+    UploadReservation reservation(uid, 0, requested);
+
     // Создаем парсер для multipart/form-data
     drogon::MultiPartParser fileUpload;
     if (fileUpload.parse(req) != 0 || fileUpload.getFiles().empty())
@@ -77,12 +132,32 @@ bool FileService::uploadFile(const std::string& user_id, int folder_id, const dr
         errorMsg = "Failed to insert file into database";
         return false;
     }
+    reservation.stored(file_size);
+
+    UsageSampler::instance()->recordUpload(user_id, 0, file_size);
+    recordActivity(user_id, "upload", 0, filename);
+    Analytics::instance()->recordFolderActivity(user_id, folder_id);
 
+    ChangeEvent event;
+    event.type = "file_added";
+    event.folder_id = folder_id;
+    event.name = filename;
+    event.file_size = file_size;
+    publishChange(user_id, {folder_id}, event);
     return true;
 }
 
 bool FileService::uploadFile(const std::string& user_id, int folder_id, const drogon::HttpRequestPtr &req, std::string &errorMsg, int group_id)
 {
+    // Загрузка в группу учитывается в квоте группы
+    int uid = std::atoi(user_id.c_str());
+    long long requested = requestedBytes(req);
+    if (!QuotaManager::instance()->reserve(uid, group_id, requested, errorMsg))
+    {
+        return false;
+    }
+    UploadReservation reservation(uid, group_id, requested);
+
     drogon::MultiPartParser fileUpload;
     if (fileUpload.parse(req) != 0 || fileUpload.getFiles().empty())
     {
@@ -125,7 +200,18 @@ bool FileService::uploadFile(const std::string& user_id, int folder_id, const dr
             return false;
         }
     }
+    reservation.stored(file_size);
+
+    UsageSampler::instance()->recordUpload(user_id, group_id, file_size);
+    recordActivity(user_id, "upload", 0, filename);
+    Analytics::instance()->recordFolderActivity(user_id, folder_id);
 
+    ChangeEvent event;
+    event.type = "file_added";
+    event.folder_id = folder_id;
+    event.name = filename;
+    event.file_size = file_size;
+    publishChange(user_id, {folder_id}, event);
     return true;
 }
 
@@ -150,41 +236,127 @@ bool FileService::createFolder(const std::string& user_id, const std::string& fo
             return false;
         }
     }
+
+    ChangeEvent event;
+    event.type = "folder_created";
+    event.folder_id = parent_folder_id;
+    event.name = folder_name;
+    publishChange(user_id, {parent_folder_id}, event);
     return true;
 }
 
-bool FileService::deleteFiles(const std::string& user_id, const std::vector<int>& file_ids, std::string &errorMsg)
+namespace {
+
+// Error message for a failed set-based operation, naming the ids that blocked it
+std::string describeFailure(const FileSetResult& result)
 {
-    for (int file_id : file_ids)
-    {
-        if (!db_->canUserModifyFile(user_id, file_id))
+    auto join = [](const std::vector<int>& ids) {
+        std::string list;
+        for (size_t i = 0; i < ids.size(); ++i)
         {
-            errorMsg = "Permission denied: cannot modify file " + std::to_string(file_id);
-            return false;
+            if (i > 0) list += ", ";
+            list += std::to_string(ids[i]);
         }
+        return list;
+    };
 
-        auto fileNameOpt = db_->getFilePath(user_id, file_id);
-        if (!fileNameOpt.has_value())
-        {
-            errorMsg = "File not found";
-            return false;
-        }
+    if (!result.denied.empty())
+    {
+        return "Permission denied: cannot modify files " + join(result.denied);
+    }
+    if (!result.not_found.empty())
+    {
+        return "Files not found: " + join(result.not_found);
+    }
+    return result.error;
+}
 
-        fs::path filePath = storagePath_ + "/" + fileNameOpt.value();
+// Change events of the transactional batch running on this thread, published on commit
+thread_local std::vector<std::function<void()>>* deferredChanges = nullptr;
 
-        if (!db_->deleteFile(user_id, file_id))
-        {
-            errorMsg = "Failed to delete file from database";
-            return false;
-        }
+// Routes change events of the current thread into a list for the lifetime of the scope
+class ChangeDeferral {
+public:
+    explicit ChangeDeferral(std::vector<std::function<void()>>* target) { deferredChanges = target; }
+    ~ChangeDeferral() { deferredChanges = nullptr; }
+};
+
+// Below this many files unlinking on the calling thread is cheaper than spawning workers
+const size_t PARALLEL_UNLINK_THRESHOLD = 64;
+
+} // namespace
+
+bool FileService::deleteFiles(const std::string& user_id, const std::vector<int>& file_ids, std::string &errorMsg)
+{
+    std::vector<fs::path> unlinkPaths;
+    if (!deleteFilesDeferred(user_id, file_ids, unlinkPaths, errorMsg))
+    {
+        return false;
+    }
 
-        if (fs::exists(filePath))
+    removeFromDisk(unlinkPaths);
+    return true;
+}
+
+bool FileService::deleteFilesDeferred(const std::string& user_id, const std::vector<int>& file_ids,
+                                      std::vector<fs::path>& unlinkPaths, std::string& errorMsg)
+{
+    auto result = db_->deleteFiles(user_id, file_ids);
+    if (!result.ok)
+    {
+        errorMsg = describeFailure(result);
+        return false;
+    }
+
+    std::vector<int> affectedFolders;
+    ChangeEvent event;
+    event.type = "files_deleted";
+    for (const auto& [file_id, file_name, folder_id] : result.files)
+    {
+        unlinkPaths.push_back(storagePath_ + "/" + file_name);
+        affectedFolders.push_back(folder_id);
+        event.file_ids.push_back(file_id);
+        recordActivity(user_id, "delete", file_id, file_name);
+    }
+
+    publishChange(user_id, affectedFolders, event);
+    return true;
+}
+
+void FileService::removeFromDisk(const std::vector<fs::path>& paths)
+{
+    auto removeRange = [&paths](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
         {
-            fs::remove(filePath);
+            std::error_code ec;
+            fs::remove(paths[i], ec);
+            if (ec)
+            {
+                LOG_WARN << "Failed to remove " << paths[i].string() << ": " << ec.message();
+            }
         }
+    };
+
+    if (paths.size() < PARALLEL_UNLINK_THRESHOLD)
+    {
+        removeRange(0, paths.size());
+        return;
     }
 
-    return true;
+    size_t workers = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    size_t chunk = (paths.size() + workers - 1) / workers;
+
+    std::vector<std::future<void>> pending;
+    for (size_t begin = chunk; begin < paths.size(); begin += chunk)
+    {
+        pending.push_back(std::async(std::launch::async, removeRange, begin, std::min(begin + chunk, paths.size())));
+    }
+    removeRange(0, std::min(chunk, paths.size()));
+
+    for (auto& task : pending)
+    {
+        task.get();
+    }
 }
 
 bool FileService::deleteFolder(const std::string& user_id, int folder_id, std::string &errorMsg)
@@ -195,11 +367,21 @@ bool FileService::deleteFolder(const std::string& user_id, int folder_id, std::s
         return false;
     }
 
+    auto parentId = db_->getParentFolderId(folder_id);
+
     if (!db_->deleteFolder(user_id, folder_id))
     {
         errorMsg = "Failed to delete folder from database";
         return false;
     }
+
+    recordActivity(user_id, "delete_folder", folder_id);
+
+    ChangeEvent event;
+    event.type = "folder_deleted";
+    event.folder_id = parentId.value_or(0);
+    event.item_id = folder_id;
+    publishChange(user_id, {parentId.value_or(0), folder_id}, event);
     return true;
 }
 
@@ -217,47 +399,61 @@ bool FileService::moveFile(const std::string& user_id, int file_id, int target_f
         return false;
     }
 
+    auto affectedFolders = db_->getFileFolderIds({file_id});
+
     if (!db_->moveFile(user_id, file_id, target_folder_id))
     {
         errorMsg = "Failed to move file";
         return false;
     }
+
+    affectedFolders.push_back(target_folder_id);
+
+    ChangeEvent event;
+    event.type = "files_moved";
+    event.folder_id = target_folder_id;
+    event.file_ids = {file_id};
+    publishChange(user_id, affectedFolders, event);
     return true;
 }
 
 bool FileService::moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id, std::string &errorMsg)
 {
-    for (int file_id : file_ids)
-    {
-        if (!db_->canUserModifyFile(user_id, file_id))
-        {
-            errorMsg = "Permission denied: cannot modify file " + std::to_string(file_id);
-            return false;
-        }
-    }
-
     if (target_folder_id > 0 && !db_->canUserAccessFolder(user_id, target_folder_id))
     {
         errorMsg = "Permission denied: cannot access target folder";
         return false;
     }
 
-    if (!db_->moveFiles(user_id, file_ids, target_folder_id))
+    auto result = db_->moveFiles(user_id, file_ids, target_folder_id);
+    if (!result.ok)
     {
-        errorMsg = "Failed to move files";
+        errorMsg = describeFailure(result);
         return false;
     }
+
+    std::vector<int> affectedFolders{target_folder_id};
+    ChangeEvent event;
+    event.type = "files_moved";
+    event.folder_id = target_folder_id;
+    for (const auto& [file_id, file_name, folder_id] : result.files)
+    {
+        affectedFolders.push_back(folder_id);
+        event.file_ids.push_back(file_id);
+    }
+
+    publishChange(user_id, affectedFolders, event);
     return true;
 }
 
-std::optional<std::string> FileService::getFilePath(const std::string& user_id, int file_id)
+std::optional<std::string> FileService::getFilePath(const std::string& user_id, int file_id, int* group_id)
 {
     if (!db_->canUserAccessFile(user_id, file_id))
     {
         return std::nullopt;
     }
 
-    auto fileNameOpt = db_->getFilePath(user_id, file_id);
+    auto fileNameOpt = db_->getFilePath(user_id, file_id, group_id);
 
     if (fileNameOpt.has_value())
     {
@@ -291,6 +487,12 @@ bool FileService::createFolder(const std::string& user_id, const std::string& fo
         errorMsg = "Failed to create folder in database";
         return false;
     }
+
+    ChangeEvent event;
+    event.type = "folder_created";
+    event.folder_id = parent_folder_id;
+    event.name = folder_name;
+    publishChange(user_id, {parent_folder_id}, event);
     return true;
 }
 
@@ -299,16 +501,33 @@ std::vector<ExtendedFileInfo> FileService::getExtendedFiles(const std::string& u
     return db_->getExtendedFiles(user_id, folder_id);
 }
 
+bool FileService::forEachExtendedFile(const std::string& user_id, int folder_id,
+                                      const std::function<void(const ExtendedFileInfo&)>& visitor)
+{
+    return db_->forEachExtendedFile(user_id, folder_id, visitor);
+}
+
 std::vector<ExtendedFolderInfo> FileService::getExtendedFolders(const std::string& user_id, int parent_folder_id)
 {
     return db_->getExtendedFolders(user_id, parent_folder_id);
 }
 
+bool FileService::forEachExtendedFolder(const std::string& user_id, int parent_folder_id,
+                                        const std::function<void(const ExtendedFolderInfo&)>& visitor)
+{
+    return db_->forEachExtendedFolder(user_id, parent_folder_id, visitor);
+}
+
 std::vector<std::pair<int, std::string>> FileService::getUserGroups(const std::string& user_id)
 {
     return db_->getUserGroups(std::stoi(user_id));
 }
 
+bool FileService::canUserAccessFolder(const std::string& user_id, int folder_id)
+{
+    return folder_id == 0 || db_->canUserAccessFolder(user_id, folder_id);
+}
+
 bool FileService::isUserInGroup(const std::string& user_id, int group_id)
 {
     auto user_groups = getUserGroups(user_id);
@@ -329,6 +548,12 @@ bool FileService::toggleFileFavorite(const std::string& user_id, int file_id, bo
         return false;
     }
 
+    // Favorites are per user, so only the user's own connections are told
+    ChangeEvent event;
+    event.type = "favorite_changed";
+    event.file_ids = {file_id};
+    event.is_favorite = is_favorite ? 1 : 0;
+    publishUserChange(user_id, event);
     return true;
 }
 
@@ -339,6 +564,11 @@ bool FileService::toggleFolderFavorite(const std::string& user_id, int folder_id
         return false;
     }
 
+    ChangeEvent event;
+    event.type = "favorite_changed";
+    event.item_id = folder_id;
+    event.is_favorite = is_favorite ? 1 : 0;
+    publishUserChange(user_id, event);
     return true;
 }
 
@@ -351,3 +581,487 @@ std::vector<ExtendedFolderInfo> FileService::getFavoriteFolders(const std::strin
 {
     return db_->getFavoriteFolders(user_id);
 }
+
+// Пакетные операции
+
+bool FileService::executeBatch(const std::string& user_id, const std::vector<BatchOperation>& operations,
+                               bool transactional, std::vector<BatchOperationResult>& results)
+{
+    results.assign(operations.size(), BatchOperationResult{});
+
+    // Membership is resolved once; every access check in the batch reuses it
+    auto group_ids = db_->getUserGroupIds(user_id);
+    DB::GroupScope groupScope(user_id, group_ids);
+
+    std::vector<fs::path> unlinkPaths;
+
+    std::vector<std::function<void()>> changes;
+    ChangeDeferral deferral(transactional ? &changes : nullptr);
+
+    // The batch runs on a connection of its own; if an operation throws, the guard rolls it back
+    std::optional<DB::Transaction> transaction;
+    if (transactional)
+    {
+        transaction.emplace(*db_);
+    }
+    if (transaction && !transaction->ok())
+    {
+        for (auto& result : results)
+        {
+            result.status = BatchOperationResult::Status::Failed;
+            result.error = "Failed to start transaction";
+        }
+        return false;
+    }
+
+    bool committed = true;
+    for (size_t i = 0; i < operations.size(); ++i)
+    {
+        std::string errorMsg;
+        if (executeOperation(user_id, group_ids, operations[i], unlinkPaths, errorMsg))
+        {
+            results[i].status = BatchOperationResult::Status::Ok;
+            continue;
+        }
+
+        results[i].status = BatchOperationResult::Status::Failed;
+        results[i].error = errorMsg;
+
+        if (transactional)
+        {
+            committed = false;
+            break;
+        }
+    }
+
+    if (transactional)
+    {
+        if (committed && !transaction->commit())
+        {
+            committed = false;
+        }
+        transaction.reset();
+
+        if (!committed)
+        {
+            // Nothing was applied: earlier successes are reported as rolled back
+            for (auto& result : results)
+            {
+                if (result.status == BatchOperationResult::Status::Ok)
+                {
+                    result.status = BatchOperationResult::Status::Skipped;
+                    result.error = "Rolled back";
+                }
+            }
+            unlinkPaths.clear();
+            changes.clear();
+        }
+
+        for (const auto& publish : changes)
+        {
+            publish();
+        }
+    }
+
+    // Files are removed from disk only once their rows are gone for good
+    removeFromDisk(unlinkPaths);
+
+    return committed;
+}
+
+bool FileService::executeOperation(const std::string& user_id, const std::vector<int>& group_ids,
+                                   const BatchOperation& operation, std::vector<fs::path>& unlinkPaths,
+                                   std::string& errorMsg)
+{
+    if (operation.op == "move_files")
+    {
+        return moveFiles(user_id, operation.file_ids, operation.target_folder_id, errorMsg);
+    }
+    if (operation.op == "delete_files")
+    {
+        return deleteFilesDeferred(user_id, operation.file_ids, unlinkPaths, errorMsg);
+    }
+    if (operation.op == "create_folder")
+    {
+        if (operation.group_id > 0 &&
+            std::find(group_ids.begin(), group_ids.end(), operation.group_id) == group_ids.end())
+        {
+            errorMsg = "Permission denied: not a member of group " + std::to_string(operation.group_id);
+            return false;
+        }
+        return createFolder(user_id, operation.folder_name, operation.parent_folder_id, errorMsg, operation.group_id);
+    }
+    if (operation.op == "delete_folder")
+    {
+        return deleteFolder(user_id, operation.folder_id, errorMsg);
+    }
+    if (operation.op == "toggle_file_favorite")
+    {
+        return toggleFileFavorite(user_id, operation.file_id, operation.is_favorite, errorMsg);
+    }
+    if (operation.op == "toggle_folder_favorite")
+    {
+        return toggleFolderFavorite(user_id, operation.folder_id, operation.is_favorite, errorMsg);
+    }
+
+    errorMsg = "Unknown operation: " + operation.op;
+    return false;
+}
+
+// Версии списков для ETag
+
+std::string FileService::folderListingETag(const std::string& user_id, int folder_id)
+{
+    auto version = db_->getListingVersion(user_id, folder_id);
+    return version ? makeETag(user_id, *version) : std::string();
+}
+
+std::string FileService::favoritesETag(const std::string& user_id)
+{
+    auto version = db_->getFavoritesVersion(user_id);
+    return version ? makeETag(user_id, *version) : std::string();
+}
+
+std::string FileService::makeETag(const std::string& user_id, const std::string& version)
+{
+    // Weak: the same listing may be sent with different content encodings
+    return "W/\"" + user_id + "-" + version + "\"";
+}
+
+// Пути
+
+namespace {
+
+const size_t MAX_PATH_LENGTH = 4096;
+const size_t MAX_PATH_COMPONENTS = 64;
+
+bool splitPath(const std::string& path, std::vector<std::string>& components, std::string& errorMsg)
+{
+    components.clear();
+    if (path.size() > MAX_PATH_LENGTH)
+    {
+        errorMsg = "Invalid path: longer than " + std::to_string(MAX_PATH_LENGTH) + " bytes";
+        return false;
+    }
+
+    std::istringstream input(path);
+    std::string component;
+    while (std::getline(input, component, '/'))
+    {
+        if (component.empty())
+        {
+            continue;
+        }
+        if (component == "." || component == "..")
+        {
+            errorMsg = "Invalid path: relative components are not supported";
+            return false;
+        }
+        components.push_back(component);
+    }
+
+    if (components.size() > MAX_PATH_COMPONENTS)
+    {
+        errorMsg = "Invalid path: more than " + std::to_string(MAX_PATH_COMPONENTS) + " components";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool FileService::resolvePath(const std::string& user_id, const std::string& path, std::vector<std::string>& components,
+                              PathLookup& lookup, std::string& errorMsg)
+{
+    if (!splitPath(path, components, errorMsg))
+    {
+        return false;
+    }
+
+    if (!db_->resolvePath(user_id, components, lookup))
+    {
+        errorMsg = "Failed to resolve path";
+        return false;
+    }
+    return true;
+}
+
+bool FileService::createFolderPath(const std::string& user_id, const std::string& path, int group_id,
+                                   std::vector<std::string>& components, std::vector<PathFolder>& folders,
+                                   std::string& errorMsg)
+{
+    if (!splitPath(path, components, errorMsg))
+    {
+        return false;
+    }
+    if (components.empty())
+    {
+        errorMsg = "Invalid path: no folder names";
+        return false;
+    }
+
+    for (const auto& component : components)
+    {
+        auto validationResult = ValidationUtils::validateName(component);
+        if (!validationResult.valid) {
+            errorMsg = "Invalid folder name: " + validationResult.errorMessage;
+            return false;
+        }
+    }
+
+    if (!db_->ensureFolderPath(user_id, components, group_id, folders))
+    {
+        errorMsg = "Failed to create folders in database";
+        return false;
+    }
+    if (folders.empty() && group_id > 0)
+    {
+        errorMsg = "Permission denied: not a member of group " + std::to_string(group_id);
+        return false;
+    }
+    if (folders.size() != components.size())
+    {
+        errorMsg = "Failed to create folders in database";
+        return false;
+    }
+
+    for (size_t i = 0; i < folders.size(); ++i)
+    {
+        if (!folders[i].created)
+        {
+            continue;
+        }
+        int parent_folder_id = i > 0 ? folders[i - 1].folder_id : 0;
+
+        ChangeEvent event;
+        event.type = "folder_created";
+        event.folder_id = parent_folder_id;
+        event.name = components[i];
+        publishChange(user_id, {parent_folder_id}, event);
+    }
+    return true;
+}
+
+// Поиск
+
+std::vector<NameIndex::Match> FileService::searchNames(const std::string& user_id, const std::string& query,
+                                                       NameIndex::Kind kind, size_t limit)
+{
+    return NameIndex::instance()->search(query, std::stoi(user_id), db_->getUserGroupIds(user_id), kind, limit);
+}
+
+std::vector<ContentMatch> FileService::searchContent(const std::string& user_id, const std::string& query, size_t limit)
+{
+    std::vector<ContentMatch> matches;
+    DB::GroupScope groupScope(user_id, db_->getUserGroupIds(user_id));
+
+    // Files the user cannot see are dropped while the postings are intersected,
+    // so they never take one of the limit places
+    auto ids = db_->getAccessibleFileIds(user_id);
+    if (ids.empty())
+    {
+        return matches;
+    }
+    std::unordered_set<int> accessibleIds(ids.begin(), ids.end());
+    auto hits = ContentIndex::instance()->search(query, limit, [&accessibleIds](int file_id) {
+        return accessibleIds.count(file_id) > 0;
+    });
+    if (hits.empty())
+    {
+        return matches;
+    }
+
+    ids.clear();
+    for (const auto& hit : hits)
+    {
+        ids.push_back(hit.file_id);
+    }
+    std::unordered_map<int, std::tuple<std::string, int, int>> details;
+    for (auto& [file_id, file_name, folder_id, file_size] : db_->getAccessibleFiles(user_id, ids))
+    {
+        details.emplace(file_id, std::make_tuple(std::move(file_name), folder_id, file_size));
+    }
+
+    // In score order; a file deleted since the ids were read is skipped
+    for (const auto& hit : hits)
+    {
+        auto it = details.find(hit.file_id);
+        if (it != details.end())
+        {
+            auto& [file_name, folder_id, file_size] = it->second;
+            matches.push_back({hit.file_id, file_name, folder_id, file_size, hit.score});
+        }
+    }
+    return matches;
+}
+
+// Журнал изменений
+
+namespace {
+
+// Cursor text: scope positions separated by commas, e.g. "u12:340,g3:55"
+std::string formatCursor(const std::vector<JournalPosition>& positions)
+{
+    std::string cursor;
+    for (const auto& position : positions)
+    {
+        if (!cursor.empty()) cursor += ",";
+        cursor += position.scope_type;
+        cursor += std::to_string(position.scope_id) + ":" + std::to_string(position.seq);
+    }
+    return cursor;
+}
+
+bool parseCursor(const std::string& cursor, std::vector<JournalPosition>& positions)
+{
+    std::istringstream input(cursor);
+    std::string item;
+    while (std::getline(input, item, ','))
+    {
+        size_t colon = item.find(':');
+        if (item.size() < 4 || (item[0] != 'u' && item[0] != 'g') || colon == std::string::npos)
+        {
+            return false;
+        }
+        try
+        {
+            size_t idEnd = 0, seqEnd = 0;
+            std::string idText = item.substr(1, colon - 1);
+            std::string seqText = item.substr(colon + 1);
+            JournalPosition position{item[0], std::stoi(idText, &idEnd), std::stoll(seqText, &seqEnd)};
+            if (idEnd != idText.size() || seqEnd != seqText.size() || position.seq < 0)
+            {
+                return false;
+            }
+            positions.push_back(position);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool FileService::getChanges(const std::string& user_id, const std::string& cursor, int limit,
+                             std::vector<JournalEntry>& changes, std::string& nextCursor, bool& hasMore,
+                             std::string& errorMsg)
+{
+    hasMore = false;
+
+    std::vector<JournalPosition> given;
+    if (!parseCursor(cursor, given))
+    {
+        errorMsg = "Invalid cursor";
+        return false;
+    }
+
+    // Only scopes the user can see now: positions for groups the user left are dropped,
+    // groups the user joined start from the beginning of their journal
+    std::vector<JournalPosition> positions{{'u', std::stoi(user_id), 0}};
+    for (int group_id : db_->getUserGroupIds(user_id))
+    {
+        positions.push_back({'g', group_id, 0});
+    }
+
+    if (cursor.empty())
+    {
+        if (!db_->getJournalHeads(positions))
+        {
+            errorMsg = "Failed to read change journal";
+            return false;
+        }
+        nextCursor = formatCursor(positions);
+        return true;
+    }
+
+    for (auto& position : positions)
+    {
+        for (const auto& known : given)
+        {
+            if (known.scope_type == position.scope_type && known.scope_id == position.scope_id)
+            {
+                position.seq = known.seq;
+                break;
+            }
+        }
+    }
+
+    // One extra row tells whether another page follows
+    if (!db_->readJournal(positions, limit + 1, changes))
+    {
+        errorMsg = "Failed to read change journal";
+        return false;
+    }
+    if (static_cast<int>(changes.size()) > limit)
+    {
+        changes.resize(limit);
+        hasMore = true;
+    }
+
+    // Rows come as a per-scope prefix, so each position moves to the last row of its scope
+    for (const auto& change : changes)
+    {
+        for (auto& position : positions)
+        {
+            if (position.scope_type == change.scope_type && position.scope_id == change.scope_id)
+            {
+                position.seq = change.seq;
+                break;
+            }
+        }
+    }
+
+    nextCursor = formatCursor(positions);
+    return true;
+}
+
+// Лента изменений
+
+void FileService::publishChange(const std::string& user_id, const std::vector<int>& folder_ids, const ChangeEvent& event)
+{
+    int owner_id = std::stoi(user_id);
+    auto publish = [owner_id, folder_ids, event]() {
+        ChangeFeed::instance()->publish(owner_id, folder_ids, event);
+    };
+
+    if (deferredChanges)
+    {
+        deferredChanges->push_back(publish);
+        return;
+    }
+    publish();
+}
+
+void FileService::publishUserChange(const std::string& user_id, const ChangeEvent& event)
+{
+    int owner_id = std::stoi(user_id);
+    auto publish = [owner_id, event]() {
+        ChangeFeed::instance()->publishToUser(owner_id, event);
+    };
+
+    if (deferredChanges)
+    {
+        deferredChanges->push_back(publish);
+        return;
+    }
+    publish();
+}
+
+void FileService::recordActivity(const std::string& user_id, const char* action, long long object_id,
+                                 const std::string& detail)
+{
+    std::string actionName = action;
+    auto record = [user_id, actionName, object_id, detail]() {
+        ActivityLog::instance()->record(user_id, actionName, object_id, detail);
+    };
+
+    if (deferredChanges)
+    {
+        deferredChanges->push_back(record);
+        return;
+    }
+    record();
+}
@@ -7,10 +7,44 @@
 #include <vector>
 #include <tuple>
 #include <optional>
+#include <functional>
+#include <unordered_map>
 #include "db.h"
+#include "change_feed.h"
+#include "name_index.h"
+#include "content_index.h"
 
 namespace fs = std::filesystem;
 
+// Одна операция пакетного запроса /api/v1/batch
+struct BatchOperation {
+    std::string op;              // move_files, delete_files, create_folder, delete_folder,
+                                 // toggle_file_favorite, toggle_folder_favorite
+    std::vector<int> file_ids;   // move_files, delete_files
+    int file_id = 0;             // toggle_file_favorite
+    int folder_id = 0;           // delete_folder, toggle_folder_favorite
+    int target_folder_id = 0;    // move_files
+    std::string folder_name;     // create_folder
+    int parent_folder_id = 0;    // create_folder
+    int group_id = 0;            // create_folder (0 = личная папка)
+    bool is_favorite = false;    // toggle_*_favorite
+};
+
+// Файл, найденный полнотекстовым поиском
+struct ContentMatch {
+    int file_id;
+    std::string file_name;
+    int folder_id;
+    int file_size;
+    double score;
+};
+
+struct BatchOperationResult {
+    enum class Status { Ok, Failed, Skipped };
+    Status status = Status::Skipped;
+    std::string error;
+};
+
 class FileService {
 public:
     // Метод для получения единственного экземпляра (Singleton)
@@ -24,10 +58,13 @@ public:
     bool uploadFile(const std::string& user_id, int folder_id, const drogon::HttpRequestPtr &req, std::string &errorMsg);
     bool uploadFile(const std::string& user_id, int folder_id, const drogon::HttpRequestPtr &req, std::string &errorMsg, int group_id = 0);
     bool deleteFiles(const std::string& user_id, const std::vector<int>& file_ids, std::string &errorMsg);
-    std::optional<std::string> getFilePath(const std::string& user_id, int file_id);
+    // group_id, if given, receives the file's group (0 = personal)
+    std::optional<std::string> getFilePath(const std::string& user_id, int file_id, int* group_id = nullptr);
     bool moveFile(const std::string& user_id, int file_id, int target_folder_id, std::string &errorMsg);
     bool moveFiles(const std::string& user_id, const std::vector<int>& file_ids, int target_folder_id, std::string &errorMsg);
     std::vector<ExtendedFileInfo> getExtendedFiles(const std::string& user_id, int folder_id);
+    bool forEachExtendedFile(const std::string& user_id, int folder_id,
+                             const std::function<void(const ExtendedFileInfo&)>& visitor);
 
     // Методы для работы с папками
     std::vector<std::tuple<int, std::string, int, std::string>> getFolders(const std::string& user_id, int parent_folder_id = -1);
@@ -35,9 +72,12 @@ public:
     bool createFolder(const std::string& user_id, const std::string& folder_name, int parent_folder_id, std::string &errorMsg, int group_id = 0);
     bool deleteFolder(const std::string& user_id, int folder_id, std::string &errorMsg);
     std::vector<ExtendedFolderInfo> getExtendedFolders(const std::string& user_id, int parent_folder_id = -1);
+    bool forEachExtendedFolder(const std::string& user_id, int parent_folder_id,
+                               const std::function<void(const ExtendedFolderInfo&)>& visitor);
 
     std::vector<std::pair<int, std::string>> getUserGroups(const std::string& user_id);
     bool isUserInGroup(const std::string& user_id, int group_id);
+    bool canUserAccessFolder(const std::string& user_id, int folder_id);
 
     // Методы для работы с избранным
     bool toggleFileFavorite(const std::string& user_id, int file_id, bool is_favorite, std::string& errorMsg);
@@ -45,7 +85,89 @@ public:
     std::vector<ExtendedFileInfo> getFavoriteFiles(const std::string& user_id);
     std::vector<ExtendedFolderInfo> getFavoriteFolders(const std::string& user_id);
 
+    /**
+     * Runs batch operations in order for one user, resolving group membership once.
+     * Transactional: all operations share one transaction on a dedicated connection;
+     * the first failure rolls everything back and the remaining operations are skipped.
+     * Otherwise every operation commits on its own.
+     *
+     * @return true if the batch as a whole was committed (always true when not transactional)
+     */
+    bool executeBatch(const std::string& user_id, const std::vector<BatchOperation>& operations,
+                      bool transactional, std::vector<BatchOperationResult>& results);
+
+    /**
+     * Resolves a slash-separated path ("/Course/Lab3/src") from the user's root
+     * in one database round trip. Empty components are ignored, so "/" is the root.
+     *
+     * @param components Set to the path split into names
+     * @return false with errorMsg "Invalid path: ..." or a database error; a path that
+     *         does not exist is not an error, lookup tells how far it resolved
+     */
+    bool resolvePath(const std::string& user_id, const std::string& path, std::vector<std::string>& components,
+                     PathLookup& lookup, std::string& errorMsg);
+
+    /**
+     * mkdir -p: creates the missing folders of a path, reusing the existing ones,
+     * in one database round trip. New folders are shared with group_id, or with
+     * the group of their parent if group_id is 0.
+     *
+     * @param folders One entry per path component
+     */
+    bool createFolderPath(const std::string& user_id, const std::string& path, int group_id,
+                          std::vector<std::string>& components, std::vector<PathFolder>& folders,
+                          std::string& errorMsg);
+
+    // Поиск по именам файлов и папок, доступных пользователю (по индексу NameIndex)
+    std::vector<NameIndex::Match> searchNames(const std::string& user_id, const std::string& query,
+                                              NameIndex::Kind kind, size_t limit);
+
+    // Полнотекстовый поиск по содержимому текстовых файлов (ContentIndex); недоступные пользователю
+    // файлы отбрасываются при пересечении списков вхождений
+    std::vector<ContentMatch> searchContent(const std::string& user_id, const std::string& query, size_t limit);
+
+    /**
+     * Delta sync over the change journal. The cursor is opaque to clients: it
+     * holds one position per scope the user can see (own items and each group).
+     * An empty cursor returns no changes, only the current position, so a client
+     * lists its folders once and then follows the journal from there.
+     *
+     * @param limit Maximum number of changes returned; hasMore is set if there are more
+     * @return false with errorMsg "Invalid cursor" or a database error
+     */
+    bool getChanges(const std::string& user_id, const std::string& cursor, int limit,
+                    std::vector<JournalEntry>& changes, std::string& nextCursor, bool& hasMore,
+                    std::string& errorMsg);
+
+    // ETag-и для списков: меняются при любом изменении, которое могло затронуть список
+    // (версии хранятся в БД, поэтому общие для всех экземпляров сервиса); пустая строка при ошибке БД
+    std::string folderListingETag(const std::string& user_id, int folder_id);
+    std::string favoritesETag(const std::string& user_id);
+
 private:
+    // Pushes a change to feed subscribers of the folders; inside a transactional
+    // batch the event is held back until the batch commits
+    void publishChange(const std::string& user_id, const std::vector<int>& folder_ids, const ChangeEvent& event);
+    void publishUserChange(const std::string& user_id, const ChangeEvent& event);
+
+    // Adds an event to the activity log, likewise held back inside a transactional batch
+    void recordActivity(const std::string& user_id, const char* action, long long object_id = 0,
+                        const std::string& detail = "");
+
+    // Runs one batch operation; files to unlink are collected instead of removed
+    bool executeOperation(const std::string& user_id, const std::vector<int>& group_ids,
+                          const BatchOperation& operation, std::vector<fs::path>& unlinkPaths,
+                          std::string& errorMsg);
+
+    // deleteFiles() without touching the disk: paths of deleted files are appended to unlinkPaths
+    // (all-or-nothing, so nothing is appended on failure)
+    bool deleteFilesDeferred(const std::string& user_id, const std::vector<int>& file_ids,
+                             std::vector<fs::path>& unlinkPaths, std::string& errorMsg);
+
+    // Removes files from storage, spreading large lists over several threads
+    void removeFromDisk(const std::vector<fs::path>& paths);
+    std::string makeETag(const std::string& user_id, const std::string& version);
+
     std::shared_ptr<DB> db_;
     std::string storagePath_;
 };